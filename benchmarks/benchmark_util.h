@@ -0,0 +1,23 @@
+#ifndef BENCHMARK_UTIL_H
+#define BENCHMARK_UTIL_H
+
+#include <chrono>
+#include <cstddef>
+
+// Prevent the compiler from optimizing away a value computed in a benchmark
+template <typename T> inline void do_not_optimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Run `op` `iterations` times and return the average nanoseconds per call
+template <typename Op> double ns_per_op(size_t iterations, Op op) {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++) {
+    op(i);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         iterations;
+}
+
+#endif // BENCHMARK_UTIL_H
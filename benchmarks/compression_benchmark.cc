@@ -0,0 +1,60 @@
+// Measures how much each response encoding shrinks a rendered page, and how
+// long compressing it takes, at 4 KiB, 64 KiB and 1 MiB pages.
+#include "benchmark_util.h"
+#include "compression.h"
+#include <cstdio>
+#include <string>
+
+namespace {
+
+// HTML shaped like a rendered markdown page: paragraphs of words drawn from
+// a small vocabulary, so it compresses like real text rather than noise
+std::string make_page(size_t size) {
+  const char *words[] = {"the",     "server", "request", "response", "handler",
+                         "location", "file",  "cache",   "markdown", "config",
+                         "session",  "thread", "log",    "static",   "body"};
+  std::string page = "<!DOCTYPE html>\n<html lang=\"en\">\n<body>\n";
+  uint32_t state = 12345;
+  while (page.size() < size) {
+    page += "<p>";
+    for (int i = 0; i < 40; i++) {
+      state = state * 1103515245 + 12345;
+      page += words[(state >> 16) % 15];
+      page += ' ';
+    }
+    page += "</p>\n";
+  }
+  page.resize(size);
+  return page;
+}
+
+void run(size_t size) {
+  std::string page = make_page(size);
+  const size_t iterations = 64 * 1024 * 1024 / size / 8 + 1;
+  for (CONTENT_ENCODING encoding :
+       {ENCODING_GZIP, ENCODING_DEFLATE, ENCODING_BROTLI}) {
+    std::optional<std::string> compressed = compress(page, encoding);
+    if (!compressed.has_value()) {
+      printf("%7zu bytes: %-7s unsupported\n", size,
+             std::string(encodingName(encoding)).c_str());
+      continue;
+    }
+    double ns = ns_per_op(iterations, [&](size_t) {
+      do_not_optimize(compress(page, encoding));
+    });
+    printf("%7zu bytes: %-7s %7zu bytes (%4.1f%%), %8.1f us, %6.1f MB/s\n",
+           size, std::string(encodingName(encoding)).c_str(),
+           compressed.value().size(),
+           100.0 * compressed.value().size() / size, ns / 1000,
+           size / ns * 1000);
+  }
+}
+
+} // namespace
+
+int main() {
+  for (size_t size : {4 * 1024, 64 * 1024, 1024 * 1024}) {
+    run(size);
+  }
+  return 0;
+}
@@ -0,0 +1,145 @@
+// Measures CrudHandler POST latency with 10k and 1M records already stored
+// for the entity, against the directory scan every POST used to do to find
+// the next ID. Records live in memory so only the handler's work is timed.
+#include "benchmark_util.h"
+#include "handlers/crud_handler.h"
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Flat in-memory storage, indexed by directory so listing one entity doesn't
+// touch the others
+class MemoryFileSystem : public FileSystemInterface {
+public:
+  bool exists(const fs::path &path) const override {
+    return read(path).has_value() || is_directory(path);
+  }
+  std::optional<std::vector<fs::path>>
+  list(const fs::path &directory) const override {
+    auto dir = directories_.find(directoryKey(directory));
+    if (dir == directories_.end()) {
+      return std::nullopt;
+    }
+    std::vector<fs::path> files;
+    files.reserve(dir->second.size());
+    for (const auto &[name, _] : dir->second) {
+      files.push_back(fs::path(dir->first) / name);
+    }
+    return files;
+  }
+  FILE_TYPE fileType(std::string file_name) const override {
+    return NO_MATCHING_TYPE;
+  }
+  std::optional<std::string> read(const fs::path &filename) const override {
+    auto dir = directories_.find(filename.parent_path().string());
+    if (dir == directories_.end()) {
+      return std::nullopt;
+    }
+    auto file = dir->second.find(filename.filename().string());
+    if (file == dir->second.end()) {
+      return std::nullopt;
+    }
+    return file->second;
+  }
+  std::optional<FileStat> stat(const fs::path &filename) const override {
+    std::optional<std::string> data = read(filename);
+    if (!data.has_value()) {
+      return std::nullopt;
+    }
+    return FileStat{data->size(), {}};
+  }
+  bool write(const fs::path &filename, const std::string &data) override {
+    directories_[filename.parent_path().string()]
+                [filename.filename().string()] = data;
+    return true;
+  }
+  bool create(const fs::path &filename, const std::string &data) override {
+    return directories_[filename.parent_path().string()]
+        .emplace(filename.filename().string(), data)
+        .second;
+  }
+  bool remove(const fs::path &filename) override {
+    return directories_[filename.parent_path().string()].erase(
+               filename.filename().string()) > 0;
+  }
+  bool is_directory(const fs::path &path) const override {
+    return directories_.count(directoryKey(path)) > 0;
+  }
+  bool create_directories(const fs::path &path) override {
+    directories_[directoryKey(path)];
+    return true;
+  }
+
+private:
+  // "/a/b/" and "/a/b" name the same directory
+  static std::string directoryKey(const fs::path &path) {
+    return (path / "").parent_path().string();
+  }
+  std::unordered_map<std::string, std::unordered_map<std::string, std::string>>
+      directories_;
+};
+
+// How the next ID used to be found: list the directory and parse every name
+int scan_max_id(const FileSystemInterface &filesystem, const fs::path &path) {
+  int max_id = 0;
+  const std::vector<fs::path> files = filesystem.list(path).value();
+  for (const fs::path &file : files) {
+    try {
+      max_id = std::max(max_id, std::stoi(file.filename().string()));
+    } catch (const std::exception &e) {
+      continue;
+    }
+  }
+  return max_id;
+}
+
+void run(size_t record_count) {
+  std::unique_ptr<MemoryFileSystem> filesystem =
+      std::make_unique<MemoryFileSystem>();
+  MemoryFileSystem *records = filesystem.get();
+  for (size_t i = 1; i <= record_count; i++) {
+    records->write("/mnt/crud/Shoes/" + std::to_string(i), "{}");
+  }
+  CrudHandler handler("/api", {{CRUD_HANDLER_DATA_PATH_ARG, "/mnt/crud"}},
+                      std::move(filesystem));
+
+  http_request request;
+  request.method(boost::beast::http::verb::post);
+  request.set(boost::beast::http::field::content_type, "application/json");
+  request.target("/api/Shoes");
+  request.body() = "{}";
+
+  const size_t scans = record_count > 100000 ? 5 : 100;
+  double scan_ns = ns_per_op(scans, [&](size_t) {
+    do_not_optimize(scan_max_id(*records, "/mnt/crud/Shoes/"));
+  });
+
+  // The first POST recovers the next ID from the stored records
+  double first_ns = ns_per_op(
+      1, [&](size_t) { do_not_optimize(handler.handle_request(request)); });
+  double post_ns = ns_per_op(100000, [&](size_t) {
+    do_not_optimize(handler.handle_request(request));
+  });
+  printf("%8zu records: POST %8.0f ns (%.0f posts/s), first POST %11.0f ns, "
+         "old per-POST directory scan %11.0f ns\n",
+         record_count, post_ns, 1e9 / post_ns, first_ns, scan_ns);
+}
+
+} // namespace
+
+int main() {
+  boost::log::core::get()->set_filter(boost::log::trivial::severity >=
+                                      boost::log::trivial::warning);
+  for (size_t record_count : {10000, 1000000}) {
+    run(record_count);
+  }
+  return 0;
+}
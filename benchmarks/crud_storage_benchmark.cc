@@ -0,0 +1,64 @@
+// Compares the CRUD storage backends: one file per record (FileSystem) and
+// the log-structured LogFileSystem, on writing, reading and listing 10k and
+// 100k small JSON records.
+#include "benchmark_util.h"
+#include "filesystem/filesystem.h"
+#include "filesystem/log_filesystem.h"
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const std::string RECORD = "{\"name\": \"shoe\", \"size\": 10, \"color\": "
+                           "\"red\", \"price\": 59.99}";
+
+void run(const char *name, FileSystemInterface &filesystem,
+         const fs::path &root, size_t record_count) {
+  const fs::path entity = root / "Shoes";
+  double write_ns = ns_per_op(record_count, [&](size_t i) {
+    filesystem.create(entity / std::to_string(i + 1), RECORD);
+  });
+  std::mt19937 rng(0);
+  double read_ns = ns_per_op(record_count, [&](size_t) {
+    do_not_optimize(
+        filesystem.read(entity / std::to_string(rng() % record_count + 1)));
+  });
+  double overwrite_ns = ns_per_op(record_count, [&](size_t) {
+    filesystem.write(entity / std::to_string(rng() % record_count + 1),
+                     RECORD);
+  });
+  double list_ns =
+      ns_per_op(5, [&](size_t) { do_not_optimize(filesystem.list(entity)); });
+  printf("%7zu records, %-15s create %7.1f us, read %6.1f us, overwrite "
+         "%7.1f us, list %9.1f ms\n",
+         record_count, name, write_ns / 1e3, read_ns / 1e3, overwrite_ns / 1e3,
+         list_ns / 1e6);
+}
+
+} // namespace
+
+int main() {
+  boost::log::core::get()->set_filter(boost::log::trivial::severity >=
+                                      boost::log::trivial::warning);
+  const fs::path root = fs::temp_directory_path() /
+                        ("crud_storage_benchmark_" + std::to_string(::getpid()));
+  for (size_t record_count : {10000, 100000}) {
+    {
+      FileSystem filesystem;
+      run("file per record", filesystem, root / "files", record_count);
+    }
+    {
+      LogFileSystem filesystem(root / "log");
+      run("log", filesystem, root / "log", record_count);
+    }
+    fs::remove_all(root);
+  }
+  return 0;
+}
@@ -0,0 +1,81 @@
+// Measures FileSystem throughput under a 90% read / 10% write mix over a
+// shared set of files, at 1 to 8 threads. For comparison it also runs the same
+// workload with every call serialized on one global mutex, the way FileSystem
+// used to lock.
+#include "benchmark_util.h"
+#include "filesystem/filesystem.h"
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const size_t FILE_COUNT = 64;
+const size_t FILE_SIZE = 4096;
+const size_t OPS_PER_THREAD = 4000;
+
+std::recursive_mutex global_mutex;
+
+// Returns operations per second across all threads
+double run(FileSystem &filesystem, const std::vector<fs::path> &files,
+           size_t thread_count, bool global_lock) {
+  const std::string data(FILE_SIZE, 'x');
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back([&, t] {
+      std::mt19937 rng(t);
+      for (size_t i = 0; i < OPS_PER_THREAD; i++) {
+        const fs::path &file = files[rng() % files.size()];
+        std::unique_lock<std::recursive_mutex> lock(global_mutex,
+                                                    std::defer_lock);
+        if (global_lock) {
+          lock.lock();
+        }
+        if (rng() % 10 == 0) {
+          filesystem.write(file, data);
+        } else {
+          do_not_optimize(filesystem.read(file));
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return thread_count * OPS_PER_THREAD /
+         std::chrono::duration<double>(elapsed).count();
+}
+
+} // namespace
+
+int main() {
+  const fs::path directory =
+      fs::temp_directory_path() /
+      ("filesystem_benchmark_" + std::to_string(::getpid()));
+  FileSystem filesystem;
+  std::vector<fs::path> files;
+  for (size_t i = 0; i < FILE_COUNT; i++) {
+    files.push_back(directory / std::to_string(i));
+    filesystem.write(files.back(), std::string(FILE_SIZE, 'x'));
+  }
+
+  for (size_t thread_count : {1, 2, 4, 8}) {
+    double global_ops = run(filesystem, files, thread_count, true);
+    double striped_ops = run(filesystem, files, thread_count, false);
+    printf("%zu threads: global lock %9.0f ops/s, striped %9.0f ops/s "
+           "(%.1fx)\n",
+           thread_count, global_ops, striped_ops, striped_ops / global_ops);
+  }
+
+  fs::remove_all(directory);
+  return 0;
+}
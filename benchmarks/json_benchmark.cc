@@ -0,0 +1,100 @@
+// Measures how long a CRUD listing of 10, 10k and 1M IDs takes to serialize
+// with JsonWriter, against the boost::property_tree path CrudHandler used to
+// take, and how fast validJson checks the result.
+#include "benchmark_util.h"
+#include "json.h"
+#include <algorithm>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace pt = boost::property_tree;
+
+namespace {
+
+std::string ptree_listing(const std::vector<std::string> &names) {
+  pt::ptree root, arr;
+  for (const std::string &name : names) {
+    pt::ptree element;
+    element.put("", name);
+    arr.push_back(std::make_pair("", element));
+  }
+  root.add_child("files", arr);
+  std::stringstream ss;
+  pt::write_json(ss, root);
+  return std::move(ss).str();
+}
+
+std::string writer_listing(const std::vector<std::string> &names) {
+  JsonWriter json;
+  json.beginObject();
+  json.key("files");
+  json.beginArray();
+  for (const std::string &name : names) {
+    json.string(name);
+  }
+  json.endArray();
+  json.endObject();
+  return json.take();
+}
+
+void run(size_t count) {
+  std::vector<std::string> names;
+  names.reserve(count);
+  for (size_t i = 1; i <= count; i++) {
+    names.push_back(std::to_string(i));
+  }
+  std::string listing = writer_listing(names);
+  if (listing != ptree_listing(names)) {
+    printf("%7zu IDs: JsonWriter output differs from write_json\n", count);
+    return;
+  }
+
+  const size_t iterations = std::max<size_t>(3, 2000000 / count);
+  double ptree_ns = ns_per_op(iterations, [&](size_t) {
+    do_not_optimize(ptree_listing(names));
+  });
+  double writer_ns = ns_per_op(iterations, [&](size_t) {
+    do_not_optimize(writer_listing(names));
+  });
+  bool valid = true;
+  double validate_ns = ns_per_op(iterations, [&](size_t) {
+    valid &= validJson(listing);
+  });
+  printf("%7zu IDs (%9zu bytes): property_tree %12.0f ns, JsonWriter %11.0f "
+         "ns (%5.1fx), validJson %11.0f ns (%6.0f MB/s)%s\n",
+         count, listing.size(), ptree_ns, writer_ns, ptree_ns / writer_ns,
+         validate_ns, listing.size() / validate_ns * 1e3,
+         valid ? "" : " INVALID");
+}
+
+// A record made mostly of long strings, where validJson spends its time
+// skipping plain characters
+void run_strings() {
+  JsonWriter json;
+  json.beginArray();
+  for (int i = 0; i < 1000; i++) {
+    json.string(std::string(1000, 'a' + i % 26));
+  }
+  json.endArray();
+  std::string record = json.take();
+  bool valid = true;
+  double validate_ns =
+      ns_per_op(1000, [&](size_t) { valid &= validJson(record); });
+  printf("1000 strings of 1000 bytes: validJson %.0f ns (%.0f MB/s)%s\n",
+         validate_ns, record.size() / validate_ns * 1e3,
+         valid ? "" : " INVALID");
+}
+
+} // namespace
+
+int main() {
+  for (size_t count : {10, 10000, 1000000}) {
+    run(count);
+  }
+  run_strings();
+  return 0;
+}
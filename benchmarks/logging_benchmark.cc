@@ -0,0 +1,126 @@
+// Measures request latency against a live server with logging off, with the
+// synchronous sinks (every record written and flushed by the request thread),
+// and with the asynchronous ones. Client threads send keep-alive GET /echo
+// requests; records go to files in a temporary directory, not the console.
+#include "io_service_pool.h"
+#include "logging.h"
+#include "request_manager.h"
+#include "server.h"
+#include <algorithm>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/beast/http.hpp>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace http = boost::beast::http;
+using boost::asio::ip::tcp;
+
+namespace {
+
+const size_t CLIENT_THREADS = 4;
+const std::chrono::seconds PHASE_DURATION(2);
+
+// Send keep-alive requests until `done`, recording each one's latency in
+// microseconds
+void client(const tcp::endpoint &endpoint, std::atomic<bool> &done,
+            std::vector<double> &latencies) {
+  boost::asio::io_service io_service;
+  tcp::socket socket(io_service);
+  socket.connect(endpoint);
+  boost::beast::flat_buffer buffer;
+  while (!done) {
+    auto start = std::chrono::steady_clock::now();
+    http::request<http::string_body> request(http::verb::get, "/echo", 11);
+    request.set(http::field::host, "localhost");
+    http::write(socket, request);
+    http::response<http::string_body> response;
+    http::read(socket, buffer, response);
+    latencies.push_back(std::chrono::duration<double, std::micro>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+  }
+}
+
+void run(const char *name, unsigned short port,
+         RequestManager &request_manager) {
+  IoServicePool io_services(THREADING_SHARED,
+                            std::thread::hardware_concurrency());
+  server echo_server(io_services.get(0), request_manager, port);
+  echo_server.start_accept();
+  std::thread runner([&] { io_services.run(); });
+
+  tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+  std::atomic<bool> done = false;
+  std::mutex latencies_mutex;
+  std::vector<double> latencies;
+  std::vector<std::thread> clients;
+  for (size_t i = 0; i < CLIENT_THREADS; i++) {
+    clients.emplace_back([&] {
+      std::vector<double> client_latencies;
+      try {
+        client(endpoint, done, client_latencies);
+      } catch (std::exception &e) {
+        fprintf(stderr, "client failed: %s\n", e.what());
+      }
+      std::lock_guard<std::mutex> lock(latencies_mutex);
+      latencies.insert(latencies.end(), client_latencies.begin(),
+                       client_latencies.end());
+    });
+  }
+  std::this_thread::sleep_for(PHASE_DURATION);
+  done = true;
+  for (std::thread &thread : clients) {
+    thread.join();
+  }
+  io_services.stop();
+  runner.join();
+
+  std::sort(latencies.begin(), latencies.end());
+  double total = 0;
+  for (double latency : latencies) {
+    total += latency;
+  }
+  printf("%-6s %9.0f requests/s, mean %7.1f us, p50 %7.1f us, p99 %7.1f us\n",
+         name, latencies.size() / (double)PHASE_DURATION.count(),
+         total / latencies.size(), latencies[latencies.size() / 2],
+         latencies[latencies.size() * 99 / 100]);
+}
+
+} // namespace
+
+int main() {
+  std::filesystem::path log_dir =
+      std::filesystem::temp_directory_path() /
+      ("logging_benchmark_" + std::to_string(::getpid()));
+  std::string log_file = (log_dir / "benchmark_%N.log").string();
+  std::unordered_map<std::string, LocationData> locations = {
+      {"/echo", LocationData("EchoHandler", {})}};
+  RequestManager request_manager(locations);
+
+  printf("%u I/O threads, %zu client threads\n",
+         std::thread::hardware_concurrency(), CLIENT_THREADS);
+  boost::log::core::get()->set_logging_enabled(false);
+  run("off", 18190, request_manager);
+  boost::log::core::get()->set_logging_enabled(true);
+
+  init_logging(LOGGING_SYNC, log_file, false);
+  run("sync", 18191, request_manager);
+  shutdown_logging();
+
+  init_logging(LOGGING_ASYNC, log_file, false);
+  run("async", 18192, request_manager);
+  shutdown_logging();
+  printf("async records dropped: %llu\n",
+         (unsigned long long)dropped_log_records());
+
+  std::filesystem::remove_all(log_dir);
+  return 0;
+}
@@ -0,0 +1,122 @@
+// Compares building a response with RequestHandler::makeResponse against the
+// old makeHeader -> string -> parseResponse round trip, for 1 KB, 1 MB and
+// 100 MB bodies. Bytes allocated while building stand in for bytes copied,
+// since every copy of the body needs its own allocation.
+#include "benchmark_util.h"
+#include "handlers/request_handler.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+namespace {
+
+std::atomic<size_t> bytes_allocated{0};
+
+// The old response path, as the handlers used to run it
+class LegacyResponseBuilder {
+public:
+  http_response build(uint statusCode, std::string contentType,
+                      std::string body) {
+    lastResponseHeader = makeHeader(statusCode, contentType, body.size());
+    lastResponse = lastResponseHeader + body;
+    return parseResponse(lastResponse);
+  }
+
+private:
+  std::string makeHeader(uint statusCode, std::string contentType,
+                         size_t contentLength) {
+    std::string responseHeader = "";
+    responseHeader += "HTTP/1.1 " + std::to_string(statusCode) + " OK\r\n";
+    responseHeader += "Content-Type: " + contentType + "\r\n";
+    responseHeader +=
+        "Content-Length: " + std::to_string(contentLength) + "\r\n";
+    responseHeader += "\r\n";
+    return responseHeader;
+  }
+
+  http_response parseResponse(std::string response) {
+    boost::system::error_code error;
+    boost::beast::http::response_parser<boost::beast::http::string_body> parser;
+    parser.body_limit(UINT32_MAX);
+    const std::string constResponse = response;
+    size_t bytes_parsed = 0;
+    do {
+      size_t position =
+          parser.put(boost::asio::buffer(constResponse) + bytes_parsed, error);
+      bytes_parsed += position;
+      if (parser.is_done()) {
+        return parser.release();
+      } else if (error) {
+        return http_response();
+      }
+    } while (true);
+  }
+
+  std::string lastResponseHeader;
+  std::string lastResponse;
+};
+
+// Exposes the builder the handlers use now
+class DirectResponseBuilder : public RequestHandler {
+public:
+  http_response handle_request(const http_request &request) {
+    return http_response();
+  }
+  http_response build(uint statusCode, std::string contentType,
+                      std::string body) {
+    return makeResponse(statusCode, contentType, std::move(body));
+  }
+};
+
+// Build `iterations` responses of `body_size` bytes, returning the average
+// bytes allocated and nanoseconds spent per response
+template <typename Builder>
+std::pair<double, double> measure(Builder &builder, size_t body_size,
+                                  size_t iterations) {
+  size_t total_bytes = 0;
+  double total_ns = 0;
+  for (size_t i = 0; i < iterations; i++) {
+    // The handler's own body (e.g. the file it read) is not counted
+    std::string body(body_size, 'x');
+    size_t bytes_before = bytes_allocated.load();
+    total_ns += ns_per_op(1, [&](size_t) {
+      http_response response =
+          builder.build(OK_STATUS, TEXT_PLAIN, std::move(body));
+      do_not_optimize(response.body().data());
+    });
+    total_bytes += bytes_allocated.load() - bytes_before;
+  }
+  return {double(total_bytes) / iterations, total_ns / iterations};
+}
+
+} // namespace
+
+void *operator new(size_t size) {
+  bytes_allocated += size;
+  if (void *ptr = std::malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+int main() {
+  LegacyResponseBuilder legacy;
+  DirectResponseBuilder direct;
+  const std::pair<size_t, size_t> cases[] = {
+      {1024, 10000}, {1024 * 1024, 100}, {100 * 1024 * 1024, 3}};
+  for (const auto &[body_size, iterations] : cases) {
+    auto [legacy_bytes, legacy_ns] = measure(legacy, body_size, iterations);
+    auto [direct_bytes, direct_ns] = measure(direct, body_size, iterations);
+    printf("%9zu byte body: parseResponse %11.0f bytes allocated (%.1fx body) "
+           "%12.0f ns | makeResponse %9.0f bytes allocated (%.1fx body) "
+           "%10.0f ns\n",
+           body_size, legacy_bytes, legacy_bytes / body_size, legacy_ns,
+           direct_bytes, direct_bytes / body_size, direct_ns);
+  }
+  return 0;
+}
@@ -0,0 +1,74 @@
+// Compares the compiled RouteTrie against the linear scan RequestManager used
+// to do over every config location, at 10, 100 and 1000 locations.
+#include "benchmark_util.h"
+#include "route_trie.h"
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// The original RequestManager::matchPath, minus the logging
+std::optional<std::string>
+linear_match(const std::unordered_map<std::string, int> &locations,
+             std::string target_path) {
+  size_t longest_path_match = 0;
+  std::string longest_prefix_matched;
+  for (auto key_value : locations) {
+    std::string path_to_match = key_value.first;
+    if (target_path == path_to_match ||
+        target_path.starts_with(path_to_match + "/")) {
+      if (path_to_match.size() > longest_path_match) {
+        longest_path_match = path_to_match.size();
+        longest_prefix_matched = path_to_match;
+      }
+    }
+  }
+  if (longest_path_match > 0) {
+    return longest_prefix_matched;
+  }
+  return {};
+}
+
+void run(size_t location_count) {
+  // Half top level locations, half nested one level below another
+  std::vector<std::string> paths;
+  std::unordered_map<std::string, int> locations;
+  for (size_t i = 0; i < location_count; i++) {
+    std::string path = i % 2 == 0 ? "/location" + std::to_string(i)
+                                   : "/location" + std::to_string(i - 1) +
+                                         "/nested" + std::to_string(i);
+    locations[path] = i;
+    paths.push_back(path);
+  }
+  RouteTrie trie(paths);
+
+  // Mix of exact, prefix and missing targets
+  std::vector<std::string> targets;
+  for (size_t i = 0; i < location_count; i++) {
+    targets.push_back(paths[i]);
+    targets.push_back(paths[i] + "/some/file.txt");
+    targets.push_back("/missing" + std::to_string(i) + "/file.txt");
+  }
+
+  const size_t iterations = 2000000 / location_count + 1000;
+  double linear_ns = ns_per_op(iterations, [&](size_t i) {
+    do_not_optimize(linear_match(locations, targets[i % targets.size()]));
+  });
+  double trie_ns = ns_per_op(iterations * 10, [&](size_t i) {
+    do_not_optimize(trie.match(targets[i % targets.size()]));
+  });
+  printf("%5zu locations: linear scan %10.1f ns/lookup, trie %6.1f ns/lookup "
+         "(%.0fx)\n",
+         location_count, linear_ns, trie_ns, linear_ns / trie_ns);
+}
+
+} // namespace
+
+int main() {
+  for (size_t location_count : {10, 100, 1000}) {
+    run(location_count);
+  }
+  return 0;
+}
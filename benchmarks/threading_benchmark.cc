@@ -0,0 +1,119 @@
+// Compares the shared io_service against one io_service per I/O thread, each
+// with its own SO_REUSEPORT acceptor (pinned to a CPU or not). Client threads
+// hammer /echo on localhost, first opening a new connection per request to
+// measure the accept rate, then reusing one connection each to measure
+// requests per second.
+#include "io_service_pool.h"
+#include "request_manager.h"
+#include "server.h"
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace http = boost::beast::http;
+using boost::asio::ip::tcp;
+
+namespace {
+
+const size_t CLIENT_THREADS = 8;
+const std::chrono::seconds PHASE_DURATION(2);
+
+// Send one GET /echo on `socket` and read the response
+void roundTrip(tcp::socket &socket) {
+  http::request<http::string_body> request(http::verb::get, "/echo", 11);
+  request.set(http::field::host, "localhost");
+  http::write(socket, request);
+  boost::beast::flat_buffer buffer;
+  http::response<http::string_body> response;
+  http::read(socket, buffer, response);
+}
+
+// Run `client` on CLIENT_THREADS threads for PHASE_DURATION, and return the
+// total number of requests per second they completed
+template <typename Client> double requestsPerSecond(Client client) {
+  std::atomic<bool> done = false;
+  std::atomic<size_t> requests = 0;
+  std::vector<std::thread> clients;
+  for (size_t i = 0; i < CLIENT_THREADS; i++) {
+    clients.emplace_back([&] {
+      size_t completed = 0;
+      try {
+        client(done, completed);
+      } catch (std::exception &e) {
+        fprintf(stderr, "client failed: %s\n", e.what());
+      }
+      requests += completed;
+    });
+  }
+  std::this_thread::sleep_for(PHASE_DURATION);
+  done = true;
+  for (std::thread &thread : clients) {
+    thread.join();
+  }
+  return requests / std::chrono::duration<double>(PHASE_DURATION).count();
+}
+
+void run(const char *name, THREADING_MODE mode, unsigned short port,
+         RequestManager &request_manager) {
+  IoServicePool io_services(mode, std::thread::hardware_concurrency());
+  std::vector<std::unique_ptr<server>> servers;
+  for (size_t i = 0; i < io_services.size(); i++) {
+    servers.push_back(std::make_unique<server>(
+        io_services.get(i), request_manager, port, mode != THREADING_SHARED));
+    servers.back()->start_accept();
+  }
+  std::thread runner([&] { io_services.run(); });
+
+  tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+  double accept_rate =
+      requestsPerSecond([&](std::atomic<bool> &done, size_t &completed) {
+        boost::asio::io_service io_service;
+        while (!done) {
+          tcp::socket socket(io_service);
+          socket.connect(endpoint);
+          roundTrip(socket);
+          completed++;
+        }
+      });
+  double keep_alive_rate =
+      requestsPerSecond([&](std::atomic<bool> &done, size_t &completed) {
+        boost::asio::io_service io_service;
+        tcp::socket socket(io_service);
+        socket.connect(endpoint);
+        while (!done) {
+          roundTrip(socket);
+          completed++;
+        }
+      });
+  printf("%-16s %9.0f connections/s, %9.0f keep-alive requests/s\n", name,
+         accept_rate, keep_alive_rate);
+
+  io_services.stop();
+  runner.join();
+}
+
+} // namespace
+
+int main() {
+  boost::log::core::get()->set_filter(boost::log::trivial::severity >=
+                                      boost::log::trivial::warning);
+  std::unordered_map<std::string, LocationData> locations = {
+      {"/echo", LocationData("EchoHandler", {})}};
+  RequestManager request_manager(locations);
+
+  printf("%u I/O threads, %zu client threads\n",
+         std::thread::hardware_concurrency(), CLIENT_THREADS);
+  run("shared", THREADING_SHARED, 18180, request_manager);
+  run("per_core", THREADING_PER_CORE, 18181, request_manager);
+  run("per_core_pinned", THREADING_PER_CORE_PINNED, 18182, request_manager);
+  return 0;
+}
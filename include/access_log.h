@@ -0,0 +1,133 @@
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Identifies an access log file; written once, at the start of the file
+const std::string ACCESS_LOG_MAGIC = "ACCLOG01";
+// Buffered records are written out this often, or sooner once the buffer
+// holds ACCESS_LOG_BUFFER_SIZE bytes
+const std::chrono::milliseconds ACCESS_LOG_FLUSH_INTERVAL(1000);
+const size_t ACCESS_LOG_BUFFER_SIZE = 256 * 1024;
+// Strings remembered for interning before the cache is cleared
+const size_t ACCESS_LOG_MAX_STRINGS = 65536;
+
+// Kinds of record in an access log file
+enum ACCESS_LOG_RECORD_TYPE : uint8_t {
+  // an AccessLogRecord
+  ACCESS_LOG_ENTRY = 0,
+  // an AccessLogString header followed by the string's bytes
+  ACCESS_LOG_STRING = 1
+};
+
+// A response written by the server, as laid out in the file. Strings are
+// written once, as ACCESS_LOG_STRING records, and referred to by the file
+// offset of that record.
+struct AccessLogRecord {
+  uint8_t type = ACCESS_LOG_ENTRY;
+  uint8_t reserved = 0;
+  uint16_t status;
+  // from reading the request to having written the response
+  uint32_t latency_us;
+  // since the Unix epoch, when the request was read
+  uint64_t timestamp_us;
+  // body bytes sent
+  uint64_t bytes;
+  uint64_t handler_offset;
+  uint64_t path_offset;
+};
+static_assert(sizeof(AccessLogRecord) == 40);
+
+struct AccessLogString {
+  uint8_t type = ACCESS_LOG_STRING;
+  uint8_t reserved = 0;
+  uint16_t length;
+};
+static_assert(sizeof(AccessLogString) == 4);
+
+// An access log record with its strings resolved, as read back from a file
+struct AccessLogEntry {
+  std::chrono::system_clock::time_point timestamp;
+  std::string handler;
+  unsigned int status;
+  uint64_t bytes;
+  std::chrono::microseconds latency;
+  std::string path;
+};
+
+// Records every response the server writes in a compact binary file, in
+// place of a formatted log line per request. Records are appended to an
+// in-memory buffer and written out in batches by a background thread; use
+// access_log_dump to convert a file to text or JSON.
+class AccessLog {
+public:
+  static AccessLog &GetInstance();
+  ~AccessLog();
+
+  // Start appending records to the file at `path`. Returns false if it can't
+  // be opened, or is not an access log.
+  bool open(const std::filesystem::path &path);
+  // Write out everything buffered and close the file
+  void close();
+  // Whether records are being written; if not, record() does nothing
+  bool enabled() const { return enabled_; }
+
+  void record(std::chrono::system_clock::time_point received,
+              std::chrono::steady_clock::duration latency, unsigned int status,
+              uint64_t bytes, std::string_view handler, std::string_view path);
+
+  // Write out everything buffered so far
+  void flush();
+
+  // Every record in the access log at `path`, or nullopt if it can't be read
+  // or is not an access log. A record cut short at the end is ignored.
+  static std::optional<std::vector<AccessLogEntry>>
+  read(const std::filesystem::path &path);
+
+private:
+  AccessLog() {}
+
+  // The offset of the string record holding `value`, appending one if it
+  // isn't cached. Callers must hold mutex_.
+  uint64_t intern(std::string_view value);
+  void append(const void *data, size_t size);
+  void flushLoop();
+
+  std::atomic<bool> enabled_ = false;
+  int fd_ = -1;
+  std::thread flusher_;
+  bool stopping_ = false;
+
+  // Guards everything below
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  // Offset in the file the next byte appended will have
+  uint64_t offset_ = 0;
+  std::string buffer_;
+  // Heterogeneous lookup, so interning a string_view doesn't copy it
+  struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view value) const {
+      return std::hash<std::string_view>()(value);
+    }
+  };
+  std::unordered_map<std::string, uint64_t, StringHash, std::equal_to<>>
+      strings_;
+
+  // Held while writing, so batches reach the file in order
+  std::mutex write_mutex_;
+};
+
+#endif // ACCESS_LOG_H
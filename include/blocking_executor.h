@@ -0,0 +1,42 @@
+#ifndef BLOCKING_EXECUTOR_H
+#define BLOCKING_EXECUTOR_H
+
+#include <atomic>
+#include <boost/asio/thread_pool.hpp>
+#include <cstddef>
+#include <functional>
+
+// A fixed pool of threads for work that blocks, such as synchronous disk
+// reads or CPU heavy rendering, so that it never runs on the I/O threads.
+//
+// The number of tasks queued or running is bounded; once the bound is
+// reached new work is rejected rather than queued, so that a burst of slow
+// requests is answered with an error instead of building an unbounded
+// backlog.
+class BlockingExecutor {
+public:
+  BlockingExecutor(size_t thread_count, size_t max_pending);
+  // Waits for queued work to finish
+  ~BlockingExecutor();
+
+  // Run `work` on one of the executor's threads. Returns false without
+  // running it if `max_pending` tasks are already queued or running.
+  bool post(std::function<void()> work);
+
+  // Number of tasks currently queued or running
+  size_t pending() const;
+
+  // The executor shared by every handler, with two threads per core (since
+  // its threads mostly wait on the disk) and room for
+  // BLOCKING_EXECUTOR_MAX_PENDING tasks
+  static BlockingExecutor &GetInstance();
+
+private:
+  boost::asio::thread_pool pool_;
+  const size_t max_pending_;
+  std::atomic<size_t> pending_{0};
+};
+
+const size_t BLOCKING_EXECUTOR_MAX_PENDING = 1024;
+
+#endif // BLOCKING_EXECUTOR_H
@@ -0,0 +1,38 @@
+#ifndef BYTE_RANGE_H
+#define BYTE_RANGE_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The most ranges honoured in one Range header. With more, the header is
+// ignored and the whole file sent, so one request can't split a file into
+// thousands of tiny parts.
+const size_t MAX_BYTE_RANGES = 16;
+
+// An inclusive range of byte positions, as in "bytes=0-499"
+struct ByteRange {
+  uint64_t first;
+  uint64_t last;
+  uint64_t length() const { return last - first + 1; }
+  bool operator==(const ByteRange &other) const = default;
+};
+
+// Parse a Range header for a representation `size` bytes long. Returns:
+// - nullopt if the header should be ignored and the whole representation
+//   sent: it is malformed, isn't in bytes, or asks for too many ranges;
+// - no ranges if none of them is satisfiable, for a 416;
+// - otherwise the satisfiable ranges in the order asked for, with any end
+//   past the last byte moved back to it.
+std::optional<std::vector<ByteRange>> parseRange(std::string_view header,
+                                                 uint64_t size);
+
+// The Content-Range value for `range` of a `size` byte representation, e.g.
+// "bytes 0-499/1234"
+std::string contentRange(const ByteRange &range, uint64_t size);
+// The Content-Range value for a 416: "bytes */1234"
+std::string unsatisfiedRange(uint64_t size);
+
+#endif // BYTE_RANGE_H
@@ -0,0 +1,78 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include "handlers/request_handler.h"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Location args turning on response compression. compress_types lists the
+// MIME types to compress, separated by spaces or commas; compression is off
+// for a location without it.
+const std::string COMPRESS_TYPES_ARG = "compress_types";
+// bodies smaller than this many bytes are sent as they are
+const std::string COMPRESS_MIN_SIZE_ARG = "compress_min_size";
+const size_t COMPRESS_DEFAULT_MIN_SIZE = 1024;
+
+// zlib level and brotli quality for compressing on the fly; precompressed
+// files can afford the slowest settings, responses can't
+const int GZIP_LEVEL = 6;
+const int BROTLI_QUALITY = 5;
+
+enum CONTENT_ENCODING {
+  ENCODING_IDENTITY,
+  ENCODING_BROTLI,
+  ENCODING_GZIP,
+  ENCODING_DEFLATE
+};
+
+// The Content-Encoding token for an encoding, e.g. "gzip"
+std::string_view encodingName(CONTENT_ENCODING encoding);
+
+// The suffix of a file's precompressed sibling in an encoding (".gz" for
+// gzip, ".br" for brotli), or nullopt for encodings nobody precompresses
+std::optional<std::string_view> precompressedSuffix(CONTENT_ENCODING encoding);
+
+// Whether this build can compress with brotli
+bool brotliSupported();
+
+// Compress `data`, or return nullopt if the encoding isn't supported
+std::optional<std::string> compress(std::string_view data,
+                                    CONTENT_ENCODING encoding);
+
+// Which responses a location compresses, and how
+class CompressionPolicy {
+public:
+  explicit CompressionPolicy(
+      const std::unordered_map<std::string, std::string> &args);
+
+  bool enabled() const { return !types_.empty(); }
+  size_t minSize() const { return min_size_; }
+
+  // Whether responses of `content_type` are compressed, so vary with the
+  // request's Accept-Encoding
+  bool compressible(std::string_view content_type) const;
+
+  // The encodings to send a `content_type` response in, best first, going by
+  // the request's Accept-Encoding q-values and breaking ties in favour of
+  // brotli, then gzip, then deflate. Empty if the response shouldn't be
+  // compressed.
+  std::vector<CONTENT_ENCODING> encodings(const http_request &request,
+                                          std::string_view content_type) const;
+
+  // Compress the body of a complete response in `encoding`, if it is at
+  // least minSize() bytes and compressing it actually saves space. Returns
+  // whether it did. Either way, a compressible response is marked as varying
+  // by Accept-Encoding.
+  bool compressResponse(http_response &response,
+                        CONTENT_ENCODING encoding) const;
+
+private:
+  std::unordered_set<std::string> types_;
+  size_t min_size_ = COMPRESS_DEFAULT_MIN_SIZE;
+};
+
+#endif // COMPRESSION_H
@@ -0,0 +1,68 @@
+#ifndef CONDITIONAL_GET_H
+#define CONDITIONAL_GET_H
+
+#include "filesystem/filesystem_interface.h"
+#include "handlers/request_handler.h"
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Location arg giving the Cache-Control header sent with every successful
+// GET, e.g. "public, max-age=3600"; none is sent without it
+const std::string CACHE_CONTROL_ARG = "cache_control";
+
+// What identifies one version of a resource to a client revalidating it
+struct Validators {
+  // A quoted entity tag, prefixed with W/ if weak
+  std::string etag;
+  // Unset if the resource has no modification time, e.g. a generated listing
+  std::optional<std::chrono::system_clock::time_point> last_modified;
+};
+
+// Validators for a version of a file, so a conditional request can be
+// answered from its stat alone. The ETag is built from the file's size and
+// modification time, plus `variant` (e.g. a content encoding) if the same
+// version is sent in more than one form. Strong unless `weak`, for responses
+// that are rendered from the file rather than being its exact bytes.
+Validators fileValidators(const FileStat &stat, std::string_view variant = "",
+                          bool weak = false);
+
+// Weak validators for a version of a file's contents, by a hash of them.
+// Unlike fileValidators, they tell apart two writes of the same size within
+// one tick of the file's modification time. Last-Modified still comes from
+// `stat`, if given.
+Validators contentValidators(std::string_view contents,
+                             const std::optional<FileStat> &stat = std::nullopt);
+
+// Weak validators for a generated response with no file behind it, built
+// from `version` of whatever it was generated from, known as `source_id`
+Validators versionValidators(uint64_t source_id, uint64_t version);
+
+// Whether the request's If-None-Match, or failing that If-Modified-Since,
+// shows the client already has the version `validators` identifies
+bool notModified(const http_request &request, const Validators &validators);
+
+// Whether the request's Range applies to the version `validators`
+// identifies: true without If-Range, otherwise only if its entity tag
+// strongly matches, or its date is exactly the Last-Modified time. A client
+// resuming a download of an older version gets the whole file instead.
+bool ifRangeMatches(const http_request &request, const Validators &validators);
+
+// Set the ETag, Last-Modified and (if not empty) Cache-Control headers
+void setValidators(boost::beast::http::fields &headers,
+                   const Validators &validators,
+                   const std::string &cache_control);
+
+// A bodiless 304 carrying `validators` and `cache_control`
+http_response notModifiedResponse(const Validators &validators,
+                                  const std::string &cache_control);
+
+// Format a time as an HTTP-date, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string httpDate(std::chrono::system_clock::time_point time);
+// Parse an HTTP-date in the preferred format above, or nullopt if malformed
+std::optional<std::chrono::system_clock::time_point>
+parseHttpDate(std::string_view date);
+
+#endif // CONDITIONAL_GET_H
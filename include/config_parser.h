@@ -12,6 +12,7 @@
 
 #include "constants.h"
 #include "location_data.h"
+#include "session_config.h"
 
 class NginxConfig;
 
@@ -42,6 +43,36 @@ class NginxConfig {
   // if no specified port exists in the expected location (inside server{...}), 
   // or the port value specified is invalid (negative, non-integer, contains letters, etc), return -1
   int findPort();
+  // to be called from main context
+  // search for a "threading" directive and return the mode it names.
+  // if there is none, the server shares one io_service between its threads.
+  // if there are several, or the mode named is unknown, return a nullopt
+  std::optional<THREADING_MODE> findThreadingMode();
+  // to be called from main context
+  // search for the directives configuring each connection: "pipeline_depth",
+  // the number of requests a connection may have read but not yet answered
+  // at once, and "idle_timeout", "header_timeout", "body_timeout" and
+  // "write_timeout", in seconds. any not given keep their SessionConfig default.
+  // if one is given several times, pipeline_depth is not a positive integer,
+  // or a timeout is not a non-negative integer, return a nullopt
+  std::optional<SessionConfig> findSessionConfig();
+  // to be called from main context
+  // search for a "shutdown_timeout" directive, the number of seconds the
+  // server waits for in-flight requests when shutting down.
+  // if there is none, return DEFAULT_SHUTDOWN_TIMEOUT.
+  // if there are several, or the value is not a non-negative integer, return a nullopt
+  std::optional<std::chrono::seconds> findShutdownTimeout();
+  // to be called from main context
+  // search for a "log_mode" directive and return the mode it names.
+  // if there is none, logging is asynchronous.
+  // if there are several, or the mode named is unknown, return a nullopt
+  std::optional<LOGGING_MODE> findLoggingMode();
+  // to be called from main context
+  // search for an "access_log" directive, and return the path of the binary
+  // access log it names.
+  // if there is none, returns the empty string
+  // if there are several, or not called from main context, returns a nullopt
+  std::optional<std::string> findAccessLog();
   // For directive arguments that may be provided in quotes, in order to contain spaces.
   // If `arg` starts and ends with matching single or double quotes, this function
   // removes those quotes, and returns the rest of the string.
@@ -61,6 +92,13 @@ class NginxConfig {
   std::optional<std::string> findRoot();
   // validate that the NginxConfig contains only allowed directives and subcontexts
   bool Validate(std::string contextType = "main");
+
+ private:
+  // search the current context for a single `directiveName` directive with a
+  // non-negative integer argument, and return it, or `default_value` if there
+  // is no such directive. if there are several, or the argument is not a
+  // non-negative integer, return a nullopt
+  std::optional<size_t> findSize(std::string directiveName, size_t default_value);
 };
 
 // The driver that parses a config file and generates an NginxConfig.
@@ -0,0 +1,34 @@
+#ifndef CONFIG_RELOADER_H
+#define CONFIG_RELOADER_H
+
+#include "request_manager.h"
+#include <boost/asio.hpp>
+#include <mutex>
+#include <string>
+
+// Reloads the locations in the config file into a RequestManager whenever the
+// server receives SIGHUP, without dropping any connection or request.
+// Settings outside the location blocks (port, threading, timeouts) only take
+// effect on restart.
+class ConfigReloader {
+public:
+  ConfigReloader(boost::asio::io_service &io_service, std::string config_path,
+                 RequestManager &request_manager);
+
+  // Re-parse and validate the config file, and route new requests with the
+  // locations in it. Returns false, keeping the current locations, if the
+  // config is invalid or its handlers can't be built.
+  bool reload();
+
+private:
+  void wait_for_signal();
+  void handle_signal(const boost::system::error_code &error, int signal_number);
+
+  std::string config_path_;
+  RequestManager &request_manager_;
+  boost::asio::signal_set signals_;
+  // Reloads happen one at a time
+  std::mutex reload_mutex_;
+};
+
+#endif // CONFIG_RELOADER_H
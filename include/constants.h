@@ -1,6 +1,7 @@
 #ifndef CONSTANTS_H
 #define CONSTANTS_H
 
+#include <chrono>
 #include <string>
 #include <unordered_set>
 #include <unordered_map>
@@ -13,18 +14,77 @@ const std::string MAIN = "main";
 // directive/context keywords
 const std::string LOCATION = "location";
 const std::string PORT = "port";
+const std::string THREADING = "threading";
+const std::string PIPELINE_DEPTH = "pipeline_depth";
+const std::string IDLE_TIMEOUT = "idle_timeout";
+const std::string HEADER_TIMEOUT = "header_timeout";
+const std::string BODY_TIMEOUT = "body_timeout";
+const std::string WRITE_TIMEOUT = "write_timeout";
+const std::string SHUTDOWN_TIMEOUT = "shutdown_timeout";
+const std::string LOG_MODE = "log_mode";
+const std::string ACCESS_LOG = "access_log";
 // how many arguments expected for a given keyword
 const std::unordered_map<std::string, uint> EXPECTED_ARG_COUNTS = {
     { LOCATION, 2 },
     { PORT, 1 },
+    { THREADING, 1 },
+    { PIPELINE_DEPTH, 1 },
+    { IDLE_TIMEOUT, 1 },
+    { HEADER_TIMEOUT, 1 },
+    { BODY_TIMEOUT, 1 },
+    { WRITE_TIMEOUT, 1 },
+    { SHUTDOWN_TIMEOUT, 1 },
+    { LOG_MODE, 1 },
+    { ACCESS_LOG, 1 },
 };
 // list of all keywords which specify directives
 const std::unordered_set<std::string> VALID_DIRECTIVES = {
-    PORT
+    PORT,
+    THREADING,
+    PIPELINE_DEPTH,
+    IDLE_TIMEOUT,
+    HEADER_TIMEOUT,
+    BODY_TIMEOUT,
+    WRITE_TIMEOUT,
+    SHUTDOWN_TIMEOUT,
+    LOG_MODE,
+    ACCESS_LOG
 };
 // list of all keywords which specify contexts/blocks
 const std::unordered_set<std::string> VALID_CONTEXTS = {
     LOCATION
 };
 
+// how the server spreads connections over its I/O threads
+enum THREADING_MODE {
+    // one io_service and acceptor, run by every thread
+    THREADING_SHARED,
+    // one io_service and SO_REUSEPORT acceptor per thread
+    THREADING_PER_CORE,
+    // as THREADING_PER_CORE, with each thread pinned to its own CPU
+    THREADING_PER_CORE_PINNED
+};
+// arguments accepted by the threading directive
+const std::unordered_map<std::string, THREADING_MODE> THREADING_MODES = {
+    { "shared", THREADING_SHARED },
+    { "per_core", THREADING_PER_CORE },
+    { "per_core_pinned", THREADING_PER_CORE_PINNED },
+};
+
+// how log records get from the thread logging them to the file and console
+enum LOGGING_MODE {
+    // written and flushed by the logging thread
+    LOGGING_SYNC,
+    // queued, and written in batches by a background thread
+    LOGGING_ASYNC
+};
+// arguments accepted by the log_mode directive
+const std::unordered_map<std::string, LOGGING_MODE> LOGGING_MODES = {
+    { "sync", LOGGING_SYNC },
+    { "async", LOGGING_ASYNC },
+};
+
+// how long a shutdown waits for connections to finish when none is configured
+const std::chrono::seconds DEFAULT_SHUTDOWN_TIMEOUT(30);
+
 #endif //CONSTANTS_H
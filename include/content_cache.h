@@ -0,0 +1,80 @@
+#ifndef CONTENT_CACHE_H
+#define CONTENT_CACHE_H
+
+#include "filesystem/filesystem_interface.h"
+#include "handlers/request_handler.h"
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// A complete response built from a file, ready to be copied out of the cache
+struct CachedContent {
+  // The version of the file the response was built from
+  FileStat version;
+  // Status line, headers and body, precomputed when the entry was cached
+  http_response response;
+  // For callers that also count writes the file's stat can't tell apart:
+  // the count the response was built at
+  uint64_t revision = 0;
+};
+
+// A thread-safe, in-memory cache of responses built from files, bounded by
+// the total size of the cached bodies and evicting the least recently used
+// entries first. Entries are keyed by file path; a lookup only hits if the
+// file's current size and modification time, and the caller's revision,
+// still match the cached version.
+class ContentCache {
+public:
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    // total size of the cached bodies, and how many there are
+    uint64_t bytes;
+    uint64_t entries;
+  };
+
+  explicit ContentCache(size_t capacity_bytes);
+
+  // Return the entry for `key` if it was built from `version` of the file,
+  // at `revision`. A stale entry is dropped, and counts as a miss.
+  std::shared_ptr<const CachedContent> get(const std::string &key,
+                                           const FileStat &version,
+                                           uint64_t revision = 0);
+
+  // Cache `content` under `key`, replacing any existing entry and evicting
+  // least recently used entries until it fits. Content larger than the whole
+  // capacity is not cached.
+  void put(const std::string &key, std::shared_ptr<const CachedContent> content);
+
+  // Drop the entry for `key`, if any
+  void invalidate(const std::string &key);
+
+  Stats stats() const;
+
+  size_t capacity() const { return capacity_bytes_; }
+
+private:
+  typedef std::pair<std::string, std::shared_ptr<const CachedContent>> Entry;
+
+  // Remove `it` from the cache; the caller must hold mtx_
+  void erase(std::list<Entry>::iterator it);
+
+  const size_t capacity_bytes_;
+
+  mutable std::mutex mtx_;
+  // most recently used first
+  std::list<Entry> lru_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+  size_t size_bytes_ = 0;
+
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> evictions_{0};
+};
+
+#endif // CONTENT_CACHE_H
@@ -0,0 +1,97 @@
+#ifndef FILE_SLICE_BODY_H
+#define FILE_SLICE_BODY_H
+
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/core/file.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+// A Beast body holding an open file, or just a byte range of it. It is sent
+// from the whole file unless narrowed with slice(), as the body of a 206.
+//
+// The session sends it with sendfile(2), straight from file() starting at
+// offset(). The writer, which reads it through user space, is only there for
+// Beast's serializer.
+struct FileSliceBody {
+  class value_type {
+  public:
+    // Open the file at `path`, covering all of it
+    void open(const char *path, boost::beast::file_mode mode,
+              boost::beast::error_code &ec) {
+      file_.open(path, mode, ec);
+      if (ec) {
+        return;
+      }
+      offset_ = 0;
+      size_ = file_.size(ec);
+      if (ec) {
+        file_.close(ec);
+      }
+    }
+
+    bool is_open() const { return file_.is_open(); }
+    boost::beast::file &file() { return file_; }
+
+    // Narrow the body to `length` bytes from `offset`, which must lie within
+    // the file
+    void slice(uint64_t offset, uint64_t length) {
+      offset_ = offset;
+      size_ = length;
+    }
+
+    // Where in the file the body starts, and how many bytes it covers
+    uint64_t offset() const { return offset_; }
+    uint64_t size() const { return size_; }
+
+  private:
+    boost::beast::file file_;
+    uint64_t offset_ = 0;
+    uint64_t size_ = 0;
+  };
+
+  static uint64_t size(const value_type &body) { return body.size(); }
+
+  class writer {
+  public:
+    using const_buffers_type = boost::asio::const_buffer;
+
+    template <bool isRequest, class Fields>
+    writer(boost::beast::http::header<isRequest, Fields> &, value_type &body)
+        : body_(body), remaining_(body.size()) {}
+
+    void init(boost::beast::error_code &ec) {
+      body_.file().seek(body_.offset(), ec);
+    }
+
+    boost::optional<std::pair<const_buffers_type, bool>>
+    get(boost::beast::error_code &ec) {
+      if (remaining_ == 0) {
+        ec = {};
+        return boost::none;
+      }
+      size_t amount =
+          static_cast<size_t>(std::min<uint64_t>(remaining_, sizeof(buf_)));
+      size_t read = body_.file().read(buf_, amount, ec);
+      if (ec) {
+        return boost::none;
+      }
+      if (read == 0) {
+        // the file shrank since the header was written
+        ec = boost::beast::http::error::short_read;
+        return boost::none;
+      }
+      remaining_ -= read;
+      return {{const_buffers_type{buf_, read}, remaining_ > 0}};
+    }
+
+  private:
+    value_type &body_;
+    uint64_t remaining_;
+    char buf_[4096];
+  };
+};
+
+#endif // FILE_SLICE_BODY_H
@@ -2,7 +2,9 @@
 #define FILESYSTEM_H
 
 #include "filesystem/filesystem_interface.h"
+#include <array>
 #include <boost/filesystem.hpp>
+#include <mutex>
 #include <optional>
 #include <string>
 
@@ -15,14 +17,45 @@ public:
   FILE_TYPE fileType(std::string file_name) const override;
   std::optional<std::string>
   read(const std::filesystem::path &filename) const override;
+  std::optional<FileStat>
+  stat(const std::filesystem::path &filename) const override;
   bool write(const std::filesystem::path &filename,
              const std::string &data) override;
+  bool create(const std::filesystem::path &filename,
+              const std::string &data) override;
+  // Moved into place with a rename, never read into memory
+  bool writeFrom(const std::filesystem::path &filename,
+                 const std::filesystem::path &source) override;
+  bool createFrom(const std::filesystem::path &filename,
+                  const std::filesystem::path &source) override;
   bool remove(const std::filesystem::path &path) override;
   bool is_directory(const std::filesystem::path &path) const override;
   bool create_directories(const std::filesystem::path &path) override;
 
 private:
-  static std::recursive_mutex mtx_;
+  // Readers take no locks: files are only ever replaced whole, by renaming a
+  // fully written temporary file over them, so a read sees either the old or
+  // the new contents. Writers to the same path are serialized by one of a
+  // fixed set of mutexes, picked by hashing the path.
+  static constexpr size_t WRITE_LOCK_STRIPES = 64;
+  static std::array<std::mutex, WRITE_LOCK_STRIPES> write_locks_;
+  static std::mutex &lockFor(const std::filesystem::path &path);
+
+  // Check that `filename` names a file, and create any missing parent
+  // directories for it
+  bool prepareFile(const std::filesystem::path &filename);
+
+  // Write `data` to a new temporary file next to `filename`, creating any
+  // missing parent directories. Returns the temporary file's path.
+  std::optional<std::filesystem::path>
+  writeTemporary(const std::filesystem::path &filename,
+                 const std::string &data);
+  // Copy `source` to a new temporary file next to `filename`, for when it
+  // lives on another filesystem and can't be linked or renamed there
+  std::optional<std::filesystem::path>
+  copyTemporary(const std::filesystem::path &filename,
+                const std::filesystem::path &source);
+
   // Some helper methods to help in performing error checking, otherwise the
   // server might panic and crash at runtime
 
@@ -1,6 +1,13 @@
 #include <string>
 #include <unordered_map>
 
+// Temporary files are written under this prefix before being renamed into
+// place, and are hidden from listings
+const std::string TEMP_FILE_PREFIX = ".tmp-";
+// Directory under a handler's data_path that request bodies are streamed into
+// while they arrive, so they never sit among the stored files
+const std::string UPLOAD_DIRECTORY = TEMP_FILE_PREFIX + "uploads";
+
 // recognized file extensions
 const std::string TEXT_FILE_EXT = ".txt";
 const std::string JPG_FILE_EXT = ".jpg";
@@ -2,11 +2,23 @@
 #define FILESYSTEM_INTERFACE_H
 
 #include "filesystem/filesystem_constants.h"
+#include <cstdint>
 #include <filesystem>
+#include <fstream>
 #include <optional>
 #include <string>
 #include <vector>
 
+// Metadata identifying a version of a file: if either changes, so may the
+// file's contents
+struct FileStat {
+  uintmax_t size;
+  std::filesystem::file_time_type last_write_time;
+  bool operator==(const FileStat &other) const {
+    return size == other.size && last_write_time == other.last_write_time;
+  }
+};
+
 class FileSystemInterface {
 public:
   // Pure virtual function to check if a file or directory exists
@@ -20,10 +32,32 @@ public:
   // Returns std::nullopt if the file doesn't exist, otherwise the file contents
   virtual std::optional<std::string>
   read(const std::filesystem::path &filename) const = 0;
+  // Pure virtual function to get the size and modification time of a file
+  // Returns std::nullopt if the path doesn't exist or isn't a regular file
+  virtual std::optional<FileStat>
+  stat(const std::filesystem::path &filename) const = 0;
   // Pure virtual function to write a string payload to a given path
   // Returns whether or not the write happened successfully
   virtual bool write(const std::filesystem::path &filename,
                      const std::string &data) = 0;
+  // Pure virtual function to write a string payload to a new file
+  // Returns false without touching the file if something already exists at
+  // the given path, so concurrent creators can't overwrite each other
+  virtual bool create(const std::filesystem::path &filename,
+                      const std::string &data) = 0;
+  // Function to store the contents of `source`, a file already written
+  // elsewhere on the local disk, at `filename` like write(). `source` is
+  // consumed if this succeeds. By default it is read into memory and
+  // written; storage that can move the file into place instead overrides it.
+  virtual bool writeFrom(const std::filesystem::path &filename,
+                         const std::filesystem::path &source) {
+    return storeFrom(filename, source, false);
+  }
+  // Function to store the contents of `source` at `filename` like create()
+  virtual bool createFrom(const std::filesystem::path &filename,
+                          const std::filesystem::path &source) {
+    return storeFrom(filename, source, true);
+  }
   // Pure virtual function to remove a file
   // Returns whether or not the removal happened successfully
   virtual bool remove(const std::filesystem::path &filename) = 0;
@@ -31,6 +65,22 @@ public:
   virtual bool is_directory(const std::filesystem::path &path) const = 0;
   // Pure virtual function to create directories
   virtual bool create_directories(const std::filesystem::path &path) = 0;
+
+private:
+  bool storeFrom(const std::filesystem::path &filename,
+                 const std::filesystem::path &source, bool exclusive) {
+    std::ifstream file(source, std::ios::binary);
+    if (!file) {
+      return false;
+    }
+    std::string data(std::istreambuf_iterator<char>{file}, {});
+    if (!(exclusive ? create(filename, data) : write(filename, data))) {
+      return false;
+    }
+    std::error_code ignored;
+    std::filesystem::remove(source, ignored);
+    return true;
+  }
 };
 
 #endif // FILESYSTEM_INTERFACE_H
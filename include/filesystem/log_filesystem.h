@@ -0,0 +1,143 @@
+#ifndef LOG_FILESYSTEM_H
+#define LOG_FILESYSTEM_H
+
+#include "filesystem/filesystem_interface.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+const size_t LOG_FILESYSTEM_DEFAULT_SEGMENT_SIZE = 64 * 1024 * 1024;
+
+// A FileSystemInterface that stores every file under `root` as a record
+// appended to a log of segment files, instead of one file per path. Writes and
+// removes are sequential appends, and an in-memory index from path to record
+// serves reads, listings and existence checks without touching the disk.
+//
+// Directories are implicit: a directory exists while some file below it does.
+//
+// The index, including each file's modification time, is rebuilt from the
+// segments on construction. Once a segment
+// fills up it is sealed. When at least half of the bytes in sealed segments
+// belong to records that have since been overwritten or removed, a background
+// thread merges them: it copies their live records to the end of the log and
+// deletes them, oldest first, so a removal is never forgotten while an older
+// version of the file is still on disk.
+class LogFileSystem : public FileSystemInterface {
+public:
+  explicit LogFileSystem(
+      const std::filesystem::path &root,
+      size_t segment_size = LOG_FILESYSTEM_DEFAULT_SEGMENT_SIZE);
+  ~LogFileSystem();
+
+  // The LogFileSystem for `root`, shared with everyone else who has opened
+  // the same directory and still holds on to it. A log must only ever have
+  // one writer, so this is how handlers rebuilt by a config reload share the
+  // log with the handlers they replace.
+  static std::shared_ptr<LogFileSystem> Open(const std::filesystem::path &root);
+
+  bool exists(const std::filesystem::path &path) const override;
+  std::optional<std::vector<std::filesystem::path>>
+  list(const std::filesystem::path &directory) const override;
+  FILE_TYPE fileType(std::string file_name) const override;
+  std::optional<std::string>
+  read(const std::filesystem::path &filename) const override;
+  std::optional<FileStat>
+  stat(const std::filesystem::path &filename) const override;
+  bool write(const std::filesystem::path &filename,
+             const std::string &data) override;
+  bool create(const std::filesystem::path &filename,
+              const std::string &data) override;
+  bool remove(const std::filesystem::path &filename) override;
+  bool is_directory(const std::filesystem::path &path) const override;
+  bool create_directories(const std::filesystem::path &path) override;
+
+  // Synchronously merge the sealed segments, if at least half garbage
+  void compact();
+  // Number of segment files currently making up the log
+  size_t segmentCount() const;
+
+private:
+  enum RecordType : uint8_t { RECORD_PUT = 0, RECORD_DELETE = 1 };
+
+  struct Segment {
+    ~Segment();
+    uint64_t id;
+    int fd = -1;
+    std::filesystem::path path;
+    // bytes written, and bytes belonging to overwritten or removed records
+    std::atomic<uint64_t> size = 0;
+    std::atomic<uint64_t> dead_bytes = 0;
+  };
+
+  // Where the current contents of a file live
+  struct Location {
+    uint64_t segment_id;
+    uint64_t record_offset;
+    uint32_t record_size;
+    uint32_t value_size;
+    std::filesystem::file_time_type last_write_time;
+  };
+
+  // Map a path below root_ to its index key: the normalized relative path,
+  // without a trailing slash. Root itself maps to "".
+  std::optional<std::string> keyFor(const std::filesystem::path &path) const;
+
+  // Rebuild the index by replaying the segments found in root_
+  void recover();
+  // Replay the records of one segment into the index. Returns the number of
+  // bytes of whole records, so a torn write at the end can be cut off.
+  uint64_t replay(Segment &segment);
+  std::shared_ptr<Segment> openSegment(uint64_t id, bool create);
+
+  // Append a record to the active segment and point the index at it. The
+  // record keeps `last_write_time`, or the current time if not given.
+  // Callers must hold write_mutex_.
+  bool append(RecordType type, const std::string &key,
+              const std::string &value,
+              std::optional<std::filesystem::file_time_type> last_write_time =
+                  std::nullopt);
+  // Account for the record at `location` no longer being live.
+  // Callers must hold index_mutex_ exclusively.
+  void markDead(const Location &location);
+  bool isDirectory(const std::string &key) const;
+
+  // Copy the records of `segment` that are still live to the end of the log
+  bool copyLiveRecords(const Segment &segment);
+  void compactionLoop();
+  void requestCompaction();
+
+  std::filesystem::path root_;
+  size_t segment_size_;
+
+  // Serializes appends, and is held before index_mutex_ when both are needed
+  std::mutex write_mutex_;
+  std::shared_ptr<Segment> active_;
+
+  // Guards index_ and segments_; readers share it
+  mutable std::shared_mutex index_mutex_;
+  std::map<std::string, Location> index_;
+  std::map<uint64_t, std::shared_ptr<Segment>> segments_;
+
+  // Held for a whole compaction run, so runs never overlap
+  std::mutex compact_run_mutex_;
+  std::mutex compaction_mutex_;
+  std::condition_variable compaction_cv_;
+  bool compaction_requested_ = false;
+  bool stopping_ = false;
+  std::thread compaction_thread_;
+
+  // Open instances, by canonical root
+  static inline std::mutex open_mutex_;
+  static inline std::unordered_map<std::string, std::weak_ptr<LogFileSystem>>
+      open_;
+};
+
+#endif // LOG_FILESYSTEM_H
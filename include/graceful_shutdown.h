@@ -0,0 +1,44 @@
+#ifndef GRACEFUL_SHUTDOWN_H
+#define GRACEFUL_SHUTDOWN_H
+
+#include "io_service_pool.h"
+#include "server.h"
+#include <boost/asio.hpp>
+#include <chrono>
+#include <vector>
+
+// Shuts the server down when it receives SIGINT or SIGTERM. The servers stop
+// accepting, every live session is asked to finish the requests it has
+// already read, and once they are all gone (or `timeout` has passed) the I/O
+// threads are stopped, so IoServicePool::run returns.
+class GracefulShutdown {
+public:
+  GracefulShutdown(IoServicePool &io_services, std::vector<server *> servers,
+                   std::chrono::seconds timeout);
+
+  // Start shutting down now, as if a signal had arrived
+  void start();
+
+  // Whether every connection finished before the timeout
+  bool drained() const;
+
+private:
+  void handle_signal(const boost::system::error_code &error, int signal_number);
+  // Check every so often whether the connections and their handlers are done
+  void wait_for_drain();
+  void handle_drain_check(const boost::system::error_code &error);
+
+  IoServicePool &io_services_;
+  std::vector<server *> servers_;
+  std::chrono::seconds timeout_;
+  boost::asio::signal_set signals_;
+  boost::asio::steady_timer drain_timer_;
+  std::chrono::steady_clock::time_point deadline_;
+  bool started_ = false;
+  bool drained_ = false;
+};
+
+// How often a shutdown checks whether the connections have drained
+const std::chrono::milliseconds GRACEFUL_SHUTDOWN_POLL_INTERVAL(50);
+
+#endif // GRACEFUL_SHUTDOWN_H
@@ -0,0 +1,89 @@
+#ifndef HANDLER_POOL_H
+#define HANDLER_POOL_H
+
+#include "location_data.h"
+#include "metrics.h"
+#include "registry.h"
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Owns the handler instances for a single config location. Instances are
+// built once, when the config is loaded, instead of once per request.
+//
+// Thread-safe handlers are built once and shared by every request. Other
+// handlers are pooled: each request leases an instance for its exclusive use
+// and returns it to the pool when the lease is destroyed.
+class HandlerPool {
+public:
+  // A handler instance leased for the duration of one request
+  class Lease {
+  public:
+    Lease(HandlerPool *pool, RequestHandler *handler);
+    Lease(Lease &&other);
+    Lease(const Lease &) = delete;
+    Lease &operator=(const Lease &) = delete;
+    ~Lease();
+    RequestHandler *operator->() const { return handler_; }
+    RequestHandler &operator*() const { return *handler_; }
+
+  private:
+    // null if the handler is shared and does not need to be returned
+    HandlerPool *pool_;
+    RequestHandler *handler_;
+  };
+
+  // Builds `pool_size` instances up front (or a single instance, if the
+  // handler is thread-safe) using `factory`, passing it `path` and `args`.
+  // A body_limit in `args` must already have been checked by
+  // NginxConfig::findLocations.
+  HandlerPool(RequestHandlerFactory factory, bool thread_safe, std::string path,
+              std::unordered_map<std::string, std::string> args,
+              size_t pool_size);
+
+  // Builds the pool for the registered handler called `handler_name`
+  static std::unique_ptr<HandlerPool>
+  Create(const std::string &handler_name, std::string path,
+         std::unordered_map<std::string, std::string> args, size_t pool_size);
+
+  // Lease a handler instance. If every pooled instance is in use, a new one
+  // is built and kept in the pool afterwards.
+  Lease acquire();
+
+  // Counters for the requests served by the pool's location and handler, or
+  // null if the pool was built from a bare factory. Series are never
+  // destroyed, so this stays valid after the pool is.
+  MetricsSeries *metrics() const { return metrics_; }
+
+  // The most bytes of request body the location takes, from its body_limit
+  uint64_t bodyLimit() const { return body_limit_; }
+  // Where the handlers stream uploads to (see RequestHandler::uploadDirectory)
+  const std::optional<std::filesystem::path> &uploadDirectory() const {
+    return upload_directory_;
+  }
+
+private:
+  void release(RequestHandler *handler);
+
+  RequestHandlerFactory factory_;
+  MetricsSeries *metrics_ = nullptr;
+  std::string path_;
+  std::unordered_map<std::string, std::string> args_;
+  uint64_t body_limit_ = DEFAULT_BODY_LIMIT;
+  std::optional<std::filesystem::path> upload_directory_;
+
+  // set iff the handler is thread-safe
+  std::unique_ptr<RequestHandler> shared_;
+
+  std::mutex mtx_;
+  // every instance built for this pool, leased or not
+  std::vector<std::unique_ptr<RequestHandler>> instances_;
+  std::vector<RequestHandler *> idle_;
+};
+
+#endif // HANDLER_POOL_H
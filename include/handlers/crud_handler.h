@@ -1,37 +1,112 @@
 #ifndef CRUD_HANDLER_H
 #define CRUD_HANDLER_H
 
+#include "conditional_get.h"
 #include "filesystem/filesystem_interface.h"
+#include "record_index.h"
 #include "registry.h"
 #include "request_handler.h"
+#include <atomic>
 #include <filesystem>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 const std::string CRUD_HANDLER_DATA_PATH_ARG = "data_path";
+// How records are stored under data_path: one file per record ("file", the
+// default) or appended to a log of segment files ("log")
+const std::string CRUD_HANDLER_STORAGE_ARG = "storage";
+const std::string CRUD_HANDLER_STORAGE_FILE = "file";
+const std::string CRUD_HANDLER_STORAGE_LOG = "log";
+// "true" to refuse POST and PUT bodies that aren't well-formed JSON with 400
+const std::string CRUD_HANDLER_VALIDATE_JSON_ARG = "validate_json";
+// Query parameters paging through a listing: at most `limit` records,
+// starting after the one named `cursor`
+const std::string CRUD_HANDLER_LIMIT_PARAM = "limit";
+const std::string CRUD_HANDLER_CURSOR_PARAM = "cursor";
+// Records per chunk of a streamed listing. A listing that fits in one chunk
+// is sent whole, with a Content-Length.
+const size_t CRUD_HANDLER_LIST_CHUNK = 1024;
 
 class CrudHandler : public RequestHandler {
 public:
   CrudHandler(std::string path,
               std::unordered_map<std::string, std::string> args,
-              std::unique_ptr<FileSystemInterface> filesystem);
+              std::shared_ptr<FileSystemInterface> filesystem);
   http_response handle_request(const http_request &request);
+  // Long listings are streamed in chunks instead of being built up front
+  http_response_variant serve(const http_request &request) override;
+  // Uploads are streamed to a directory of their own under data_path, and
+  // moved into place from there
+  std::optional<std::filesystem::path> uploadDirectory() const override;
+  http_response handle_upload(const http_request &request,
+                              const UploadedBody &body) override;
   static RequestHandler *
   Init(std::string path, std::unordered_map<std::string, std::string> args);
   static inline ArgSet expectedArgs = {CRUD_HANDLER_DATA_PATH_ARG};
+  static inline ArgSet optionalArgs = {CRUD_HANDLER_STORAGE_ARG,
+                                       CRUD_HANDLER_VALIDATE_JSON_ARG,
+                                       CACHE_CONTROL_ARG};
+  // ID counters and record indexes are behind their own locks
+  static inline const bool threadSafe = true;
 
 private:
-  http_response handle_get(const std::filesystem::path &path);
+  // Respond to `request`, whose body is in `upload` if it was streamed there.
+  // A listing is streamed only if `stream`.
+  http_response_variant handle(const http_request &request,
+                               const UploadedBody *upload, bool stream);
+  http_response_variant handle_get(const http_request &request,
+                                   const std::filesystem::path &path,
+                                   std::string_view query, bool stream);
   http_response handle_post(const std::filesystem::path &path,
-                            std::string data);
+                            const http_request &request,
+                            const UploadedBody *upload);
   http_response handle_delete(const std::filesystem::path &path);
-  http_response handle_put(const std::filesystem::path &path, std::string data);
+  http_response handle_put(const std::filesystem::path &path,
+                           const http_request &request,
+                           const UploadedBody *upload);
+  // Store the request's body at `path`, only if nothing is there yet when
+  // `create`. A streamed body is moved into place rather than copied.
+  bool store(const std::filesystem::path &path, const http_request &request,
+             const UploadedBody *upload, bool create);
 
-  http_response list(const std::filesystem::path &path);
+  http_response_variant list(const http_request &request,
+                             const std::filesystem::path &path,
+                             std::string_view query, bool stream);
+
+  // The index of the records in `entity_path`, created (but not loaded) the
+  // first time it is asked for
+  std::shared_ptr<RecordIndex> recordIndex(const std::filesystem::path &entity_path);
+
+  // Hand out the next unused ID for the entity stored in `entity_path`
+  int allocateId(const std::filesystem::path &entity_path);
+  // Return the largest numeric filename in `entity_path`, or 0 if none
+  int maxExistingId(const std::filesystem::path &entity_path);
+
+  // IDs are handed out from an atomic counter per entity, recovered by
+  // scanning the entity's directory the first time it is POSTed to
+  struct EntityIds {
+    std::once_flag recovered;
+    std::atomic<int> next_id = 1;
+  };
 
   std::string path_;
   std::string data_path_;
-  std::unique_ptr<FileSystemInterface> filesystem_;
+  // Shared with any other handler storing records in the same log
+  std::shared_ptr<FileSystemInterface> filesystem_;
+  // sent with every record and listing served, unless empty
+  std::string cache_control_;
+  bool validate_json_;
+  std::shared_mutex entity_ids_mutex_;
+  std::unordered_map<std::string, std::unique_ptr<EntityIds>> entity_ids_;
+  // Each entity's records in listing order, loaded by the first listing and
+  // then kept up to date by POST, PUT and DELETE. Records changed behind the
+  // handler's back show up after a restart.
+  std::shared_mutex indexes_mutex_;
+  std::unordered_map<std::string, std::shared_ptr<RecordIndex>> indexes_;
 };
 
 REGISTER_HANDLER(CrudHandler);
@@ -10,7 +10,10 @@ class EchoHandler : public RequestHandler {
         EchoHandler();
         static RequestHandler* Init(std::string path, std::unordered_map<std::string, std::string> args);
         static inline ArgSet expectedArgs = {};
+        static inline const bool threadSafe = true;
         http_response handle_request(const http_request& request);
+        // Responds straight away, so runs on the I/O thread
+        bool respondsInline() const override { return true; }
 };
 
 REGISTER_HANDLER(EchoHandler);
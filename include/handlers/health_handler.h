@@ -9,8 +9,11 @@ public:
     HealthHandler();
     HealthHandler(std::string path, std::unordered_map<std::string, std::string> args);
     http_response handle_request(const http_request& request);
+    // Responds straight away, so runs on the I/O thread
+    bool respondsInline() const override { return true; }
     static RequestHandler* Init(std::string path, std::unordered_map<std::string, std::string> args);
     static inline ArgSet expectedArgs = {};
+    static inline const bool threadSafe = true;
 };
 
 REGISTER_HANDLER(HealthHandler);
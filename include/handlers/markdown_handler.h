@@ -1,9 +1,14 @@
 #ifndef MARKDOWN_HANDLER_H
 #define MARKDOWN_HANDLER_H
 
+#include "compression.h"
+#include "conditional_get.h"
+#include "content_cache.h"
 #include "filesystem/filesystem_interface.h"
 #include "registry.h"
 #include "request_handler.h"
+#include <array>
+#include <atomic>
 #include <filesystem>
 #include <memory>
 #include <vector>
@@ -11,6 +16,9 @@
 const std::string MARKDOWN_HANDLER_DATA_PATH_ARG = "data_path";
 // specifies where the handler should get the CSS for the markdown
 const std::string MARKDOWN_HANDLER_FORMAT_PATH_ARG = "format_path";
+// byte budget for caching rendered pages in memory; 0 turns the cache off
+const std::string MARKDOWN_HANDLER_CACHE_SIZE_ARG = "cache_size";
+const size_t MARKDOWN_HANDLER_DEFAULT_CACHE_SIZE = 16 * 1024 * 1024;
 
 class MarkdownHandler : public RequestHandler {
 public:
@@ -18,20 +26,53 @@ public:
                   std::unordered_map<std::string, std::string> args,
                   std::unique_ptr<FileSystemInterface> filesystem);
   http_response handle_request(const http_request &request);
+  // Uploads are streamed to a directory of their own under data_path, and
+  // moved into place from there
+  std::optional<std::filesystem::path> uploadDirectory() const override;
+  http_response handle_upload(const http_request &request,
+                              const UploadedBody &body) override;
   static RequestHandler *
   Init(std::string path, std::unordered_map<std::string, std::string> args);
   static inline ArgSet expectedArgs = {
     MARKDOWN_HANDLER_DATA_PATH_ARG,
     MARKDOWN_HANDLER_FORMAT_PATH_ARG
   };
+  static inline ArgSet optionalArgs = {
+    MARKDOWN_HANDLER_CACHE_SIZE_ARG,
+    COMPRESS_TYPES_ARG,
+    COMPRESS_MIN_SIZE_ARG,
+    CACHE_CONTROL_ARG
+  };
+  // The render cache locks itself, and page revisions are atomic
+  static inline const bool threadSafe = true;
+
+  // Hit/miss/eviction counters for the rendered page cache, or nullopt if
+  // caching is turned off
+  std::optional<ContentCache::Stats> cacheStats() const;
 
 private:
-  http_response handle_get(const std::filesystem::path &path);
+  // Respond to `request`, whose body is in `upload` if it was streamed there
+  http_response handle(const http_request &request, const UploadedBody *upload);
+  http_response handle_get(const http_request &request,
+                           const std::filesystem::path &path);
+  // A 304 for the page at `path`, which the client has as `validators`
+  http_response notModifiedPage(const std::filesystem::path &path,
+                                const Validators &validators);
   http_response handle_post(const std::filesystem::path &path,
-                            std::string data);
+                            const http_request &request,
+                            const UploadedBody *upload);
   http_response handle_put(const std::filesystem::path &path,
-                            std::string data);
+                           const http_request &request,
+                           const UploadedBody *upload);
+  // Write the request's body to `path`, moving a streamed body into place
+  bool store(const std::filesystem::path &path, const http_request &request,
+             const UploadedBody *upload);
   http_response handle_delete(const std::filesystem::path &path);
+  // Drop every cached encoding of the page at `path`, once it has been
+  // written, and move its revision on
+  void invalidate(const std::filesystem::path &path);
+  // The write counter for the page at `path`
+  std::atomic<uint64_t> &revision(const std::filesystem::path &path);
 
   // Longest matching prefix
   std::string path_;
@@ -41,6 +82,21 @@ private:
   // the markdown stylesheet from the static handler
   std::string format_path_;
   std::unique_ptr<FileSystemInterface> filesystem_;
+  // Rendered pages, keyed by file path and versioned by the file's stat, so
+  // a GET for an unchanged page skips reading and rendering it. Compressed
+  // renders are cached alongside, under the path plus the encoding. Null if
+  // caching is turned off.
+  std::unique_ptr<ContentCache> cache_;
+  // Bumped once a write to a page through the handler is done. A GET reads
+  // its page's counter before reading the page, and caches its render at
+  // that count, so a render of the old page that finishes after the write
+  // never hits. Pages share counters by hash of their path; a write only
+  // costs the other pages on its counter a cache miss.
+  std::array<std::atomic<uint64_t>, 64> revisions_ = {};
+  // off unless compress_types was configured
+  CompressionPolicy compression_;
+  // sent with every page served, unless empty
+  std::string cache_control_;
 };
 
 REGISTER_HANDLER(MarkdownHandler);
@@ -0,0 +1,24 @@
+#ifndef METRICS_HANDLER_H
+#define METRICS_HANDLER_H
+
+#include "registry.h"
+#include "request_handler.h"
+
+// Serves the server's metrics in the Prometheus text exposition format:
+// request, status code and byte counts and latency histograms for every
+// location and handler, plus connection gauges.
+class MetricsHandler : public RequestHandler {
+public:
+    MetricsHandler();
+    MetricsHandler(std::string path, std::unordered_map<std::string, std::string> args);
+    http_response handle_request(const http_request& request);
+    // Responds straight away, so runs on the I/O thread
+    bool respondsInline() const override { return true; }
+    static RequestHandler* Init(std::string path, std::unordered_map<std::string, std::string> args);
+    static inline ArgSet expectedArgs = {};
+    static inline const bool threadSafe = true;
+};
+
+REGISTER_HANDLER(MetricsHandler);
+
+#endif // METRICS_HANDLER_H
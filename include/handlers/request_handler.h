@@ -1,17 +1,21 @@
 #ifndef REQUEST_HANDLER_H
 #define REQUEST_HANDLER_H
 
+#include "file_slice_body.h"
+#include "stream_body.h"
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 #include <unordered_map>
 #include <iostream>
 #include <boost/log/trivial.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <unordered_set>
+#include <variant>
 
-const std::string HTTP_PREFIX = "HTTP/1.1 ";
-const std::string CONTENT_TYPE = "Content-Type: ";
-const std::string CONTENT_LENGTH = "Content-Length: ";
-const std::string CRLF = "\r\n";
 // Content types, see 
 // https://developer.mozilla.org/en-US/docs/Web/HTTP/Basics_of_HTTP/MIME_types/Common_types
 const std::string TEXT_PLAIN = "text/plain";
@@ -24,57 +28,134 @@ const std::string IMAGE_X_ICON = "image/x-icon";
 const std::string APPLICATION_ZIP = "application/zip";
 const std::string JSON = "application/json";
 const std::string MARKDOWN = "text/markdown";
+const std::string PROMETHEUS_TEXT = "text/plain; version=0.0.4";
 // status codes, see
 // https://developer.mozilla.org/en-US/docs/Web/HTTP/Status
 enum RESPONSE_CODE : unsigned int {
     OK_STATUS = 200,
     NO_CONTENT_STATUS = 204,
+    PARTIAL_CONTENT_STATUS = 206,
+    NOT_MODIFIED_STATUS = 304,
     BAD_REQUEST_STATUS = 400,
     NOT_FOUND_STATUS = 404,
     NOT_SUPPORTED_STATUS = 405,
-    INTERNAL_SERVER_ERROR_STATUS = 500
-};
-const std::unordered_map<uint, std::string> STATUS_CODE_REASONS = {
-    {OK_STATUS, "OK"},
-    {BAD_REQUEST_STATUS, "Bad Request"},
-    {NOT_FOUND_STATUS, "Not Found"},
-    {NOT_SUPPORTED_STATUS, "Method Not Allowed"},
-    {INTERNAL_SERVER_ERROR_STATUS, "Internal Server Error"}
+    PAYLOAD_TOO_LARGE_STATUS = 413,
+    RANGE_NOT_SATISFIABLE_STATUS = 416,
+    INTERNAL_SERVER_ERROR_STATUS = 500,
+    SERVICE_UNAVAILABLE_STATUS = 503
 };
 
 typedef boost::beast::http::string_body http_string_body;
 typedef boost::beast::http::field http_fields;
 typedef boost::beast::http::response<http_string_body> http_response;
 typedef boost::beast::http::request<http_string_body> http_request;
+// An open file, or a byte range of one, sent with sendfile(2)
+typedef FileSliceBody http_file_body;
+typedef boost::beast::http::response<http_file_body> http_file_response;
+// A response whose body is generated as it is sent, in chunks
+typedef boost::beast::http::response<StreamBody> http_stream_response;
+// Any response a handler may hand to the session to write
+typedef std::variant<http_response, http_file_response, http_stream_response> http_response_variant;
+// Names of the arguments a handler takes in its location block
+typedef std::unordered_set<std::string> ArgSet;
+// Receives the response to a request handled asynchronously
+typedef std::function<void(http_response_variant)> ResponseCallback;
+
+// A request body the session streamed to a temporary file as it arrived,
+// instead of reading it into memory (see RequestHandler::uploadDirectory).
+// The file is removed once the last reference to it goes, unless a handler
+// has moved it into place by then.
+class UploadedBody {
+public:
+    UploadedBody(std::filesystem::path path, uint64_t size);
+    ~UploadedBody();
+    UploadedBody(const UploadedBody&) = delete;
+    UploadedBody& operator=(const UploadedBody&) = delete;
+
+    // A fresh name for a temporary upload file in `directory`
+    static std::filesystem::path temporaryPath(const std::filesystem::path& directory);
+    // Remove the upload files in `directory` left behind by servers that
+    // are no longer running, e.g. because they crashed mid-upload
+    static void removeStale(const std::filesystem::path& directory);
+
+    const std::filesystem::path& path() const { return path_; }
+    uint64_t size() const { return size_; }
+
+private:
+    std::filesystem::path path_;
+    uint64_t size_;
+};
 
 
 class RequestHandler {
 
 public:
+    virtual ~RequestHandler() = default;
+
     //Pure virtual function to generate a response to a given request
     virtual http_response handle_request(const http_request& request) = 0;
-    
-    //Member function to return last generated response as a string.
-    std::string getLastResponse();
 
-    //(For Testing) Member function to return response header as a string.
-    std::string getLastResponseHeader();
-    
-protected:
-    //Function to formulate the response header
-    std::string makeHeader(uint statusCode, std::string contentType, size_t contentLength);
+    //Function the session calls to respond to a request. Handlers that can
+    //respond without holding the whole body in memory (e.g. by pointing the
+    //session at a file) override this; by default it is handle_request.
+    virtual http_response_variant serve(const http_request& request);
+
+    //Function the session calls to respond to a request without blocking the
+    //I/O thread it runs on. The response is passed to `done`, possibly from
+    //another thread; `request` must stay alive until then. By default serve()
+    //runs inline if respondsInline(), and otherwise on the BlockingExecutor,
+    //with a 503 if it is full. Handlers that wait on something override this
+    //to wait asynchronously on `io_service`.
+    virtual void handle_request_async(const http_request& request,
+                                      boost::asio::io_service& io_service,
+                                      ResponseCallback done);
+
+    //Whether serve() responds straight away, without touching the disk or
+    //waiting on anything, so it may run on the I/O thread. False by default.
+    virtual bool respondsInline() const;
 
-    //Function to create http response object from given response string
-    http_response parseResponse(std::string response);
+    //Directory the session streams the bodies of POST and PUT requests into,
+    //so they never sit in memory whole, or nullopt (the default) to read them
+    //into request.body() like any other. Handlers that store uploads on disk
+    //return a directory on the same filesystem, so a finished upload can be
+    //renamed into place, and get those requests through handle_upload.
+    virtual std::optional<std::filesystem::path> uploadDirectory() const;
 
-    //Member function used to log the behavior of handle_request in a structured format
-    void log_handle_request_details(const std::string requestTarget, std::string requestHandlerName, unsigned int responseCode);
+    //Function to generate a response to a request whose body was streamed to
+    //`body`, leaving request.body() empty. By default the file is read back
+    //into the body and handed to handle_request; that only happens if a
+    //config reload swapped the handler while the body was arriving.
+    virtual http_response handle_upload(const http_request& request, const UploadedBody& body);
 
-    //Private member to hold last generated response header.
-    std::string lastResponseHeader;
+    //Function the session calls instead of handle_request_async for a
+    //request with a streamed body. `body` is kept alive until `done` is
+    //called. By default handle_upload runs on the BlockingExecutor.
+    virtual void handle_upload_async(const http_request& request,
+                                     std::shared_ptr<UploadedBody> body,
+                                     boost::asio::io_service& io_service,
+                                     ResponseCallback done);
+
+    //Arguments a handler accepts in its location block, but does not require.
+    //Handlers with optional arguments declare their own optionalArgs.
+    static inline ArgSet optionalArgs = {};
+
+    //Whether one instance may serve concurrent requests from several threads.
+    //A handler that says so must keep no per-request state in members, and
+    //everything it shares between requests (its filesystem included) must
+    //be safe to use concurrently. Handlers that keep per-request state leave
+    //this false and are pooled, so each instance only serves one request at
+    //a time (see HandlerPool). Overrides say what makes them safe.
+    static inline const bool threadSafe = false;
+    
+protected:
+    //Function to build a response with the given status, content type and
+    //body. The body is moved into the response, and Content-Length is set to
+    //its size.
+    http_response makeResponse(uint statusCode, const std::string& contentType, std::string body = "");
 
-    //Private member to hold last generated response.
-    std::string lastResponse;
+    //Member function used to log the behavior of handle_request in a structured format.
+    //Nothing is logged while the AccessLog is enabled, since it records the response.
+    void log_handle_request_details(boost::beast::string_view requestTarget, boost::beast::string_view requestHandlerName, unsigned int responseCode);
     
 };
 
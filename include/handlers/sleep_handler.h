@@ -3,13 +3,22 @@
 
 #include "registry.h"
 #include "request_handler.h"
+#include <chrono>
+
+const std::chrono::milliseconds SLEEP_HANDLER_DURATION(3000);
 
 class SleepHandler : public RequestHandler {
     public:
         SleepHandler(std::string path, std::unordered_map<std::string, std::string> args);
         static RequestHandler* Init(std::string path, std::unordered_map<std::string, std::string> args);
         static inline ArgSet expectedArgs = {};
+        static inline const bool threadSafe = true;
         http_response handle_request(const http_request& request);
+        // Waits on a timer instead of a sleeping thread, so the I/O thread
+        // is free to serve other connections in the meantime
+        void handle_request_async(const http_request& request,
+                                  boost::asio::io_service& io_service,
+                                  ResponseCallback done) override;
 };
 
 REGISTER_HANDLER(SleepHandler);
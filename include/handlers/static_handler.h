@@ -1,11 +1,20 @@
 #ifndef STATIC_HANDLER_H
 #define STATIC_HANDLER_H
 
+#include "byte_range.h"
+#include "compression.h"
+#include "conditional_get.h"
+#include "content_cache.h"
 #include "registry.h"
 #include "request_handler.h"
 #include "filesystem/filesystem_interface.h"
+#include <memory>
 
 const std::string STATIC_HANDLER_ROOT_ARG = "root";
+// byte budget for caching this location's files in memory; no cache if unset
+const std::string STATIC_HANDLER_CACHE_SIZE_ARG = "cache_size";
+// larger files are always streamed from disk, even with a cache
+const uintmax_t STATIC_HANDLER_MAX_CACHED_FILE_SIZE = 1024 * 1024;
 
 class StaticHandler : public RequestHandler {
     public:
@@ -13,12 +22,64 @@ class StaticHandler : public RequestHandler {
                       std::unordered_map<std::string, std::string> args,
                       std::unique_ptr<FileSystemInterface> filesystem);
         http_response handle_request(const http_request& request);
+        // Responds to GETs for existing files with the open file rather than
+        // its contents; anything else goes through handle_request
+        http_response_variant serve(const http_request& request);
+        // Hit/miss/eviction counters for this location's file cache, or
+        // nullopt if it has no cache
+        std::optional<ContentCache::Stats> cacheStats() const;
         static RequestHandler* Init(std::string path, std::unordered_map<std::string, std::string> args);
         static inline ArgSet expectedArgs = {STATIC_HANDLER_ROOT_ARG};
+        static inline ArgSet optionalArgs = {STATIC_HANDLER_CACHE_SIZE_ARG,
+                                             COMPRESS_TYPES_ARG,
+                                             COMPRESS_MIN_SIZE_ARG,
+                                             CACHE_CONTROL_ARG};
+        static inline const bool threadSafe = true;
     private:
+        // The file under root_ that the request's target refers to
+        std::filesystem::path targetFile(const http_request& request);
+        // The MIME type to serve a file type as, or nullopt if unsupported
+        std::optional<std::string> contentType(FILE_TYPE file_type);
+        // Respond from cache_ if it holds this version of the file in
+        // `encoding`, otherwise read the file and cache the response
+        http_response cachedResponse(const http_request& request,
+                                     const std::filesystem::path& target,
+                                     const FileStat& file_stat,
+                                     CONTENT_ENCODING encoding);
+        // The 304 for a request whose client already has the version of the
+        // file that `validators` identifies
+        http_response notModifiedFor(const http_request& request,
+                                     const Validators& validators,
+                                     const std::string& content_type);
+        // The 206 or 416 for a request with a Range header that applies to
+        // `file`, the version of the response `validators` identifies.
+        // nullopt if the whole file should be sent instead: there is no
+        // Range, it is malformed or for another version, or its ranges add
+        // up to too much to gather in memory.
+        std::optional<http_response_variant>
+        rangeResponse(const http_request& request,
+                      const std::filesystem::path& file, uint64_t file_size,
+                      const std::string& content_type,
+                      CONTENT_ENCODING encoding,
+                      const Validators& validators);
+        // Respond with the open file at `file`, or just `range` of it,
+        // sent as `content_type` in `encoding`; nullopt if it can't be opened
+        std::optional<http_file_response>
+        streamFile(const http_request& request,
+                   const std::filesystem::path& file,
+                   const std::string& content_type,
+                   CONTENT_ENCODING encoding,
+                   std::optional<ByteRange> range = std::nullopt);
+
         std::string path_;
         std::string root_;
         std::unique_ptr<FileSystemInterface> filesystem_;
+        // null unless cache_size was configured
+        std::unique_ptr<ContentCache> cache_;
+        // off unless compress_types was configured
+        CompressionPolicy compression_;
+        // sent with every file served, unless empty
+        std::string cache_control_;
 };
 
 REGISTER_HANDLER(StaticHandler);
@@ -0,0 +1,39 @@
+#ifndef IO_SERVICE_POOL_H
+#define IO_SERVICE_POOL_H
+
+#include "constants.h"
+#include <boost/asio/io_service.hpp>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// The I/O threads of the server, and the io_services they run.
+//
+// With THREADING_SHARED every thread runs one shared io_service, so a
+// connection's completions may run on any of them. Otherwise each thread runs
+// an io_service of its own, which should get its own acceptor so that the
+// connections it accepts, and everything they do, stay on that thread. With
+// THREADING_PER_CORE_PINNED each thread is also pinned to its own CPU.
+class IoServicePool {
+public:
+  IoServicePool(THREADING_MODE mode, size_t thread_count);
+
+  // Number of io_services: 1 when shared, one per thread otherwise
+  size_t size() const;
+  boost::asio::io_service &get(size_t index);
+
+  // Run every io_service on its threads, blocking until they all return
+  void run();
+  // Stop every io_service, making run() return
+  void stop();
+
+private:
+  // Pin the calling thread to the `index`th CPU it is allowed to run on
+  static void pinToCpu(size_t index);
+
+  THREADING_MODE mode_;
+  size_t thread_count_;
+  std::vector<std::unique_ptr<boost::asio::io_service>> io_services_;
+};
+
+#endif // IO_SERVICE_POOL_H
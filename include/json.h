@@ -0,0 +1,64 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Containers nested deeper than this are rejected by validJson()
+const size_t JSON_MAX_DEPTH = 512;
+
+// Writes JSON straight into a string as it goes, laid out the way
+// boost::property_tree's write_json lays it out: four spaces of indent per
+// level, one member or element per line, and a newline after the top-level
+// value. Empty containers are written as {} and [].
+//
+// The text can be taken a piece at a time with take(), so a long document can
+// be sent while the rest of it is still being written.
+class JsonWriter {
+public:
+  void beginObject();
+  void endObject();
+  void beginArray();
+  void endArray();
+  // Name the next member of the current object
+  void key(std::string_view name);
+
+  void string(std::string_view value);
+  void number(int64_t value);
+  void boolean(bool value);
+  void null();
+
+  // Everything written since the last take()
+  std::string take();
+  const std::string &text() const { return out_; }
+
+private:
+  // Write whatever separates the next value from the one before it
+  void beforeValue();
+  void open(char bracket);
+  void close(char bracket);
+  void afterValue();
+  void appendString(std::string_view value);
+
+  struct Level {
+    bool empty;
+  };
+  std::string out_;
+  std::vector<Level> levels_;
+  // The next value is a member's, so follows its key on the same line
+  bool after_key_ = false;
+};
+
+// `value` as a JSON string, quotes included
+std::string jsonString(std::string_view value);
+
+// Whether `text` is exactly one well-formed JSON value (RFC 8259), with
+// optional whitespace around it and valid UTF-8 in its strings. Runs of
+// plain string characters are skipped 16 bytes at a time where SSE2 is
+// available.
+bool validJson(std::string_view text);
+
+#endif // JSON_H
@@ -1,9 +1,16 @@
 #ifndef LOCATION_DATA_H
 #define LOCATION_DATA_H
 
+#include <cstdint>
 #include <unordered_map>
 #include <string>
 
+// Arg every location accepts, whatever its handler: the most bytes of request
+// body it takes. Larger requests are answered with 413.
+const std::string BODY_LIMIT_ARG = "body_limit";
+// Beast's own default for requests
+const uint64_t DEFAULT_BODY_LIMIT = 1024 * 1024;
+
 struct LocationData {
     LocationData(std::string handler, std::unordered_map<std::string,std::string> arg_map);
     LocationData();
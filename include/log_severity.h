@@ -0,0 +1,22 @@
+#ifndef LOG_SEVERITY_H
+#define LOG_SEVERITY_H
+
+#include <boost/log/trivial.hpp>
+
+// The least severe level compiled into the binary. Statements logged through
+// LOG_AT below it are discarded at compile time, so they cost nothing at all,
+// not even the run time severity check BOOST_LOG_TRIVIAL makes. Release
+// builds set it to info; other builds keep everything and filter at run time.
+#ifndef MIN_LOG_SEVERITY
+#define MIN_LOG_SEVERITY trace
+#endif
+
+// BOOST_LOG_TRIVIAL(level), unless level is below MIN_LOG_SEVERITY. Meant for
+// trace and debug statements on hot paths.
+#define LOG_AT(level)                                                         \
+  if constexpr (::boost::log::trivial::level <                                \
+                ::boost::log::trivial::MIN_LOG_SEVERITY) {                     \
+  } else                                                                      \
+    BOOST_LOG_TRIVIAL(level)
+
+#endif // LOG_SEVERITY_H
@@ -1,6 +1,7 @@
 #ifndef LOGGING_H
 #define LOGGING_H
 
+#include "constants.h"
 #include <boost/log/core.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/log/expressions.hpp>
@@ -9,8 +10,30 @@
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/sources/severity_logger.hpp>
 #include <boost/log/sources/record_ostream.hpp>
+#include <chrono>
+#include <cstdint>
+#include <string>
 
-// Function that initializes the necessities for Boost logging 
-void init_logging();
+// How many records each asynchronous sink queues before it overflows
+const size_t ASYNC_LOG_QUEUE_SIZE = 8192;
+// How often the background thread writes out the queued records
+const std::chrono::milliseconds ASYNC_LOG_FLUSH_INTERVAL(50);
 
-#endif // LOGGING_H
\ No newline at end of file
+// Function that initializes the necessities for Boost logging.
+// In LOGGING_ASYNC mode a record is only queued by the thread logging it, and
+// a background thread formats and writes out the queue in batches, flushing
+// once per batch. If a queue is full, records below warning are dropped, and
+// more severe ones wait for room.
+void init_logging(LOGGING_MODE mode = LOGGING_ASYNC,
+                  const std::string &file_name =
+                      "logging/fortnite-gamers_%N.log",
+                  bool log_to_console = true);
+
+// Write out everything queued, stop the background thread, and remove the
+// sinks added by init_logging
+void shutdown_logging();
+
+// Number of records dropped because an asynchronous queue was full
+uint64_t dropped_log_records();
+
+#endif // LOGGING_H
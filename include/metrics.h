@@ -0,0 +1,94 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Counter shards per series. Each thread always updates the same shard, so
+// threads only share a cache line once there are more of them than shards.
+const size_t METRICS_SHARDS = 16;
+// Status codes counted individually; any other is counted as "other"
+const std::array<unsigned int, 14> METRICS_STATUS_CODES = {
+    200, 201, 204, 206, 304, 400, 404, 405, 408, 413, 416, 500, 503, 504};
+// Latency histogram buckets. Bucket i counts requests that took under
+// 2^(METRICS_FIRST_BUCKET_BITS + i) microseconds but not under the bucket
+// before's bound, so from 64us up to about 16s; the last bucket counts
+// everything slower.
+const size_t METRICS_FIRST_BUCKET_BITS = 6;
+const size_t METRICS_LATENCY_BUCKETS = 20;
+
+// Counters for the requests one handler served at one location. Recording
+// only does relaxed atomic increments on the calling thread's shard; shards
+// are merged when the counters are read.
+class MetricsSeries {
+public:
+  MetricsSeries(std::string location, std::string handler);
+
+  // Count a response, its request and response body bytes, and how long it
+  // took from reading the request to writing the response
+  void record(unsigned int status, uint64_t bytes_in, uint64_t bytes_out,
+              std::chrono::steady_clock::duration latency);
+
+  // Counters summed over every shard
+  struct Totals {
+    uint64_t requests = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    // indexed like METRICS_STATUS_CODES, with "other" last
+    std::array<uint64_t, METRICS_STATUS_CODES.size() + 1> statuses = {};
+    std::array<uint64_t, METRICS_LATENCY_BUCKETS> latency_buckets = {};
+    uint64_t latency_sum_us = 0;
+  };
+  Totals totals() const;
+
+  const std::string &location() const { return location_; }
+  const std::string &handler() const { return handler_; }
+
+private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> requests = 0;
+    std::atomic<uint64_t> bytes_in = 0;
+    std::atomic<uint64_t> bytes_out = 0;
+    std::array<std::atomic<uint64_t>, METRICS_STATUS_CODES.size() + 1>
+        statuses = {};
+    std::array<std::atomic<uint64_t>, METRICS_LATENCY_BUCKETS>
+        latency_buckets = {};
+    std::atomic<uint64_t> latency_sum_us = 0;
+  };
+
+  const std::string location_;
+  const std::string handler_;
+  std::array<Shard, METRICS_SHARDS> shards_;
+};
+
+// Every MetricsSeries, by location and handler. Series are created when a
+// config is loaded and live for the rest of the program, so a reload keeps
+// counting into the same series for a location and handler it still has.
+class Metrics {
+public:
+  static Metrics &GetInstance();
+
+  // The series for `handler` at `location`, created if it doesn't exist yet
+  MetricsSeries &series(const std::string &location, const std::string &handler);
+
+  // Write every series in the Prometheus text exposition format
+  void write(std::ostream &out) const;
+
+private:
+  Metrics() {}
+
+  mutable std::mutex mutex_;
+  std::map<std::pair<std::string, std::string>, std::unique_ptr<MetricsSeries>>
+      series_;
+};
+
+#endif // METRICS_H
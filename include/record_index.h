@@ -0,0 +1,57 @@
+#ifndef RECORD_INDEX_H
+#define RECORD_INDEX_H
+
+#include "filesystem/filesystem_interface.h"
+#include <cstdint>
+#include <filesystem>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+// Orders record names the way listings show them: numeric IDs first, by
+// value, then any other names alphabetically
+struct RecordOrder {
+  bool operator()(const std::string &a, const std::string &b) const;
+};
+
+// The names of one entity's records, kept sorted so a listing can be served
+// a page at a time without walking the entity's directory. It is loaded from
+// the filesystem the first time it is needed, then kept up to date by
+// whoever creates and removes the records. Safe to share between threads.
+class RecordIndex {
+public:
+  RecordIndex();
+
+  // List the records in `directory` into the index, unless it is already
+  // loaded. Returns false, leaving the index unloaded, if the directory
+  // can't be listed.
+  bool load(const FileSystemInterface &filesystem,
+            const std::filesystem::path &directory);
+
+  // Add or drop a record. Ignored until the index is loaded, since loading
+  // will see the change anyway.
+  void insert(const std::string &name);
+  void erase(const std::string &name);
+
+  // Up to `limit` names, in order, starting after `after` (from the first
+  // if it is empty). `more` is set to whether any names follow them.
+  std::vector<std::string> page(const std::string &after, size_t limit,
+                                bool &more) const;
+
+  // Changes whenever a record is added or dropped
+  uint64_t version() const;
+  // Tells this index apart from any other, including one for the same
+  // entity before a restart, so (id, version) identifies a listing
+  uint64_t id() const { return id_; }
+  size_t size() const;
+
+private:
+  const uint64_t id_;
+  mutable std::shared_mutex mutex_;
+  bool loaded_ = false;
+  uint64_t version_ = 0;
+  std::set<std::string, RecordOrder> names_;
+};
+
+#endif // RECORD_INDEX_H
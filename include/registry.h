@@ -8,17 +8,23 @@
 #include "handlers/request_handler.h"
 
 typedef std::function<RequestHandler*(std::string, std::unordered_map<std::string,std::string>)> RequestHandlerFactory;
-typedef std::unordered_set<std::string> ArgSet;
 
+// Maps handler names to their factories. Only written to during static
+// initialization; after startup it is read-only, so lookups must not use
+// operator[].
 class Registry{
     public:
         bool RegisterHandler(
             const std::string& name,
             RequestHandlerFactory factory,
-            ArgSet& expected_arg_set
+            ArgSet& expected_arg_set,
+            ArgSet& optional_arg_set,
+            bool thread_safe
         ) {
             initializer_map_[name] = factory;
             expected_args_map_[name] = expected_arg_set;
+            optional_args_map_[name] = optional_arg_set;
+            thread_safe_map_[name] = thread_safe;
             return true;
         }
 
@@ -29,12 +35,15 @@ class Registry{
 
         std::unordered_map<std::string, RequestHandlerFactory> initializer_map_;
         std::unordered_map<std::string, ArgSet> expected_args_map_;
+        // arguments a handler accepts but does not require
+        std::unordered_map<std::string, ArgSet> optional_args_map_;
+        std::unordered_map<std::string, bool> thread_safe_map_;
     private:
         Registry(){};
 };
 
 #define REGISTER_HANDLER(HANDLER) \
-  static bool HANDLER##Register = Registry::GetInstance().RegisterHandler(#HANDLER, &HANDLER::Init, HANDLER::expectedArgs)
+  static bool HANDLER##Register = Registry::GetInstance().RegisterHandler(#HANDLER, &HANDLER::Init, HANDLER::expectedArgs, HANDLER::optionalArgs, HANDLER::threadSafe)
 
 
 #endif // REGISTRY_H
@@ -1,9 +1,17 @@
 #ifndef REQUEST_MANAGER_H
 #define REQUEST_MANAGER_H
 
+#include "handler_pool.h"
 #include "handlers/request_handler.h"
 #include "location_data.h"
+#include "routing_table.h"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
 #include <optional>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -11,12 +19,65 @@ class RequestManager {
 
   public:
 
-    RequestManager(std::unordered_map<std::string, LocationData>& locations);
+    // Builds the routing table, along with the handler instances for every
+    // location. `pool_size` is how many instances to build up front for
+    // handlers which are not thread-safe, usually the number of I/O threads.
+    RequestManager(std::unordered_map<std::string, LocationData>& locations,
+                   size_t pool_size = std::thread::hardware_concurrency());
+
+    // Build a new routing table for `locations`, and route every request
+    // from now on with it. Requests already being handled finish with the
+    // table (and handler instances) they started with, which is destroyed
+    // once they are all done. Throws if a location's handlers can't be built,
+    // leaving the current table in place.
+    void reload(const std::unordered_map<std::string, LocationData>& locations);
+
+    // The routing table currently in use
+    std::shared_ptr<const RoutingTable> routingTable() const;
 
     // send request to the appropriate request handler, based on which location it matches with.
     // then, return the response from that handler
     http_response manageRequest(http_request request);
 
+    // like manageRequest, but lets the handler respond with any response
+    // type the session knows how to write (see RequestHandler::serve)
+    http_response_variant serveRequest(http_request request);
+
+    // The handlers a request was routed to, along with the table they
+    // belong to, which the route keeps alive
+    struct Route {
+      std::shared_ptr<const RoutingTable> table;
+      HandlerPool *handlers = nullptr;
+    };
+    // Route `header` with the current routing table. A request is routed
+    // once, as soon as its header arrives, so its body is read and handled
+    // by the same location even if the table is reloaded in between.
+    Route route(const http_request &header) const;
+
+    // like serveRequest, but without blocking the calling I/O thread (see
+    // RequestHandler::handle_request_async), and with the handlers `route`
+    // found. `request` must stay alive until `done` is called with the
+    // response, possibly from another thread.
+    // If the request's body was streamed to `upload` instead of read into
+    // the request, the handler gets it through handle_upload_async.
+    // Returns the metrics series of the location and handler serving the
+    // request (see HandlerPool::metrics).
+    MetricsSeries *serveRequestAsync(Route route, http_request &request,
+                           boost::asio::io_service &io_service,
+                           ResponseCallback done,
+                           std::shared_ptr<UploadedBody> upload = nullptr);
+
+    // How the body of a request should be read, once its header has arrived
+    struct BodyPolicy {
+      // The most bytes of body the location takes
+      uint64_t limit;
+      // Where to stream the body to, if its handler takes it as a file
+      std::optional<std::filesystem::path> upload_directory;
+    };
+    // The BodyPolicy of the location `route` found for `header`. Only POST
+    // and PUT bodies are streamed to a file.
+    static BodyPolicy bodyPolicy(const Route &route, const http_request &header);
+
     // Find longest path in prefix which is a prefix of the target path
     // acceptable "prefix matches" are exact match (with trailing slash ignored)
     // or prefix (with trailing slash added).
@@ -24,7 +85,11 @@ class RequestManager {
     std::optional<std::string> matchPath(std::string target_path);
 
     private:
-      std::unordered_map<std::string, LocationData> locations_;
+      size_t pool_size_;
+
+      // The current routing table. Swapped as a whole by reload(); readers
+      // get a reference to whichever table was current when they looked.
+      std::atomic<std::shared_ptr<const RoutingTable>> table_;
 
 };
 
@@ -0,0 +1,51 @@
+#ifndef ROUTE_TRIE_H
+#define ROUTE_TRIE_H
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A compiled, immutable trie over the '/'-separated segments of the config
+// location paths. Built once at startup, it answers longest-prefix queries in
+// O(target length) without allocating.
+//
+// A path matches a target if the target is exactly the path, or the path
+// followed by '/' is a prefix of the target (the same rule the linear scan in
+// RequestManager used to apply).
+class RouteTrie {
+public:
+  RouteTrie();
+
+  // Compile the trie from the given location paths. The value returned by
+  // match() is the index of the matched path within `paths`.
+  // Empty paths can never match, so they are skipped.
+  explicit RouteTrie(const std::vector<std::string> &paths);
+
+  // Return the index of the longest path matching `target`, or nullopt if no
+  // path matches.
+  std::optional<size_t> match(std::string_view target) const;
+
+private:
+  // Nodes are stored breadth first, so the children of a node are contiguous
+  // and sorted by segment, allowing a binary search per path segment.
+  struct Node {
+    // segment label, stored in segments_
+    size_t segment_offset = 0;
+    size_t segment_length = 0;
+    // children are nodes_[first_child, first_child + child_count)
+    size_t first_child = 0;
+    size_t child_count = 0;
+    // index of the path ending at this node, if any
+    std::optional<size_t> route;
+  };
+
+  std::string_view segment(const Node &node) const;
+  const Node *findChild(const Node &node, std::string_view segment) const;
+
+  std::vector<Node> nodes_;
+  std::string segments_;
+};
+
+#endif // ROUTE_TRIE_H
@@ -0,0 +1,48 @@
+#ifndef ROUTING_TABLE_H
+#define ROUTING_TABLE_H
+
+#include "handler_pool.h"
+#include "location_data.h"
+#include "route_trie.h"
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Everything needed to route a request for one version of the config: the
+// handlers for every location, and the trie matching targets to them. Built
+// in one go when the config is loaded, and never modified after, so any
+// number of threads may use it at once.
+class RoutingTable {
+public:
+  // Builds the handler instances for every location. `pool_size` is how
+  // many instances to build up front for handlers which are not thread-safe.
+  RoutingTable(const std::unordered_map<std::string, LocationData> &locations,
+               size_t pool_size);
+
+  // Return the handlers for the location matching `target`
+  HandlerPool &handlersFor(std::string_view target) const;
+
+  // Return the path of the location matching `target`, or nullopt if none does
+  std::optional<std::string> matchPath(std::string_view target) const;
+
+private:
+  // A config location, as stored in the routing table
+  struct Route {
+    std::string path_;
+    LocationData location_data_;
+    // Built once from location_data_, when the config is loaded
+    std::unique_ptr<HandlerPool> handlers_;
+  };
+
+  // Routes indexed by the values returned from route_trie_
+  std::vector<Route> routes_;
+  // Compiled from the route paths at construction
+  RouteTrie route_trie_;
+  // Serves requests which match no location at all
+  std::unique_ptr<HandlerPool> not_found_handlers_;
+};
+
+#endif // ROUTING_TABLE_H
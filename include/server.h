@@ -12,29 +12,44 @@ public:
     // Parameters:
     //   io_service: Reference to the Boost.Asio IO service to be used for asynchronous operations.
     //   request_manager: The object in charge of determining which handler to use and returning the response
-    //   port: The port number on which the server will listen for incoming connections.
+    //   port: The port number on which the server will listen for incoming connections,
+    //         or 0 for any free port (see port()).
+    //   reuse_port: Whether to set SO_REUSEPORT on the listening socket, so that several
+    //               servers, each on its own io_service, can accept on the same port.
+    //   session_config: Settings for every connection the server accepts.
     server(boost::asio::io_service& io_service, 
         RequestManager& request_manager,
-        unsigned short port);
+        unsigned short port,
+        bool reuse_port = false,
+        SessionConfig session_config = {});
     
     // Public member function to start accepting connections.
     // Creates a new session object for each incoming connection and initiates an asynchronous accept operation.
     void start_accept();
 
+    // Public member function to stop accepting connections, so the server
+    // can shut down. Connections already accepted are left alone.
+    // May be called from any thread.
+    void stop();
+
+    // Public member function to get the port the server is listening on
+    unsigned short port() const;
+
 private:
     // Private member function to handle the completion of an asynchronous accept operation.
     // This function is called when an incoming connection is accepted.
     // If no error occurs, it starts the session by calling 'start()' on the session object.
-    // If an error occurs, it cleans up the session object and continues accepting connections.
+    // If an error occurs, the session object is dropped and it continues accepting connections.
     // Parameters:
-    //   new_session: Pointer to the session object representing the newly accepted connection.
+    //   new_session: The session object representing the newly accepted connection.
     //   error: The error code associated with the completion of the accept operation.
-    void handle_accept(session* new_session, const boost::system::error_code& error);
+    void handle_accept(std::shared_ptr<session> new_session, const boost::system::error_code& error);
 
     // Member variables
     boost::asio::io_service& io_service_;
     boost::asio::ip::tcp::acceptor acceptor_;
     std::shared_ptr<RequestManager> request_manager_;
+    SessionConfig session_config_;
 };
 
 #endif // SERVER_H
\ No newline at end of file
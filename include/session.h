@@ -1,13 +1,61 @@
 #ifndef SESSION_H
 #define SESSION_H
 
+#include <array>
+#include <atomic>
 #include <boost/asio.hpp>
+#include <boost/beast/http/file_body.hpp>
+#include <chrono>
+#include <deque>
+#include <filesystem>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 #include "request_manager.h"
+#include "session_config.h"
 
 using boost::asio::ip::tcp;
 
-class session {
+// The deadlines a connection can miss, each closing it
+enum SESSION_TIMEOUT {
+    // no request arrived while nothing was in flight
+    SESSION_IDLE_TIMEOUT = 0,
+    // a request's header took too long to arrive
+    SESSION_HEADER_TIMEOUT,
+    // no more of a request's body arrived for too long
+    SESSION_BODY_TIMEOUT,
+    // the client stopped accepting a response
+    SESSION_WRITE_TIMEOUT,
+    SESSION_TIMEOUT_COUNT
+};
+
+// The name `timeout` goes by in logs and metrics, e.g. "idle"
+const char* timeoutName(SESSION_TIMEOUT timeout);
+
+// A single client connection. Requests are read as soon as they arrive, even
+// while earlier ones on the same connection are still being handled (HTTP/1.1
+// pipelining), up to config.pipeline_depth at once. GET, HEAD and OPTIONS
+// requests are handed to their handlers straight away; any other request
+// waits until the ones before it are answered, and holds back the ones after
+// it until it is. Responses are written in the order the requests came in.
+//
+// Bodies are read into memory, up to their location's body_limit, unless the
+// location's handler takes uploads as files: then the body of a POST or PUT
+// is written to a temporary file as it arrives, through a fixed size buffer,
+// and the handler moves the finished file into place.
+//
+// Reads and writes are bounded by the timeouts in config, so a slow or idle
+// client cannot hold on to a connection forever.
+//
+// Sessions are owned through shared_ptrs held by their pending operations:
+// every read and write completion handler and every handler callback keeps
+// its session alive, and the session is destroyed once the last of them has
+// returned. Timer waits only hold a weak_ptr, so a deadline never keeps a
+// finished session around.
+// Every completion handler runs on the socket's strand, so a session is only
+// ever used by one thread at a time.
+class session : public std::enable_shared_from_this<session> {
 
 public:
     // Constructor for the session class.
@@ -15,42 +63,235 @@ public:
     // Parameters:
     //   io_service: Reference to the Boost.Asio IO service to be used for asynchronous operations.
     //   manager: shared pointer to request manager that was initialized in server
-    session(boost::asio::io_service& io_service, std::shared_ptr<RequestManager> manager);
+    //   config: settings for the connection
+    session(boost::asio::io_service& io_service, std::shared_ptr<RequestManager> manager,
+            SessionConfig config = {});
+    ~session();
 
     // Member function to access the TCP socket associated with the session.
     // Returns:
     //   A reference to the TCP socket used by this session.
     boost::asio::ip::tcp::socket& socket();
 
-    // Member function to start an asynchronous read operation on the socket.
-    // This function initiates an asynchronous read operation on the socket to read data into the 'data_' buffer.
-    // When the read operation completes, the handle_read function is called.
+    // Member function to start reading requests from the socket, and add
+    // the session to the SessionRegistry.
+    // The session must be owned by a shared_ptr.
     void start();
 
+    // Member function to stop reading new requests. Requests already read,
+    // or already arriving, are answered, then the connection is closed.
+    // May be called from any thread.
+    void shutdown();
+
+    // Number of connections closed so far, across all sessions, for missing
+    // the given deadline
+    static uint64_t timeoutCount(SESSION_TIMEOUT timeout);
+
 private:
+    // A request that has been read, and its response once its handler is done
+    struct PendingRequest {
+        http_request request;
+        std::optional<http_response_variant> response;
+        // For metrics and the access log: when the request was read, and the
+        // location and handler answering it (null if it was never routed)
+        std::chrono::system_clock::time_point received_at = std::chrono::system_clock::now();
+        std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();
+        MetricsSeries* metrics = nullptr;
+        // Where the body went instead of request.body(), if it was streamed
+        std::shared_ptr<UploadedBody> upload;
+        // The handlers it was routed to when its header arrived, until it is
+        // handed to them
+        RequestManager::Route route;
+        // Whether it has been handed to its handler yet
+        bool handled = false;
+    };
+
+    // Private member function to start reading the next request, unless a
+    // read is already in progress, the connection is closing, or
+    // config_.pipeline_depth requests are already pending. Waits for the
+    // socket to become readable first, under the idle timeout if nothing is
+    // in flight, unless part of a request is already sitting in request_buf_.
+    void start_read();
+    void handle_wait_read(const boost::system::error_code& error);
+
+    // Private member functions to read a request's header into parser_, then
+    // its body, each under its own timeout. The body is read a piece at a
+    // time, and each piece that arrives renews the body timeout.
+    void read_header();
+    void handle_read_header(const boost::system::error_code& error, size_t bytes_transferred);
+    void read_body();
+    void handle_read_body(const boost::system::error_code& error, size_t bytes_transferred);
+
     // Private member function to handle the completion of an asynchronous read operation.
-    // This function is called when an asynchronous read operation initiated by 'start()' completes.
+    // Hands the request in parser_ to its handler and starts reading the next one.
     // Parameters:
     //   error: The error code associated with the completion of the read operation.
     //   bytes_transferred: The number of bytes transferred during the read operation.
     void handle_read(const boost::system::error_code& error, size_t bytes_transferred);
 
+    // Private member functions to stream the body of the request in parser_
+    // to a new temporary file in `directory`, then hand the request and the
+    // file to its handler.
+    void read_upload(const std::filesystem::path& directory);
+    void read_upload_some();
+    void handle_read_upload(const boost::system::error_code& error, size_t bytes_transferred);
+
+    // Private member function to queue a request that has been read in
+    // full for its handler, and start reading the next one. `upload` holds
+    // its body if it was streamed to a file.
+    void dispatch(http_request request, std::shared_ptr<UploadedBody> upload);
+
+    // Private member function to hand the queued requests that may run now
+    // to their handlers. Safe requests (GET, HEAD, OPTIONS) run alongside
+    // each other, but any other request waits for the ones before it to be
+    // answered, and the ones after it wait for its answer, so that their
+    // side effects happen in the order they were sent.
+    void dispatch_ready();
+
+    // Private member function to hand `pending` to its handler, which
+    // responds in handle_response
+    void handle(PendingRequest* pending);
+
+    // Private member function to stop reading and answer with a bodiless
+    // `status` once the requests before it have been answered
+    void reject(unsigned int status);
+
+    // Private member function to record the response a handler produced for
+    // `pending`. Handlers may respond from another thread, so the response is
+    // handed back to the socket's strand first.
+    void handle_response(PendingRequest* pending, http_response_variant response);
+
+    // Private member function to write the responses at the front of
+    // pipeline_ that are ready, unless a write is already in progress. Several
+    // ready string responses are gathered into a single write.
+    void write_responses();
+
+    // Private member functions to start writing the response to the request
+    // at the front of pipeline_, one per kind of response a handler may
+    // produce. All complete in handle_write.
+    void write_response(http_response& response);
+    void write_response(http_file_response& response);
+    void write_response(http_stream_response& response);
+
+    // Private member functions to write the gathered responses in
+    // write_buf_, or a string or stream response through its serializer, a
+    // piece at a time. Each piece the client accepts renews the write
+    // timeout.
+    void write_buffered();
+    template <class Serializer>
+    void write_serialized(Serializer& serializer);
+
+    // Private member functions to send the body of a file response with
+    // sendfile(2), straight from the file descriptor to the socket, once its
+    // header has been written. send_file_body sends as much as the socket
+    // accepts, then waits for it to become writable again.
+    void handle_write_header(const boost::system::error_code& error, size_t bytes_transferred);
+    void send_file_body();
+
     // Private member function to handle the completion of an asynchronous write operation.
-    // This function is called when an asynchronous write operation initiated by 'handle_read()' completes.
+    // Drops the responses written, then writes the next ready ones and resumes
+    // reading if the pipeline was full.
     // Parameters:
     //   error: The error code associated with the completion of the write operation.
     void handle_write(const boost::system::error_code& error, size_t bytes_transferred);
 
+    // Private member functions for the read and write deadlines. Each timer
+    // always has a wait outstanding, which handle_deadline renews; moving
+    // its expiry just wakes it early. A timeout of 0 means no deadline.
+    void set_deadline(boost::asio::steady_timer& timer, std::chrono::seconds timeout);
+    void clear_deadline(boost::asio::steady_timer& timer);
+    void wait_for_deadline(boost::asio::steady_timer& timer);
+    void handle_deadline(boost::asio::steady_timer& timer);
+
+    // Private member function to count the response written for `pending`
+    // in its metrics series, and add it to the AccessLog
+    void record_response(const PendingRequest& pending);
+
+    // Private member function to close the connection for missing `timeout`
+    void handle_timeout(SESSION_TIMEOUT timeout);
+
+    // Private member function to stop reading and writing, dropping any
+    // responses still to come
+    void close();
+
+    // Private member function to close the connection and stop the timers
+    // once the session is closing and nothing is left to read, handle or
+    // write, so that it can be destroyed.
+    void finish_if_done();
+
     // Member variables
+    SessionConfig config_;
+    boost::asio::io_service& io_service_;
     boost::asio::ip::tcp::socket socket_;
     std::shared_ptr<RequestManager> request_manager_;
 
     boost::beast::flat_buffer request_buf_;
-    http_request request_;
-    http_response response_;
+    // Parses the request currently being read
+    std::optional<boost::beast::http::request_parser<http_string_body>> parser_;
+    // Takes over from parser_ after the header for a body streamed to the
+    // temporary file at upload_path_
+    std::optional<boost::beast::http::request_parser<boost::beast::http::file_body>> upload_parser_;
+    std::filesystem::path upload_path_;
+    // Where the request currently being read was routed, once its header
+    // has arrived
+    RequestManager::Route route_;
+    // Requests read but not yet answered, oldest first. Handlers hold
+    // references to their requests, so entries never move.
+    std::deque<std::unique_ptr<PendingRequest>> pipeline_;
+
+    bool reading_ = false;
+    bool writing_ = false;
+    // Set while dispatch_ready runs, and if it is asked to run again meanwhile
+    bool dispatching_ = false;
+    bool redispatch_ = false;
+    // Set once no more requests will be read from the connection
+    bool read_closed_ = false;
+    // Set once the connection can no longer be written to; responses still
+    // to come are dropped
+    bool write_failed_ = false;
+
+    // Deadline for the read in progress, and which timeout it enforces
+    boost::asio::steady_timer read_timer_;
+    SESSION_TIMEOUT read_timeout_ = SESSION_IDLE_TIMEOUT;
+    // Deadline for the write in progress
+    boost::asio::steady_timer write_timer_;
+    // Set once the session is done; the timers stop renewing their waits
+    bool finished_ = false;
+
+    // How many responses at the front of pipeline_ the current write covers
+    size_t responses_in_write_ = 0;
+    // Several string responses serialized for one gathered write
+    boost::beast::flat_buffer write_buf_;
+    // Write a single string or stream response
+    std::optional<boost::beast::http::response_serializer<http_string_body>> string_serializer_;
+    std::optional<boost::beast::http::response_serializer<StreamBody>> stream_serializer_;
+    // Writes the header of a file response; its body is sent by send_file_body
+    std::optional<boost::beast::http::response_serializer<http_file_body>> file_serializer_;
+    // How much of the file response's body has been sent so far
+    uint64_t file_offset_ = 0;
+
+    static inline std::array<std::atomic<uint64_t>, SESSION_TIMEOUT_COUNT> timeout_counts_ = {};
+};
+
+// Every session that has started and not yet finished, so that they can all
+// be asked to finish up when the server shuts down.
+class SessionRegistry {
+public:
+    static SessionRegistry& GetInstance();
+
+    void add(const std::shared_ptr<session>& live_session);
+    void remove(session* finished_session);
+    // Number of live sessions
+    size_t size() const;
+    // Call shutdown() on every live session
+    void shutdownAll();
+
+private:
+    SessionRegistry() {}
 
-    //Private member to hold in progress request
-    std::string partialRequest;
+    mutable std::mutex mutex_;
+    // Weak, so the registry never keeps a session alive
+    std::unordered_map<session*, std::weak_ptr<session>> sessions_;
 };
 
 #endif // SESSION_H
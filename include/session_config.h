@@ -0,0 +1,23 @@
+#ifndef SESSION_CONFIG_H
+#define SESSION_CONFIG_H
+
+#include <chrono>
+#include <cstddef>
+
+// Per connection settings, from the top level of the config. A timeout of 0
+// disables it.
+struct SessionConfig {
+  // How many requests may have been read but not yet answered at once
+  size_t pipeline_depth = 16;
+  // How long a connection with no requests in flight may wait for the first
+  // byte of its next request
+  std::chrono::seconds idle_timeout{60};
+  // How long a request's header may take to arrive, from its first byte
+  std::chrono::seconds header_timeout{10};
+  // How long a request's body may go without any more of it arriving
+  std::chrono::seconds body_timeout{30};
+  // How long writing a response may go without the client accepting any of it
+  std::chrono::seconds write_timeout{30};
+};
+
+#endif // SESSION_CONFIG_H
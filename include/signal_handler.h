@@ -1,8 +0,0 @@
-#ifndef SIGNAL_HANDLER_H
-#define SIGNAL_HANDLER_H
-
-#include <boost/log/trivial.hpp>
-
-void signalHandler(int signal);
-
-#endif // SIGNAL_HANDLER_H
\ No newline at end of file
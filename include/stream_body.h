@@ -0,0 +1,72 @@
+#ifndef STREAM_BODY_H
+#define STREAM_BODY_H
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+
+// A Beast body produced a piece at a time while it is written, for responses
+// too large to build up front. It has no size, so it goes out with chunked
+// transfer encoding, one chunk per piece.
+struct StreamBody {
+  // Produces the next piece of the body, or an empty string once it is done.
+  // Called on the connection's I/O thread, so it must not block for long.
+  typedef std::function<std::string()> Source;
+
+  class value_type {
+  public:
+    value_type() = default;
+    explicit value_type(Source source) : source_(std::move(source)) {}
+
+    // The next piece of the body, or an empty string once it is done
+    std::string next() {
+      if (!source_) {
+        return {};
+      }
+      std::string piece = source_();
+      size_ += piece.size();
+      return piece;
+    }
+
+    // How many bytes of the body have been produced so far
+    uint64_t size() const { return size_; }
+
+  private:
+    Source source_;
+    uint64_t size_ = 0;
+  };
+
+  class writer {
+  public:
+    using const_buffers_type = boost::asio::const_buffer;
+
+    template <bool isRequest, class Fields>
+    writer(boost::beast::http::header<isRequest, Fields> &, value_type &body)
+        : body_(body) {}
+
+    void init(boost::beast::error_code &ec) { ec = {}; }
+
+    boost::optional<std::pair<const_buffers_type, bool>>
+    get(boost::beast::error_code &ec) {
+      ec = {};
+      // The serializer is done with the last piece by the time it asks for
+      // the next one
+      piece_ = body_.next();
+      if (piece_.empty()) {
+        return boost::none;
+      }
+      return {{const_buffers_type{piece_.data(), piece_.size()}, true}};
+    }
+
+  private:
+    value_type &body_;
+    std::string piece_;
+  };
+};
+
+#endif // STREAM_BODY_H
@@ -0,0 +1,239 @@
+#include "access_log.h"
+#include <algorithm>
+#include <boost/log/trivial.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Write all of `data`, retrying short writes
+bool writeAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = ::write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+} // namespace
+
+AccessLog &AccessLog::GetInstance() {
+  static AccessLog instance;
+  return instance;
+}
+
+AccessLog::~AccessLog() { close(); }
+
+bool AccessLog::open(const std::filesystem::path &path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    BOOST_LOG_TRIVIAL(error) << "Failed to open access log " << path << ": "
+                             << std::strerror(errno);
+    return false;
+  }
+  struct stat file_stat;
+  if (::fstat(fd, &file_stat) != 0) {
+    ::close(fd);
+    return false;
+  }
+  uint64_t size = file_stat.st_size;
+  if (size == 0) {
+    if (!writeAll(fd, ACCESS_LOG_MAGIC.data(), ACCESS_LOG_MAGIC.size())) {
+      ::close(fd);
+      return false;
+    }
+    size = ACCESS_LOG_MAGIC.size();
+  } else {
+    std::string magic(ACCESS_LOG_MAGIC.size(), '\0');
+    if (::pread(fd, magic.data(), magic.size(), 0) !=
+            (ssize_t)magic.size() ||
+        magic != ACCESS_LOG_MAGIC) {
+      BOOST_LOG_TRIVIAL(error) << path << " is not an access log";
+      ::close(fd);
+      return false;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  fd_ = fd;
+  offset_ = size;
+  buffer_.reserve(ACCESS_LOG_BUFFER_SIZE * 2);
+  stopping_ = false;
+  flusher_ = std::thread([this] { flushLoop(); });
+  enabled_ = true;
+  BOOST_LOG_TRIVIAL(info) << "Writing access log to " << path;
+  return true;
+}
+
+void AccessLog::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_) {
+      return;
+    }
+    enabled_ = false;
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  flusher_.join();
+  // Records may still have been added by threads that saw enabled_ just
+  // before it was cleared
+  std::lock_guard<std::mutex> write_lock(write_mutex_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!writeAll(fd_, buffer_.data(), buffer_.size())) {
+    BOOST_LOG_TRIVIAL(error) << "Failed to write access log: "
+                             << std::strerror(errno);
+  }
+  buffer_.clear();
+  ::close(fd_);
+  fd_ = -1;
+  strings_.clear();
+}
+
+void AccessLog::record(std::chrono::system_clock::time_point received,
+                       std::chrono::steady_clock::duration latency,
+                       unsigned int status, uint64_t bytes,
+                       std::string_view handler, std::string_view path) {
+  if (!enabled_) {
+    return;
+  }
+  AccessLogRecord record;
+  record.status = status;
+  record.latency_us = std::min<int64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(latency).count(),
+      UINT32_MAX);
+  record.timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                            received.time_since_epoch())
+                            .count();
+  record.bytes = bytes;
+  bool full;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0) {
+      return;
+    }
+    record.handler_offset = intern(handler);
+    record.path_offset = intern(path);
+    append(&record, sizeof(record));
+    full = buffer_.size() >= ACCESS_LOG_BUFFER_SIZE;
+  }
+  if (full) {
+    wake_.notify_one();
+  }
+}
+
+uint64_t AccessLog::intern(std::string_view value) {
+  value = value.substr(0, UINT16_MAX);
+  auto it = strings_.find(value);
+  if (it != strings_.end()) {
+    return it->second;
+  }
+  if (strings_.size() >= ACCESS_LOG_MAX_STRINGS) {
+    // Strings already written stay valid; they are just written again
+    strings_.clear();
+  }
+  uint64_t offset = offset_;
+  AccessLogString header;
+  header.length = value.size();
+  append(&header, sizeof(header));
+  append(value.data(), value.size());
+  strings_.emplace(value, offset);
+  return offset;
+}
+
+void AccessLog::append(const void *data, size_t size) {
+  buffer_.append(static_cast<const char *>(data), size);
+  offset_ += size;
+}
+
+void AccessLog::flush() {
+  std::lock_guard<std::mutex> write_lock(write_mutex_);
+  std::string batch;
+  int fd;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    batch.reserve(ACCESS_LOG_BUFFER_SIZE * 2);
+    batch.swap(buffer_);
+    fd = fd_;
+  }
+  if (fd >= 0 && !batch.empty() && !writeAll(fd, batch.data(), batch.size())) {
+    BOOST_LOG_TRIVIAL(error) << "Failed to write access log: "
+                             << std::strerror(errno);
+  }
+}
+
+void AccessLog::flushLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    wake_.wait_for(lock, ACCESS_LOG_FLUSH_INTERVAL, [this] {
+      return stopping_ || buffer_.size() >= ACCESS_LOG_BUFFER_SIZE;
+    });
+    lock.unlock();
+    flush();
+    lock.lock();
+  }
+}
+
+std::optional<std::vector<AccessLogEntry>>
+AccessLog::read(const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return {};
+  }
+  std::stringstream contents;
+  contents << file.rdbuf();
+  const std::string data = contents.str();
+  if (data.compare(0, ACCESS_LOG_MAGIC.size(), ACCESS_LOG_MAGIC) != 0) {
+    return {};
+  }
+
+  std::unordered_map<uint64_t, std::string> strings;
+  std::vector<AccessLogEntry> entries;
+  size_t offset = ACCESS_LOG_MAGIC.size();
+  while (offset < data.size()) {
+    uint8_t type = data[offset];
+    if (type == ACCESS_LOG_STRING) {
+      AccessLogString header;
+      if (offset + sizeof(header) > data.size()) {
+        break;
+      }
+      std::memcpy(&header, data.data() + offset, sizeof(header));
+      if (offset + sizeof(header) + header.length > data.size()) {
+        break;
+      }
+      strings[offset] = data.substr(offset + sizeof(header), header.length);
+      offset += sizeof(header) + header.length;
+    } else if (type == ACCESS_LOG_ENTRY) {
+      AccessLogRecord record;
+      if (offset + sizeof(record) > data.size()) {
+        break;
+      }
+      std::memcpy(&record, data.data() + offset, sizeof(record));
+      offset += sizeof(record);
+      entries.push_back(AccessLogEntry{
+          std::chrono::system_clock::time_point(
+              std::chrono::microseconds(record.timestamp_us)),
+          strings[record.handler_offset], record.status, record.bytes,
+          std::chrono::microseconds(record.latency_us),
+          strings[record.path_offset]});
+    } else {
+      BOOST_LOG_TRIVIAL(error) << "Unknown access log record type "
+                               << (int)type << " at offset " << offset;
+      break;
+    }
+  }
+  return entries;
+}
@@ -0,0 +1,61 @@
+// Converts a binary access log written by the server to text, one line per
+// response, or to JSON lines with --json. Each JSON line is one object kept
+// on a single line, so strings are escaped with jsonString() rather than
+// laid out by JsonWriter.
+//
+// Usage: access_log_dump <access_log> [--json]
+
+#include "access_log.h"
+#include "json.h"
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <string>
+
+namespace {
+
+// `timestamp` as ISO 8601 in UTC, with microseconds
+std::string formatTimestamp(std::chrono::system_clock::time_point timestamp) {
+  auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                    timestamp.time_since_epoch())
+                    .count();
+  std::time_t seconds = micros / 1000000;
+  std::tm utc;
+  gmtime_r(&seconds, &utc);
+  char formatted[64];
+  size_t length = std::strftime(formatted, sizeof(formatted),
+                                "%Y-%m-%dT%H:%M:%S", &utc);
+  std::snprintf(formatted + length, sizeof(formatted) - length, ".%06lldZ",
+                (long long)(micros % 1000000));
+  return formatted;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  bool json = argc == 3 && std::string(argv[2]) == "--json";
+  if (argc != 2 && !json) {
+    std::cerr << "Usage: access_log_dump <access_log> [--json]\n";
+    return 1;
+  }
+  std::optional<std::vector<AccessLogEntry>> entries = AccessLog::read(argv[1]);
+  if (!entries.has_value()) {
+    std::cerr << argv[1] << " is not a readable access log\n";
+    return 1;
+  }
+  for (const AccessLogEntry &entry : entries.value()) {
+    if (json) {
+      std::cout << "{\"timestamp\": " << jsonString(formatTimestamp(entry.timestamp))
+                << ", \"handler\": " << jsonString(entry.handler)
+                << ", \"status\": " << entry.status
+                << ", \"bytes\": " << entry.bytes
+                << ", \"latency_us\": " << entry.latency.count()
+                << ", \"path\": " << jsonString(entry.path) << "}\n";
+    } else {
+      std::cout << formatTimestamp(entry.timestamp) << " " << entry.handler
+                << " " << entry.status << " " << entry.bytes << " "
+                << entry.latency.count() << "us " << entry.path << "\n";
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,40 @@
+#include "blocking_executor.h"
+#include <algorithm>
+#include <boost/asio/post.hpp>
+#include <boost/log/trivial.hpp>
+#include <thread>
+
+BlockingExecutor::BlockingExecutor(size_t thread_count, size_t max_pending)
+    : pool_(thread_count), max_pending_(max_pending) {}
+
+BlockingExecutor::~BlockingExecutor() { pool_.join(); }
+
+bool BlockingExecutor::post(std::function<void()> work) {
+  // Reserve a slot, unless they're all taken
+  size_t pending = pending_.load(std::memory_order_relaxed);
+  do {
+    if (pending >= max_pending_) {
+      BOOST_LOG_TRIVIAL(warning)
+          << "Blocking executor is full (" << pending << " tasks); rejecting";
+      return false;
+    }
+  } while (!pending_.compare_exchange_weak(pending, pending + 1,
+                                           std::memory_order_relaxed));
+
+  boost::asio::post(pool_, [this, work = std::move(work)] {
+    work();
+    pending_.fetch_sub(1, std::memory_order_relaxed);
+  });
+  return true;
+}
+
+size_t BlockingExecutor::pending() const {
+  return pending_.load(std::memory_order_relaxed);
+}
+
+BlockingExecutor &BlockingExecutor::GetInstance() {
+  static BlockingExecutor instance(
+      std::max(4u, 2 * std::thread::hardware_concurrency()),
+      BLOCKING_EXECUTOR_MAX_PENDING);
+  return instance;
+}
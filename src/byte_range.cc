@@ -0,0 +1,99 @@
+#include "byte_range.h"
+#include <algorithm>
+#include <charconv>
+
+namespace {
+
+std::string_view trim(std::string_view value) {
+  size_t start = value.find_first_not_of(" \t");
+  if (start == std::string_view::npos) {
+    return {};
+  }
+  size_t end = value.find_last_not_of(" \t");
+  return value.substr(start, end - start + 1);
+}
+
+// Parse all of `digits` as a number
+std::optional<uint64_t> parseNumber(std::string_view digits) {
+  uint64_t value;
+  auto [end, error] =
+      std::from_chars(digits.data(), digits.data() + digits.size(), value);
+  if (digits.empty() || error != std::errc() ||
+      end != digits.data() + digits.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+} // namespace
+
+std::optional<std::vector<ByteRange>> parseRange(std::string_view header,
+                                                 uint64_t size) {
+  header = trim(header);
+  if (!header.starts_with("bytes=")) {
+    return std::nullopt;
+  }
+  header.remove_prefix(6);
+
+  std::vector<ByteRange> ranges;
+  size_t specs = 0;
+  while (!header.empty()) {
+    size_t comma = header.find(',');
+    std::string_view spec = trim(header.substr(0, comma));
+    header = comma == std::string_view::npos ? "" : header.substr(comma + 1);
+    // empty list elements are allowed, as in "bytes=0-1,,5-6"
+    if (spec.empty()) {
+      continue;
+    }
+    if (++specs > MAX_BYTE_RANGES) {
+      return std::nullopt;
+    }
+    size_t dash = spec.find('-');
+    if (dash == std::string_view::npos) {
+      return std::nullopt;
+    }
+
+    if (dash == 0) {
+      // "-500" is the last 500 bytes
+      std::optional<uint64_t> suffix = parseNumber(spec.substr(1));
+      if (!suffix.has_value()) {
+        return std::nullopt;
+      }
+      if (suffix.value() > 0 && size > 0) {
+        ranges.push_back(
+            {size - std::min(suffix.value(), size), size - 1});
+      }
+      continue;
+    }
+
+    std::optional<uint64_t> first = parseNumber(spec.substr(0, dash));
+    if (!first.has_value()) {
+      return std::nullopt;
+    }
+    // "500-" runs to the end
+    uint64_t last = UINT64_MAX;
+    if (dash + 1 < spec.size()) {
+      std::optional<uint64_t> end = parseNumber(spec.substr(dash + 1));
+      if (!end.has_value() || end.value() < first.value()) {
+        return std::nullopt;
+      }
+      last = end.value();
+    }
+    if (first.value() < size) {
+      ranges.push_back({first.value(), std::min(last, size - 1)});
+    }
+  }
+  if (specs == 0) {
+    return std::nullopt;
+  }
+  return ranges;
+}
+
+std::string contentRange(const ByteRange &range, uint64_t size) {
+  return "bytes " + std::to_string(range.first) + "-" +
+         std::to_string(range.last) + "/" + std::to_string(size);
+}
+
+std::string unsatisfiedRange(uint64_t size) {
+  return "bytes */" + std::to_string(size);
+}
@@ -0,0 +1,223 @@
+#include "compression.h"
+#include <algorithm>
+#include <boost/log/trivial.hpp>
+#include <cctype>
+#include <cstdlib>
+#include <zlib.h>
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace {
+
+std::string_view trim(std::string_view value) {
+  size_t start = value.find_first_not_of(" \t");
+  if (start == std::string_view::npos) {
+    return {};
+  }
+  size_t end = value.find_last_not_of(" \t");
+  return value.substr(start, end - start + 1);
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                    [](char x, char y) {
+                      return std::tolower(static_cast<unsigned char>(x)) ==
+                             std::tolower(static_cast<unsigned char>(y));
+                    });
+}
+
+// zlib's deflate, wrapped in a gzip header and trailer if `gzip`
+std::optional<std::string> zlibCompress(std::string_view data, bool gzip) {
+  z_stream stream{};
+  // 16 more window bits asks zlib for a gzip wrapper instead of a zlib one
+  if (deflateInit2(&stream, GZIP_LEVEL, Z_DEFLATED, gzip ? 15 + 16 : 15, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return std::nullopt;
+  }
+  std::string out(deflateBound(&stream, data.size()), '\0');
+  stream.next_in =
+      reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+  stream.avail_in = data.size();
+  stream.next_out = reinterpret_cast<Bytef *>(out.data());
+  stream.avail_out = out.size();
+  int result = deflate(&stream, Z_FINISH);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  if (result != Z_STREAM_END) {
+    return std::nullopt;
+  }
+  return out;
+}
+
+} // namespace
+
+std::string_view encodingName(CONTENT_ENCODING encoding) {
+  switch (encoding) {
+  case ENCODING_BROTLI:
+    return "br";
+  case ENCODING_GZIP:
+    return "gzip";
+  case ENCODING_DEFLATE:
+    return "deflate";
+  default:
+    return "identity";
+  }
+}
+
+std::optional<std::string_view> precompressedSuffix(CONTENT_ENCODING encoding) {
+  switch (encoding) {
+  case ENCODING_BROTLI:
+    return ".br";
+  case ENCODING_GZIP:
+    return ".gz";
+  default:
+    return std::nullopt;
+  }
+}
+
+bool brotliSupported() {
+#ifdef HAVE_BROTLI
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::optional<std::string> compress(std::string_view data,
+                                    CONTENT_ENCODING encoding) {
+  switch (encoding) {
+  case ENCODING_GZIP:
+    return zlibCompress(data, true);
+  case ENCODING_DEFLATE:
+    return zlibCompress(data, false);
+#ifdef HAVE_BROTLI
+  case ENCODING_BROTLI: {
+    // the bound is 0 if it would overflow; an empty input still needs a byte
+    size_t size = std::max<size_t>(
+        BrotliEncoderMaxCompressedSize(data.size()), 16);
+    std::string out(size, '\0');
+    if (!BrotliEncoderCompress(
+            BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+            data.size(), reinterpret_cast<const uint8_t *>(data.data()),
+            &size, reinterpret_cast<uint8_t *>(out.data()))) {
+      return std::nullopt;
+    }
+    out.resize(size);
+    return out;
+  }
+#endif
+  default:
+    return std::nullopt;
+  }
+}
+
+CompressionPolicy::CompressionPolicy(
+    const std::unordered_map<std::string, std::string> &args) {
+  auto types = args.find(COMPRESS_TYPES_ARG);
+  if (types == args.end()) {
+    return;
+  }
+  std::string_view list = types->second;
+  while (!list.empty()) {
+    size_t end = list.find_first_of(" ,\t");
+    std::string_view type = list.substr(0, end);
+    if (!type.empty()) {
+      types_.emplace(type);
+    }
+    list = end == std::string_view::npos ? "" : list.substr(end + 1);
+  }
+
+  auto min_size = args.find(COMPRESS_MIN_SIZE_ARG);
+  if (min_size != args.end()) {
+    try {
+      min_size_ = std::stoull(min_size->second);
+    } catch (const std::exception &e) {
+      BOOST_LOG_TRIVIAL(warning) << "Invalid compress_min_size "
+                                 << min_size->second << "; using the default";
+    }
+  }
+}
+
+bool CompressionPolicy::compressible(std::string_view content_type) const {
+  // ignore parameters like "; charset=utf-8"
+  content_type = trim(content_type.substr(0, content_type.find(';')));
+  return types_.contains(std::string(content_type));
+}
+
+std::vector<CONTENT_ENCODING>
+CompressionPolicy::encodings(const http_request &request,
+                             std::string_view content_type) const {
+  auto header = request.find(http_fields::accept_encoding);
+  if (header == request.end() || !compressible(content_type)) {
+    return {};
+  }
+
+  // q-value of each coding the client listed, by CONTENT_ENCODING; -1 if
+  // it wasn't listed, in which case "*" decides
+  double weights[] = {-1, -1, -1, -1};
+  double any = -1;
+  std::string_view value(header->value().data(), header->value().size());
+  while (!value.empty()) {
+    size_t end = value.find(',');
+    std::string_view element = value.substr(0, end);
+    value = end == std::string_view::npos ? "" : value.substr(end + 1);
+
+    std::string_view coding = trim(element.substr(0, element.find(';')));
+    double weight = 1;
+    size_t q = element.find("q=");
+    if (q != std::string_view::npos) {
+      weight = std::strtod(std::string(element.substr(q + 2)).c_str(), nullptr);
+    }
+    if (equalsIgnoreCase(coding, "br")) {
+      weights[ENCODING_BROTLI] = weight;
+    } else if (equalsIgnoreCase(coding, "gzip") ||
+               equalsIgnoreCase(coding, "x-gzip")) {
+      weights[ENCODING_GZIP] = weight;
+    } else if (equalsIgnoreCase(coding, "deflate")) {
+      weights[ENCODING_DEFLATE] = weight;
+    } else if (coding == "*") {
+      any = weight;
+    }
+  }
+
+  std::vector<std::pair<double, CONTENT_ENCODING>> acceptable;
+  for (CONTENT_ENCODING encoding :
+       {ENCODING_BROTLI, ENCODING_GZIP, ENCODING_DEFLATE}) {
+    if (encoding == ENCODING_BROTLI && !brotliSupported()) {
+      continue;
+    }
+    double weight = weights[encoding] >= 0 ? weights[encoding] : any;
+    if (weight > 0) {
+      acceptable.emplace_back(weight, encoding);
+    }
+  }
+  std::stable_sort(acceptable.begin(), acceptable.end(),
+                   [](const auto &a, const auto &b) { return a.first > b.first; });
+  std::vector<CONTENT_ENCODING> result;
+  for (const auto &[weight, encoding] : acceptable) {
+    result.push_back(encoding);
+  }
+  return result;
+}
+
+bool CompressionPolicy::compressResponse(http_response &response,
+                                         CONTENT_ENCODING encoding) const {
+  boost::beast::string_view content_type = response[http_fields::content_type];
+  if (!compressible(std::string_view(content_type.data(), content_type.size()))) {
+    return false;
+  }
+  response.set(http_fields::vary, "Accept-Encoding");
+  if (encoding == ENCODING_IDENTITY || response.body().size() < min_size_) {
+    return false;
+  }
+  std::optional<std::string> compressed = compress(response.body(), encoding);
+  if (!compressed.has_value() ||
+      compressed.value().size() >= response.body().size()) {
+    return false;
+  }
+  response.set(http_fields::content_encoding, std::string(encodingName(encoding)));
+  response.content_length(compressed.value().size());
+  response.body() = std::move(compressed.value());
+  return true;
+}
@@ -0,0 +1,171 @@
+#include "conditional_get.h"
+#include <cstdio>
+#include <ctime>
+
+namespace {
+
+// The opaque part of an entity tag, without any W/ prefix
+std::string_view opaqueTag(std::string_view etag) {
+  if (etag.starts_with("W/")) {
+    etag.remove_prefix(2);
+  }
+  return etag;
+}
+
+// Whether an If-None-Match list holds "*" or a tag weakly matching `etag`
+bool matchesAny(std::string_view list, std::string_view etag) {
+  std::string_view opaque = opaqueTag(etag);
+  size_t i = 0;
+  while (i < list.size()) {
+    if (list[i] == ' ' || list[i] == '\t' || list[i] == ',') {
+      i++;
+    } else if (list[i] == '*') {
+      return true;
+    } else {
+      if (list.substr(i).starts_with("W/")) {
+        i += 2;
+      }
+      if (i >= list.size() || list[i] != '"') {
+        return false;
+      }
+      size_t end = list.find('"', i + 1);
+      if (end == std::string_view::npos) {
+        return false;
+      }
+      if (list.substr(i, end + 1 - i) == opaque) {
+        return true;
+      }
+      i = end + 1;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+Validators fileValidators(const FileStat &stat, std::string_view variant,
+                          bool weak) {
+  auto modified = std::chrono::file_clock::to_sys(stat.last_write_time);
+  char tag[64];
+  snprintf(tag, sizeof(tag), "%jx-%llx", stat.size,
+           static_cast<unsigned long long>(
+               std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   modified.time_since_epoch())
+                   .count()));
+  std::string etag = weak ? "W/\"" : "\"";
+  etag += tag;
+  if (!variant.empty()) {
+    etag += '-';
+    etag += variant;
+  }
+  etag += '"';
+  return Validators{
+      etag, std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+                modified)};
+}
+
+Validators contentValidators(std::string_view contents,
+                             const std::optional<FileStat> &stat) {
+  // 64-bit FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (char c : contents) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+  }
+  char etag[48];
+  snprintf(etag, sizeof(etag), "W/\"%zx-%016llx\"", contents.size(),
+           static_cast<unsigned long long>(hash));
+  Validators validators{etag, std::nullopt};
+  if (stat.has_value()) {
+    validators.last_modified = fileValidators(stat.value()).last_modified;
+  }
+  return validators;
+}
+
+Validators versionValidators(uint64_t source_id, uint64_t version) {
+  char etag[48];
+  snprintf(etag, sizeof(etag), "W/\"%016llx-%llx\"",
+           static_cast<unsigned long long>(source_id),
+           static_cast<unsigned long long>(version));
+  return Validators{etag, std::nullopt};
+}
+
+bool notModified(const http_request &request, const Validators &validators) {
+  // If-Modified-Since is ignored when If-None-Match is given
+  auto if_none_match = request.find(http_fields::if_none_match);
+  if (if_none_match != request.end()) {
+    return matchesAny(std::string_view(if_none_match->value().data(),
+                                       if_none_match->value().size()),
+                      validators.etag);
+  }
+  auto if_modified_since = request.find(http_fields::if_modified_since);
+  if (if_modified_since == request.end() ||
+      !validators.last_modified.has_value()) {
+    return false;
+  }
+  std::optional<std::chrono::system_clock::time_point> since =
+      parseHttpDate(std::string_view(if_modified_since->value().data(),
+                                     if_modified_since->value().size()));
+  // HTTP-dates only go down to the second
+  return since.has_value() &&
+         std::chrono::floor<std::chrono::seconds>(
+             validators.last_modified.value()) <= since.value();
+}
+
+bool ifRangeMatches(const http_request &request, const Validators &validators) {
+  auto if_range = request.find(http_fields::if_range);
+  if (if_range == request.end()) {
+    return true;
+  }
+  std::string_view value(if_range->value().data(), if_range->value().size());
+  if (value.starts_with('"') || value.starts_with("W/")) {
+    // Only strong tags match; a weak one can't vouch for the exact bytes
+    return !validators.etag.starts_with("W/") && value == validators.etag;
+  }
+  std::optional<std::chrono::system_clock::time_point> date =
+      parseHttpDate(value);
+  return date.has_value() && validators.last_modified.has_value() &&
+         std::chrono::floor<std::chrono::seconds>(
+             validators.last_modified.value()) == date.value();
+}
+
+void setValidators(boost::beast::http::fields &headers,
+                   const Validators &validators,
+                   const std::string &cache_control) {
+  headers.set(http_fields::etag, validators.etag);
+  if (validators.last_modified.has_value()) {
+    headers.set(http_fields::last_modified,
+                httpDate(validators.last_modified.value()));
+  }
+  if (!cache_control.empty()) {
+    headers.set(http_fields::cache_control, cache_control);
+  }
+}
+
+http_response notModifiedResponse(const Validators &validators,
+                                  const std::string &cache_control) {
+  http_response response;
+  response.result(NOT_MODIFIED_STATUS);
+  setValidators(response, validators, cache_control);
+  return response;
+}
+
+std::string httpDate(std::chrono::system_clock::time_point time) {
+  std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+  std::tm tm;
+  gmtime_r(&seconds, &tm);
+  char date[32];
+  strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  return date;
+}
+
+std::optional<std::chrono::system_clock::time_point>
+parseHttpDate(std::string_view date) {
+  std::string terminated(date);
+  std::tm tm{};
+  const char *end =
+      strptime(terminated.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  if (end == nullptr || *end != '\0') {
+    return std::nullopt;
+  }
+  return std::chrono::system_clock::from_time_t(timegm(&tm));
+}
@@ -8,6 +8,7 @@
 //   http://lxr.nginx.org/source/src/core/ngx_conf_file.c
 
 #include "config_parser.h"
+#include "log_severity.h"
 #include "registry.h"
 #include <boost/log/trivial.hpp>
 #include <cstdio>
@@ -18,6 +19,17 @@
 #include <string>
 #include <vector>
 
+namespace {
+
+// Whether `arg` is a plain non-negative decimal number that fits in a size_t:
+// no sign, suffix or anything else around the digits
+bool isSize(const std::string &arg) {
+  return !arg.empty() && arg.size() <= 18 &&
+         arg.find_first_not_of(DIGITS) == std::string::npos;
+}
+
+} // namespace
+
 NginxConfig::NginxConfig(std::string contextName) : contextName(contextName) {}
 
 std::string NginxConfig::ToString(int depth) {
@@ -173,7 +185,7 @@ NginxConfigParser::TokenType NginxConfigParser::ParseToken(std::istream *input,
 
 bool NginxConfigParser::Parse(std::istream *config_file, NginxConfig *config) {
   // Log and init parsing
-  BOOST_LOG_TRIVIAL(debug) << "Starting Parse";
+  LOG_AT(debug) << "Starting Parse";
   std::stack<NginxConfig *> config_stack;
   config_stack.push(config);
   TokenType last_token_type = TOKEN_TYPE_START;
@@ -183,7 +195,7 @@ bool NginxConfigParser::Parse(std::istream *config_file, NginxConfig *config) {
     token_type = ParseToken(config_file, &token);
 
     // Log each token type followed by the token itself as parser loops
-    BOOST_LOG_TRIVIAL(debug)
+    LOG_AT(debug)
         << std::string(TokenTypeAsString(token_type)) + ": " + token + "\n";
 
     if (token_type == TOKEN_TYPE_ERROR) {
@@ -295,7 +307,7 @@ NginxConfig::findDirectives(std::string directiveName) {
 }
 
 bool NginxConfig::Validate(std::string baseContextType) {
-  BOOST_LOG_TRIVIAL(debug) << "Validating Top Level Directives";
+  LOG_AT(debug) << "Validating Top Level Directives";
   for (const auto &statement : statements_) {
     std::string statement_type = statement->tokens_[0];
     if (VALID_DIRECTIVES.contains(statement_type)) {
@@ -347,6 +359,124 @@ int NginxConfig::findPort() {
   return -1;
 }
 
+std::optional<THREADING_MODE> NginxConfig::findThreadingMode() {
+  if (contextName != MAIN) {
+    return {};
+  }
+  std::vector<NginxConfigStatement *> threading_directives =
+      findDirectives(THREADING);
+  if (threading_directives.empty()) {
+    return THREADING_SHARED;
+  }
+  if (threading_directives.size() != 1) {
+    BOOST_LOG_TRIVIAL(warning) << "multiple threading directives in config";
+    return {};
+  }
+  std::string mode = unquoteArg(threading_directives[0]->tokens_[1]);
+  if (!THREADING_MODES.contains(mode)) {
+    BOOST_LOG_TRIVIAL(warning) << "unknown threading mode: " << mode;
+    return {};
+  }
+  return THREADING_MODES.at(mode);
+}
+
+std::optional<SessionConfig> NginxConfig::findSessionConfig() {
+  if (contextName != MAIN) {
+    return {};
+  }
+  SessionConfig session_config;
+  std::optional<size_t> pipeline_depth =
+      findSize(PIPELINE_DEPTH, session_config.pipeline_depth);
+  if (!pipeline_depth.has_value() || pipeline_depth.value() == 0) {
+    BOOST_LOG_TRIVIAL(warning) << "pipeline_depth must be a positive integer";
+    return {};
+  }
+  session_config.pipeline_depth = pipeline_depth.value();
+  std::pair<std::string, std::chrono::seconds *> timeouts[] = {
+      {IDLE_TIMEOUT, &session_config.idle_timeout},
+      {HEADER_TIMEOUT, &session_config.header_timeout},
+      {BODY_TIMEOUT, &session_config.body_timeout},
+      {WRITE_TIMEOUT, &session_config.write_timeout},
+  };
+  for (auto &[directive_name, timeout] : timeouts) {
+    std::optional<size_t> seconds = findSize(directive_name, timeout->count());
+    if (!seconds.has_value()) {
+      return {};
+    }
+    *timeout = std::chrono::seconds(seconds.value());
+  }
+  return session_config;
+}
+
+std::optional<std::chrono::seconds> NginxConfig::findShutdownTimeout() {
+  if (contextName != MAIN) {
+    return {};
+  }
+  std::optional<size_t> seconds =
+      findSize(SHUTDOWN_TIMEOUT, DEFAULT_SHUTDOWN_TIMEOUT.count());
+  if (!seconds.has_value()) {
+    return {};
+  }
+  return std::chrono::seconds(seconds.value());
+}
+
+std::optional<LOGGING_MODE> NginxConfig::findLoggingMode() {
+  if (contextName != MAIN) {
+    return {};
+  }
+  std::vector<NginxConfigStatement *> log_mode_directives =
+      findDirectives(LOG_MODE);
+  if (log_mode_directives.empty()) {
+    return LOGGING_ASYNC;
+  }
+  if (log_mode_directives.size() != 1) {
+    BOOST_LOG_TRIVIAL(warning) << "multiple log_mode directives in config";
+    return {};
+  }
+  std::string mode = unquoteArg(log_mode_directives[0]->tokens_[1]);
+  if (!LOGGING_MODES.contains(mode)) {
+    BOOST_LOG_TRIVIAL(warning) << "unknown log mode: " << mode;
+    return {};
+  }
+  return LOGGING_MODES.at(mode);
+}
+
+std::optional<std::string> NginxConfig::findAccessLog() {
+  if (contextName != MAIN) {
+    return {};
+  }
+  std::vector<NginxConfigStatement *> access_log_directives =
+      findDirectives(ACCESS_LOG);
+  if (access_log_directives.empty()) {
+    return "";
+  }
+  if (access_log_directives.size() != 1) {
+    BOOST_LOG_TRIVIAL(warning) << "multiple access_log directives in config";
+    return {};
+  }
+  return unquoteArg(access_log_directives[0]->tokens_[1]);
+}
+
+std::optional<size_t> NginxConfig::findSize(std::string directiveName,
+                                            size_t default_value) {
+  std::vector<NginxConfigStatement *> directives =
+      findDirectives(directiveName);
+  if (directives.empty()) {
+    return default_value;
+  }
+  if (directives.size() != 1) {
+    BOOST_LOG_TRIVIAL(warning) << "multiple " << directiveName
+                               << " directives in config";
+    return {};
+  }
+  std::string arg = unquoteArg(directives[0]->tokens_[1]);
+  if (!isSize(arg)) {
+    BOOST_LOG_TRIVIAL(warning) << "invalid " << directiveName << ": " << arg;
+    return {};
+  }
+  return std::stoull(arg);
+}
+
 std::string NginxConfig::unquoteArg(std::string arg){
   std::string unquoted = arg;
   if ((unquoted.front() == '"' && unquoted.back() == '"') ||
@@ -388,7 +518,9 @@ NginxConfig::findLocations() {
     }
     LocationData location_data;
     location_data.handler_ = handler;
-    ArgSet expected_args = Registry::GetInstance().expected_args_map_[handler];
+    ArgSet expected_args = Registry::GetInstance().expected_args_map_.at(handler);
+    ArgSet optional_args = Registry::GetInstance().optional_args_map_.at(handler);
+    size_t expected_args_found = 0;
     NginxConfig *location_block = directive->child_block_.get();
     // gather data from inside location_block into location_data.arg_map_
     for (auto &statement : location_block->statements_) {
@@ -406,20 +538,28 @@ NginxConfig::findLocations() {
                                 << " contains duplicate directive " << keyword;
         return {};
       }
-      // only expected arguments may be provided
-      if (!expected_args.contains(keyword)) {
+      // only expected or optional arguments may be provided, along with
+      // the ones every location takes
+      if (expected_args.contains(keyword)) {
+        expected_args_found++;
+      } else if (!optional_args.contains(keyword) && keyword != BODY_LIMIT_ARG) {
         BOOST_LOG_TRIVIAL(warning)
             << "Handler " << handler << " received unrecognized directive "
             << keyword;
         return {};
       }
       std::string value = unquoteArg(statement->tokens_[1]);
+      if (keyword == BODY_LIMIT_ARG && !isSize(value)) {
+        BOOST_LOG_TRIVIAL(warning) << "Location with path " << path
+                                   << " has invalid body_limit " << value;
+        return {};
+      }
       location_data.arg_map_.insert({keyword, value});
     }
-    if (expected_args.size() != location_data.arg_map_.size()) {
+    if (expected_args.size() != expected_args_found) {
       BOOST_LOG_TRIVIAL(warning)
           << "Hander " << handler << " expected " << expected_args.size()
-          << " directive(s), received " << location_data.arg_map_.size();
+          << " directive(s), received " << expected_args_found;
       return {};
     }
     locations.insert({path, location_data});
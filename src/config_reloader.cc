@@ -0,0 +1,60 @@
+#include "config_reloader.h"
+#include "blocking_executor.h"
+#include "config_parser.h"
+#include <boost/log/trivial.hpp>
+#include <csignal>
+
+ConfigReloader::ConfigReloader(boost::asio::io_service &io_service,
+                               std::string config_path,
+                               RequestManager &request_manager)
+    : config_path_(std::move(config_path)), request_manager_(request_manager),
+      signals_(io_service, SIGHUP) {
+  wait_for_signal();
+}
+
+void ConfigReloader::wait_for_signal() {
+  signals_.async_wait(
+      [this](const boost::system::error_code &error, int signal_number) {
+        handle_signal(error, signal_number);
+      });
+}
+
+void ConfigReloader::handle_signal(const boost::system::error_code &error,
+                                   int signal_number) {
+  if (error) {
+    return;
+  }
+  BOOST_LOG_TRIVIAL(info) << "Received SIGHUP, reloading " << config_path_;
+  // Building handlers may touch the disk, so keep it off the I/O thread
+  if (!BlockingExecutor::GetInstance().post([this] { reload(); })) {
+    BOOST_LOG_TRIVIAL(warning) << "Server too busy to reload the config";
+  }
+  wait_for_signal();
+}
+
+bool ConfigReloader::reload() {
+  std::lock_guard<std::mutex> lock(reload_mutex_);
+  NginxConfigParser config_parser;
+  NginxConfig config;
+  if (!config_parser.Parse(config_path_.c_str(), &config)) {
+    BOOST_LOG_TRIVIAL(error) << "Reloaded config failed to parse & validate; "
+                                "keeping the current one";
+    return false;
+  }
+  std::optional<std::unordered_map<std::string, LocationData>> locations =
+      config.findLocations();
+  if (!locations.has_value()) {
+    BOOST_LOG_TRIVIAL(error) << "Failed to extract location data from "
+                                "reloaded config; keeping the current one";
+    return false;
+  }
+  try {
+    request_manager_.reload(locations.value());
+  } catch (std::exception &e) {
+    BOOST_LOG_TRIVIAL(error) << "Failed to build handlers for reloaded "
+                                "config; keeping the current one: "
+                             << e.what();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,72 @@
+#include "content_cache.h"
+#include "log_severity.h"
+#include <boost/log/trivial.hpp>
+
+ContentCache::ContentCache(size_t capacity_bytes)
+    : capacity_bytes_(capacity_bytes) {}
+
+std::shared_ptr<const CachedContent>
+ContentCache::get(const std::string &key, const FileStat &version,
+                  uint64_t revision) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  if (!(it->second->second->version == version) ||
+      it->second->second->revision != revision) {
+    LOG_AT(debug) << "Cached content for " << key << " is stale";
+    erase(it->second);
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  // Move to the front, as the most recently used entry
+  lru_.splice(lru_.begin(), lru_, it->second);
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  return it->second->second;
+}
+
+void ContentCache::put(const std::string &key,
+                       std::shared_ptr<const CachedContent> content) {
+  const size_t content_size = content->response.body().size();
+  if (content_size > capacity_bytes_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lk(mtx_);
+  auto existing = entries_.find(key);
+  if (existing != entries_.end()) {
+    erase(existing->second);
+  }
+  while (size_bytes_ + content_size > capacity_bytes_) {
+    LOG_AT(debug) << "Evicting cached content for "
+                  << lru_.back().first;
+    erase(std::prev(lru_.end()));
+    evictions_.fetch_add(1, std::memory_order_relaxed);
+  }
+  lru_.emplace_front(key, std::move(content));
+  entries_[key] = lru_.begin();
+  size_bytes_ += content_size;
+}
+
+void ContentCache::invalidate(const std::string &key) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    erase(it->second);
+  }
+}
+
+ContentCache::Stats ContentCache::stats() const {
+  std::lock_guard<std::mutex> lk(mtx_);
+  return Stats{hits_.load(std::memory_order_relaxed),
+               misses_.load(std::memory_order_relaxed),
+               evictions_.load(std::memory_order_relaxed), size_bytes_,
+               entries_.size()};
+}
+
+void ContentCache::erase(std::list<Entry>::iterator it) {
+  size_bytes_ -= it->second->response.body().size();
+  entries_.erase(it->first);
+  lru_.erase(it);
+}
@@ -1,4 +1,6 @@
 #include "filesystem/filesystem.h"
+#include "log_severity.h"
+#include <atomic>
 #include <boost/log/trivial.hpp>
 #include <filesystem>
 #include <fstream>
@@ -9,14 +11,34 @@
 
 namespace fs = std::filesystem;
 
-std::recursive_mutex FileSystem::mtx_;
+namespace {
+
+// Distinguishes the temporary files of concurrent writers
+std::atomic<uint64_t> temp_file_count{0};
+
+// A new temporary file name next to `filename`. It lives in the same
+// directory so the rename into place can't cross filesystems.
+fs::path temporaryPath(const fs::path &filename) {
+  return filename.parent_path() /
+         (TEMP_FILE_PREFIX + filename.filename().string() + "." +
+          std::to_string(temp_file_count.fetch_add(1, std::memory_order_relaxed)));
+}
+
+} // namespace
+
+std::array<std::mutex, FileSystem::WRITE_LOCK_STRIPES> FileSystem::write_locks_;
+
+std::mutex &FileSystem::lockFor(const fs::path &path) {
+  // Normalize so that e.g. "a//b" and "a/b" share a lock
+  return write_locks_[fs::hash_value(path.lexically_normal()) %
+                      WRITE_LOCK_STRIPES];
+}
 
 bool FileSystem::exists(const fs::path &path) const {
-  std::lock_guard<std::recursive_mutex> lk(mtx_);
   std::error_code ec;
   bool path_exists = fs::exists(path, ec);
   if (ec) {
-    BOOST_LOG_TRIVIAL(debug)
+    LOG_AT(debug)
         << "failed to check existence of " << path << " because " << ec;
     return false;
   }
@@ -25,18 +47,23 @@ bool FileSystem::exists(const fs::path &path) const {
 
 std::optional<std::vector<fs::path>>
 FileSystem::list(const fs::path &directory) const {
-  std::lock_guard<std::recursive_mutex> lk(mtx_);
   if (!exists(directory)) {
-    BOOST_LOG_TRIVIAL(debug) << directory << " doesn't exist";
+    LOG_AT(debug) << directory << " doesn't exist";
     return std::nullopt;
   }
   if (!is_directory(directory)) {
-    BOOST_LOG_TRIVIAL(debug) << directory << " is not a directory";
+    LOG_AT(debug) << directory << " is not a directory";
     return std::nullopt;
   }
 
   std::vector<fs::path> files;
-  for (const auto &dir_entry : fs::directory_iterator{directory}) {
+  std::error_code ec;
+  for (const auto &dir_entry : fs::directory_iterator{directory, ec}) {
+    // Skip files still being written
+    const std::string filename = dir_entry.path().filename().string();
+    if (filename.rfind(TEMP_FILE_PREFIX, 0) == 0) {
+      continue;
+    }
     if (is_regular_file(dir_entry)) {
       files.push_back(dir_entry);
     }
@@ -55,13 +82,12 @@ FILE_TYPE FileSystem::fileType(std::string file_name) const {
 }
 
 std::optional<std::string> FileSystem::read(const fs::path &filename) const {
-  std::lock_guard<std::recursive_mutex> lk(mtx_);
   if (!exists(filename)) {
-    BOOST_LOG_TRIVIAL(debug) << filename << " doesn't exist";
+    LOG_AT(debug) << filename << " doesn't exist";
     return std::nullopt;
   }
   if (!is_regular_file(filename)) {
-    BOOST_LOG_TRIVIAL(debug) << filename << " is not a regular file";
+    LOG_AT(debug) << filename << " is not a regular file";
     return std::nullopt;
   }
 
@@ -70,10 +96,29 @@ std::optional<std::string> FileSystem::read(const fs::path &filename) const {
   return data;
 }
 
-bool FileSystem::write(const fs::path &filename, const std::string &data) {
-  std::lock_guard<std::recursive_mutex> lk(mtx_);
+std::optional<FileStat> FileSystem::stat(const fs::path &filename) const {
+  std::error_code ec;
+  fs::file_status status = fs::status(filename, ec);
+  if (ec || !fs::is_regular_file(status)) {
+    LOG_AT(debug) << filename << " is not a regular file";
+    return std::nullopt;
+  }
+  FileStat file_stat;
+  file_stat.size = fs::file_size(filename, ec);
+  if (!ec) {
+    file_stat.last_write_time = fs::last_write_time(filename, ec);
+  }
+  if (ec) {
+    LOG_AT(debug)
+        << "failed to stat " << filename << " because " << ec;
+    return std::nullopt;
+  }
+  return file_stat;
+}
+
+bool FileSystem::prepareFile(const fs::path &filename) {
   if (!filename.has_filename()) {
-    BOOST_LOG_TRIVIAL(debug) << filename << " doesn't refer to a file";
+    LOG_AT(debug) << filename << " doesn't refer to a file";
     return false;
   }
 
@@ -81,41 +126,164 @@ bool FileSystem::write(const fs::path &filename, const std::string &data) {
   std::error_code ec;
   fs::create_directories(filename.parent_path(), ec);
   if (ec) {
-    BOOST_LOG_TRIVIAL(debug)
+    LOG_AT(debug)
         << "failed to create parent directories: " << filename.parent_path()
         << " because " << ec;
     return false;
   }
+  return true;
+}
 
-  std::ofstream ofs(filename);
+std::optional<fs::path>
+FileSystem::writeTemporary(const fs::path &filename, const std::string &data) {
+  if (!prepareFile(filename)) {
+    return std::nullopt;
+  }
+  std::error_code ec;
+  const fs::path temp_path = temporaryPath(filename);
+  std::ofstream ofs(temp_path, std::ios::binary);
   ofs << data;
   ofs.close();
+  if (ofs.fail()) {
+    LOG_AT(debug) << "failed to write " << temp_path;
+    fs::remove(temp_path, ec);
+    return std::nullopt;
+  }
+  return temp_path;
+}
+
+std::optional<fs::path> FileSystem::copyTemporary(const fs::path &filename,
+                                                  const fs::path &source) {
+  std::error_code ec;
+  const fs::path temp_path = temporaryPath(filename);
+  fs::copy_file(source, temp_path, ec);
+  if (ec) {
+    LOG_AT(debug) << "failed to copy " << source << " to " << temp_path
+                  << " because " << ec;
+    fs::remove(temp_path, ec);
+    return std::nullopt;
+  }
+  return temp_path;
+}
+
+bool FileSystem::write(const fs::path &filename, const std::string &data) {
+  std::lock_guard<std::mutex> lk(lockFor(filename));
+  std::optional<fs::path> temp_path = writeTemporary(filename, data);
+  if (!temp_path.has_value()) {
+    return false;
+  }
+
+  // Atomically replaces any existing file
+  std::error_code ec;
+  fs::rename(temp_path.value(), filename, ec);
+  if (ec) {
+    LOG_AT(debug)
+        << "failed to move " << temp_path.value() << " to " << filename
+        << " because " << ec;
+    fs::remove(temp_path.value(), ec);
+    return false;
+  }
+  return true;
+}
+
+bool FileSystem::create(const fs::path &filename, const std::string &data) {
+  std::lock_guard<std::mutex> lk(lockFor(filename));
+  std::optional<fs::path> temp_path = writeTemporary(filename, data);
+  if (!temp_path.has_value()) {
+    return false;
+  }
+
+  // Unlike a rename, linking fails if the destination already exists, even
+  // if another process created it
+  std::error_code ec;
+  fs::create_hard_link(temp_path.value(), filename, ec);
+  if (ec) {
+    LOG_AT(debug) << "failed to create " << filename << " because "
+                  << ec;
+  }
+  bool created = !ec;
+  fs::remove(temp_path.value(), ec);
+  return created;
+}
+
+bool FileSystem::writeFrom(const fs::path &filename, const fs::path &source) {
+  std::lock_guard<std::mutex> lk(lockFor(filename));
+  if (!prepareFile(filename)) {
+    return false;
+  }
+
+  // Atomically replaces any existing file, without copying a byte
+  std::error_code ec;
+  fs::rename(source, filename, ec);
+  if (ec == std::errc::cross_device_link) {
+    std::optional<fs::path> temp_path = copyTemporary(filename, source);
+    if (!temp_path.has_value()) {
+      return false;
+    }
+    fs::rename(temp_path.value(), filename, ec);
+    std::error_code ignored;
+    fs::remove(ec ? temp_path.value() : source, ignored);
+  }
+  if (ec) {
+    LOG_AT(debug) << "failed to move " << source << " to " << filename
+                  << " because " << ec;
+    return false;
+  }
+  return true;
+}
+
+bool FileSystem::createFrom(const fs::path &filename, const fs::path &source) {
+  std::lock_guard<std::mutex> lk(lockFor(filename));
+  if (!prepareFile(filename)) {
+    return false;
+  }
+
+  // As in create(), linking fails if the destination already exists. The
+  // source is then left where it is, to be stored somewhere else.
+  std::error_code ec;
+  std::optional<fs::path> temp_path;
+  fs::create_hard_link(source, filename, ec);
+  if (ec == std::errc::cross_device_link) {
+    temp_path = copyTemporary(filename, source);
+    if (!temp_path.has_value()) {
+      return false;
+    }
+    fs::create_hard_link(temp_path.value(), filename, ec);
+  }
+  std::error_code ignored;
+  if (temp_path.has_value()) {
+    fs::remove(temp_path.value(), ignored);
+  }
+  if (ec) {
+    LOG_AT(debug) << "failed to create " << filename << " because " << ec;
+    return false;
+  }
+  fs::remove(source, ignored);
   return true;
 }
 
 bool FileSystem::remove(const fs::path &filename) {
-  std::lock_guard<std::recursive_mutex> lk(mtx_);
+  std::lock_guard<std::mutex> lk(lockFor(filename));
   if (!is_regular_file(filename)) {
-    BOOST_LOG_TRIVIAL(debug) << "couldn't delete " << filename
-                             << " because it is not a regular file";
+    LOG_AT(debug) << "couldn't delete " << filename
+                  << " because it is not a regular file";
     return false;
   }
 
   std::error_code ec;
   bool removed = fs::remove(filename, ec);
   if (ec) {
-    BOOST_LOG_TRIVIAL(debug) << "couldn't delete regular file " << filename;
+    LOG_AT(debug) << "couldn't delete regular file " << filename;
     return false;
   }
   return removed;
 }
 
 bool FileSystem::is_regular_file(const fs::path &path) const {
-  std::lock_guard<std::recursive_mutex> lk(mtx_);
   std::error_code ec;
   bool is_regular_file = fs::is_regular_file(path, ec);
   if (ec) {
-    BOOST_LOG_TRIVIAL(debug)
+    LOG_AT(debug)
         << "failed to check if " << path << " is a regular file because " << ec;
     return false;
   }
@@ -123,11 +291,10 @@ bool FileSystem::is_regular_file(const fs::path &path) const {
 }
 
 bool FileSystem::is_directory(const fs::path &path) const {
-  std::lock_guard<std::recursive_mutex> lk(mtx_);
   std::error_code ec;
   bool is_directory = fs::is_directory(path, ec);
   if (ec) {
-    BOOST_LOG_TRIVIAL(debug)
+    LOG_AT(debug)
         << "failed to check if " << path << " is a directory because " << ec;
     return false;
   }
@@ -135,11 +302,10 @@ bool FileSystem::is_directory(const fs::path &path) const {
 }
 
 bool FileSystem::create_directories(const fs::path &path) {
-  std::lock_guard<std::recursive_mutex> lk(mtx_);
   std::error_code ec;
   bool created = fs::create_directories(path, ec);
   if (ec) {
-    BOOST_LOG_TRIVIAL(debug)
+    LOG_AT(debug)
         << "failed to create directories at " << path << " because " << ec;
     return false;
   }
@@ -0,0 +1,587 @@
+#include "filesystem/log_filesystem.h"
+#include "log_severity.h"
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/log/trivial.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Every record is a header followed by the key and value bytes:
+//   uint32 key size | uint32 value size | uint8 record type |
+//   int64 modification time, in file clock ticks since its epoch
+// The time is kept so a file's stat survives recovery and compaction.
+const size_t RECORD_HEADER_SIZE = 17;
+
+const std::string SEGMENT_PREFIX = "segment-";
+const std::string SEGMENT_SUFFIX = ".log";
+
+// Segment ids are zero padded so the files list in log order
+std::string segmentName(uint64_t id) {
+  std::string number = std::to_string(id);
+  if (number.size() < 6) {
+    number.insert(0, 6 - number.size(), '0');
+  }
+  return SEGMENT_PREFIX + number + SEGMENT_SUFFIX;
+}
+
+// Return the id of a segment file name, or nullopt if it isn't one
+std::optional<uint64_t> segmentId(const std::string &name) {
+  if (name.size() <= SEGMENT_PREFIX.size() + SEGMENT_SUFFIX.size() ||
+      name.rfind(SEGMENT_PREFIX, 0) != 0 ||
+      name.compare(name.size() - SEGMENT_SUFFIX.size(), SEGMENT_SUFFIX.size(),
+                   SEGMENT_SUFFIX) != 0) {
+    return std::nullopt;
+  }
+  const std::string number = name.substr(
+      SEGMENT_PREFIX.size(),
+      name.size() - SEGMENT_PREFIX.size() - SEGMENT_SUFFIX.size());
+  if (!std::all_of(number.begin(), number.end(), ::isdigit)) {
+    return std::nullopt;
+  }
+  return std::stoull(number);
+}
+
+bool startsWith(const std::string &value, const std::string &prefix) {
+  return value.compare(0, prefix.size(), prefix) == 0;
+}
+
+// pread/pwrite the whole buffer, retrying short transfers
+bool readFully(int fd, char *data, size_t size, uint64_t offset) {
+  while (size > 0) {
+    ssize_t count = ::pread(fd, data, size, offset);
+    if (count <= 0) {
+      return false;
+    }
+    data += count;
+    size -= count;
+    offset += count;
+  }
+  return true;
+}
+
+bool writeFully(int fd, const char *data, size_t size, uint64_t offset) {
+  while (size > 0) {
+    ssize_t count = ::pwrite(fd, data, size, offset);
+    if (count <= 0) {
+      return false;
+    }
+    data += count;
+    size -= count;
+    offset += count;
+  }
+  return true;
+}
+
+} // namespace
+
+LogFileSystem::Segment::~Segment() {
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+LogFileSystem::LogFileSystem(const fs::path &root, size_t segment_size)
+    : segment_size_(segment_size) {
+  std::string normal_root = root.lexically_normal().string();
+  while (normal_root.size() > 1 && normal_root.back() == '/') {
+    normal_root.pop_back();
+  }
+  root_ = normal_root;
+  recover();
+  compaction_thread_ = std::thread([this] { compactionLoop(); });
+}
+
+LogFileSystem::~LogFileSystem() {
+  {
+    std::lock_guard<std::mutex> lock(compaction_mutex_);
+    stopping_ = true;
+  }
+  compaction_cv_.notify_one();
+  compaction_thread_.join();
+  // Get the last appends onto the disk before going away
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  if (active_ != nullptr && ::fdatasync(active_->fd) != 0) {
+    BOOST_LOG_TRIVIAL(warning) << "Failed to sync " << active_->path;
+  }
+}
+
+std::shared_ptr<LogFileSystem> LogFileSystem::Open(const fs::path &root) {
+  std::error_code error;
+  std::string key = fs::weakly_canonical(root, error).string();
+  if (error) {
+    key = root.lexically_normal().string();
+  }
+  std::lock_guard<std::mutex> lock(open_mutex_);
+  std::shared_ptr<LogFileSystem> filesystem = open_[key].lock();
+  if (filesystem == nullptr) {
+    filesystem = std::make_shared<LogFileSystem>(root);
+    open_[key] = filesystem;
+  }
+  return filesystem;
+}
+
+std::optional<std::string> LogFileSystem::keyFor(const fs::path &path) const {
+  std::string normal_path = path.lexically_normal().string();
+  while (normal_path.size() > 1 && normal_path.back() == '/') {
+    normal_path.pop_back();
+  }
+  const std::string key = fs::path(normal_path).lexically_relative(root_);
+  if (key.empty() || key == ".." || startsWith(key, "../")) {
+    LOG_AT(debug) << path << " is outside of " << root_;
+    return std::nullopt;
+  }
+  if (key == ".") {
+    return "";
+  }
+  return key;
+}
+
+void LogFileSystem::recover() {
+  std::error_code ec;
+  fs::create_directories(root_, ec);
+  if (ec) {
+    BOOST_LOG_TRIVIAL(error)
+        << "failed to create log directory " << root_ << " because " << ec;
+    return;
+  }
+
+  std::vector<uint64_t> ids;
+  for (const auto &dir_entry : fs::directory_iterator{root_, ec}) {
+    std::optional<uint64_t> id =
+        segmentId(dir_entry.path().filename().string());
+    if (id.has_value()) {
+      ids.push_back(id.value());
+    }
+  }
+  std::sort(ids.begin(), ids.end());
+
+  for (uint64_t id : ids) {
+    std::shared_ptr<Segment> segment = openSegment(id, false);
+    if (!segment) {
+      continue;
+    }
+    segments_[id] = segment;
+    uint64_t valid_size = replay(*segment);
+    if (valid_size < segment->size) {
+      BOOST_LOG_TRIVIAL(warning)
+          << "discarding " << segment->size - valid_size
+          << " bytes of incomplete records at the end of " << segment->path;
+      if (::ftruncate(segment->fd, valid_size) != 0) {
+        BOOST_LOG_TRIVIAL(error) << "failed to truncate " << segment->path;
+      }
+      segment->size = valid_size;
+    }
+  }
+
+  // Keep appending to the newest segment while it has room
+  if (!segments_.empty() && segments_.rbegin()->second->size < segment_size_) {
+    active_ = segments_.rbegin()->second;
+    return;
+  }
+  uint64_t id = segments_.empty() ? 1 : segments_.rbegin()->first + 1;
+  active_ = openSegment(id, true);
+  if (active_) {
+    segments_[id] = active_;
+  }
+}
+
+uint64_t LogFileSystem::replay(Segment &segment) {
+  std::string data(segment.size, '\0');
+  if (!readFully(segment.fd, data.data(), data.size(), 0)) {
+    BOOST_LOG_TRIVIAL(error) << "failed to read " << segment.path;
+    return 0;
+  }
+
+  uint64_t offset = 0;
+  while (offset + RECORD_HEADER_SIZE <= data.size()) {
+    uint32_t key_size, value_size;
+    memcpy(&key_size, &data[offset], sizeof(key_size));
+    memcpy(&value_size, &data[offset + 4], sizeof(value_size));
+    RecordType type = static_cast<RecordType>(data[offset + 8]);
+    int64_t ticks;
+    memcpy(&ticks, &data[offset + 9], sizeof(ticks));
+    uint64_t record_size = RECORD_HEADER_SIZE + key_size + value_size;
+    if (offset + record_size > data.size() ||
+        (type != RECORD_PUT && type != RECORD_DELETE)) {
+      break;
+    }
+    const std::string key =
+        data.substr(offset + RECORD_HEADER_SIZE, key_size);
+
+    auto existing = index_.find(key);
+    if (existing != index_.end()) {
+      markDead(existing->second);
+    }
+    if (type == RECORD_PUT) {
+      index_[key] = Location{
+          segment.id, offset, static_cast<uint32_t>(record_size), value_size,
+          fs::file_time_type(fs::file_time_type::duration(ticks))};
+    } else {
+      index_.erase(key);
+      segment.dead_bytes += record_size;
+    }
+    offset += record_size;
+  }
+  return offset;
+}
+
+std::shared_ptr<LogFileSystem::Segment>
+LogFileSystem::openSegment(uint64_t id, bool create) {
+  std::shared_ptr<Segment> segment = std::make_shared<Segment>();
+  segment->id = id;
+  segment->path = root_ / segmentName(id);
+  int flags = create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR;
+  segment->fd = ::open(segment->path.c_str(), flags | O_CLOEXEC, 0644);
+  if (segment->fd < 0) {
+    BOOST_LOG_TRIVIAL(error) << "failed to open segment " << segment->path
+                             << ": " << strerror(errno);
+    return nullptr;
+  }
+  off_t size = ::lseek(segment->fd, 0, SEEK_END);
+  segment->size = size < 0 ? 0 : size;
+  return segment;
+}
+
+bool LogFileSystem::exists(const fs::path &path) const {
+  std::optional<std::string> key = keyFor(path);
+  if (!key.has_value()) {
+    return false;
+  }
+  std::shared_lock<std::shared_mutex> lock(index_mutex_);
+  return index_.count(key.value()) > 0 || isDirectory(key.value());
+}
+
+std::optional<std::vector<fs::path>>
+LogFileSystem::list(const fs::path &directory) const {
+  std::optional<std::string> key = keyFor(directory);
+  if (!key.has_value()) {
+    return std::nullopt;
+  }
+  std::shared_lock<std::shared_mutex> lock(index_mutex_);
+  if (!isDirectory(key.value())) {
+    LOG_AT(debug) << directory << " is not a directory";
+    return std::nullopt;
+  }
+
+  // Files in a directory are contiguous in the sorted index
+  const std::string prefix = key->empty() ? "" : key.value() + "/";
+  std::vector<fs::path> files;
+  for (auto it = index_.lower_bound(prefix);
+       it != index_.end() && startsWith(it->first, prefix); ++it) {
+    // Skip files in subdirectories
+    if (it->first.find('/', prefix.size()) == std::string::npos) {
+      files.push_back(root_ / it->first);
+    }
+  }
+  return files;
+}
+
+FILE_TYPE LogFileSystem::fileType(std::string file_name) const {
+  std::string file_extension =
+      boost::filesystem::path(file_name).extension().string();
+  if (FILE_TYPE_MAP.find(file_extension) == FILE_TYPE_MAP.end()) {
+    return NO_MATCHING_TYPE;
+  } else {
+    return FILE_TYPE_MAP.find(file_extension)->second;
+  }
+}
+
+std::optional<std::string> LogFileSystem::read(const fs::path &filename) const {
+  std::optional<std::string> key = keyFor(filename);
+  if (!key.has_value()) {
+    return std::nullopt;
+  }
+  Location location;
+  std::shared_ptr<Segment> segment;
+  {
+    std::shared_lock<std::shared_mutex> lock(index_mutex_);
+    auto it = index_.find(key.value());
+    if (it == index_.end()) {
+      LOG_AT(debug) << filename << " doesn't exist";
+      return std::nullopt;
+    }
+    location = it->second;
+    segment = segments_.at(location.segment_id);
+  }
+
+  // Records are never modified once written, and the segment stays open while
+  // we hold it even if compaction deletes it, so no lock is needed to read
+  std::string data(location.value_size, '\0');
+  if (!readFully(segment->fd, data.data(), data.size(),
+                 location.record_offset + RECORD_HEADER_SIZE + key->size())) {
+    BOOST_LOG_TRIVIAL(error) << "failed to read " << filename << " from "
+                             << segment->path;
+    return std::nullopt;
+  }
+  return data;
+}
+
+std::optional<FileStat> LogFileSystem::stat(const fs::path &filename) const {
+  std::optional<std::string> key = keyFor(filename);
+  if (!key.has_value()) {
+    return std::nullopt;
+  }
+  std::shared_lock<std::shared_mutex> lock(index_mutex_);
+  auto it = index_.find(key.value());
+  if (it == index_.end()) {
+    return std::nullopt;
+  }
+  return FileStat{it->second.value_size, it->second.last_write_time};
+}
+
+bool LogFileSystem::write(const fs::path &filename, const std::string &data) {
+  std::optional<std::string> key = keyFor(filename);
+  if (!key.has_value() || key->empty() || !filename.has_filename()) {
+    LOG_AT(debug) << filename << " doesn't refer to a file";
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  return append(RECORD_PUT, key.value(), data);
+}
+
+bool LogFileSystem::create(const fs::path &filename, const std::string &data) {
+  std::optional<std::string> key = keyFor(filename);
+  if (!key.has_value() || key->empty() || !filename.has_filename()) {
+    LOG_AT(debug) << filename << " doesn't refer to a file";
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  {
+    std::shared_lock<std::shared_mutex> index_lock(index_mutex_);
+    if (index_.count(key.value()) > 0) {
+      LOG_AT(debug) << "failed to create " << filename
+                    << " because it already exists";
+      return false;
+    }
+  }
+  return append(RECORD_PUT, key.value(), data);
+}
+
+bool LogFileSystem::remove(const fs::path &filename) {
+  std::optional<std::string> key = keyFor(filename);
+  if (!key.has_value()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  {
+    std::shared_lock<std::shared_mutex> index_lock(index_mutex_);
+    if (index_.count(key.value()) == 0) {
+      LOG_AT(debug) << "couldn't delete " << filename
+                    << " because it doesn't exist";
+      return false;
+    }
+  }
+  return append(RECORD_DELETE, key.value(), "");
+}
+
+bool LogFileSystem::is_directory(const fs::path &path) const {
+  std::optional<std::string> key = keyFor(path);
+  if (!key.has_value()) {
+    return false;
+  }
+  std::shared_lock<std::shared_mutex> lock(index_mutex_);
+  return isDirectory(key.value());
+}
+
+bool LogFileSystem::create_directories(const fs::path &path) {
+  // Directories come into existence with the first file written below them
+  return keyFor(path).has_value();
+}
+
+bool LogFileSystem::isDirectory(const std::string &key) const {
+  if (key.empty()) {
+    return true;
+  }
+  const std::string prefix = key + "/";
+  auto it = index_.lower_bound(prefix);
+  return it != index_.end() && startsWith(it->first, prefix);
+}
+
+bool LogFileSystem::append(RecordType type, const std::string &key,
+                           const std::string &value,
+                           std::optional<fs::file_time_type> last_write_time) {
+  if (!active_) {
+    BOOST_LOG_TRIVIAL(error) << "no segment in " << root_ << " to write to";
+    return false;
+  }
+  const uint64_t record_size = RECORD_HEADER_SIZE + key.size() + value.size();
+
+  // Seal the active segment once the record would overflow it
+  if (active_->size > 0 && active_->size + record_size > segment_size_) {
+    std::shared_ptr<Segment> next = openSegment(active_->id + 1, true);
+    if (!next) {
+      return false;
+    }
+    {
+      std::unique_lock<std::shared_mutex> lock(index_mutex_);
+      segments_[next->id] = next;
+    }
+    active_ = next;
+    requestCompaction();
+  }
+
+  const fs::file_time_type modified =
+      last_write_time.value_or(fs::file_time_type::clock::now());
+  std::string record(RECORD_HEADER_SIZE, '\0');
+  uint32_t key_size = key.size();
+  uint32_t value_size = value.size();
+  int64_t ticks = modified.time_since_epoch().count();
+  memcpy(&record[0], &key_size, sizeof(key_size));
+  memcpy(&record[4], &value_size, sizeof(value_size));
+  record[8] = type;
+  memcpy(&record[9], &ticks, sizeof(ticks));
+  record += key;
+  record += value;
+
+  const uint64_t offset = active_->size;
+  if (!writeFully(active_->fd, record.data(), record.size(), offset)) {
+    BOOST_LOG_TRIVIAL(error) << "failed to append to " << active_->path << ": "
+                             << strerror(errno);
+    return false;
+  }
+  active_->size += record_size;
+
+  std::unique_lock<std::shared_mutex> lock(index_mutex_);
+  auto existing = index_.find(key);
+  if (existing != index_.end()) {
+    markDead(existing->second);
+  }
+  if (type == RECORD_PUT) {
+    index_[key] = Location{active_->id, offset,
+                           static_cast<uint32_t>(record_size), value_size,
+                           modified};
+  } else {
+    index_.erase(key);
+    active_->dead_bytes += record_size;
+  }
+  return true;
+}
+
+void LogFileSystem::markDead(const Location &location) {
+  auto it = segments_.find(location.segment_id);
+  if (it != segments_.end()) {
+    it->second->dead_bytes += location.record_size;
+  }
+}
+
+void LogFileSystem::compact() {
+  std::lock_guard<std::mutex> run_lock(compact_run_mutex_);
+  // Every segment but the newest, which is still being appended to
+  std::vector<std::shared_ptr<Segment>> sealed;
+  uint64_t size = 0;
+  uint64_t dead_bytes = 0;
+  {
+    std::shared_lock<std::shared_mutex> lock(index_mutex_);
+    for (const auto &[id, segment] : segments_) {
+      if (id != segments_.rbegin()->first) {
+        sealed.push_back(segment);
+        size += segment->size;
+        dead_bytes += segment->dead_bytes;
+      }
+    }
+  }
+  if (sealed.empty() || dead_bytes * 2 < size) {
+    return;
+  }
+  LOG_AT(debug) << "merging " << sealed.size() << " segments in "
+                << root_ << " (" << dead_bytes << " of " << size
+                << " bytes are garbage)";
+
+  for (const std::shared_ptr<Segment> &segment : sealed) {
+    if (!copyLiveRecords(*segment)) {
+      return;
+    }
+  }
+  // Removals aren't copied, so the files they removed must go first: delete
+  // oldest first, in case we crash part way through
+  for (const std::shared_ptr<Segment> &segment : sealed) {
+    {
+      std::lock_guard<std::mutex> lock(write_mutex_);
+      std::unique_lock<std::shared_mutex> index_lock(index_mutex_);
+      segments_.erase(segment->id);
+    }
+    std::error_code ec;
+    fs::remove(segment->path, ec);
+    if (ec) {
+      BOOST_LOG_TRIVIAL(error) << "failed to delete merged segment "
+                               << segment->path << " because " << ec;
+    }
+  }
+}
+
+bool LogFileSystem::copyLiveRecords(const Segment &segment) {
+  // Sealed segments never change, so they can be read without locking
+  std::string data(segment.size, '\0');
+  if (!readFully(segment.fd, data.data(), data.size(), 0)) {
+    BOOST_LOG_TRIVIAL(error) << "failed to read " << segment.path
+                             << " for compaction";
+    return false;
+  }
+
+  uint64_t offset = 0;
+  while (offset + RECORD_HEADER_SIZE <= data.size()) {
+    uint32_t key_size, value_size;
+    memcpy(&key_size, &data[offset], sizeof(key_size));
+    memcpy(&value_size, &data[offset + 4], sizeof(value_size));
+    const uint64_t record_size = RECORD_HEADER_SIZE + key_size + value_size;
+    const std::string key =
+        data.substr(offset + RECORD_HEADER_SIZE, key_size);
+
+    // Writes may race with compaction, so liveness is checked under the write
+    // lock, right before copying. A record is live if the index still points
+    // at it, which is never the case for removals.
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    std::optional<fs::file_time_type> last_write_time;
+    {
+      std::shared_lock<std::shared_mutex> index_lock(index_mutex_);
+      auto it = index_.find(key);
+      if (it != index_.end() && it->second.segment_id == segment.id &&
+          it->second.record_offset == offset) {
+        last_write_time = it->second.last_write_time;
+      }
+    }
+    if (last_write_time.has_value() &&
+        !append(RECORD_PUT, key,
+                data.substr(offset + RECORD_HEADER_SIZE + key_size, value_size),
+                last_write_time)) {
+      BOOST_LOG_TRIVIAL(error) << "failed to compact " << segment.path;
+      return false;
+    }
+    offset += record_size;
+  }
+  return true;
+}
+
+size_t LogFileSystem::segmentCount() const {
+  std::shared_lock<std::shared_mutex> lock(index_mutex_);
+  return segments_.size();
+}
+
+void LogFileSystem::requestCompaction() {
+  {
+    std::lock_guard<std::mutex> lock(compaction_mutex_);
+    compaction_requested_ = true;
+  }
+  compaction_cv_.notify_one();
+}
+
+void LogFileSystem::compactionLoop() {
+  while (true) {
+    std::unique_lock<std::mutex> lock(compaction_mutex_);
+    compaction_cv_.wait(lock,
+                        [this] { return stopping_ || compaction_requested_; });
+    if (stopping_) {
+      return;
+    }
+    compaction_requested_ = false;
+    lock.unlock();
+    compact();
+  }
+}
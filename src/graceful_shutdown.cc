@@ -0,0 +1,72 @@
+#include "graceful_shutdown.h"
+#include "blocking_executor.h"
+#include <boost/log/trivial.hpp>
+#include <csignal>
+
+GracefulShutdown::GracefulShutdown(IoServicePool &io_services,
+                                   std::vector<server *> servers,
+                                   std::chrono::seconds timeout)
+    : io_services_(io_services), servers_(std::move(servers)),
+      timeout_(timeout), signals_(io_services.get(0), SIGINT, SIGTERM),
+      drain_timer_(io_services.get(0)) {
+  signals_.async_wait([this](const boost::system::error_code &error,
+                             int signal_number) {
+    handle_signal(error, signal_number);
+  });
+}
+
+void GracefulShutdown::handle_signal(const boost::system::error_code &error,
+                                     int signal_number) {
+  if (error) {
+    return;
+  }
+  BOOST_LOG_TRIVIAL(info) << "Received termination signal (" << signal_number
+                          << "), shutting down";
+  start();
+}
+
+void GracefulShutdown::start() {
+  // Runs on the first io_service, like the signal handler
+  boost::asio::dispatch(io_services_.get(0), [this] {
+    if (started_) {
+      return;
+    }
+    started_ = true;
+    deadline_ = std::chrono::steady_clock::now() + timeout_;
+    for (server *s : servers_) {
+      s->stop();
+    }
+    SessionRegistry::GetInstance().shutdownAll();
+    wait_for_drain();
+  });
+}
+
+bool GracefulShutdown::drained() const { return drained_; }
+
+void GracefulShutdown::wait_for_drain() {
+  drain_timer_.expires_after(GRACEFUL_SHUTDOWN_POLL_INTERVAL);
+  drain_timer_.async_wait([this](const boost::system::error_code &error) {
+    handle_drain_check(error);
+  });
+}
+
+void GracefulShutdown::handle_drain_check(const boost::system::error_code &error) {
+  if (error) {
+    return;
+  }
+  size_t sessions = SessionRegistry::GetInstance().size();
+  size_t pending = BlockingExecutor::GetInstance().pending();
+  if (sessions == 0 && pending == 0) {
+    BOOST_LOG_TRIVIAL(info) << "All connections drained";
+    drained_ = true;
+  } else if (std::chrono::steady_clock::now() >= deadline_) {
+    BOOST_LOG_TRIVIAL(warning)
+        << "Shutdown timed out with " << sessions << " connections and "
+        << pending << " handlers still running";
+  } else {
+    wait_for_drain();
+    return;
+  }
+  signals_.cancel();
+  io_services_.stop();
+}
@@ -0,0 +1,80 @@
+#include "handler_pool.h"
+#include "log_severity.h"
+#include <algorithm>
+#include <boost/log/trivial.hpp>
+#include <string>
+#include <utility>
+
+HandlerPool::Lease::Lease(HandlerPool *pool, RequestHandler *handler)
+    : pool_(pool), handler_(handler) {}
+
+HandlerPool::Lease::Lease(Lease &&other)
+    : pool_(other.pool_), handler_(other.handler_) {
+  other.pool_ = nullptr;
+  other.handler_ = nullptr;
+}
+
+HandlerPool::Lease::~Lease() {
+  if (pool_ != nullptr) {
+    pool_->release(handler_);
+  }
+}
+
+HandlerPool::HandlerPool(RequestHandlerFactory factory, bool thread_safe,
+                         std::string path,
+                         std::unordered_map<std::string, std::string> args,
+                         size_t pool_size)
+    : factory_(std::move(factory)), path_(std::move(path)),
+      args_(std::move(args)) {
+  // A plain decimal number, checked by NginxConfig::findLocations
+  auto body_limit = args_.find(BODY_LIMIT_ARG);
+  if (body_limit != args_.end()) {
+    body_limit_ = std::stoull(body_limit->second);
+  }
+
+  if (thread_safe) {
+    shared_.reset(factory_(path_, args_));
+    upload_directory_ = shared_->uploadDirectory();
+    return;
+  }
+  for (size_t i = 0; i < std::max<size_t>(pool_size, 1); i++) {
+    instances_.emplace_back(factory_(path_, args_));
+    idle_.push_back(instances_.back().get());
+  }
+  upload_directory_ = instances_.front()->uploadDirectory();
+}
+
+std::unique_ptr<HandlerPool>
+HandlerPool::Create(const std::string &handler_name, std::string path,
+                    std::unordered_map<std::string, std::string> args,
+                    size_t pool_size) {
+  const Registry &registry = Registry::GetInstance();
+  std::unique_ptr<HandlerPool> pool = std::make_unique<HandlerPool>(
+      registry.initializer_map_.at(handler_name),
+      registry.thread_safe_map_.at(handler_name), path, std::move(args),
+      pool_size);
+  pool->metrics_ = &Metrics::GetInstance().series(path, handler_name);
+  return pool;
+}
+
+HandlerPool::Lease HandlerPool::acquire() {
+  if (shared_) {
+    return Lease(nullptr, shared_.get());
+  }
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (idle_.empty()) {
+    LOG_AT(debug) << "Handler pool for " << path_
+                  << " exhausted, growing to "
+                  << instances_.size() + 1 << " instances";
+    instances_.emplace_back(factory_(path_, args_));
+    return Lease(this, instances_.back().get());
+  }
+  RequestHandler *handler = idle_.back();
+  idle_.pop_back();
+  return Lease(this, handler);
+}
+
+void HandlerPool::release(RequestHandler *handler) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  idle_.push_back(handler);
+}
@@ -1,79 +1,275 @@
 #include "handlers/crud_handler.h"
 #include "filesystem/filesystem.h"
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/property_tree/ptree.hpp>
+#include "filesystem/log_filesystem.h"
+#include "json.h"
+#include "log_severity.h"
+#include <algorithm>
+#include <charconv>
+#include <fcntl.h>
 #include <filesystem>
 #include <memory>
 #include <optional>
+#include <stdexcept>
 #include <string>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <vector>
 
 namespace fs = std::filesystem;
-namespace pt = boost::property_tree;
+
+namespace {
+
+// The value of the query parameter `name`, with any %XX escapes decoded and
+// each + taken as a space, as in a form, or nullopt if the query doesn't have
+// it
+std::optional<std::string> queryParam(std::string_view query,
+                                      std::string_view name) {
+  while (!query.empty()) {
+    size_t end = query.find('&');
+    std::string_view param = query.substr(0, end);
+    query = end == std::string_view::npos ? "" : query.substr(end + 1);
+    size_t equals = param.find('=');
+    if (param.substr(0, equals) != name) {
+      continue;
+    }
+    std::string_view raw =
+        equals == std::string_view::npos ? "" : param.substr(equals + 1);
+    std::string value;
+    for (size_t i = 0; i < raw.size(); i++) {
+      unsigned int byte = 0;
+      if (raw[i] == '+') {
+        value += ' ';
+      } else if (raw[i] == '%' && i + 2 < raw.size() &&
+          std::from_chars(raw.data() + i + 1, raw.data() + i + 3, byte, 16)
+                  .ptr == raw.data() + i + 3) {
+        value += static_cast<char>(byte);
+        i += 2;
+      } else {
+        value += raw[i];
+      }
+    }
+    return value;
+  }
+  return std::nullopt;
+}
+
+// Whether the request's body, or the file it was streamed to, is a
+// well-formed JSON document. A streamed body is mapped rather than read in.
+bool validBody(const http_request &request, const UploadedBody *upload) {
+  if (upload == nullptr) {
+    return validJson(request.body());
+  }
+  if (upload->size() == 0) {
+    return validJson("");
+  }
+  int fd = ::open(upload->path().c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  void *data = ::mmap(nullptr, upload->size(), PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  bool valid =
+      validJson(std::string_view(static_cast<const char *>(data), upload->size()));
+  ::munmap(data, upload->size());
+  return valid;
+}
+
+// Writes out a listing from an index a chunk of records at a time. A listing
+// cut short by its limit ends with the cursor to continue from.
+class ListingWriter {
+public:
+  ListingWriter(std::shared_ptr<RecordIndex> index, std::string cursor,
+                std::optional<size_t> limit)
+      : index_(std::move(index)), after_(std::move(cursor)), remaining_(limit) {}
+
+  // The next chunk of the listing, or an empty string once it is done
+  std::string operator()() {
+    if (done_) {
+      return {};
+    }
+    if (!started_) {
+      json_.beginObject();
+      json_.key("files");
+      json_.beginArray();
+      started_ = true;
+    }
+    size_t want = CRUD_HANDLER_LIST_CHUNK;
+    if (remaining_.has_value()) {
+      want = std::min(want, remaining_.value());
+    }
+    bool more = false;
+    std::vector<std::string> names = index_->page(after_, want, more);
+    for (const std::string &name : names) {
+      json_.string(name);
+    }
+    if (!names.empty()) {
+      after_ = names.back();
+    }
+    if (remaining_.has_value()) {
+      remaining_.value() -= names.size();
+    }
+    if (!more || remaining_ == 0) {
+      json_.endArray();
+      if (more) {
+        json_.key("next");
+        json_.string(after_);
+      }
+      json_.endObject();
+      done_ = true;
+    }
+    return json_.take();
+  }
+
+  bool done() const { return done_; }
+
+private:
+  std::shared_ptr<RecordIndex> index_;
+  // the last record written, or the cursor the listing started from
+  std::string after_;
+  std::optional<size_t> remaining_;
+  JsonWriter json_;
+  bool started_ = false;
+  bool done_ = false;
+};
+
+} // namespace
 
 CrudHandler::CrudHandler(std::string path,
                          std::unordered_map<std::string, std::string> args,
-                         std::unique_ptr<FileSystemInterface> filesystem)
+                         std::shared_ptr<FileSystemInterface> filesystem)
     : path_(path), data_path_(args.at(CRUD_HANDLER_DATA_PATH_ARG)),
-      filesystem_(std::move(filesystem)) {}
+      filesystem_(std::move(filesystem)),
+      cache_control_(args[CACHE_CONTROL_ARG]),
+      validate_json_(args[CRUD_HANDLER_VALIDATE_JSON_ARG] == "true") {}
 
 http_response CrudHandler::handle_request(const http_request &request) {
-  BOOST_LOG_TRIVIAL(debug) << "Handling CRUD request";
+  return std::get<http_response>(handle(request, nullptr, false));
+}
+
+http_response_variant CrudHandler::serve(const http_request &request) {
+  // HTTP/1.0 has no chunked encoding
+  return handle(request, nullptr, request.version() >= 11);
+}
+
+std::optional<fs::path> CrudHandler::uploadDirectory() const {
+  return fs::path(data_path_) / UPLOAD_DIRECTORY;
+}
+
+http_response CrudHandler::handle_upload(const http_request &request,
+                                         const UploadedBody &body) {
+  return std::get<http_response>(handle(request, &body, false));
+}
+
+http_response_variant CrudHandler::handle(const http_request &request,
+                                          const UploadedBody *upload,
+                                          bool stream) {
+  LOG_AT(debug) << "Handling CRUD request";
 
   // Get the "true" target path by replacing the api prefix with the actual
-  // filesystem path that the handler is mounted to
-  const std::string target_suffix =
-      std::string(request.target()).substr(path_.size());
+  // filesystem path that the handler is mounted to, leaving off any query
+  const std::string_view request_target(request.target().data(),
+                                        request.target().size());
+  const size_t query_start = request_target.find('?');
+  const std::string_view query =
+      query_start == std::string_view::npos
+          ? ""
+          : request_target.substr(query_start + 1);
+  const std::string target_suffix(
+      request_target.substr(0, query_start).substr(path_.size()));
   const fs::path target = data_path_ + target_suffix;
 
+  if (validate_json_ &&
+      (request.method() == boost::beast::http::verb::post ||
+       request.method() == boost::beast::http::verb::put) &&
+      !validBody(request, upload)) {
+    log_handle_request_details(request.target(), "CrudHandler", BAD_REQUEST_STATUS);
+    LOG_AT(debug) << "CRUD handler refusing to store malformed JSON at "
+                  << target;
+    return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN);
+  }
+
   if (request.method() == boost::beast::http::verb::get) {
-    return handle_get(target);
+    return handle_get(request, target, query, stream);
   } else if (request.method() == boost::beast::http::verb::post &&
                 request.at(boost::beast::http::field::content_type) == "application/json") {
-    return handle_post(target, request.body());
+    return handle_post(target, request, upload);
   } else if (request.method() == boost::beast::http::verb::delete_) {
     return handle_delete(target);
   } else if (request.method() == boost::beast::http::verb::put &&
                 request.at(boost::beast::http::field::content_type) == "application/json") {
-    return handle_put(target, request.body());
+    return handle_put(target, request, upload);
   }
 
   // Unimplemented functionality, return 400
-  log_handle_request_details(std::string(request.target()), "CrudHandler", BAD_REQUEST_STATUS);
-  BOOST_LOG_TRIVIAL(debug) << "CRUD handler doesn't implement "
-                             << request.method() << "; returning BAD_REQUEST";
-  return parseResponse(makeHeader(BAD_REQUEST_STATUS, TEXT_PLAIN, 0));
+  log_handle_request_details(request.target(), "CrudHandler", BAD_REQUEST_STATUS);
+  LOG_AT(debug) << "CRUD handler doesn't implement "
+                << request.method() << "; returning BAD_REQUEST";
+  return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN);
 }
 
 RequestHandler *
 CrudHandler::Init(std::string path,
                   std::unordered_map<std::string, std::string> args) {
-  return new CrudHandler(path, args, std::make_unique<FileSystem>());
+  UploadedBody::removeStale(fs::path(args[CRUD_HANDLER_DATA_PATH_ARG]) /
+                            UPLOAD_DIRECTORY);
+  auto storage = args.find(CRUD_HANDLER_STORAGE_ARG);
+  std::shared_ptr<FileSystemInterface> filesystem;
+  if (storage == args.end() || storage->second == CRUD_HANDLER_STORAGE_FILE) {
+    filesystem = std::make_shared<FileSystem>();
+  } else if (storage->second == CRUD_HANDLER_STORAGE_LOG) {
+    filesystem = LogFileSystem::Open(args[CRUD_HANDLER_DATA_PATH_ARG]);
+  } else {
+    // Falling back to files would hide the records already in a log
+    throw std::invalid_argument("Unknown storage " + storage->second +
+                                " for " + path);
+  }
+  return new CrudHandler(path, args, std::move(filesystem));
 }
 
-http_response CrudHandler::handle_get(const fs::path &path) {
+http_response_variant CrudHandler::handle_get(const http_request &request,
+                                              const fs::path &path,
+                                              std::string_view query,
+                                              bool stream) {
   // for List (no ID given)
   if (filesystem_->is_directory(path)) {
-    return list(path);
+    return list(request, path, query, stream);
   }
 
-  // for ID specific retrieval
-  const std::optional<std::string> body_opt = filesystem_->read(path);
+  // for ID specific retrieval; a client that already has this version of the
+  // record is answered from its stat alone
+  std::optional<FileStat> file_stat = filesystem_->stat(path);
+  std::optional<Validators> validators;
+  if (file_stat.has_value()) {
+    validators = fileValidators(file_stat.value());
+    if (notModified(request, validators.value())) {
+      log_handle_request_details(std::string(path), "CrudHandler", NOT_MODIFIED_STATUS);
+      return notModifiedResponse(validators.value(), cache_control_);
+    }
+  }
+  std::optional<std::string> body_opt = filesystem_->read(path);
   if (!body_opt.has_value()) {
     log_handle_request_details(std::string(path), "CrudHandler", INTERNAL_SERVER_ERROR_STATUS);
     BOOST_LOG_TRIVIAL(warning)
         << "CRUD[GET]: failed to read file at path " << path;
-    return parseResponse(
-        makeHeader(INTERNAL_SERVER_ERROR_STATUS, TEXT_PLAIN, 0));
+    return makeResponse(INTERNAL_SERVER_ERROR_STATUS, TEXT_PLAIN);
   }
 
   log_handle_request_details(std::string(path), "CrudHandler", OK_STATUS);
-  const std::string body = body_opt.value();
-  const std::string header = makeHeader(OK_STATUS, JSON, body.size());
-  return parseResponse(header + body);
+  http_response response =
+      makeResponse(OK_STATUS, JSON, std::move(body_opt.value()));
+  if (validators.has_value()) {
+    setValidators(response, validators.value(), cache_control_);
+  }
+  return response;
 }
 
-http_response CrudHandler::handle_post(const fs::path &path, std::string data) {
+http_response CrudHandler::handle_post(const fs::path &path,
+                                       const http_request &request,
+                                       const UploadedBody *upload) {
   const fs::path data_path{data_path_};
 
   // Remove trailing slash from the path
@@ -91,25 +287,73 @@ http_response CrudHandler::handle_post(const fs::path &path, std::string data) {
     log_handle_request_details(std::string(path), "CrudHandler", BAD_REQUEST_STATUS);
     BOOST_LOG_TRIVIAL(warning)
         << "CRUD[POST]: POST path " << path << " should have only one element ";
-    return parseResponse(makeHeader(BAD_REQUEST_STATUS, TEXT_PLAIN, 0));
+    return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN);
   }
   if (!filesystem_->create_directories(path)) {
     log_handle_request_details(std::string(path), "CrudHandler", BAD_REQUEST_STATUS);
     BOOST_LOG_TRIVIAL(warning)
         << "CRUD[POST]: failing to create directories at path: " << path;
-    return parseResponse(makeHeader(BAD_REQUEST_STATUS, TEXT_PLAIN, 0));
+    return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN);
   }
 
+  // Make a new file in the path with a fresh ID. The file may still exist if
+  // it was created outside of POST (e.g. by a PUT), so skip over those IDs.
+  int newID = allocateId(normal_fs_path);
+  while (!store(normal_fs_path / std::to_string(newID), request, upload, true)) {
+    if (!filesystem_->exists(normal_fs_path / std::to_string(newID))) {
+      log_handle_request_details(std::string(path), "CrudHandler",
+                                 INTERNAL_SERVER_ERROR_STATUS);
+      BOOST_LOG_TRIVIAL(warning)
+          << "CRUD[POST]: failed to create file with ID " << newID
+          << " at path: " << path;
+      return makeResponse(INTERNAL_SERVER_ERROR_STATUS, TEXT_PLAIN);
+    }
+    newID = allocateId(normal_fs_path);
+  }
+  recordIndex(normal_fs_path)->insert(std::to_string(newID));
+
+  // Return the new ID, as a string like the names in a listing
+  JsonWriter json;
+  json.beginObject();
+  json.key("id");
+  json.string(std::to_string(newID));
+  json.endObject();
+  log_handle_request_details(std::string(path), "CrudHandler", OK_STATUS);
+  return makeResponse(OK_STATUS, JSON, json.take());
+}
+
+int CrudHandler::allocateId(const fs::path &entity_path) {
+  const std::string key = entity_path.string();
+  EntityIds *ids = nullptr;
+  {
+    std::shared_lock<std::shared_mutex> lock(entity_ids_mutex_);
+    auto it = entity_ids_.find(key);
+    if (it != entity_ids_.end()) {
+      ids = it->second.get();
+    }
+  }
+  if (ids == nullptr) {
+    std::unique_lock<std::shared_mutex> lock(entity_ids_mutex_);
+    std::unique_ptr<EntityIds> &entry = entity_ids_[key];
+    if (!entry) {
+      entry = std::make_unique<EntityIds>();
+    }
+    ids = entry.get();
+  }
+
+  // Only the first POST to an entity pays for the directory scan
+  std::call_once(ids->recovered, [&] {
+    ids->next_id = maxExistingId(entity_path) + 1;
+  });
+  return ids->next_id.fetch_add(1);
+}
+
+int CrudHandler::maxExistingId(const fs::path &entity_path) {
   const std::optional<std::vector<fs::path>> files_opt =
-      filesystem_->list(path);
+      filesystem_->list(entity_path / "");
   if (!files_opt.has_value()) {
-    log_handle_request_details(std::string(path), "CrudHandler", NOT_FOUND_STATUS);
-    BOOST_LOG_TRIVIAL(debug)
-        << "CRUD[POST]: failed to list files at path: " << path;
-    return parseResponse(
-        makeHeader(NOT_FOUND_STATUS, TEXT_PLAIN, 0));
+    return 0;
   }
-  // Get maximal ID in the path
   int maxID = 0;
   for (const auto &filepath : files_opt.value()) {
     const std::string filename = filepath.filename().string();
@@ -123,21 +367,7 @@ http_response CrudHandler::handle_post(const fs::path &path, std::string data) {
       continue;
     }
   }
-
-  // Increment ID, and make a new file in the path with new ID
-  filesystem_->write(path / std::to_string(maxID + 1), data);
-
-  // Create JSON containing new ID, serialize into string, and return it
-  pt::ptree root, id;
-  root.put("id", maxID + 1);
-  std::stringstream ss;
-  pt::write_json(ss, root);
-
-  // Return response
-  log_handle_request_details(std::string(path), "CrudHandler", OK_STATUS);
-  const std::string body = ss.str();
-  const std::string header = makeHeader(OK_STATUS, JSON, body.size());
-  return parseResponse(header + body);
+  return maxID;
 }
 
 http_response CrudHandler::handle_delete(const fs::path &path) {
@@ -146,25 +376,25 @@ http_response CrudHandler::handle_delete(const fs::path &path) {
     log_handle_request_details(std::string(path), "CrudHandler", BAD_REQUEST_STATUS);
     BOOST_LOG_TRIVIAL(warning) << "CRUD[DELETE]: request target " << path
                                << " is not a valid path element";
-    return parseResponse(makeHeader(BAD_REQUEST_STATUS, TEXT_PLAIN, 0));
+    return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN);
   }
 
   // file DNE
   if (!filesystem_->exists(path)) {
     log_handle_request_details(std::string(path), "CrudHandler", BAD_REQUEST_STATUS);
-    BOOST_LOG_TRIVIAL(debug)
+    LOG_AT(debug)
         << "CRUD[DELETE]: file at " << path << " does not exist";
-    return parseResponse(makeHeader(BAD_REQUEST_STATUS, TEXT_PLAIN, 0));
+    return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN);
   }
 
   // couldn't remove
   if (!filesystem_->remove(path)) {
     log_handle_request_details(std::string(path), "CrudHandler", INTERNAL_SERVER_ERROR_STATUS);
-    BOOST_LOG_TRIVIAL(debug)
+    LOG_AT(debug)
         << "CRUD[DELETE]: couldn't remove file at " << path;
-    return parseResponse(
-        makeHeader(INTERNAL_SERVER_ERROR_STATUS, TEXT_PLAIN, 0));
+    return makeResponse(INTERNAL_SERVER_ERROR_STATUS, TEXT_PLAIN);
   }
+  recordIndex(path.parent_path())->erase(path.filename().string());
 
   // successful removal
   log_handle_request_details(std::string(path), "CrudHandler", NO_CONTENT_STATUS);
@@ -173,17 +403,25 @@ http_response CrudHandler::handle_delete(const fs::path &path) {
   return response;
 }
 
-http_response CrudHandler::handle_put(const fs::path &path, std::string data) {
+http_response CrudHandler::handle_put(const fs::path &path,
+                                      const http_request &request,
+                                      const UploadedBody *upload) {
   // check if is directory
   if (filesystem_->is_directory(path)) {
     log_handle_request_details(std::string(path), "CrudHandler", BAD_REQUEST_STATUS);
     BOOST_LOG_TRIVIAL(warning)
         << "CRUD[PUT]: cannot PUT to a directory; path: " << path;
-    return parseResponse(makeHeader(BAD_REQUEST_STATUS, TEXT_PLAIN, 0));
+    return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN);
   }
 
   // write new body
-  filesystem_->write(path, data);
+  if (!store(path, request, upload, false)) {
+    log_handle_request_details(std::string(path), "CrudHandler", INTERNAL_SERVER_ERROR_STATUS);
+    BOOST_LOG_TRIVIAL(warning)
+        << "CRUD[PUT]: failed to write file at path " << path;
+    return makeResponse(INTERNAL_SERVER_ERROR_STATUS, TEXT_PLAIN);
+  }
+  recordIndex(path.parent_path())->insert(path.filename().string());
 
   // 204 no_content as response for PUT (check RFC for detail)  
   log_handle_request_details(std::string(path), "CrudHandler", NO_CONTENT_STATUS);
@@ -192,30 +430,100 @@ http_response CrudHandler::handle_put(const fs::path &path, std::string data) {
   return response;
 }
 
-http_response CrudHandler::list(const fs::path &path) {
-  std::optional<std::vector<fs::path>> file_paths_opt = filesystem_->list(path);
-  if (!file_paths_opt.has_value()) {
+bool CrudHandler::store(const fs::path &path, const http_request &request,
+                        const UploadedBody *upload, bool create) {
+  if (upload != nullptr) {
+    return create ? filesystem_->createFrom(path, upload->path())
+                  : filesystem_->writeFrom(path, upload->path());
+  }
+  return create ? filesystem_->create(path, request.body())
+                : filesystem_->write(path, request.body());
+}
+
+std::shared_ptr<RecordIndex> CrudHandler::recordIndex(const fs::path &entity_path) {
+  // "Shoes" and "Shoes/" are the same entity
+  std::string key = entity_path.lexically_normal().string();
+  while (key.size() > 1 && key.back() == '/') {
+    key.pop_back();
+  }
+  {
+    std::shared_lock<std::shared_mutex> lock(indexes_mutex_);
+    auto it = indexes_.find(key);
+    if (it != indexes_.end()) {
+      return it->second;
+    }
+  }
+  std::unique_lock<std::shared_mutex> lock(indexes_mutex_);
+  std::shared_ptr<RecordIndex> &index = indexes_[key];
+  if (!index) {
+    index = std::make_shared<RecordIndex>();
+  }
+  return index;
+}
+
+http_response_variant CrudHandler::list(const http_request &request,
+                                        const fs::path &path,
+                                        std::string_view query, bool stream) {
+  std::optional<size_t> limit;
+  std::optional<std::string> limit_param =
+      queryParam(query, CRUD_HANDLER_LIMIT_PARAM);
+  if (limit_param.has_value()) {
+    const std::string &value = limit_param.value();
+    size_t parsed = 0;
+    auto [end, error] =
+        std::from_chars(value.data(), value.data() + value.size(), parsed);
+    if (error != std::errc() || end != value.data() + value.size() ||
+        parsed == 0) {
+      log_handle_request_details(std::string(path), "CrudHandler", BAD_REQUEST_STATUS);
+      LOG_AT(debug) << "CRUD handler got invalid limit " << value;
+      return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN);
+    }
+    limit = parsed;
+  }
+
+  // Only the first listing of an entity walks its directory
+  std::shared_ptr<RecordIndex> index = recordIndex(path);
+  if (!index->load(*filesystem_, path)) {
     log_handle_request_details(std::string(path), "CrudHandler", INTERNAL_SERVER_ERROR_STATUS);
-    BOOST_LOG_TRIVIAL(debug)
+    LOG_AT(debug)
         << "CRUD handler failed to list files at path " << path;
-    return parseResponse(
-        makeHeader(INTERNAL_SERVER_ERROR_STATUS, TEXT_PLAIN, 0));
+    return makeResponse(INTERNAL_SERVER_ERROR_STATUS, TEXT_PLAIN);
   }
 
-  // Add all filenames to a JSON array
-  pt::ptree root, arr;
-  for (const auto &file_path : file_paths_opt.value()) {
-    pt::ptree element;
-    element.put("", file_path.filename().string());
-    arr.push_back(std::make_pair("", element));
+  // A directory's modification time misses records being rewritten in
+  // place, so the listing is validated by the version of the index instead.
+  // Every page of it shares the tag, since each has its own URL.
+  Validators validators = versionValidators(index->id(), index->version());
+  if (notModified(request, validators)) {
+    log_handle_request_details(std::string(path), "CrudHandler", NOT_MODIFIED_STATUS);
+    return notModifiedResponse(validators, cache_control_);
   }
-  root.add_child("files", arr);
-
-  // Serialize the JSON array to a string, and use that as the body
   log_handle_request_details(std::string(path), "CrudHandler", OK_STATUS);
-  std::stringstream ss;
-  pt::write_json(ss, root);
-  const std::string body = ss.str();
-  const std::string header = makeHeader(OK_STATUS, JSON, body.size());
-  return parseResponse(header + body);
+
+  ListingWriter writer(index,
+                       queryParam(query, CRUD_HANDLER_CURSOR_PARAM).value_or(""),
+                       limit);
+  std::string body = writer();
+  if (!stream) {
+    while (!writer.done()) {
+      body += writer();
+    }
+  }
+  if (writer.done()) {
+    http_response response = makeResponse(OK_STATUS, JSON, std::move(body));
+    setValidators(response, validators, cache_control_);
+    return response;
+  }
+
+  // The rest of the records are read from the index as they are sent
+  http_stream_response response;
+  response.result(OK_STATUS);
+  response.set(boost::beast::http::field::content_type, JSON);
+  setValidators(response, validators, cache_control_);
+  response.body() = StreamBody::value_type(
+      [first = std::move(body), writer = std::move(writer)]() mutable {
+        return first.empty() ? writer() : std::exchange(first, {});
+      });
+  response.chunked(true);
+  return response;
 }
@@ -11,18 +11,13 @@ EchoHandler::EchoHandler() {}
 http_response EchoHandler::handle_request(const http_request &request) {
   //Only echo GET requests
   if (request.method() != boost::beast::http::verb::get){
-    lastResponseHeader = makeHeader(BAD_REQUEST_STATUS, TEXT_PLAIN, 0);
-    lastResponse = lastResponseHeader;
-    return parseResponse(lastResponse);
+    return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN);
   }
   // Convert the request to a string
-  log_handle_request_details(std::string(request.target()), "EchoHandler", OK_STATUS);
+  log_handle_request_details(request.target(), "EchoHandler", OK_STATUS);
   std::stringstream reqstream;
   reqstream << request;
-  std::string requestString = reqstream.str();
-  lastResponseHeader = makeHeader(OK_STATUS, TEXT_PLAIN, requestString.size());
-  lastResponse = lastResponseHeader + requestString;
-  return parseResponse(lastResponse);
+  return makeResponse(OK_STATUS, TEXT_PLAIN, std::move(reqstream).str());
 }
 
 RequestHandler *
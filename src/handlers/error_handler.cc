@@ -13,16 +13,12 @@ http_response ErrorHandler::handle_request(const http_request &request) {
   //If bad method, then request is invalid
   if (request.method() != boost::beast::http::verb::get && request.method() != boost::beast::http::verb::put && request.method() != boost::beast::http::verb::delete_ &&
       request.method() != boost::beast::http::verb::post){
-    log_handle_request_details(std::string(request.target()), "ErrorHandler", BAD_REQUEST_STATUS);
-    lastResponseHeader = makeHeader(BAD_REQUEST_STATUS, TEXT_PLAIN, 0);
-    lastResponse = lastResponseHeader;
-    return parseResponse(lastResponse);
+    log_handle_request_details(request.target(), "ErrorHandler", BAD_REQUEST_STATUS);
+    return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN);
   }
-  log_handle_request_details(std::string(request.target()), "ErrorHandler", NOT_FOUND_STATUS);
+  log_handle_request_details(request.target(), "ErrorHandler", NOT_FOUND_STATUS);
   //Otherwise, well formed method but not supported
-  lastResponseHeader = makeHeader(NOT_FOUND_STATUS, TEXT_PLAIN, 0);
-  lastResponse = lastResponseHeader;
-  return parseResponse(lastResponse);
+  return makeResponse(NOT_FOUND_STATUS, TEXT_PLAIN);
 }
 
 RequestHandler *
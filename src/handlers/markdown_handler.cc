@@ -1,5 +1,6 @@
 #include "handlers/markdown_handler.h"
 #include "filesystem/filesystem.h"
+#include "log_severity.h"
 #include "markdown_parser.h"
 #include <filesystem>
 #include <memory>
@@ -9,16 +10,64 @@
 
 namespace fs = std::filesystem;
 
+namespace {
+
+// Where the render of `path` in `encoding` is cached
+std::string cacheKey(const fs::path &path, CONTENT_ENCODING encoding) {
+  if (encoding == ENCODING_IDENTITY) {
+    return path.string();
+  }
+  return path.string() + ";" + std::string(encodingName(encoding));
+}
+
+// The validators a cached render was sent with
+Validators cachedValidators(const CachedContent &cached) {
+  Validators validators = fileValidators(cached.version, "", true);
+  validators.etag = std::string(cached.response[http_fields::etag]);
+  return validators;
+}
+
+} // namespace
+
 MarkdownHandler::MarkdownHandler(std::string path,
                                  std::unordered_map<std::string, std::string> args,
                                  std::unique_ptr<FileSystemInterface> filesystem)
     : path_(path), 
       data_path_(args.at(MARKDOWN_HANDLER_DATA_PATH_ARG)),
       format_path_(args.at(MARKDOWN_HANDLER_FORMAT_PATH_ARG)),
-      filesystem_(std::move(filesystem)) {}
+      filesystem_(std::move(filesystem)), compression_(args),
+      cache_control_(args[CACHE_CONTROL_ARG]) {
+  size_t cache_size = MARKDOWN_HANDLER_DEFAULT_CACHE_SIZE;
+  if (args.count(MARKDOWN_HANDLER_CACHE_SIZE_ARG)) {
+    try {
+      cache_size = std::stoull(args[MARKDOWN_HANDLER_CACHE_SIZE_ARG]);
+    } catch (const std::exception &e) {
+      BOOST_LOG_TRIVIAL(warning)
+          << "Invalid cache_size for " << path_ << ": "
+          << args[MARKDOWN_HANDLER_CACHE_SIZE_ARG] << "; using the default";
+    }
+  }
+  if (cache_size > 0) {
+    cache_ = std::make_unique<ContentCache>(cache_size);
+  }
+}
 
 http_response MarkdownHandler::handle_request(const http_request &request) {
-  BOOST_LOG_TRIVIAL(debug) << "Handling Markdown request";
+  return handle(request, nullptr);
+}
+
+std::optional<fs::path> MarkdownHandler::uploadDirectory() const {
+  return fs::path(data_path_) / UPLOAD_DIRECTORY;
+}
+
+http_response MarkdownHandler::handle_upload(const http_request &request,
+                                             const UploadedBody &body) {
+  return handle(request, &body);
+}
+
+http_response MarkdownHandler::handle(const http_request &request,
+                                      const UploadedBody *upload) {
+  LOG_AT(debug) << "Handling Markdown request";
 
   // Get the "true" target path by replacing the api prefix with the actual
   // filesystem path that the handler is mounted to
@@ -27,82 +76,191 @@ http_response MarkdownHandler::handle_request(const http_request &request) {
   const fs::path target = data_path_ + target_suffix;
 
   if (request.method() == boost::beast::http::verb::get) {
-    return handle_get(target);
+    return handle_get(request, target);
   } else if (request.method() == boost::beast::http::verb::post &&
                 request.at(boost::beast::http::field::content_type) == MARKDOWN) {
-    return handle_post(target, request.body());
+    return handle_post(target, request, upload);
   } else if (request.method() == boost::beast::http::verb::put &&
                 request.at(boost::beast::http::field::content_type) == MARKDOWN) {
-    return handle_put(target, request.body());
+    return handle_put(target, request, upload);
   } else if (request.method() == boost::beast::http::verb::delete_) {
     return handle_delete(target);
   }
 
   // Unimplemented functionality, return 400
-  log_handle_request_details(std::string(request.target()), "MarkdownHandler", NOT_SUPPORTED_STATUS);
-  BOOST_LOG_TRIVIAL(debug) << "Markdown handler doesn't implement "
-                             << request.method() << "; returning NOT_SUPPORTED";
-  return parseResponse(makeHeader(NOT_SUPPORTED_STATUS, TEXT_PLAIN, 0));
+  log_handle_request_details(request.target(), "MarkdownHandler", NOT_SUPPORTED_STATUS);
+  LOG_AT(debug) << "Markdown handler doesn't implement "
+                << request.method() << "; returning NOT_SUPPORTED";
+  return makeResponse(NOT_SUPPORTED_STATUS, TEXT_PLAIN);
 }
 
 RequestHandler *
 MarkdownHandler::Init(std::string path,
                   std::unordered_map<std::string, std::string> args) {
+  UploadedBody::removeStale(fs::path(args[MARKDOWN_HANDLER_DATA_PATH_ARG]) /
+                            UPLOAD_DIRECTORY);
   return new MarkdownHandler(path, args, std::make_unique<FileSystem>());
 }
 
-http_response MarkdownHandler::handle_get(const fs::path &path) {
+http_response MarkdownHandler::handle_get(const http_request &request,
+                                          const fs::path &path) {
   FILE_TYPE file_type = filesystem_->fileType(path);
   if (file_type != MARKDOWN_FILE) {
     log_handle_request_details(std::string(path), "MarkdownHandler", BAD_REQUEST_STATUS);
     BOOST_LOG_TRIVIAL(warning)
         << "MARKDOWN[GET]: file requested to read is not a Markdown file " << path;
     std::string body = "Could not retrieve '" + std::string(path) + "', not a markdown file";
-    std::string header = makeHeader(BAD_REQUEST_STATUS, TEXT_PLAIN, body.length());
-    return parseResponse(header + body);
+    return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN, std::move(body));
   }
   if (!filesystem_->exists(path)){
     log_handle_request_details(std::string(path), "MarkdownHandler", NOT_FOUND_STATUS);
     BOOST_LOG_TRIVIAL(warning)
         << "MARKDOWN[GET]: file requested to get does not exist " << path;
-    return parseResponse(makeHeader(NOT_FOUND_STATUS, TEXT_PLAIN, 0));
+    return makeResponse(NOT_FOUND_STATUS, TEXT_PLAIN);
+  }
+  std::vector<CONTENT_ENCODING> encodings =
+      compression_.encodings(request, TEXT_HTML);
+  CONTENT_ENCODING encoding =
+      encodings.empty() ? ENCODING_IDENTITY : encodings.front();
+  // Take the revision, then stat, before reading, so a concurrent write can
+  // only make the cached version look older than the page, never newer
+  const uint64_t page_revision = revision(path).load();
+  std::optional<FileStat> file_stat = filesystem_->stat(path);
+  std::shared_ptr<const CachedContent> rendered;
+  if (cache_) {
+    if (file_stat.has_value()) {
+      std::shared_ptr<const CachedContent> cached =
+          cache_->get(cacheKey(path, encoding), file_stat.value(),
+                      page_revision);
+      if (cached) {
+        Validators validators = cachedValidators(*cached);
+        if (notModified(request, validators)) {
+          return notModifiedPage(path, validators);
+        }
+        log_handle_request_details(std::string(path), "MarkdownHandler", OK_STATUS);
+        return cached->response;
+      }
+      // A page too small to compress, or not yet compressed in this
+      // encoding, may still have an uncompressed render
+      if (encoding != ENCODING_IDENTITY) {
+        rendered =
+            cache_->get(path.string(), file_stat.value(), page_revision);
+      }
+    }
   }
-  const std::optional<std::string> file_opt = filesystem_->read(path);
+  if (rendered) {
+    Validators validators = cachedValidators(*rendered);
+    if (notModified(request, validators)) {
+      return notModifiedPage(path, validators);
+    }
+    log_handle_request_details(std::string(path), "MarkdownHandler", OK_STATUS);
+    http_response response = rendered->response;
+    if (compression_.compressResponse(response, encoding)) {
+      cache_->put(cacheKey(path, encoding),
+                  std::make_shared<CachedContent>(CachedContent{
+                      file_stat.value(), response, page_revision}));
+    }
+    return response;
+  }
+  std::optional<std::string> file_opt = filesystem_->read(path);
   if (!file_opt.has_value()) {
     log_handle_request_details(std::string(path), "MarkdownHandler", INTERNAL_SERVER_ERROR_STATUS);
     BOOST_LOG_TRIVIAL(warning)
         << "MARKDOWN[GET]: failed to read file at path " << path;
     std::string body = "Failed to read file " + std::string(path);
-    std::string header = makeHeader(INTERNAL_SERVER_ERROR_STATUS, TEXT_PLAIN, body.length());
-    return parseResponse(header + body);
+    return makeResponse(INTERNAL_SERVER_ERROR_STATUS, TEXT_PLAIN, std::move(body));
+  }
+  // The page's stat can't tell apart two writes of the same size within one
+  // tick of its modification time, so the ETag comes from its contents. A
+  // render isn't the file's exact bytes, so the ETag is weak, which also
+  // lets every encoding of the page share it.
+  Validators validators = contentValidators(file_opt.value(), file_stat);
+  if (notModified(request, validators)) {
+    return notModifiedPage(path, validators);
   }
 
   log_handle_request_details(std::string(path), "MarkdownHandler", OK_STATUS);
   MarkdownParser parser = MarkdownParser(format_path_);
-  const std::string body =  parser.parse_markdown(file_opt.value());
-  const std::string header = makeHeader(OK_STATUS, TEXT_HTML, body.size());
-  return parseResponse(header + body);
+  http_response response =
+      makeResponse(OK_STATUS, TEXT_HTML,
+                   parser.parse_markdown(std::move(file_opt.value())));
+  // Only marks the page as varying by Accept-Encoding, if it is compressible
+  compression_.compressResponse(response, ENCODING_IDENTITY);
+  setValidators(response, validators, cache_control_);
+  if (cache_ && file_stat.has_value()) {
+    cache_->put(path.string(),
+                std::make_shared<CachedContent>(CachedContent{
+                    file_stat.value(), response, page_revision}));
+  }
+  if (compression_.compressResponse(response, encoding) && cache_ &&
+      file_stat.has_value()) {
+    cache_->put(cacheKey(path, encoding),
+                std::make_shared<CachedContent>(CachedContent{
+                    file_stat.value(), response, page_revision}));
+  }
+  return response;
 }
 
-http_response MarkdownHandler::handle_put(const fs::path &path, std::string data) {
+http_response MarkdownHandler::notModifiedPage(const fs::path &path,
+                                               const Validators &validators) {
+  log_handle_request_details(std::string(path), "MarkdownHandler", NOT_MODIFIED_STATUS);
+  http_response response = notModifiedResponse(validators, cache_control_);
+  if (compression_.compressible(TEXT_HTML)) {
+    response.set(http_fields::vary, "Accept-Encoding");
+  }
+  return response;
+}
+
+void MarkdownHandler::invalidate(const fs::path &path) {
+  // Renders of the old page still in progress are cached at the old count
+  revision(path).fetch_add(1);
+  if (!cache_) {
+    return;
+  }
+  for (CONTENT_ENCODING encoding : {ENCODING_IDENTITY, ENCODING_BROTLI,
+                                    ENCODING_GZIP, ENCODING_DEFLATE}) {
+    cache_->invalidate(cacheKey(path, encoding));
+  }
+}
+
+std::atomic<uint64_t> &MarkdownHandler::revision(const fs::path &path) {
+  return revisions_[std::hash<std::string>()(path.string()) % revisions_.size()];
+}
+
+std::optional<ContentCache::Stats> MarkdownHandler::cacheStats() const {
+  if (!cache_) {
+    return std::nullopt;
+  }
+  return cache_->stats();
+}
+
+http_response MarkdownHandler::handle_put(const fs::path &path,
+                                          const http_request &request,
+                                          const UploadedBody *upload) {
   FILE_TYPE file_type = filesystem_->fileType(path);
   if (file_type != MARKDOWN_FILE) {
     log_handle_request_details(std::string(path), "MarkdownHandler", BAD_REQUEST_STATUS);
     BOOST_LOG_TRIVIAL(warning)
         << "MARKDOWN[PUT]: file requested to put is not a Markdown file " << path;
     std::string body = "Failed to update '" + std::string(path) + "', not a markdown file";
-    std::string header = makeHeader(BAD_REQUEST_STATUS, TEXT_PLAIN, body.length());
-    return parseResponse(header + body);
+    return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN, std::move(body));
   }
   if (!filesystem_->exists(path)) {
     log_handle_request_details(std::string(path), "MarkdownHandler", NOT_FOUND_STATUS);
     BOOST_LOG_TRIVIAL(warning)
         << "MARKDOWN[PUT]: file requested to update does not exist " << path;
-    return parseResponse(
-        makeHeader(NOT_FOUND_STATUS, TEXT_PLAIN, 0));
+    return makeResponse(NOT_FOUND_STATUS, TEXT_PLAIN);
   }
   // write new body
-  filesystem_->write(path, data);
+  if (!store(path, request, upload)) {
+    log_handle_request_details(std::string(path), "MarkdownHandler", INTERNAL_SERVER_ERROR_STATUS);
+    BOOST_LOG_TRIVIAL(warning)
+        << "MARKDOWN[PUT]: failed to write file " << path;
+    return makeResponse(INTERNAL_SERVER_ERROR_STATUS, TEXT_PLAIN);
+  }
+  // the page's stat changes too, but its modification time may be too coarse
+  // to tell two quick writes apart, so its revision moves on as well
+  invalidate(path);
 
   // 204 no_content as response for PUT (check RFC for detail)  
   log_handle_request_details(std::string(path), "MarkdownHandler", NO_CONTENT_STATUS);
@@ -111,26 +269,32 @@ http_response MarkdownHandler::handle_put(const fs::path &path, std::string data
   return response;
 }
 
-http_response MarkdownHandler::handle_post(const fs::path &path, std::string data) {
+http_response MarkdownHandler::handle_post(const fs::path &path,
+                                           const http_request &request,
+                                           const UploadedBody *upload) {
   FILE_TYPE file_type = filesystem_->fileType(path);
   if (file_type != MARKDOWN_FILE) {
     log_handle_request_details(std::string(path), "MarkdownHandler", BAD_REQUEST_STATUS);
     BOOST_LOG_TRIVIAL(warning)
         << "MARKDOWN[POST]: file requested to post is not a Markdown file " << path;
     std::string body = "Failed to create '" + std::string(path) + "', file name must end with '.md'";
-    std::string header = makeHeader(BAD_REQUEST_STATUS, TEXT_PLAIN, body.length());
-    return parseResponse(header + body);
+    return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN, std::move(body));
   }
   if (filesystem_->exists(path)) {
     log_handle_request_details(std::string(path), "MarkdownHandler", BAD_REQUEST_STATUS);
     BOOST_LOG_TRIVIAL(warning)
         << "MARKDOWN[POST]: file requested to create already exists " << path;
     std::string body = "Failed to create '" + std::string(path) + "', file already exists";
-    std::string header = makeHeader(BAD_REQUEST_STATUS, TEXT_PLAIN, body.length());
-    return parseResponse(header + body);
+    return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN, std::move(body));
   }
   // update body
-  filesystem_->write(path, data);
+  if (!store(path, request, upload)) {
+    log_handle_request_details(std::string(path), "MarkdownHandler", INTERNAL_SERVER_ERROR_STATUS);
+    BOOST_LOG_TRIVIAL(warning)
+        << "MARKDOWN[POST]: failed to write file " << path;
+    return makeResponse(INTERNAL_SERVER_ERROR_STATUS, TEXT_PLAIN);
+  }
+  invalidate(path);
 
   // 204 no_content as response for POST (check RFC for detail)
   log_handle_request_details(std::string(path), "MarkdownHandler", NO_CONTENT_STATUS);
@@ -139,35 +303,39 @@ http_response MarkdownHandler::handle_post(const fs::path &path, std::string dat
   return response;  
 }
 
+bool MarkdownHandler::store(const fs::path &path, const http_request &request,
+                            const UploadedBody *upload) {
+  return upload != nullptr ? filesystem_->writeFrom(path, upload->path())
+                           : filesystem_->write(path, request.body());
+}
+
 http_response MarkdownHandler::handle_delete(const fs::path &path) {
   // no specific file name/id given, trying to delete directory
   if (filesystem_->is_directory(path)) {
     log_handle_request_details(std::string(path), "MarkdownHandler", BAD_REQUEST_STATUS);
     BOOST_LOG_TRIVIAL(warning) << "MARKDOWN[DELETE]: request target " << path
                                << " is not a valid path element, trying to delete a directory";
-    std::string header = makeHeader(BAD_REQUEST_STATUS, TEXT_PLAIN, 0);;
-    std::string body = "Cannot delete '" + std::string(path) + "', not a markdown file";
-    return parseResponse(header + body);
+    return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN);
   }
 
   // file DNE
   if (!filesystem_->exists(path)) {
     log_handle_request_details(std::string(path), "MarkdownHandler", NOT_FOUND_STATUS);
-    BOOST_LOG_TRIVIAL(debug)
+    LOG_AT(debug)
         << "MARKDOWN[DELETE]: file at " << path << " does not exist";
-    return parseResponse(makeHeader(NOT_FOUND_STATUS, TEXT_PLAIN, 0));
+    return makeResponse(NOT_FOUND_STATUS, TEXT_PLAIN);
   }
 
   // couldn't remove
   if (!filesystem_->remove(path)) {
     log_handle_request_details(std::string(path), "MarkdownHandler", INTERNAL_SERVER_ERROR_STATUS);
-    BOOST_LOG_TRIVIAL(debug)
+    LOG_AT(debug)
         << "MARKDOWN[DELETE]: couldn't remove file at " << path;
-    return parseResponse(
-        makeHeader(INTERNAL_SERVER_ERROR_STATUS, TEXT_PLAIN, 0));
+    return makeResponse(INTERNAL_SERVER_ERROR_STATUS, TEXT_PLAIN);
   }
 
   // successful removal
+  invalidate(path);
   log_handle_request_details(std::string(path), "MarkdownHandler", NO_CONTENT_STATUS);
   http_response response;
   response.result(boost::beast::http::status::no_content);
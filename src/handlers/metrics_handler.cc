@@ -0,0 +1,40 @@
+#include "handlers/metrics_handler.h"
+#include "logging.h"
+#include "metrics.h"
+#include "session.h"
+#include <sstream>
+
+MetricsHandler::MetricsHandler(){}
+MetricsHandler::MetricsHandler(std::string path, std::unordered_map<std::string, std::string> args) {}
+
+http_response MetricsHandler::handle_request(const http_request& request){
+    //Only respond to GET requests
+    if (request.method() != boost::beast::http::verb::get){
+        log_handle_request_details(request.target(), "MetricsHandler", NOT_SUPPORTED_STATUS);
+        return makeResponse(NOT_SUPPORTED_STATUS, TEXT_PLAIN);
+    }
+
+    std::ostringstream body;
+    Metrics::GetInstance().write(body);
+
+    body << "# HELP webserver_active_connections Connections currently open.\n"
+         << "# TYPE webserver_active_connections gauge\n"
+         << "webserver_active_connections " << SessionRegistry::GetInstance().size() << "\n";
+    body << "# HELP webserver_connection_timeouts_total Connections closed for missing a deadline, by deadline.\n"
+         << "# TYPE webserver_connection_timeouts_total counter\n";
+    for (int i = 0; i < SESSION_TIMEOUT_COUNT; i++) {
+        SESSION_TIMEOUT timeout = static_cast<SESSION_TIMEOUT>(i);
+        body << "webserver_connection_timeouts_total{timeout=\"" << timeoutName(timeout) << "\"} "
+             << session::timeoutCount(timeout) << "\n";
+    }
+    body << "# HELP webserver_log_records_dropped_total Log records dropped because the log queue was full.\n"
+         << "# TYPE webserver_log_records_dropped_total counter\n"
+         << "webserver_log_records_dropped_total " << dropped_log_records() << "\n";
+
+    log_handle_request_details(request.target(), "MetricsHandler", OK_STATUS);
+    return makeResponse(OK_STATUS, PROMETHEUS_TEXT, body.str());
+}
+
+RequestHandler* MetricsHandler::Init(std::string path, std::unordered_map<std::string, std::string> args){
+    return new MetricsHandler(path, args);
+}
@@ -1,51 +1,130 @@
 #include "handlers/request_handler.h"
+#include "access_log.h"
+#include "blocking_executor.h"
+#include "filesystem/filesystem_constants.h"
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <fstream>
+#include <signal.h>
+#include <system_error>
+#include <unistd.h>
 
-std::string RequestHandler::makeHeader(uint statusCode, std::string contentType,
-                                       size_t contentLength) {
-  std::string responseHeader = "";
-  responseHeader += HTTP_PREFIX + std::to_string(statusCode) + " " +
-                    STATUS_CODE_REASONS.at(statusCode) + CRLF;
-  responseHeader += CONTENT_TYPE + contentType + CRLF;
-  responseHeader += CONTENT_LENGTH + std::to_string(contentLength) + CRLF;
-  responseHeader += CRLF;
-  BOOST_LOG_TRIVIAL(info) << responseHeader;
-  return responseHeader;
-}
-
-void RequestHandler::log_handle_request_details(const std::string requestTarget, std::string requestHandlerName, unsigned int responseCode){
-  std::string handlerInfo = "[Handler: " + requestHandlerName + "] ";
-  std::string targetPathInfo = "[Request Path: " + requestTarget + "] ";
-  std::string responseCodeInfo = "[Response Code: " + std::to_string(responseCode) + "] ";
-  BOOST_LOG_TRIVIAL(info) << "[ResponseMetrics] " << handlerInfo << targetPathInfo << responseCodeInfo;
-}
-
-http_response RequestHandler::parseResponse(std::string response) {
-  boost::system::error_code error;
-  boost::beast::http::response_parser<boost::beast::http::string_body> parser;
-  parser.body_limit(UINT32_MAX);
-  const std::string constResponse = response;
-  size_t bytes_parsed = 0;
-  do {
-    size_t position =
-        parser.put(boost::asio::buffer(constResponse) + bytes_parsed, error);
-    bytes_parsed += position;
-    BOOST_LOG_TRIVIAL(debug) << "Is parser done? :" << parser.is_done();
-    BOOST_LOG_TRIVIAL(debug) << "Bytes parsed: " << bytes_parsed;
-    if (parser.is_done()) {
-      return parser.get();
-    } else if (error) {
-      // Basic response object given during failure
-      BOOST_LOG_TRIVIAL(warning) << error.message();
-      return http_response();
+namespace {
+
+const std::string UPLOAD_FILE_PREFIX = TEMP_FILE_PREFIX + "upload-";
+
+// Distinguishes the uploads in progress
+std::atomic<uint64_t> upload_count{0};
+
+} // namespace
+
+UploadedBody::UploadedBody(std::filesystem::path path, uint64_t size)
+    : path_(std::move(path)), size_(size) {}
+
+UploadedBody::~UploadedBody() {
+  // Nothing to do if a handler already moved it
+  std::error_code ignored;
+  std::filesystem::remove(path_, ignored);
+}
+
+std::filesystem::path
+UploadedBody::temporaryPath(const std::filesystem::path &directory) {
+  // The pid keeps servers sharing a directory apart. The prefix hides it
+  // from listings while it is written.
+  return directory /
+         (UPLOAD_FILE_PREFIX + std::to_string(::getpid()) + "-" +
+          std::to_string(upload_count.fetch_add(1, std::memory_order_relaxed)));
+}
+
+void UploadedBody::removeStale(const std::filesystem::path &directory) {
+  std::error_code ec;
+  for (const auto &dir_entry : std::filesystem::directory_iterator{directory, ec}) {
+    const std::string filename = dir_entry.path().filename().string();
+    if (filename.rfind(UPLOAD_FILE_PREFIX, 0) != 0) {
+      continue;
     }
-  } while (true);
-  return http_response();
+    // Uploads of a server that is still running, this one included, may
+    // still be in progress
+    const char *pid_start = filename.data() + UPLOAD_FILE_PREFIX.size();
+    pid_t pid = 0;
+    auto [end, error] =
+        std::from_chars(pid_start, filename.data() + filename.size(), pid);
+    if (error == std::errc() && pid > 0 &&
+        (::kill(pid, 0) == 0 || errno != ESRCH)) {
+      continue;
+    }
+    BOOST_LOG_TRIVIAL(info) << "Removing stale upload " << dir_entry.path();
+    std::filesystem::remove(dir_entry.path(), ec);
+  }
+}
+
+http_response RequestHandler::makeResponse(uint statusCode,
+                                           const std::string &contentType,
+                                           std::string body) {
+  http_response response;
+  response.result(statusCode);
+  response.set(http_fields::content_type, contentType);
+  response.content_length(body.size());
+  response.body() = std::move(body);
+  return response;
+}
+
+http_response_variant RequestHandler::serve(const http_request &request) {
+  return handle_request(request);
 }
 
-// Return last generated response.
-std::string RequestHandler::getLastResponse() { return lastResponse; }
+void RequestHandler::handle_request_async(const http_request &request,
+                                          boost::asio::io_service & /*io_service*/,
+                                          ResponseCallback done) {
+  if (respondsInline()) {
+    done(serve(request));
+    return;
+  }
+  bool posted = BlockingExecutor::GetInstance().post(
+      [this, &request, done] { done(serve(request)); });
+  if (!posted) {
+    log_handle_request_details(request.target(), "RequestHandler",
+                               SERVICE_UNAVAILABLE_STATUS);
+    done(makeResponse(SERVICE_UNAVAILABLE_STATUS, TEXT_PLAIN));
+  }
+}
+
+bool RequestHandler::respondsInline() const { return false; }
+
+std::optional<std::filesystem::path> RequestHandler::uploadDirectory() const {
+  return std::nullopt;
+}
+
+http_response RequestHandler::handle_upload(const http_request &request,
+                                            const UploadedBody &body) {
+  http_request buffered = request;
+  std::ifstream file(body.path(), std::ios::binary);
+  buffered.body().assign(std::istreambuf_iterator<char>{file}, {});
+  buffered.prepare_payload();
+  return handle_request(buffered);
+}
+
+void RequestHandler::handle_upload_async(const http_request &request,
+                                         std::shared_ptr<UploadedBody> body,
+                                         boost::asio::io_service & /*io_service*/,
+                                         ResponseCallback done) {
+  bool posted = BlockingExecutor::GetInstance().post(
+      [this, &request, body, done] { done(handle_upload(request, *body)); });
+  if (!posted) {
+    log_handle_request_details(request.target(), "RequestHandler",
+                               SERVICE_UNAVAILABLE_STATUS);
+    done(makeResponse(SERVICE_UNAVAILABLE_STATUS, TEXT_PLAIN));
+  }
+}
 
-// Return generated response header.
-std::string RequestHandler::getLastResponseHeader() {
-  return lastResponseHeader;
+void RequestHandler::log_handle_request_details(boost::beast::string_view requestTarget, boost::beast::string_view requestHandlerName, unsigned int responseCode){
+  // The access log already records every response, without formatting a line
+  if (AccessLog::GetInstance().enabled()) {
+    return;
+  }
+  // Streamed piece by piece; nothing is built unless the record is kept
+  BOOST_LOG_TRIVIAL(info) << "[ResponseMetrics] [Handler: " << requestHandlerName
+                          << "] [Request Path: " << requestTarget
+                          << "] [Response Code: " << responseCode << "] ";
 }
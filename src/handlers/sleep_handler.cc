@@ -1,20 +1,39 @@
 #include "handlers/sleep_handler.h"
-#include <chrono>
+#include <boost/asio/steady_timer.hpp>
+#include <memory>
 #include <thread>
 
 SleepHandler::SleepHandler(std::string path,
                            std::unordered_map<std::string, std::string> args) {}
 
 http_response SleepHandler::handle_request(const http_request &request) {
-  log_handle_request_details(std::string(request.target()), "SleepHandler", OK_STATUS);
+  log_handle_request_details(request.target(), "SleepHandler", OK_STATUS);
 
   // Sleep for 3 seconds
-  std::this_thread::sleep_for(std::chrono::milliseconds(3000));
+  std::this_thread::sleep_for(SLEEP_HANDLER_DURATION);
   BOOST_LOG_TRIVIAL(info) << "End sleep handler";
-  std::string body = "Sleep handler test";
-  lastResponseHeader = makeHeader(OK_STATUS, TEXT_PLAIN, body.size());
-  lastResponse = lastResponseHeader + body;
-  return parseResponse(lastResponse);
+  return makeResponse(OK_STATUS, TEXT_PLAIN, "Sleep handler test");
+}
+
+void SleepHandler::handle_request_async(const http_request &request,
+                                        boost::asio::io_service &io_service,
+                                        ResponseCallback done) {
+  log_handle_request_details(request.target(), "SleepHandler", OK_STATUS);
+
+  // The timer lives until its completion handler has run
+  std::shared_ptr<boost::asio::steady_timer> timer =
+      std::make_shared<boost::asio::steady_timer>(io_service,
+                                                  SLEEP_HANDLER_DURATION);
+  timer->async_wait([this, timer, done](const boost::system::error_code &error) {
+    if (error) {
+      // The wait was cut short, so there's nothing to report having slept
+      BOOST_LOG_TRIVIAL(error) << "Sleep handler timer failed: " << error.message();
+      done(makeResponse(SERVICE_UNAVAILABLE_STATUS, TEXT_PLAIN));
+      return;
+    }
+    BOOST_LOG_TRIVIAL(info) << "End sleep handler";
+    done(makeResponse(OK_STATUS, TEXT_PLAIN, "Sleep handler test"));
+  });
 }
 
 RequestHandler *
@@ -1,77 +1,387 @@
 #include "handlers/static_handler.h"
 #include "filesystem/filesystem.h"
+#include "log_severity.h"
+#include <random>
 
 StaticHandler::StaticHandler(std::string path,
                              std::unordered_map<std::string, std::string> args,
                              std::unique_ptr<FileSystemInterface> filesystem)
     : path_(path), root_(args[STATIC_HANDLER_ROOT_ARG]), 
-    filesystem_(std::move(filesystem))  {}
+    filesystem_(std::move(filesystem)), compression_(args),
+    cache_control_(args[CACHE_CONTROL_ARG])  {
+  if (args.count(STATIC_HANDLER_CACHE_SIZE_ARG) == 0) {
+    return;
+  }
+  try {
+    size_t cache_size = std::stoull(args[STATIC_HANDLER_CACHE_SIZE_ARG]);
+    cache_ = std::make_unique<ContentCache>(cache_size);
+  } catch (const std::exception &e) {
+    BOOST_LOG_TRIVIAL(warning)
+        << "Invalid cache_size for " << path_ << ": "
+        << args[STATIC_HANDLER_CACHE_SIZE_ARG] << "; not caching files";
+  }
+}
 
 http_response StaticHandler::handle_request(const http_request &request) {
-  BOOST_LOG_TRIVIAL(info) << "Handling static request";
+  LOG_AT(debug) << "Handling static request";
   //Only respond to GET requests
   if (request.method() != boost::beast::http::verb::get){
-    lastResponseHeader = makeHeader(BAD_REQUEST_STATUS, TEXT_PLAIN, 0);
-    lastResponse = lastResponseHeader;
-    return parseResponse(lastResponse);
-  }
-  RESPONSE_CODE status_code;
-  std::string content_type;
-  uintmax_t content_length = 0;
-  std::string responseString;
-  std::string target_suffix =
-      std::string(request.target()).substr(path_.size());
-  const std::filesystem::path target = root_ + target_suffix;
-  FILE_TYPE file_type = filesystem_->fileType(target);
-  BOOST_LOG_TRIVIAL(info) << "File requested: " << target;
-  std::optional<std::string> read_response = filesystem_->read(target);
-  responseString = read_response.has_value() ? read_response.value() : "";
-  if (file_type == NO_MATCHING_TYPE || !read_response.has_value()) {
+    return makeResponse(BAD_REQUEST_STATUS, TEXT_PLAIN);
+  }
+  const std::filesystem::path target = targetFile(request);
+  LOG_AT(debug) << "File requested: " << target;
+  std::optional<std::string> content_type =
+      contentType(filesystem_->fileType(target));
+  std::optional<std::string> read_response;
+  if (content_type.has_value()) {
+    read_response = filesystem_->read(target);
+  }
+  if (!read_response.has_value()) {
     BOOST_LOG_TRIVIAL(warning) << "No acceptable matching file type found";
-    status_code = NOT_FOUND_STATUS;
-    content_type = TEXT_PLAIN;
-    log_handle_request_details(std::string(request.target()), "StaticHandler", status_code);
-  } else {
-    status_code = OK_STATUS;
-    log_handle_request_details(std::string(request.target()), "StaticHandler", status_code);
-    switch (file_type) {
-    case TEXT_FILE:
-      BOOST_LOG_TRIVIAL(info) << "Text file requested";
-      content_type = TEXT_PLAIN;
-      break;
-    case JPG_FILE:
-      BOOST_LOG_TRIVIAL(info) << "Jpeg file requested";
-      content_type = IMAGE_JPEG;
-      break;
-    case ICO_FILE:
-      BOOST_LOG_TRIVIAL(info) << "ICO file requested";
-      content_type = IMAGE_X_ICON;
-      break;
-    case HTML_FILE:
-      BOOST_LOG_TRIVIAL(info) << "HTML file requested";
-      content_type = TEXT_HTML;
-      break;
-    case ZIP_FILE:
-      BOOST_LOG_TRIVIAL(info) << "Zip file requested";
-      content_type = APPLICATION_ZIP;
-      break;
-    case CSS_FILE:
-      BOOST_LOG_TRIVIAL(info) << "CSS file requested";
-      content_type = TEXT_CSS;
-      break;
-    case JS_FILE:
-      BOOST_LOG_TRIVIAL(info) << "JS file requested";
-      content_type = TEXT_JS;
-      break;
-    case PNG_FILE:
-      BOOST_LOG_TRIVIAL(info) << "PNG file requested";
-      content_type = IMAGE_PNG;
+    log_handle_request_details(request.target(), "StaticHandler", NOT_FOUND_STATUS);
+    return makeResponse(NOT_FOUND_STATUS, TEXT_PLAIN);
+  }
+  log_handle_request_details(request.target(), "StaticHandler", OK_STATUS);
+  http_response response = makeResponse(OK_STATUS, content_type.value(),
+                                        std::move(read_response.value()));
+  std::vector<CONTENT_ENCODING> encodings =
+      compression_.encodings(request, content_type.value());
+  compression_.compressResponse(
+      response, encodings.empty() ? ENCODING_IDENTITY : encodings.front());
+  return response;
+}
+
+http_response_variant StaticHandler::serve(const http_request &request) {
+  if (request.method() != boost::beast::http::verb::get) {
+    return handle_request(request);
+  }
+  const std::filesystem::path target = targetFile(request);
+  std::optional<std::string> content_type =
+      contentType(filesystem_->fileType(target));
+  if (!content_type.has_value() || !filesystem_->exists(target) ||
+      filesystem_->is_directory(target)) {
+    return handle_request(request);
+  }
+
+  // A precompressed sibling of the file beats compressing it on every
+  // request, and works for files too big to compress in memory
+  std::vector<CONTENT_ENCODING> encodings =
+      compression_.encodings(request, content_type.value());
+  for (CONTENT_ENCODING encoding : encodings) {
+    std::optional<std::string_view> suffix = precompressedSuffix(encoding);
+    if (!suffix.has_value()) {
+      continue;
+    }
+    std::filesystem::path sibling = target.string() + std::string(suffix.value());
+    std::optional<FileStat> sibling_stat = filesystem_->stat(sibling);
+    if (!sibling_stat.has_value()) {
+      continue;
+    }
+    Validators validators =
+        fileValidators(sibling_stat.value(), encodingName(encoding));
+    if (notModified(request, validators)) {
+      return notModifiedFor(request, validators, content_type.value());
+    }
+    std::optional<http_response_variant> partial =
+        rangeResponse(request, sibling, sibling_stat.value().size,
+                      content_type.value(), encoding, validators);
+    if (partial.has_value()) {
+      return std::move(partial.value());
+    }
+    std::optional<http_file_response> response =
+        streamFile(request, sibling, content_type.value(), encoding);
+    if (response.has_value()) {
+      setValidators(response.value(), validators, cache_control_);
+      return std::move(response.value());
+    }
+  }
+
+  std::optional<FileStat> file_stat = filesystem_->stat(target);
+  if (!file_stat.has_value()) {
+    return handle_request(request);
+  }
+  // Only files small enough to hold in memory are compressed, and only if
+  // they are big enough for it to be worth it
+  const bool in_memory =
+      file_stat.value().size <= STATIC_HANDLER_MAX_CACHED_FILE_SIZE;
+  CONTENT_ENCODING encoding = ENCODING_IDENTITY;
+  if (!encodings.empty() && in_memory &&
+      file_stat.value().size >= compression_.minSize()) {
+    encoding = encodings.front();
+  }
+  // Each encoding of a version of the file is a different response, so it
+  // needs its own ETag
+  Validators validators = fileValidators(
+      file_stat.value(),
+      encoding == ENCODING_IDENTITY ? "" : encodingName(encoding));
+  if (notModified(request, validators)) {
+    return notModifiedFor(request, validators, content_type.value());
+  }
+  // Ranges are only served from the file itself, never from a compressed
+  // copy made on the fly
+  if (encoding == ENCODING_IDENTITY) {
+    std::optional<http_response_variant> partial =
+        rangeResponse(request, target, file_stat.value().size,
+                      content_type.value(), encoding, validators);
+    if (partial.has_value()) {
+      return std::move(partial.value());
+    }
+  }
+
+  if (in_memory && (cache_ || encoding != ENCODING_IDENTITY)) {
+    http_response response =
+        cache_ ? cachedResponse(request, target, file_stat.value(), encoding)
+               : handle_request(request);
+    if (response.result_int() == OK_STATUS) {
+      setValidators(response, validators, cache_control_);
+      if (encoding == ENCODING_IDENTITY) {
+        response.set(http_fields::accept_ranges, "bytes");
+      }
+    }
+    return response;
+  }
+
+  std::optional<http_file_response> response =
+      streamFile(request, target, content_type.value(), ENCODING_IDENTITY);
+  if (!response.has_value()) {
+    return handle_request(request);
+  }
+  setValidators(response.value(), validators, cache_control_);
+  return std::move(response.value());
+}
+
+http_response StaticHandler::notModifiedFor(const http_request &request,
+                                            const Validators &validators,
+                                            const std::string &content_type) {
+  LOG_AT(debug) << "Not modified: " << request.target();
+  log_handle_request_details(request.target(), "StaticHandler",
+                             NOT_MODIFIED_STATUS);
+  http_response response = notModifiedResponse(validators, cache_control_);
+  if (compression_.compressible(content_type)) {
+    response.set(http_fields::vary, "Accept-Encoding");
+  }
+  return response;
+}
+
+std::optional<http_response_variant>
+StaticHandler::rangeResponse(const http_request &request,
+                             const std::filesystem::path &file,
+                             uint64_t file_size,
+                             const std::string &content_type,
+                             CONTENT_ENCODING encoding,
+                             const Validators &validators) {
+  auto header = request.find(http_fields::range);
+  if (header == request.end() || !ifRangeMatches(request, validators)) {
+    return std::nullopt;
+  }
+  std::optional<std::vector<ByteRange>> ranges = parseRange(
+      std::string_view(header->value().data(), header->value().size()),
+      file_size);
+  if (!ranges.has_value()) {
+    return std::nullopt;
+  }
+
+  if (ranges.value().empty()) {
+    log_handle_request_details(request.target(), "StaticHandler",
+                               RANGE_NOT_SATISFIABLE_STATUS);
+    http_response response =
+        makeResponse(RANGE_NOT_SATISFIABLE_STATUS, TEXT_PLAIN);
+    response.set(http_fields::content_range, unsatisfiedRange(file_size));
+    return response;
+  }
+
+  if (ranges.value().size() == 1) {
+    std::optional<http_file_response> response = streamFile(
+        request, file, content_type, encoding, ranges.value().front());
+    if (!response.has_value()) {
+      return std::nullopt;
     }
+    setValidators(response.value(), validators, cache_control_);
+    return std::move(response.value());
+  }
+
+  // Several ranges go out as one multipart/byteranges body, read into memory
+  // with positional reads. Past the in-memory limit, send the whole file.
+  uint64_t total = 0;
+  for (const ByteRange &range : ranges.value()) {
+    total += range.length();
+  }
+  if (total > STATIC_HANDLER_MAX_CACHED_FILE_SIZE) {
+    return std::nullopt;
+  }
+  boost::beast::error_code ec;
+  boost::beast::file input;
+  input.open(file.c_str(), boost::beast::file_mode::read, ec);
+  if (ec) {
+    BOOST_LOG_TRIVIAL(warning) << "Failed to open " << file << ": "
+                               << ec.message();
+    return std::nullopt;
+  }
+
+  // Random, so no file can contain it by accident
+  thread_local std::mt19937_64 random{std::random_device{}()};
+  char boundary[33];
+  snprintf(boundary, sizeof(boundary), "%016llx%016llx",
+           static_cast<unsigned long long>(random()),
+           static_cast<unsigned long long>(random()));
+  std::string body;
+  body.reserve(total + ranges.value().size() * 128);
+  for (const ByteRange &range : ranges.value()) {
+    body += "--";
+    body += boundary;
+    body += "\r\nContent-Type: " + content_type;
+    body += "\r\nContent-Range: " + contentRange(range, file_size) + "\r\n\r\n";
+    size_t start = body.size();
+    body.resize(start + range.length());
+    input.seek(range.first, ec);
+    size_t read = 0;
+    while (!ec && read < range.length()) {
+      size_t n = input.read(body.data() + start + read, range.length() - read, ec);
+      if (n == 0) {
+        break;
+      }
+      read += n;
+    }
+    if (ec || read < range.length()) {
+      // the file shrank since it was stat'd
+      BOOST_LOG_TRIVIAL(warning) << "Failed to read " << file;
+      return std::nullopt;
+    }
+    body += "\r\n";
+  }
+  body += "--";
+  body += boundary;
+  body += "--\r\n";
+
+  log_handle_request_details(request.target(), "StaticHandler",
+                             PARTIAL_CONTENT_STATUS);
+  http_response response = makeResponse(
+      PARTIAL_CONTENT_STATUS,
+      "multipart/byteranges; boundary=" + std::string(boundary),
+      std::move(body));
+  if (compression_.compressible(content_type)) {
+    response.set(http_fields::vary, "Accept-Encoding");
+  }
+  if (encoding != ENCODING_IDENTITY) {
+    response.set(http_fields::content_encoding,
+                 std::string(encodingName(encoding)));
+  }
+  response.set(http_fields::accept_ranges, "bytes");
+  setValidators(response, validators, cache_control_);
+  return response;
+}
+
+std::optional<http_file_response>
+StaticHandler::streamFile(const http_request &request,
+                          const std::filesystem::path &file,
+                          const std::string &content_type,
+                          CONTENT_ENCODING encoding,
+                          std::optional<ByteRange> range) {
+  // Hand the open file to the session, which sends it straight from the
+  // descriptor to the socket instead of reading it into memory
+  boost::beast::error_code ec;
+  http_file_body::value_type body;
+  body.open(file.c_str(), boost::beast::file_mode::scan, ec);
+  if (ec) {
+    BOOST_LOG_TRIVIAL(warning) << "Failed to open " << file << ": "
+                               << ec.message();
+    return std::nullopt;
+  }
+  LOG_AT(debug) << "Streaming file: " << file;
+  http_file_response response;
+  if (range.has_value()) {
+    log_handle_request_details(request.target(), "StaticHandler",
+                               PARTIAL_CONTENT_STATUS);
+    response.result(PARTIAL_CONTENT_STATUS);
+    response.set(http_fields::content_range,
+                 contentRange(range.value(), body.size()));
+    body.slice(range.value().first, range.value().length());
+  } else {
+    log_handle_request_details(request.target(), "StaticHandler", OK_STATUS);
+    response.result(OK_STATUS);
+  }
+  response.set(http_fields::content_type, content_type);
+  response.set(http_fields::accept_ranges, "bytes");
+  if (compression_.compressible(content_type)) {
+    response.set(http_fields::vary, "Accept-Encoding");
+  }
+  if (encoding != ENCODING_IDENTITY) {
+    response.set(http_fields::content_encoding,
+                 std::string(encodingName(encoding)));
+  }
+  response.content_length(body.size());
+  response.body() = std::move(body);
+  return response;
+}
+
+std::optional<ContentCache::Stats> StaticHandler::cacheStats() const {
+  if (!cache_) {
+    return std::nullopt;
+  }
+  return cache_->stats();
+}
+
+http_response StaticHandler::cachedResponse(const http_request &request,
+                                            const std::filesystem::path &target,
+                                            const FileStat &file_stat,
+                                            CONTENT_ENCODING encoding) {
+  // Each encoding of a file is cached on its own
+  std::string key = target.string();
+  if (encoding != ENCODING_IDENTITY) {
+    key += ";" + std::string(encodingName(encoding));
+  }
+  std::shared_ptr<const CachedContent> cached = cache_->get(key, file_stat);
+  if (cached) {
+    LOG_AT(debug) << "Serving cached file: " << target;
+    log_handle_request_details(request.target(), "StaticHandler", OK_STATUS);
+    return cached->response;
+  }
+  http_response response = handle_request(request);
+  if (response.result_int() == OK_STATUS) {
+    cache_->put(key,
+                std::make_shared<CachedContent>(CachedContent{file_stat, response}));
+  }
+  return response;
+}
+
+std::filesystem::path StaticHandler::targetFile(const http_request &request) {
+  std::string target_suffix =
+      std::string(request.target()).substr(path_.size());
+  return root_ + target_suffix;
+}
+
+std::optional<std::string> StaticHandler::contentType(FILE_TYPE file_type) {
+  switch (file_type) {
+  case TEXT_FILE:
+    LOG_AT(debug) << "Text file requested";
+    return TEXT_PLAIN;
+  case JPG_FILE:
+    LOG_AT(debug) << "Jpeg file requested";
+    return IMAGE_JPEG;
+  case ICO_FILE:
+    LOG_AT(debug) << "ICO file requested";
+    return IMAGE_X_ICON;
+  case HTML_FILE:
+    LOG_AT(debug) << "HTML file requested";
+    return TEXT_HTML;
+  case ZIP_FILE:
+    LOG_AT(debug) << "Zip file requested";
+    return APPLICATION_ZIP;
+  case MARKDOWN_FILE:
+    LOG_AT(debug) << "Markdown file requested";
+    return MARKDOWN;
+  case CSS_FILE:
+    LOG_AT(debug) << "CSS file requested";
+    return TEXT_CSS;
+  case JS_FILE:
+    LOG_AT(debug) << "JS file requested";
+    return TEXT_JS;
+  case PNG_FILE:
+    LOG_AT(debug) << "PNG file requested";
+    return IMAGE_PNG;
+  default:
+    return std::nullopt;
   }
-  content_length += responseString.size();
-  lastResponseHeader = makeHeader(status_code, content_type, content_length);
-  lastResponse = lastResponseHeader + responseString;
-  return parseResponse(lastResponse);
 }
 
 RequestHandler *
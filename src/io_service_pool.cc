@@ -0,0 +1,76 @@
+#include "io_service_pool.h"
+#include "log_severity.h"
+#include <algorithm>
+#include <boost/log/trivial.hpp>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+
+IoServicePool::IoServicePool(THREADING_MODE mode, size_t thread_count)
+    : mode_(mode), thread_count_(std::max<size_t>(thread_count, 1)) {
+  if (mode_ == THREADING_SHARED) {
+    io_services_.push_back(std::make_unique<boost::asio::io_service>());
+    return;
+  }
+  for (size_t i = 0; i < thread_count_; i++) {
+    // Each io_service is run by a single thread
+    io_services_.push_back(std::make_unique<boost::asio::io_service>(1));
+  }
+}
+
+size_t IoServicePool::size() const { return io_services_.size(); }
+
+boost::asio::io_service &IoServicePool::get(size_t index) {
+  return *io_services_[index];
+}
+
+void IoServicePool::run() {
+  BOOST_LOG_TRIVIAL(info) << "Running " << thread_count_ << " I/O threads on "
+                          << io_services_.size() << " io_service(s)";
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < thread_count_; i++) {
+    boost::asio::io_service &io_service = *io_services_[i % size()];
+    bool pin = mode_ == THREADING_PER_CORE_PINNED;
+    threads.emplace_back([&io_service, pin, i] {
+      if (pin) {
+        pinToCpu(i);
+      }
+      io_service.run();
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+void IoServicePool::stop() {
+  for (std::unique_ptr<boost::asio::io_service> &io_service : io_services_) {
+    io_service->stop();
+  }
+}
+
+void IoServicePool::pinToCpu(size_t index) {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 ||
+      CPU_COUNT(&allowed) == 0) {
+    BOOST_LOG_TRIVIAL(warning) << "Could not get CPU affinity; not pinning";
+    return;
+  }
+  // Find the (index % allowed CPUs)th allowed CPU
+  size_t skip = index % CPU_COUNT(&allowed);
+  int cpu = 0;
+  for (; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed) && skip-- == 0) {
+      break;
+    }
+  }
+  cpu_set_t pinned;
+  CPU_ZERO(&pinned);
+  CPU_SET(cpu, &pinned);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned) != 0) {
+    BOOST_LOG_TRIVIAL(warning) << "Could not pin I/O thread to CPU " << cpu;
+    return;
+  }
+  LOG_AT(debug) << "Pinned I/O thread " << index << " to CPU " << cpu;
+}
@@ -0,0 +1,402 @@
+#include "json.h"
+#include <cstdio>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const char INDENT[] = "    ";
+
+void appendEscaped(std::string &out, std::string_view value) {
+  for (char c : value) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\b':
+      out += "\\b";
+      break;
+    case '\f':
+      out += "\\f";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char escape[8];
+        snprintf(escape, sizeof(escape), "\\u%04x", c);
+        out += escape;
+      } else {
+        out += c;
+      }
+    }
+  }
+}
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+bool isHex(char c) {
+  return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+void skipWhitespace(const char *&p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+    p++;
+  }
+}
+
+// Advance `p` past characters that can appear in a string as they are:
+// ASCII other than control characters, quotes and backslashes
+void skipPlain(const char *&p, const char *end) {
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  // Compared as signed bytes, anything from 0x80 up is negative, so this
+  // catches control characters and the start of multibyte UTF-8 alike
+  const __m128i space = _mm_set1_epi8(0x20);
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                     _mm_cmpeq_epi8(chunk, backslash)),
+        _mm_cmplt_epi8(chunk, space));
+    int mask = _mm_movemask_epi8(special);
+    if (mask != 0) {
+      p += __builtin_ctz(mask);
+      return;
+    }
+    p += 16;
+  }
+#endif
+  while (p < end) {
+    unsigned char c = *p;
+    if (c == '"' || c == '\\' || c < 0x20 || c >= 0x80) {
+      return;
+    }
+    p++;
+  }
+}
+
+// Advance `p` past one UTF-8 encoded character starting with a byte >= 0x80,
+// rejecting overlong encodings, surrogates and anything past U+10FFFF
+bool skipMultibyte(const char *&p, const char *end) {
+  unsigned char lead = *p;
+  size_t length;
+  unsigned char min = 0x80, max = 0xBF;
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    length = 2;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    length = 3;
+    if (lead == 0xE0) {
+      min = 0xA0;
+    } else if (lead == 0xED) {
+      max = 0x9F;
+    }
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    length = 4;
+    if (lead == 0xF0) {
+      min = 0x90;
+    } else if (lead == 0xF4) {
+      max = 0x8F;
+    }
+  } else {
+    return false;
+  }
+  if (static_cast<size_t>(end - p) < length) {
+    return false;
+  }
+  for (size_t i = 1; i < length; i++) {
+    unsigned char c = p[i];
+    // only the first continuation byte has a narrower range
+    if (i == 1 ? (c < min || c > max) : (c < 0x80 || c > 0xBF)) {
+      return false;
+    }
+  }
+  p += length;
+  return true;
+}
+
+// Advance `p` past a string, starting at its opening quote
+bool skipString(const char *&p, const char *end) {
+  p++;
+  while (true) {
+    skipPlain(p, end);
+    if (p >= end) {
+      return false;
+    }
+    unsigned char c = *p;
+    if (c == '"') {
+      p++;
+      return true;
+    }
+    if (c == '\\') {
+      if (end - p < 2) {
+        return false;
+      }
+      switch (p[1]) {
+      case '"':
+      case '\\':
+      case '/':
+      case 'b':
+      case 'f':
+      case 'n':
+      case 'r':
+      case 't':
+        p += 2;
+        break;
+      case 'u':
+        if (end - p < 6 || !isHex(p[2]) || !isHex(p[3]) || !isHex(p[4]) ||
+            !isHex(p[5])) {
+          return false;
+        }
+        p += 6;
+        break;
+      default:
+        return false;
+      }
+    } else if (c < 0x20) {
+      return false;
+    } else if (!skipMultibyte(p, end)) {
+      return false;
+    }
+  }
+}
+
+bool skipDigits(const char *&p, const char *end) {
+  const char *start = p;
+  while (p < end && isDigit(*p)) {
+    p++;
+  }
+  return p > start;
+}
+
+// Advance `p` past a number: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+bool skipNumber(const char *&p, const char *end) {
+  if (*p == '-') {
+    p++;
+  }
+  if (p < end && *p == '0') {
+    p++;
+  } else if (!skipDigits(p, end)) {
+    return false;
+  }
+  if (p < end && *p == '.') {
+    p++;
+    if (!skipDigits(p, end)) {
+      return false;
+    }
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    if (p < end && (*p == '+' || *p == '-')) {
+      p++;
+    }
+    if (!skipDigits(p, end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool skipLiteral(const char *&p, const char *end, std::string_view literal) {
+  if (std::string_view(p, end - p).substr(0, literal.size()) != literal) {
+    return false;
+  }
+  p += literal.size();
+  return true;
+}
+
+// Advance `p` past an object member's name and the colon after it
+bool skipKey(const char *&p, const char *end) {
+  skipWhitespace(p, end);
+  if (p >= end || *p != '"' || !skipString(p, end)) {
+    return false;
+  }
+  skipWhitespace(p, end);
+  if (p >= end || *p != ':') {
+    return false;
+  }
+  p++;
+  return true;
+}
+
+} // namespace
+
+void JsonWriter::beginObject() { open('{'); }
+void JsonWriter::endObject() { close('}'); }
+void JsonWriter::beginArray() { open('['); }
+void JsonWriter::endArray() { close(']'); }
+
+void JsonWriter::key(std::string_view name) {
+  Level &level = levels_.back();
+  out_ += level.empty ? "\n" : ",\n";
+  level.empty = false;
+  for (size_t i = 0; i < levels_.size(); i++) {
+    out_ += INDENT;
+  }
+  appendString(name);
+  out_ += ": ";
+  after_key_ = true;
+}
+
+void JsonWriter::string(std::string_view value) {
+  beforeValue();
+  appendString(value);
+  afterValue();
+}
+
+void JsonWriter::number(int64_t value) {
+  beforeValue();
+  out_ += std::to_string(value);
+  afterValue();
+}
+
+void JsonWriter::boolean(bool value) {
+  beforeValue();
+  out_ += value ? "true" : "false";
+  afterValue();
+}
+
+void JsonWriter::null() {
+  beforeValue();
+  out_ += "null";
+  afterValue();
+}
+
+std::string JsonWriter::take() {
+  std::string taken;
+  taken.swap(out_);
+  return taken;
+}
+
+void JsonWriter::beforeValue() {
+  if (after_key_) {
+    after_key_ = false;
+    return;
+  }
+  if (levels_.empty()) {
+    return;
+  }
+  // an array element, on a line of its own
+  Level &level = levels_.back();
+  out_ += level.empty ? "\n" : ",\n";
+  level.empty = false;
+  for (size_t i = 0; i < levels_.size(); i++) {
+    out_ += INDENT;
+  }
+}
+
+void JsonWriter::open(char bracket) {
+  beforeValue();
+  out_ += bracket;
+  levels_.push_back(Level{true});
+}
+
+void JsonWriter::close(char bracket) {
+  bool empty = levels_.back().empty;
+  levels_.pop_back();
+  if (!empty) {
+    out_ += '\n';
+    for (size_t i = 0; i < levels_.size(); i++) {
+      out_ += INDENT;
+    }
+  }
+  out_ += bracket;
+  afterValue();
+}
+
+void JsonWriter::afterValue() {
+  if (levels_.empty()) {
+    out_ += '\n';
+  }
+}
+
+void JsonWriter::appendString(std::string_view value) {
+  out_ += '"';
+  appendEscaped(out_, value);
+  out_ += '"';
+}
+
+std::string jsonString(std::string_view value) {
+  std::string quoted = "\"";
+  appendEscaped(quoted, value);
+  quoted += '"';
+  return quoted;
+}
+
+bool validJson(std::string_view text) {
+  const char *p = text.data();
+  const char *end = p + text.size();
+  // the brackets of the containers we are inside, innermost last
+  std::string open;
+  while (true) {
+    // a value
+    skipWhitespace(p, end);
+    if (p >= end) {
+      return false;
+    }
+    char c = *p;
+    if (c == '{' || c == '[') {
+      if (open.size() >= JSON_MAX_DEPTH) {
+        return false;
+      }
+      p++;
+      skipWhitespace(p, end);
+      if (p < end && *p == (c == '{' ? '}' : ']')) {
+        p++;
+      } else {
+        open += c;
+        if (c == '{' && !skipKey(p, end)) {
+          return false;
+        }
+        continue;
+      }
+    } else if (c == '"') {
+      if (!skipString(p, end)) {
+        return false;
+      }
+    } else if (c == '-' || isDigit(c)) {
+      if (!skipNumber(p, end)) {
+        return false;
+      }
+    } else if (!skipLiteral(p, end, "true") && !skipLiteral(p, end, "false") &&
+               !skipLiteral(p, end, "null")) {
+      return false;
+    }
+
+    // after a value: close whatever containers end here, then expect the
+    // next element or member
+    while (true) {
+      skipWhitespace(p, end);
+      if (open.empty()) {
+        return p == end;
+      }
+      if (p >= end) {
+        return false;
+      }
+      if (*p == ',') {
+        p++;
+        if (open.back() == '{' && !skipKey(p, end)) {
+          return false;
+        }
+        break;
+      }
+      if (*p != (open.back() == '{' ? '}' : ']')) {
+        return false;
+      }
+      p++;
+      open.pop_back();
+    }
+  }
+}
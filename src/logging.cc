@@ -1,14 +1,25 @@
 #include "logging.h"
+#include <atomic>
+#include <boost/core/null_deleter.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/block_on_overflow.hpp>
+#include <boost/log/sinks/bounded_fifo_queue.hpp>
 #include <boost/log/sinks/text_file_backend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
 #include <boost/log/sources/record_ostream.hpp>
 #include <boost/log/sources/severity_logger.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/utility/setup/console.hpp>
 #include <boost/log/utility/setup/file.hpp>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace logging = boost::log;
 namespace sinks = boost::log::sinks;
@@ -19,7 +30,94 @@ namespace expr = boost::log::expressions;
 BOOST_LOG_ATTRIBUTE_KEYWORD(line_id, "LineID", unsigned int)
 BOOST_LOG_ATTRIBUTE_KEYWORD(tag_attr, "Tag", std::string)
 
-void init_logging() {
+namespace {
+
+std::atomic<uint64_t> dropped_records = 0;
+
+// Everything init_logging set up, so shutdown_logging can take it down
+struct LoggingState {
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool wake_requested = false;
+  bool stopping = false;
+  // Write out one asynchronous sink's queue and flush its backend
+  std::vector<std::function<void()>> drains;
+  std::vector<boost::shared_ptr<sinks::sink>> sinks;
+  std::thread flusher;
+};
+
+LoggingState &state() {
+  static LoggingState logging_state;
+  return logging_state;
+}
+
+// Wake the flusher before its next interval
+void wake_flusher() {
+  LoggingState &logging_state = state();
+  {
+    std::lock_guard<std::mutex> lock(logging_state.mutex);
+    logging_state.wake_requested = true;
+  }
+  logging_state.wake.notify_one();
+}
+
+void flush_loop() {
+  LoggingState &logging_state = state();
+  std::unique_lock<std::mutex> lock(logging_state.mutex);
+  while (!logging_state.stopping) {
+    logging_state.wake.wait_for(lock, ASYNC_LOG_FLUSH_INTERVAL, [&] {
+      return logging_state.stopping || logging_state.wake_requested;
+    });
+    logging_state.wake_requested = false;
+    lock.unlock();
+    for (const std::function<void()> &drain : logging_state.drains) {
+      drain();
+    }
+    lock.lock();
+  }
+}
+
+// Overflow policy for the asynchronous queues. Warnings and errors wait for
+// the flusher to make room, so they are never lost; anything less severe is
+// dropped rather than stall a request.
+class drop_below_warning_on_overflow : public sinks::block_on_overflow {
+public:
+  template <typename LockT>
+  bool on_overflow(logging::record_view const &record, LockT &lock) {
+    wake_flusher();
+    auto severity = record[logging::trivial::severity];
+    if (severity && severity.get() >= logging::trivial::warning) {
+      return block_on_overflow::on_overflow(record, lock);
+    }
+    dropped_records++;
+    return false;
+  }
+};
+
+typedef sinks::bounded_fifo_queue<ASYNC_LOG_QUEUE_SIZE,
+                                  drop_below_warning_on_overflow>
+    async_queue;
+
+// Queue records for `backend`, to be fed to it by the flusher
+template <typename Backend>
+void add_async_sink(boost::shared_ptr<Backend> backend,
+                    const logging::formatter &fmt) {
+  typedef sinks::asynchronous_sink<Backend, async_queue> sink_t;
+  boost::shared_ptr<sink_t> sink =
+      boost::make_shared<sink_t>(backend, /*start_thread=*/false);
+  sink->set_formatter(fmt);
+  logging::core::get()->add_sink(sink);
+  state().sinks.push_back(sink);
+  state().drains.push_back([sink] {
+    sink->feed_records();
+    sink->locked_backend()->flush();
+  });
+}
+
+} // namespace
+
+void init_logging(LOGGING_MODE mode, const std::string &file_name,
+                  bool log_to_console) {
 
   // Setup the common formatter for all sinks
   logging::formatter fmt =
@@ -37,22 +135,42 @@ void init_logging() {
                    << "[" << logging::trivial::severity << "] "
                    << expr::smessage;
 
-  // Setup file logging
-  logging::add_file_log(
-      keywords::file_name =
-          "logging/fortnite-gamers_%N.log", /*< TODO: make file name pattern
-                                               more descriptive, say with time
-                                               file is created >*/
-      keywords::rotation_size =
-          10 * 1024 * 1024, /*< rotate files every 10 MiB... >*/
-      keywords::time_based_rotation = sinks::file::rotation_at_time_point(
-          0, 0, 0),           /*< ...or at midnight >*/
-      keywords::format = fmt, /*< log record format >*/
-      keywords::auto_flush = true);
-
-  // Setup console logging
-  logging::add_console_log(std::cout, keywords::auto_flush = true,
-                           keywords::format = fmt);
+  if (mode == LOGGING_SYNC) {
+    // Setup file logging
+    state().sinks.push_back(logging::add_file_log(
+        keywords::file_name = file_name, /*< TODO: make file name pattern
+                                            more descriptive, say with time
+                                            file is created >*/
+        keywords::rotation_size =
+            10 * 1024 * 1024, /*< rotate files every 10 MiB... >*/
+        keywords::time_based_rotation = sinks::file::rotation_at_time_point(
+            0, 0, 0),           /*< ...or at midnight >*/
+        keywords::format = fmt, /*< log record format >*/
+        keywords::auto_flush = true));
+
+    // Setup console logging
+    if (log_to_console) {
+      state().sinks.push_back(logging::add_console_log(
+          std::cout, keywords::auto_flush = true, keywords::format = fmt));
+    }
+  } else {
+    // Same files as above, flushed by the flusher once per batch
+    add_async_sink(boost::make_shared<sinks::text_file_backend>(
+                       keywords::file_name = file_name,
+                       keywords::rotation_size = 10 * 1024 * 1024,
+                       keywords::time_based_rotation =
+                           sinks::file::rotation_at_time_point(0, 0, 0)),
+                   fmt);
+    if (log_to_console) {
+      boost::shared_ptr<sinks::text_ostream_backend> console_backend =
+          boost::make_shared<sinks::text_ostream_backend>();
+      console_backend->add_stream(
+          boost::shared_ptr<std::ostream>(&std::cout, boost::null_deleter()));
+      add_async_sink(console_backend, fmt);
+    }
+    state().stopping = false;
+    state().flusher = std::thread(flush_loop);
+  }
 
   // Only logs with a severity greater than or equal to info will show. Severity
   // levels are as follows in order of severity: trace, debug, info, warning,
@@ -62,4 +180,24 @@ void init_logging() {
 
   // Add attributes to the logs
   logging::add_common_attributes();
-}
\ No newline at end of file
+}
+
+void shutdown_logging() {
+  LoggingState &logging_state = state();
+  if (logging_state.flusher.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(logging_state.mutex);
+      logging_state.stopping = true;
+    }
+    logging_state.wake.notify_one();
+    logging_state.flusher.join();
+  }
+  logging::core::get()->flush();
+  for (const boost::shared_ptr<sinks::sink> &sink : logging_state.sinks) {
+    logging::core::get()->remove_sink(sink);
+  }
+  logging_state.sinks.clear();
+  logging_state.drains.clear();
+}
+
+uint64_t dropped_log_records() { return dropped_records; }
@@ -0,0 +1,182 @@
+#include "metrics.h"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+
+namespace {
+
+// The shard the calling thread updates
+size_t shardIndex() {
+  static std::atomic<size_t> next_thread = 0;
+  thread_local const size_t index = next_thread++ % METRICS_SHARDS;
+  return index;
+}
+
+size_t statusIndex(unsigned int status) {
+  auto it = std::find(METRICS_STATUS_CODES.begin(), METRICS_STATUS_CODES.end(),
+                      status);
+  return it - METRICS_STATUS_CODES.begin();
+}
+
+size_t latencyBucket(uint64_t latency_us) {
+  size_t bits = std::bit_width(latency_us);
+  if (bits <= METRICS_FIRST_BUCKET_BITS) {
+    return 0;
+  }
+  return std::min(bits - METRICS_FIRST_BUCKET_BITS,
+                  METRICS_LATENCY_BUCKETS - 1);
+}
+
+// `value` escaped for use as a label value
+std::string escapeLabel(const std::string &value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+// `microseconds` in seconds, without losing precision
+std::string seconds(uint64_t microseconds) {
+  char formatted[32];
+  std::snprintf(formatted, sizeof(formatted), "%llu.%06llu",
+                (unsigned long long)(microseconds / 1000000),
+                (unsigned long long)(microseconds % 1000000));
+  return formatted;
+}
+
+void writeHeader(std::ostream &out, const std::string &name,
+                 const std::string &type, const std::string &help) {
+  out << "# HELP " << name << " " << help << "\n";
+  out << "# TYPE " << name << " " << type << "\n";
+}
+
+} // namespace
+
+MetricsSeries::MetricsSeries(std::string location, std::string handler)
+    : location_(std::move(location)), handler_(std::move(handler)) {}
+
+void MetricsSeries::record(unsigned int status, uint64_t bytes_in,
+                           uint64_t bytes_out,
+                           std::chrono::steady_clock::duration latency) {
+  uint64_t latency_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+  Shard &shard = shards_[shardIndex()];
+  shard.requests.fetch_add(1, std::memory_order_relaxed);
+  shard.bytes_in.fetch_add(bytes_in, std::memory_order_relaxed);
+  shard.bytes_out.fetch_add(bytes_out, std::memory_order_relaxed);
+  shard.statuses[statusIndex(status)].fetch_add(1, std::memory_order_relaxed);
+  shard.latency_buckets[latencyBucket(latency_us)].fetch_add(
+      1, std::memory_order_relaxed);
+  shard.latency_sum_us.fetch_add(latency_us, std::memory_order_relaxed);
+}
+
+MetricsSeries::Totals MetricsSeries::totals() const {
+  Totals totals;
+  for (const Shard &shard : shards_) {
+    totals.requests += shard.requests.load(std::memory_order_relaxed);
+    totals.bytes_in += shard.bytes_in.load(std::memory_order_relaxed);
+    totals.bytes_out += shard.bytes_out.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < totals.statuses.size(); i++) {
+      totals.statuses[i] += shard.statuses[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < totals.latency_buckets.size(); i++) {
+      totals.latency_buckets[i] +=
+          shard.latency_buckets[i].load(std::memory_order_relaxed);
+    }
+    totals.latency_sum_us +=
+        shard.latency_sum_us.load(std::memory_order_relaxed);
+  }
+  return totals;
+}
+
+Metrics &Metrics::GetInstance() {
+  static Metrics instance;
+  return instance;
+}
+
+MetricsSeries &Metrics::series(const std::string &location,
+                               const std::string &handler) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<MetricsSeries> &series = series_[{location, handler}];
+  if (!series) {
+    series = std::make_unique<MetricsSeries>(location, handler);
+  }
+  return *series;
+}
+
+void Metrics::write(std::ostream &out) const {
+  // Shards are merged once per series, not once per metric
+  std::vector<std::pair<std::string, MetricsSeries::Totals>> all_totals;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &[key, series] : series_) {
+      all_totals.emplace_back("location=\"" + escapeLabel(key.first) +
+                                  "\",handler=\"" + escapeLabel(key.second) +
+                                  "\"",
+                              series->totals());
+    }
+  }
+
+  writeHeader(out, "webserver_requests_total", "counter",
+              "Requests served, by location and handler.");
+  for (const auto &[labels, totals] : all_totals) {
+    out << "webserver_requests_total{" << labels << "} " << totals.requests
+        << "\n";
+  }
+  writeHeader(out, "webserver_responses_total", "counter",
+              "Responses sent, by location, handler and status code.");
+  for (const auto &[labels, totals] : all_totals) {
+    for (size_t i = 0; i < totals.statuses.size(); i++) {
+      if (totals.statuses[i] == 0) {
+        continue;
+      }
+      out << "webserver_responses_total{" << labels << ",code=\"";
+      if (i < METRICS_STATUS_CODES.size()) {
+        out << METRICS_STATUS_CODES[i];
+      } else {
+        out << "other";
+      }
+      out << "\"} " << totals.statuses[i] << "\n";
+    }
+  }
+  writeHeader(out, "webserver_request_bytes_total", "counter",
+              "Request body bytes received, by location and handler.");
+  for (const auto &[labels, totals] : all_totals) {
+    out << "webserver_request_bytes_total{" << labels << "} "
+        << totals.bytes_in << "\n";
+  }
+  writeHeader(out, "webserver_response_bytes_total", "counter",
+              "Response body bytes sent, by location and handler.");
+  for (const auto &[labels, totals] : all_totals) {
+    out << "webserver_response_bytes_total{" << labels << "} "
+        << totals.bytes_out << "\n";
+  }
+  writeHeader(out, "webserver_request_duration_seconds", "histogram",
+              "Time from reading a request to writing its response, by "
+              "location and handler.");
+  for (const auto &[labels, totals] : all_totals) {
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i + 1 < METRICS_LATENCY_BUCKETS; i++) {
+      cumulative += totals.latency_buckets[i];
+      out << "webserver_request_duration_seconds_bucket{" << labels
+          << ",le=\""
+          << seconds(uint64_t(1) << (METRICS_FIRST_BUCKET_BITS + i))
+          << "\"} " << cumulative << "\n";
+    }
+    cumulative += totals.latency_buckets.back();
+    out << "webserver_request_duration_seconds_bucket{" << labels
+        << ",le=\"+Inf\"} " << cumulative << "\n";
+    out << "webserver_request_duration_seconds_sum{" << labels << "} "
+        << seconds(totals.latency_sum_us) << "\n";
+    out << "webserver_request_duration_seconds_count{" << labels << "} "
+        << cumulative << "\n";
+  }
+}
@@ -0,0 +1,97 @@
+#include "record_index.h"
+#include <algorithm>
+#include <mutex>
+#include <random>
+
+namespace {
+
+bool isNumeric(const std::string &name) {
+  return !name.empty() && std::all_of(name.begin(), name.end(), [](char c) {
+    return c >= '0' && c <= '9';
+  });
+}
+
+uint64_t randomId() {
+  std::random_device device;
+  return (static_cast<uint64_t>(device()) << 32) | device();
+}
+
+} // namespace
+
+bool RecordOrder::operator()(const std::string &a, const std::string &b) const {
+  bool a_numeric = isNumeric(a);
+  bool b_numeric = isNumeric(b);
+  if (a_numeric != b_numeric) {
+    return a_numeric;
+  }
+  if (a_numeric && a.size() != b.size()) {
+    // IDs are never zero-padded, so a shorter one is smaller
+    return a.size() < b.size();
+  }
+  return a < b;
+}
+
+RecordIndex::RecordIndex() : id_(randomId()) {}
+
+bool RecordIndex::load(const FileSystemInterface &filesystem,
+                       const std::filesystem::path &directory) {
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (loaded_) {
+      return true;
+    }
+  }
+  // Records added or dropped while the directory is listed wait for the
+  // lock, so the index can't miss them
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (loaded_) {
+    return true;
+  }
+  std::optional<std::vector<std::filesystem::path>> files =
+      filesystem.list(directory / "");
+  if (!files.has_value()) {
+    return false;
+  }
+  for (const std::filesystem::path &file : files.value()) {
+    names_.insert(file.filename().string());
+  }
+  loaded_ = true;
+  version_++;
+  return true;
+}
+
+void RecordIndex::insert(const std::string &name) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (loaded_ && names_.insert(name).second) {
+    version_++;
+  }
+}
+
+void RecordIndex::erase(const std::string &name) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (loaded_ && names_.erase(name) > 0) {
+    version_++;
+  }
+}
+
+std::vector<std::string> RecordIndex::page(const std::string &after,
+                                           size_t limit, bool &more) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  auto it = after.empty() ? names_.begin() : names_.upper_bound(after);
+  std::vector<std::string> names;
+  for (; it != names_.end() && names.size() < limit; ++it) {
+    names.push_back(*it);
+  }
+  more = it != names_.end();
+  return names;
+}
+
+uint64_t RecordIndex::version() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return version_;
+}
+
+size_t RecordIndex::size() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return names_.size();
+}
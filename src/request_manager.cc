@@ -1,71 +1,109 @@
 #include "request_manager.h"
+#include "log_severity.h"
 #include "registry.h"
 #include <boost/log/attributes/named_scope.hpp>
 #include <boost/log/trivial.hpp>
 #include <string>
-#include <tuple>
-#include <unordered_set>
+#include <string_view>
+
+namespace {
+
+std::string_view target(const http_request &request) {
+  const boost::beast::string_view target = request.target();
+  return std::string_view(target.data(), target.size());
+}
+
+} // namespace
 
 RequestManager::RequestManager(
-    std::unordered_map<std::string, LocationData> &locations)
-    : locations_(locations) {
-  // Configure path for 404 errors
-  locations_["/"] = LocationData("ErrorHandler", {});
+    std::unordered_map<std::string, LocationData> &locations,
+    size_t pool_size)
+    : pool_size_(pool_size),
+      table_(std::make_shared<const RoutingTable>(locations, pool_size)) {}
+
+void RequestManager::reload(
+    const std::unordered_map<std::string, LocationData> &locations) {
+  // Built before anything is swapped, so a failure leaves the old table
+  std::shared_ptr<const RoutingTable> table =
+      std::make_shared<const RoutingTable>(locations, pool_size_);
+  table_.store(std::move(table));
+  BOOST_LOG_TRIVIAL(info) << "Routing table reloaded with " << locations.size()
+                          << " locations";
+}
+
+std::shared_ptr<const RoutingTable> RequestManager::routingTable() const {
+  // Loaded afresh every time rather than cached per thread, so an idle
+  // thread never keeps a replaced table alive
+  return table_.load();
 }
 
 http_response RequestManager::manageRequest(http_request request) {
-  BOOST_LOG_TRIVIAL(trace) << "RequestManager::manageRequest";
-  // extract path
-  std::string target_path = std::string(request.target());
+  LOG_AT(trace) << "RequestManager::manageRequest";
   // Set payload content length
   request.prepare_payload();
+  std::shared_ptr<const RoutingTable> table = routingTable();
+  return table->handlersFor(target(request)).acquire()->handle_request(request);
+}
 
-  // Find longest matching prefix for location path
-  std::optional<std::string> longest_matched_prefix_optional =
-      matchPath(target_path);
-
-  std::shared_ptr<RequestHandler> handler;
-  if (!longest_matched_prefix_optional.has_value()) {
-    BOOST_LOG_TRIVIAL(warning) << "No matching path/handler found, something "
-                               "wrong on our end, returning 404 error";
-    handler.reset(
-        Registry::GetInstance().initializer_map_["ErrorHandler"]("", {}));
-    return handler->handle_request(request);
-  }
-
-  std::string longest_matched_prefix = longest_matched_prefix_optional.value();
-  BOOST_LOG_TRIVIAL(debug) << "matched path: " << longest_matched_prefix;
-
-  // retrieve data for location (handler name, args)
-  LocationData location_data = locations_[longest_matched_prefix];
+http_response_variant RequestManager::serveRequest(http_request request) {
+  LOG_AT(trace) << "RequestManager::serveRequest";
+  // Set payload content length
+  request.prepare_payload();
+  std::shared_ptr<const RoutingTable> table = routingTable();
+  return table->handlersFor(target(request)).acquire()->serve(request);
+}
 
-  // We have a handler for the matched location
-  BOOST_LOG_TRIVIAL(debug) << "Request manager found appropriate handler: " << location_data.handler_;
-  handler.reset(
-      Registry::GetInstance().initializer_map_[location_data.handler_](
-          longest_matched_prefix, location_data.arg_map_));
-  return handler->handle_request(request);
+RequestManager::Route
+RequestManager::route(const http_request &header) const {
+  std::shared_ptr<const RoutingTable> table = routingTable();
+  HandlerPool &handlers = table->handlersFor(target(header));
+  return Route{std::move(table), &handlers};
 }
 
-std::optional<std::string> RequestManager::matchPath(std::string target_path) {
-  BOOST_LOG_TRIVIAL(trace) << "RequestManager::matchPath";
-  // collect all paths from config locations
-  int longest_path_match = 0;
-  std::string longest_prefix_matched;
-  for (auto key_value : locations_) {
-    std::string path_to_match = key_value.first;
-    if (target_path == path_to_match ||
-        target_path.starts_with(path_to_match + "/")) {
-      if (path_to_match.size() > longest_path_match) {
-        BOOST_LOG_TRIVIAL(debug) << "new longest prefix " << path_to_match;
-        longest_path_match = path_to_match.size();
-        longest_prefix_matched = path_to_match;
-      }
-    }
+MetricsSeries *RequestManager::serveRequestAsync(Route route,
+                                       http_request &request,
+                                       boost::asio::io_service &io_service,
+                                       ResponseCallback done,
+                                       std::shared_ptr<UploadedBody> upload) {
+  LOG_AT(trace) << "RequestManager::serveRequestAsync";
+  // Set payload content length, unless the body is somewhere else
+  if (!upload) {
+    request.prepare_payload();
   }
-  if (longest_path_match > 0) {
-    return longest_prefix_matched;
+  // Keep the handler leased, and the table it belongs to alive, until it has
+  // responded. The lease is released before the table.
+  struct InFlight {
+    std::shared_ptr<const RoutingTable> table;
+    HandlerPool::Lease lease;
+  };
+  HandlerPool &handlers = *route.handlers;
+  std::shared_ptr<InFlight> in_flight =
+      std::make_shared<InFlight>(InFlight{std::move(route.table), handlers.acquire()});
+  ResponseCallback respond = [in_flight, done](http_response_variant response) {
+    done(std::move(response));
+  };
+  if (upload) {
+    in_flight->lease->handle_upload_async(request, std::move(upload),
+                                          io_service, std::move(respond));
   } else {
-    return {};
+    in_flight->lease->handle_request_async(request, io_service,
+                                           std::move(respond));
   }
+  return handlers.metrics();
+}
+
+RequestManager::BodyPolicy
+RequestManager::bodyPolicy(const Route &route, const http_request &header) {
+  HandlerPool &handlers = *route.handlers;
+  BodyPolicy policy{handlers.bodyLimit(), std::nullopt};
+  if (header.method() == boost::beast::http::verb::post ||
+      header.method() == boost::beast::http::verb::put) {
+    policy.upload_directory = handlers.uploadDirectory();
+  }
+  return policy;
+}
+
+std::optional<std::string> RequestManager::matchPath(std::string target_path) {
+  LOG_AT(trace) << "RequestManager::matchPath";
+  return routingTable()->matchPath(target_path);
 }
@@ -0,0 +1,115 @@
+#include "route_trie.h"
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <queue>
+#include <utility>
+
+namespace {
+
+// Mutable tree used only while compiling; std::map keeps children sorted.
+struct BuildNode {
+  std::optional<size_t> route;
+  std::map<std::string, std::unique_ptr<BuildNode>> children;
+};
+
+} // namespace
+
+RouteTrie::RouteTrie() : nodes_(1) {}
+
+RouteTrie::RouteTrie(const std::vector<std::string> &paths) {
+  BuildNode build_root;
+  for (size_t i = 0; i < paths.size(); i++) {
+    const std::string &path = paths[i];
+    if (path.empty()) {
+      continue;
+    }
+    // "/static/css" becomes the segments "", "static", "css"
+    BuildNode *node = &build_root;
+    size_t start = 0;
+    while (true) {
+      size_t end = path.find('/', start);
+      if (end == std::string::npos) {
+        end = path.size();
+      }
+      std::unique_ptr<BuildNode> &child =
+          node->children[path.substr(start, end - start)];
+      if (!child) {
+        child = std::make_unique<BuildNode>();
+      }
+      node = child.get();
+      if (end == path.size()) {
+        break;
+      }
+      start = end + 1;
+    }
+    node->route = i;
+  }
+
+  // Flatten breadth first so each node's children end up contiguous
+  std::queue<const BuildNode *> pending;
+  pending.push(&build_root);
+  nodes_.emplace_back();
+  size_t next_index = 0;
+  while (!pending.empty()) {
+    const BuildNode *build_node = pending.front();
+    pending.pop();
+    Node &node = nodes_[next_index++];
+    node.route = build_node->route;
+    node.first_child = nodes_.size();
+    node.child_count = build_node->children.size();
+    for (const auto &[label, child] : build_node->children) {
+      Node flat_child;
+      flat_child.segment_offset = segments_.size();
+      flat_child.segment_length = label.size();
+      segments_ += label;
+      // `node` may be invalidated by this push, so it is not used afterwards
+      nodes_.push_back(flat_child);
+      pending.push(child.get());
+    }
+  }
+}
+
+std::optional<size_t> RouteTrie::match(std::string_view target) const {
+  const Node *node = &nodes_[0];
+  std::optional<size_t> longest_match;
+  size_t start = 0;
+  while (true) {
+    size_t end = target.find('/', start);
+    if (end == std::string_view::npos) {
+      end = target.size();
+    }
+    node = findChild(*node, target.substr(start, end - start));
+    if (node == nullptr) {
+      break;
+    }
+    // deeper nodes always correspond to longer paths
+    if (node->route.has_value()) {
+      longest_match = node->route;
+    }
+    if (end == target.size()) {
+      break;
+    }
+    start = end + 1;
+  }
+  return longest_match;
+}
+
+std::string_view RouteTrie::segment(const Node &node) const {
+  return std::string_view(segments_).substr(node.segment_offset,
+                                            node.segment_length);
+}
+
+const RouteTrie::Node *RouteTrie::findChild(const Node &node,
+                                            std::string_view segment) const {
+  auto first = nodes_.begin() + node.first_child;
+  auto last = first + node.child_count;
+  auto it = std::lower_bound(first, last, segment,
+                             [this](const Node &child, std::string_view value) {
+                               return this->segment(child) < value;
+                             });
+  if (it == last || this->segment(*it) != segment) {
+    return nullptr;
+  }
+  return &*it;
+}
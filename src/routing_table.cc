@@ -0,0 +1,52 @@
+#include "routing_table.h"
+#include "log_severity.h"
+#include <boost/log/trivial.hpp>
+
+RoutingTable::RoutingTable(
+    const std::unordered_map<std::string, LocationData> &locations,
+    size_t pool_size) {
+  std::unordered_map<std::string, LocationData> all_locations = locations;
+  // Configure path for 404 errors
+  all_locations["/"] = LocationData("ErrorHandler", {});
+
+  // Compile the routing table and build every location's handlers once;
+  // serving a request never touches the map or the registry again
+  std::vector<std::string> paths;
+  for (const auto &[path, location_data] : all_locations) {
+    routes_.push_back({path, location_data,
+                       HandlerPool::Create(location_data.handler_, path,
+                                           location_data.arg_map_, pool_size)});
+    paths.push_back(path);
+  }
+  route_trie_ = RouteTrie(paths);
+  not_found_handlers_ = HandlerPool::Create("ErrorHandler", "", {}, pool_size);
+}
+
+HandlerPool &RoutingTable::handlersFor(std::string_view target) const {
+  // Find longest matching prefix for location path
+  std::optional<size_t> route_index = route_trie_.match(target);
+
+  if (!route_index.has_value()) {
+    BOOST_LOG_TRIVIAL(warning) << "No matching path/handler found, something "
+                               "wrong on our end, returning 404 error";
+    return *not_found_handlers_;
+  }
+
+  // retrieve data for location (path, handler name, args)
+  const Route &route = routes_[route_index.value()];
+  LOG_AT(debug) << "matched path: " << route.path_;
+
+  // We have a handler for the matched location
+  LOG_AT(debug) << "Request manager found appropriate handler: "
+                << route.location_data_.handler_;
+  return *route.handlers_;
+}
+
+std::optional<std::string>
+RoutingTable::matchPath(std::string_view target) const {
+  std::optional<size_t> route_index = route_trie_.match(target);
+  if (!route_index.has_value()) {
+    return {};
+  }
+  return routes_[route_index.value()].path_;
+}
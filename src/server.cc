@@ -1,5 +1,4 @@
 #include "server.h"
-#include "signal_handler.h"
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/bind/bind.hpp>
 #include <boost/log/attributes/named_scope.hpp>
@@ -7,43 +6,75 @@
 
 namespace asio = boost::asio;
 
+typedef asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>
+    reuse_port_option;
+
 server::server(boost::asio::io_service &io_service,
-               RequestManager &request_manager, unsigned short port)
+               RequestManager &request_manager, unsigned short port,
+               bool reuse_port, SessionConfig session_config)
     : io_service_(io_service),
-      acceptor_(io_service, tcp::endpoint(tcp::v4(), port)) {
-  request_manager_.reset(&request_manager);
+      // Accepts complete on the strand, so stop() can close the acceptor
+      // without racing them
+      acceptor_(asio::make_strand(io_service)),
+      // The request manager outlives the server, which does not own it
+      request_manager_(std::shared_ptr<RequestManager>(), &request_manager),
+      session_config_(session_config) {
+  tcp::endpoint endpoint(tcp::v4(), port);
+  acceptor_.open(endpoint.protocol());
+  acceptor_.set_option(tcp::acceptor::reuse_address(true));
+  if (reuse_port) {
+    acceptor_.set_option(reuse_port_option(true));
+  }
+  acceptor_.bind(endpoint);
+  acceptor_.listen();
   BOOST_LOG_TRIVIAL(info) << "Server starting up";
 }
 
 void server::start_accept() {
-  // Log that the connection is started, add signal handler
+  // Log that the connection is started
   BOOST_LOG_NAMED_SCOPE("Start Accept")
   BOOST_LOG_TRIVIAL(info) << "Ready to accept a new connection";
-  std::signal(SIGINT, signalHandler);
 
   // Create new session for server
-  session *new_session = new session(io_service_, request_manager_);
+  std::shared_ptr<session> new_session =
+      std::make_shared<session>(io_service_, request_manager_, session_config_);
   acceptor_.async_accept(new_session->socket(),
                          boost::bind(&server::handle_accept, this, new_session,
                                      boost::asio::placeholders::error));
 }
 
-void server::handle_accept(session *new_session,
+void server::handle_accept(std::shared_ptr<session> new_session,
                            const boost::system::error_code &error) {
   BOOST_LOG_NAMED_SCOPE("Handle Accept")
   BOOST_LOG_TRIVIAL(info) << "New connection request received, starting to accept it";
   if (!error) {
+    // Get the IP address of the client when accepting, before the session
+    // starts using the socket. The client may already have gone.
+    boost::system::error_code endpoint_error;
+    asio::ip::tcp::endpoint remoteEndpoint =
+        new_session->socket().remote_endpoint(endpoint_error);
+    if (!endpoint_error) {
+      BOOST_LOG_TRIVIAL(info) << "Request is coming from ip: "
+                              << remoteEndpoint.address().to_string();
+    }
     new_session->start();
-
-    // Get the IP address of the client when accepting
-    tcp::socket &socket = new_session->socket();
-    asio::ip::tcp::endpoint remoteEndpoint = socket.remote_endpoint();
-    asio::ip::address ipAddress = remoteEndpoint.address();
-    BOOST_LOG_TRIVIAL(info) << "Request is coming from ip: " << ipAddress.to_string();
-  } else {
-    delete new_session;
   }
 
-  // Get ready to accept a new connection
+  // Get ready to accept a new connection, unless we have been stopped
+  if (!acceptor_.is_open()) {
+    return;
+  }
   start_accept();
 }
+
+void server::stop() {
+  asio::post(acceptor_.get_executor(), [this] {
+    BOOST_LOG_TRIVIAL(info) << "Server no longer accepting connections";
+    boost::system::error_code ignored;
+    acceptor_.close(ignored);
+  });
+}
+
+unsigned short server::port() const {
+  return acceptor_.local_endpoint().port();
+}
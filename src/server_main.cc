@@ -8,15 +8,22 @@
 // file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 //
 
+#include "access_log.h"
 #include "config_parser.h"
+#include "config_reloader.h"
+#include "graceful_shutdown.h"
+#include "io_service_pool.h"
 #include "logging.h"
 #include "request_manager.h"
 #include "server.h"
+#include <boost/log/core.hpp>
 #include <boost/log/sources/severity_logger.hpp>
 #include <boost/log/trivial.hpp>
-#include <boost/thread.hpp>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
 
 namespace logging = boost::log;
 namespace src = boost::log::sources;
@@ -24,10 +31,6 @@ namespace src = boost::log::sources;
 int main(int argc, char *argv[]) {
   using namespace logging::trivial;
 
-  // Initialize logging, Demonstrate logging capability.
-  init_logging();
-  BOOST_LOG_TRIVIAL(info) << "Logging Initialized, starting server executable";
-
   // TODO: add logs to the logic here.
   try {
     if (argc != 2) {
@@ -35,9 +38,7 @@ int main(int argc, char *argv[]) {
       return 1;
     }
 
-    boost::asio::io_service io_service;
-
-    // Parse config
+    // Parse config. Until logging is initialized, logs go to the console.
     NginxConfigParser config_parser;
     NginxConfig config;
     bool successful_parse = config_parser.Parse(argv[1], &config);
@@ -45,11 +46,45 @@ int main(int argc, char *argv[]) {
       BOOST_LOG_TRIVIAL(error) << "Config failed to parse & validate";
       throw("Config failed to parse or is invalid");
     }
+    std::optional<LOGGING_MODE> logging_mode = config.findLoggingMode();
+    if (!logging_mode.has_value()) {
+      BOOST_LOG_TRIVIAL(error) << "Log mode not provided properly";
+      throw("Log mode not provided properly");
+    }
+
+    // Initialize logging, Demonstrate logging capability.
+    init_logging(logging_mode.value());
+    BOOST_LOG_TRIVIAL(info) << "Logging Initialized, starting server executable";
+    std::optional<std::string> access_log = config.findAccessLog();
+    if (!access_log.has_value()) {
+      BOOST_LOG_TRIVIAL(error) << "Access log not provided properly";
+      throw("Access log not provided properly");
+    }
+    if (!access_log->empty() && !AccessLog::GetInstance().open(access_log.value())) {
+      throw("Access log could not be opened");
+    }
+
     int port_number = config.findPort();
     if (port_number == -1) {
       BOOST_LOG_TRIVIAL(error) << "Port not provided properly";
       throw("Port number not provided properly");
     }
+    std::optional<THREADING_MODE> threading_mode = config.findThreadingMode();
+    if (!threading_mode.has_value()) {
+      BOOST_LOG_TRIVIAL(error) << "Threading mode not provided properly";
+      throw("Threading mode not provided properly");
+    }
+    std::optional<SessionConfig> session_config = config.findSessionConfig();
+    if (!session_config.has_value()) {
+      BOOST_LOG_TRIVIAL(error) << "Connection settings not provided properly";
+      throw("Connection settings not provided properly");
+    }
+    std::optional<std::chrono::seconds> shutdown_timeout =
+        config.findShutdownTimeout();
+    if (!shutdown_timeout.has_value()) {
+      BOOST_LOG_TRIVIAL(error) << "Shutdown timeout not provided properly";
+      throw("Shutdown timeout not provided properly");
+    }
 
     // Setup request manager
     std::optional<std::unordered_map<std::string, LocationData>> locations =
@@ -60,20 +95,43 @@ int main(int argc, char *argv[]) {
     }
     RequestManager request_manager = RequestManager(locations.value());
 
-    // Setup server
-    server s(io_service, request_manager, port_number);
-    s.start_accept();
-
-    // Run io with thread pool
-    boost::thread_group tg;
-    for (unsigned i = 0; i < std::thread::hardware_concurrency(); ++i) {
-        tg.create_thread(boost::bind(&boost::asio::io_service::run, &io_service));
+    // Setup I/O threads, and a server accepting on each of their io_services
+    IoServicePool io_services(threading_mode.value(),
+                              std::thread::hardware_concurrency());
+    std::vector<std::unique_ptr<server>> servers;
+    std::vector<server *> server_ptrs;
+    for (size_t i = 0; i < io_services.size(); i++) {
+      servers.push_back(std::make_unique<server>(
+          io_services.get(i), request_manager, port_number,
+          threading_mode.value() != THREADING_SHARED,
+          session_config.value()));
+      servers.back()->start_accept();
+      server_ptrs.push_back(servers.back().get());
     }
-    tg.join_all();
 
+    // Swaps in the config's locations on SIGHUP
+    ConfigReloader reloader(io_services.get(0), argv[1], request_manager);
+
+    // Runs until SIGINT or SIGTERM, and the connections have drained
+    GracefulShutdown shutdown(io_services, server_ptrs,
+                              shutdown_timeout.value());
+    io_services.run();
+
+    if (!shutdown.drained()) {
+      // Handlers may still be running on other threads, so nothing they
+      // use can be safely destroyed
+      BOOST_LOG_TRIVIAL(warning) << "Exiting with requests still in flight";
+      AccessLog::GetInstance().flush();
+      logging::core::get()->flush();
+      std::_Exit(EXIT_FAILURE);
+    }
+    BOOST_LOG_TRIVIAL(info) << "Server shut down";
   } catch (std::exception &e) {
     std::cerr << "Exception: " << e.what() << "\n";
   }
 
+  // Handlers, and the storage they write to, are destroyed by now
+  AccessLog::GetInstance().close();
+  shutdown_logging();
   return 0;
 }
@@ -1,51 +1,649 @@
 #include "session.h"
+#include "access_log.h"
+#include "log_severity.h"
+#include <boost/beast/core/ostream.hpp>
 #include <boost/bind/bind.hpp>
+#include <cerrno>
+#include <limits>
+#include <system_error>
+#include <sys/sendfile.h>
+#include <vector>
 
 session::session(boost::asio::io_service &io_service,
-                 std::shared_ptr<RequestManager> request_manager)
-    : socket_(io_service), request_manager_(request_manager) {}
+                 std::shared_ptr<RequestManager> request_manager,
+                 SessionConfig config)
+    : config_(config), io_service_(io_service),
+      socket_(boost::asio::make_strand(io_service)),
+      request_manager_(request_manager), read_timer_(socket_.get_executor()),
+      write_timer_(socket_.get_executor()) {}
 
 tcp::socket &session::socket() { return socket_; }
 
-// Start reading from socket into buffer data_
-// Completion handler is handle_read
 void session::start() {
-  boost::beast::http::async_read(
-      socket_, request_buf_, request_,
-      boost::beast::bind_front_handler(&session::handle_read, this));
+  SessionRegistry::GetInstance().add(shared_from_this());
+  clear_deadline(read_timer_);
+  clear_deadline(write_timer_);
+  wait_for_deadline(read_timer_);
+  wait_for_deadline(write_timer_);
+  start_read();
 }
 
-// Creates HTTP response from a vector of buffers holding responseHeader and
-// data_ This vector of buffers is converted to a stirng then written to socket_
-// Completion handler of this write to socket_ is handle_write
+uint64_t session::timeoutCount(SESSION_TIMEOUT timeout) {
+  return timeout_counts_[timeout].load(std::memory_order_relaxed);
+}
+
+// Wait for the next request to start arriving
+// Completion handler is handle_wait_read
+void session::start_read() {
+  if (reading_ || read_closed_ || pipeline_.size() >= config_.pipeline_depth) {
+    return;
+  }
+  reading_ = true;
+  if (request_buf_.size() > 0) {
+    read_header();
+    return;
+  }
+  // Only a connection with nothing in flight is idle; otherwise the client
+  // is waiting on us
+  read_timeout_ = SESSION_IDLE_TIMEOUT;
+  if (pipeline_.empty()) {
+    set_deadline(read_timer_, config_.idle_timeout);
+  }
+  socket_.async_wait(
+      tcp::socket::wait_read,
+      boost::beast::bind_front_handler(&session::handle_wait_read, shared_from_this()));
+}
+
+void session::handle_wait_read(const boost::system::error_code &error) {
+  if (error) {
+    handle_read(error, 0);
+    return;
+  }
+  read_header();
+}
+
+// Read the header of the next request into parser_
+// Completion handler is handle_read_header
+void session::read_header() {
+  read_timeout_ = SESSION_HEADER_TIMEOUT;
+  set_deadline(read_timer_, config_.header_timeout);
+  parser_.emplace();
+  // Each location has its own limit, checked once the header says which
+  // location the request is for. Beast treats boost::none as smaller than
+  // any Content-Length, so the check is held off with the largest limit.
+  parser_->body_limit(std::numeric_limits<uint64_t>::max());
+  boost::beast::http::async_read_header(
+      socket_, request_buf_, *parser_,
+      boost::beast::bind_front_handler(&session::handle_read_header, shared_from_this()));
+}
+
+// Read the rest of the request, if it has a body
+// Completion handler is handle_read_body, or handle_read_upload
+void session::handle_read_header(const boost::system::error_code &error,
+                                 size_t bytes_transferred) {
+  if (!error) {
+    route_ = request_manager_->route(parser_->get());
+  }
+  if (error || parser_->is_done()) {
+    handle_read(error, bytes_transferred);
+    return;
+  }
+  RequestManager::BodyPolicy policy =
+      RequestManager::bodyPolicy(route_, parser_->get());
+  if (parser_->content_length().value_or(0) > policy.limit) {
+    handle_read(boost::beast::http::error::body_limit, bytes_transferred);
+    return;
+  }
+  // A chunked body is held to the limit as it arrives
+  parser_->body_limit(policy.limit);
+  read_timeout_ = SESSION_BODY_TIMEOUT;
+  set_deadline(read_timer_, config_.body_timeout);
+  if (policy.upload_directory.has_value()) {
+    read_upload(policy.upload_directory.value());
+    return;
+  }
+  read_body();
+}
+
+// Read the body into the request a piece at a time
+void session::read_body() {
+  boost::beast::http::async_read_some(
+      socket_, request_buf_, *parser_,
+      boost::beast::bind_front_handler(&session::handle_read_body, shared_from_this()));
+}
+
+void session::handle_read_body(const boost::system::error_code &error,
+                               size_t bytes_transferred) {
+  if (error || parser_->is_done()) {
+    handle_read(error, bytes_transferred);
+    return;
+  }
+  if (bytes_transferred > 0) {
+    // The client is keeping up; give it a full body_timeout again
+    set_deadline(read_timer_, config_.body_timeout);
+  }
+  read_body();
+}
+
+// Hands the request to the request manager, whose handler responds in
+// handle_response, and reads the next one
 void session::handle_read(const boost::system::error_code &error,
                           size_t bytes_transferred) {
+  reading_ = false;
+  clear_deadline(read_timer_);
   if (error) {
-    BOOST_LOG_TRIVIAL(error) << "Problem parsing the http request: "  << error.message();
-    response_.result(boost::beast::http::status::bad_request);
-    response_.set(boost::beast::http::field::content_type, "text/plain");
-    boost::beast::http::write(socket_, response_);
-    delete this;
+    route_ = {};
+    read_closed_ = true;
+    if (error == boost::beast::http::error::end_of_stream ||
+        error == boost::asio::error::operation_aborted) {
+      LOG_AT(debug) << "Connection closed: " << error.message();
+    } else if (error == boost::beast::http::error::body_limit) {
+      BOOST_LOG_TRIVIAL(info) << "Request body over the location's body_limit";
+      reject(PAYLOAD_TOO_LARGE_STATUS);
+    } else {
+      BOOST_LOG_TRIVIAL(error) << "Problem parsing the http request: "  << error.message();
+      reject(BAD_REQUEST_STATUS);
+    }
+    write_responses();
     return;
   }
-  response_ = request_manager_->manageRequest(request_);
-  boost::beast::http::async_write(
-      socket_, response_,
-      boost::beast::bind_front_handler(&session::handle_write, this));
+
+  http_request request = parser_->release();
+  parser_.reset();
+  dispatch(std::move(request), nullptr);
 }
 
-// Read from socket into data_
-// Completion handler is handle_read
-// These two handle functions give us a loop allowing user to send another
-// request after response from first is
+// Write the body to the temporary file as it arrives, a piece at a time
+// Completion handler is handle_read_upload
+void session::read_upload(const std::filesystem::path &directory) {
+  std::error_code ignored;
+  std::filesystem::create_directories(directory, ignored);
+  upload_path_ = UploadedBody::temporaryPath(directory);
+  upload_parser_.emplace(std::move(*parser_));
+  parser_.reset();
+  boost::beast::error_code error;
+  upload_parser_->get().body().open(upload_path_.c_str(),
+                                    boost::beast::file_mode::write_new, error);
+  if (error) {
+    BOOST_LOG_TRIVIAL(error) << "Failed to open " << upload_path_
+                             << " for an upload: " << error.message();
+    upload_parser_.reset();
+    // The body is still on its way, so nothing more can be read
+    reading_ = false;
+    read_closed_ = true;
+    clear_deadline(read_timer_);
+    reject(INTERNAL_SERVER_ERROR_STATUS);
+    write_responses();
+    return;
+  }
+  read_upload_some();
+}
+
+void session::read_upload_some() {
+  boost::beast::http::async_read_some(
+      socket_, request_buf_, *upload_parser_,
+      boost::beast::bind_front_handler(&session::handle_read_upload, shared_from_this()));
+}
+
+void session::handle_read_upload(const boost::system::error_code &error,
+                                 size_t bytes_transferred) {
+  if (error) {
+    upload_parser_.reset();
+    std::error_code ignored;
+    std::filesystem::remove(upload_path_, ignored);
+    handle_read(error, bytes_transferred);
+    return;
+  }
+  if (!upload_parser_->is_done()) {
+    if (bytes_transferred > 0) {
+      set_deadline(read_timer_, config_.body_timeout);
+    }
+    read_upload_some();
+    return;
+  }
+  reading_ = false;
+  clear_deadline(read_timer_);
+  boost::beast::http::request<boost::beast::http::file_body> message =
+      upload_parser_->release();
+  upload_parser_.reset();
+  // Flushed before the handler gets to it
+  message.body().close();
+  std::error_code size_error;
+  uint64_t size = std::filesystem::file_size(upload_path_, size_error);
+  dispatch(http_request(std::move(message.base())),
+           std::make_shared<UploadedBody>(upload_path_, size_error ? 0 : size));
+}
+
+namespace {
+
+// Whether requests with `method` may be handled alongside others: they don't
+// change anything, so the order they run in can't be told apart (RFC 9110
+// section 9.2.1)
+bool isSafe(boost::beast::http::verb method) {
+  return method == boost::beast::http::verb::get ||
+         method == boost::beast::http::verb::head ||
+         method == boost::beast::http::verb::options;
+}
+
+} // namespace
+
+void session::dispatch(http_request request,
+                       std::shared_ptr<UploadedBody> upload) {
+  pipeline_.push_back(std::make_unique<PendingRequest>());
+  PendingRequest *pending = pipeline_.back().get();
+  pending->request = std::move(request);
+  pending->upload = std::move(upload);
+  pending->route = std::move(route_);
+  dispatch_ready();
+  start_read();
+}
+
+void session::dispatch_ready() {
+  // A handler that responds inline comes back here through handle_response;
+  // the outer call picks up whatever it unblocked
+  if (dispatching_) {
+    redispatch_ = true;
+    return;
+  }
+  dispatching_ = true;
+  do {
+    redispatch_ = false;
+    bool earlier_in_flight = false;
+    for (size_t i = 0; i < pipeline_.size(); i++) {
+      PendingRequest &pending = *pipeline_[i];
+      if (pending.response.has_value()) {
+        continue;
+      }
+      bool safe = isSafe(pending.request.method());
+      if (!pending.handled) {
+        if (write_failed_) {
+          // Nobody is left to read the answers to the requests held back
+          pipeline_.erase(pipeline_.begin() + i, pipeline_.end());
+          break;
+        }
+        if (!safe && earlier_in_flight) {
+          break;
+        }
+        handle(&pending);
+        // Handling may have changed the pipeline; look again from the start
+        redispatch_ = true;
+        break;
+      }
+      if (!safe) {
+        // Nothing after it runs until it is done
+        break;
+      }
+      earlier_in_flight = true;
+    }
+  } while (redispatch_);
+  dispatching_ = false;
+}
+
+void session::handle(PendingRequest *pending) {
+  pending->handled = true;
+  pending->metrics = request_manager_->serveRequestAsync(
+      std::move(pending->route), pending->request, io_service_,
+      [self = shared_from_this(), pending](http_response_variant response) {
+        // Runs inline if we are already on the socket's strand
+        boost::asio::dispatch(
+            self->socket_.get_executor(),
+            [self, pending, response = std::move(response)]() mutable {
+              self->handle_response(pending, std::move(response));
+            });
+      },
+      pending->upload);
+}
+
+void session::reject(unsigned int status) {
+  http_response response;
+  response.result(status);
+  response.set(boost::beast::http::field::content_type, "text/plain");
+  response.prepare_payload();
+  pipeline_.push_back(std::make_unique<PendingRequest>());
+  pipeline_.back()->response = std::move(response);
+}
+
+void session::handle_response(PendingRequest *pending,
+                              http_response_variant response) {
+  pending->response = std::move(response);
+  if (!isSafe(pending->request.method())) {
+    dispatch_ready();
+  }
+  write_responses();
+}
+
+void session::write_responses() {
+  if (writing_) {
+    return;
+  }
+  if (write_failed_) {
+    // Nobody is left to read these
+    while (!pipeline_.empty() && pipeline_.front()->response.has_value()) {
+      pipeline_.pop_front();
+    }
+  }
+  if (write_failed_ || pipeline_.empty() ||
+      !pipeline_.front()->response.has_value()) {
+    finish_if_done();
+    return;
+  }
+
+  writing_ = true;
+  set_deadline(write_timer_, config_.write_timeout);
+  // Gather the string responses ready at the front into one write
+  size_t ready = 0;
+  while (ready < pipeline_.size() &&
+         pipeline_[ready]->response.has_value() &&
+         std::holds_alternative<http_response>(*pipeline_[ready]->response)) {
+    ready++;
+  }
+  if (ready > 1) {
+    responses_in_write_ = ready;
+    {
+      // Commits to write_buf_ when it goes out of scope
+      auto stream = boost::beast::ostream(write_buf_);
+      for (size_t i = 0; i < ready; i++) {
+        stream << std::get<http_response>(*pipeline_[i]->response);
+      }
+    }
+    write_buffered();
+    return;
+  }
+  responses_in_write_ = 1;
+  std::visit([this](auto &response) { write_response(response); },
+             *pipeline_.front()->response);
+}
+
+void session::write_buffered() {
+  socket_.async_write_some(
+      write_buf_.data(),
+      [this, self = shared_from_this()](const boost::system::error_code &error,
+                                        size_t bytes_transferred) {
+        if (error) {
+          handle_write(error, bytes_transferred);
+          return;
+        }
+        write_buf_.consume(bytes_transferred);
+        if (write_buf_.size() == 0) {
+          handle_write(error, bytes_transferred);
+          return;
+        }
+        // The client is keeping up; give it a full write_timeout again
+        set_deadline(write_timer_, config_.write_timeout);
+        write_buffered();
+      });
+}
+
+template <class Serializer>
+void session::write_serialized(Serializer &serializer) {
+  boost::beast::http::async_write_some(
+      socket_, serializer,
+      [this, self = shared_from_this(), &serializer](
+          const boost::system::error_code &error, size_t bytes_transferred) {
+        if (error || serializer.is_done()) {
+          handle_write(error, bytes_transferred);
+          return;
+        }
+        if (bytes_transferred > 0) {
+          set_deadline(write_timer_, config_.write_timeout);
+        }
+        write_serialized(serializer);
+      });
+}
+
+void session::write_response(http_response &response) {
+  string_serializer_.emplace(response);
+  write_serialized(*string_serializer_);
+}
+
+void session::write_response(http_stream_response &response) {
+  // Each piece of the body goes out as a chunk as soon as it is produced
+  stream_serializer_.emplace(response);
+  write_serialized(*stream_serializer_);
+}
+
+void session::write_response(http_file_response &response) {
+  // Only the header goes through Beast; the body never enters user space
+  file_serializer_.emplace(response);
+  file_offset_ = 0;
+  boost::beast::http::async_write_header(
+      socket_, *file_serializer_,
+      boost::beast::bind_front_handler(&session::handle_write_header, shared_from_this()));
+}
+
+void session::handle_write_header(const boost::system::error_code &error,
+                                  size_t bytes_transferred) {
+  if (error) {
+    handle_write(error, bytes_transferred);
+    return;
+  }
+  send_file_body();
+}
+
+void session::send_file_body() {
+  http_file_body::value_type &body = std::get<http_file_response>(*pipeline_.front()->response).body();
+  // file_offset_ counts the bytes sent from the start of the body, which
+  // may be a slice from the middle of the file
+  const uint64_t body_size = body.size();
+  socket_.native_non_blocking(true);
+  while (file_offset_ < body_size) {
+    off_t offset = body.offset() + file_offset_;
+    ssize_t sent = ::sendfile(socket_.native_handle(),
+                              body.file().native_handle(), &offset,
+                              body_size - file_offset_);
+    if (sent > 0) {
+      file_offset_ += sent;
+      // The client is keeping up; give it a full write_timeout again
+      set_deadline(write_timer_, config_.write_timeout);
+    } else if (sent < 0 && errno == EINTR) {
+      continue;
+    } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      // Socket buffer is full; resume once the client has drained some of it
+      socket_.async_wait(tcp::socket::wait_write,
+                         [this, self = shared_from_this()](
+                             const boost::system::error_code &error) {
+                           if (error) {
+                             handle_write(error, file_offset_);
+                             return;
+                           }
+                           send_file_body();
+                         });
+      return;
+    } else {
+      // sendfile failed, or the file shrank after its header was written
+      boost::system::error_code error =
+          sent < 0 ? boost::system::error_code(errno, boost::system::system_category())
+                   : boost::asio::error::eof;
+      BOOST_LOG_TRIVIAL(error) << "Failed to send file body: " << error.message();
+      handle_write(error, file_offset_);
+      return;
+    }
+  }
+  handle_write({}, file_offset_);
+}
+
+// Drops the responses written, then writes the next ready ones and, with room
+// in the pipeline again, reads the next request
 void session::handle_write(const boost::system::error_code &error,
                            size_t bytes_transferred) {
+  writing_ = false;
+  clear_deadline(write_timer_);
+  // Release the responses, closing any file they held open
+  string_serializer_.reset();
+  stream_serializer_.reset();
+  file_serializer_.reset();
+  write_buf_.clear();
+  for (size_t i = 0; i < responses_in_write_; i++) {
+    if (!error) {
+      record_response(*pipeline_.front());
+    }
+    pipeline_.pop_front();
+  }
+  responses_in_write_ = 0;
   if (error) {
-    delete this;
+    LOG_AT(debug) << "Failed to write response: " << error.message();
+    close();
+  } else if (reading_ && read_timeout_ == SESSION_IDLE_TIMEOUT &&
+             pipeline_.empty()) {
+    // Nothing is in flight any more while we wait for the next request
+    set_deadline(read_timer_, config_.idle_timeout);
+  }
+  start_read();
+  write_responses();
+}
+
+void session::record_response(const PendingRequest &pending) {
+  AccessLog &access_log = AccessLog::GetInstance();
+  if (pending.metrics == nullptr && !access_log.enabled()) {
+    return;
+  }
+  unsigned int status = 0;
+  uint64_t bytes = 0;
+  std::visit(
+      [&](auto &response) {
+        status = response.result_int();
+        bytes = response.body().size();
+      },
+      *pending.response);
+  std::chrono::steady_clock::duration latency =
+      std::chrono::steady_clock::now() - pending.received;
+  if (pending.metrics != nullptr) {
+    uint64_t request_bytes = pending.upload ? pending.upload->size()
+                                            : pending.request.body().size();
+    pending.metrics->record(status, request_bytes, bytes, latency);
+  }
+  if (access_log.enabled()) {
+    boost::beast::string_view target = pending.request.target();
+    access_log.record(pending.received_at, latency, status, bytes,
+                      pending.metrics != nullptr ? pending.metrics->handler()
+                                                 : "-",
+                      std::string_view(target.data(), target.size()));
+  }
+}
+
+void session::set_deadline(boost::asio::steady_timer &timer,
+                           std::chrono::seconds timeout) {
+  if (timeout.count() == 0) {
+    clear_deadline(timer);
     return;
   }
-  request_.body() = "";
-  boost::beast::http::async_read(
-      socket_, request_buf_, request_,
-      boost::beast::bind_front_handler(&session::handle_read, this));
+  timer.expires_after(timeout);
+}
+
+void session::clear_deadline(boost::asio::steady_timer &timer) {
+  timer.expires_at(boost::asio::steady_timer::time_point::max());
+}
+
+void session::wait_for_deadline(boost::asio::steady_timer &timer) {
+  // Weak, so a wait still outstanding never keeps a finished session alive;
+  // the reads and writes in progress do that
+  timer.async_wait([weak_self = weak_from_this(),
+                    &timer](const boost::system::error_code &) {
+    if (std::shared_ptr<session> self = weak_self.lock()) {
+      self->handle_deadline(timer);
+    }
+  });
+}
+
+// Runs whenever the timer expires or its expiry is moved
+void session::handle_deadline(boost::asio::steady_timer &timer) {
+  if (finished_) {
+    // Let go of the session
+    return;
+  }
+  if (timer.expiry() <= boost::asio::steady_timer::clock_type::now()) {
+    handle_timeout(&timer == &read_timer_ ? read_timeout_
+                                          : SESSION_WRITE_TIMEOUT);
+    clear_deadline(timer);
+  }
+  wait_for_deadline(timer);
+}
+
+const char *timeoutName(SESSION_TIMEOUT timeout) {
+  static const char *const names[SESSION_TIMEOUT_COUNT] = {"idle", "header",
+                                                           "body", "write"};
+  return names[timeout];
+}
+
+void session::handle_timeout(SESSION_TIMEOUT timeout) {
+  timeout_counts_[timeout].fetch_add(1, std::memory_order_relaxed);
+  BOOST_LOG_TRIVIAL(info) << "Closing connection: " << timeoutName(timeout)
+                          << " timeout";
+  // The reads and writes in progress fail, and then finish the session
+  close();
+}
+
+void session::close() {
+  read_closed_ = true;
+  write_failed_ = true;
+  // Cancels any read or write in progress
+  boost::system::error_code ignored;
+  socket_.close(ignored);
+}
+
+void session::finish_if_done() {
+  if (finished_ || !read_closed_ || reading_ || writing_ || !pipeline_.empty()) {
+    return;
+  }
+  // Once the handlers in progress return nothing refers to the session any
+  // more, and it is destroyed. It stops counting as live right away.
+  finished_ = true;
+  read_timer_.cancel();
+  write_timer_.cancel();
+  boost::system::error_code ignored;
+  socket_.close(ignored);
+  SessionRegistry::GetInstance().remove(this);
+}
+
+void session::shutdown() {
+  boost::asio::dispatch(socket_.get_executor(), [self = shared_from_this()] {
+    self->read_closed_ = true;
+    if (self->reading_ && self->read_timeout_ == SESSION_IDLE_TIMEOUT) {
+      // Wake the wait for a request that has not started arriving; one
+      // already arriving is read and answered
+      boost::system::error_code ignored;
+      self->socket_.shutdown(tcp::socket::shutdown_receive, ignored);
+    }
+    self->write_responses();
+  });
+}
+
+session::~session() { SessionRegistry::GetInstance().remove(this); }
+
+SessionRegistry &SessionRegistry::GetInstance() {
+  static SessionRegistry instance;
+  return instance;
+}
+
+void SessionRegistry::add(const std::shared_ptr<session> &live_session) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sessions_[live_session.get()] = live_session;
+}
+
+void SessionRegistry::remove(session *finished_session) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sessions_.erase(finished_session);
+}
+
+size_t SessionRegistry::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sessions_.size();
+}
+
+void SessionRegistry::shutdownAll() {
+  std::vector<std::shared_ptr<session>> live_sessions;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &[_, weak_session] : sessions_) {
+      // Null if the session is already being destroyed
+      if (std::shared_ptr<session> live_session = weak_session.lock()) {
+        live_sessions.push_back(std::move(live_session));
+      }
+    }
+  }
+  BOOST_LOG_TRIVIAL(info) << "Shutting down " << live_sessions.size()
+                          << " connections";
+  for (std::shared_ptr<session> &live_session : live_sessions) {
+    live_session->shutdown();
+  }
 }
@@ -0,0 +1,100 @@
+#include "access_log.h"
+#include "gtest/gtest.h"
+#include <fstream>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+class AccessLogTest : public testing::Test {
+protected:
+  void SetUp() override {
+    path = fs::temp_directory_path() /
+           ("access_log_test_" + std::to_string(::getpid()));
+    fs::remove(path);
+  }
+  void TearDown() override {
+    access_log.close();
+    fs::remove(path);
+  }
+  void record(unsigned int status, std::string_view handler,
+              std::string_view target) {
+    access_log.record(received, std::chrono::microseconds(1500), status, 42,
+                      handler, target);
+  }
+  AccessLog &access_log = AccessLog::GetInstance();
+  fs::path path;
+  std::chrono::system_clock::time_point received =
+      std::chrono::system_clock::time_point(std::chrono::seconds(1700000000));
+};
+
+// Records are read back as written, and nothing is written while closed
+TEST_F(AccessLogTest, RoundTrip) {
+  record(200, "EchoHandler", "/echo");
+  EXPECT_FALSE(access_log.enabled());
+
+  ASSERT_TRUE(access_log.open(path));
+  EXPECT_TRUE(access_log.enabled());
+  record(200, "EchoHandler", "/echo");
+  record(404, "ErrorHandler", "/missing");
+  record(200, "EchoHandler", "/echo");
+  access_log.close();
+
+  std::optional<std::vector<AccessLogEntry>> entries = AccessLog::read(path);
+  ASSERT_TRUE(entries.has_value());
+  ASSERT_EQ(entries->size(), 3);
+  EXPECT_EQ(entries->at(0).timestamp, received);
+  EXPECT_EQ(entries->at(0).handler, "EchoHandler");
+  EXPECT_EQ(entries->at(0).status, 200);
+  EXPECT_EQ(entries->at(0).bytes, 42);
+  EXPECT_EQ(entries->at(0).latency, std::chrono::microseconds(1500));
+  EXPECT_EQ(entries->at(0).path, "/echo");
+  EXPECT_EQ(entries->at(1).handler, "ErrorHandler");
+  EXPECT_EQ(entries->at(1).status, 404);
+  EXPECT_EQ(entries->at(1).path, "/missing");
+  EXPECT_EQ(entries->at(2).path, "/echo");
+}
+
+// Repeated strings are only written once
+TEST_F(AccessLogTest, InternsStrings) {
+  ASSERT_TRUE(access_log.open(path));
+  for (int i = 0; i < 100; i++) {
+    record(200, "StaticHandler", "/static/index.html");
+  }
+  access_log.close();
+  EXPECT_EQ(fs::file_size(path),
+            ACCESS_LOG_MAGIC.size() + 2 * sizeof(AccessLogString) +
+                std::string("StaticHandler/static/index.html").size() +
+                100 * sizeof(AccessLogRecord));
+}
+
+// Reopening appends to the log, and a torn record at the end is ignored
+TEST_F(AccessLogTest, AppendsAndSkipsTornRecord) {
+  ASSERT_TRUE(access_log.open(path));
+  record(200, "EchoHandler", "/echo");
+  access_log.close();
+  ASSERT_TRUE(access_log.open(path));
+  record(201, "CrudHandler", "/api/Shoes");
+  access_log.close();
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::app);
+    file << std::string(sizeof(AccessLogRecord) / 2, '\0');
+  }
+
+  std::optional<std::vector<AccessLogEntry>> entries = AccessLog::read(path);
+  ASSERT_TRUE(entries.has_value());
+  ASSERT_EQ(entries->size(), 2);
+  EXPECT_EQ(entries->at(0).path, "/echo");
+  EXPECT_EQ(entries->at(1).handler, "CrudHandler");
+  EXPECT_EQ(entries->at(1).status, 201);
+}
+
+// Files which are not access logs are neither appended to nor read
+TEST_F(AccessLogTest, RejectsOtherFiles) {
+  {
+    std::ofstream file(path);
+    file << "not an access log";
+  }
+  EXPECT_FALSE(access_log.open(path));
+  EXPECT_FALSE(AccessLog::read(path).has_value());
+  EXPECT_FALSE(AccessLog::read(path.string() + "_missing").has_value());
+}
@@ -0,0 +1,41 @@
+#include "blocking_executor.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <future>
+#include <thread>
+
+class BlockingExecutorTest : public testing::Test {
+protected:
+  void SetUp() override {}
+};
+
+// Posted work runs on the executor's threads
+TEST_F(BlockingExecutorTest, RunsWork) {
+  BlockingExecutor executor(2, 10);
+  std::promise<std::thread::id> ran_on;
+  EXPECT_TRUE(executor.post(
+      [&] { ran_on.set_value(std::this_thread::get_id()); }));
+  EXPECT_NE(ran_on.get_future().get(), std::this_thread::get_id());
+}
+
+// Work is rejected once max_pending tasks are queued or running, and
+// accepted again once they finish
+TEST_F(BlockingExecutorTest, RejectsWhenFull) {
+  BlockingExecutor executor(1, 2);
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::atomic<int> finished = 0;
+  EXPECT_TRUE(executor.post([&, released] { released.wait(); finished++; }));
+  EXPECT_TRUE(executor.post([&, released] { released.wait(); finished++; }));
+  EXPECT_FALSE(executor.post([&] { finished++; }));
+  EXPECT_EQ(executor.pending(), 2);
+
+  release.set_value();
+  while (executor.pending() > 0) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(finished, 2);
+  std::promise<void> ran;
+  EXPECT_TRUE(executor.post([&] { ran.set_value(); }));
+  ran.get_future().wait();
+}
@@ -0,0 +1,55 @@
+#include "byte_range.h"
+#include "gtest/gtest.h"
+
+typedef std::vector<ByteRange> Ranges;
+
+TEST(ByteRangeTest, SingleRanges) {
+  EXPECT_EQ(parseRange("bytes=0-499", 1000), Ranges({{0, 499}}));
+  EXPECT_EQ(parseRange("bytes=500-", 1000), Ranges({{500, 999}}));
+  EXPECT_EQ(parseRange("bytes=-200", 1000), Ranges({{800, 999}}));
+  // ends past the last byte are pulled back to it
+  EXPECT_EQ(parseRange("bytes=900-5000", 1000), Ranges({{900, 999}}));
+  EXPECT_EQ(parseRange("bytes=-5000", 1000), Ranges({{0, 999}}));
+  EXPECT_EQ(parseRange(" bytes=0-0 ", 1000), Ranges({{0, 0}}));
+  EXPECT_EQ(parseRange("bytes=0-499", 1000).value().front().length(), 500);
+}
+
+TEST(ByteRangeTest, MultipleRanges) {
+  EXPECT_EQ(parseRange("bytes=0-9, 20-29,-5", 100),
+            Ranges({{0, 9}, {20, 29}, {95, 99}}));
+  // unsatisfiable ranges are dropped, and empty elements skipped
+  EXPECT_EQ(parseRange("bytes=0-9,,200-300", 100), Ranges({{0, 9}}));
+}
+
+// No satisfiable range means a 416
+TEST(ByteRangeTest, Unsatisfiable) {
+  EXPECT_EQ(parseRange("bytes=1000-", 1000), Ranges());
+  EXPECT_EQ(parseRange("bytes=1000-2000,5000-", 1000), Ranges());
+  EXPECT_EQ(parseRange("bytes=-0", 1000), Ranges());
+  EXPECT_EQ(parseRange("bytes=0-", 0), Ranges());
+  EXPECT_EQ(parseRange("bytes=-10", 0), Ranges());
+}
+
+// A header that can't be understood is ignored
+TEST(ByteRangeTest, Ignored) {
+  EXPECT_EQ(parseRange("items=0-9", 100), std::nullopt);
+  EXPECT_EQ(parseRange("bytes=", 100), std::nullopt);
+  EXPECT_EQ(parseRange("bytes=9-0", 100), std::nullopt);
+  EXPECT_EQ(parseRange("bytes=a-b", 100), std::nullopt);
+  EXPECT_EQ(parseRange("bytes=5", 100), std::nullopt);
+  EXPECT_EQ(parseRange("bytes=0-9,x", 100), std::nullopt);
+  EXPECT_EQ(parseRange("bytes=-", 100), std::nullopt);
+  EXPECT_EQ(parseRange("bytes=99999999999999999999-", 100), std::nullopt);
+
+  std::string many = "bytes=0-0";
+  for (size_t i = 1; i < MAX_BYTE_RANGES; i++) {
+    many += "," + std::to_string(i) + "-" + std::to_string(i);
+  }
+  EXPECT_EQ(parseRange(many, 100).value().size(), MAX_BYTE_RANGES);
+  EXPECT_EQ(parseRange(many + ",50-60", 100), std::nullopt);
+}
+
+TEST(ByteRangeTest, ContentRange) {
+  EXPECT_EQ(contentRange({0, 499}, 1234), "bytes 0-499/1234");
+  EXPECT_EQ(unsatisfiedRange(1234), "bytes */1234");
+}
@@ -0,0 +1,110 @@
+#include "compression.h"
+#include "gtest/gtest.h"
+#include <zlib.h>
+
+class CompressionTest : public testing::Test {
+protected:
+  CompressionPolicy html_policy{
+      {{COMPRESS_TYPES_ARG, "text/html, text/css"}, {COMPRESS_MIN_SIZE_ARG, "16"}}};
+
+  // The encodings `html_policy` picks for an HTML response to a request
+  // sending `accept_encoding`
+  std::vector<CONTENT_ENCODING> encodings(const std::string &accept_encoding) {
+    http_request request{boost::beast::http::verb::get, "/", 11};
+    request.set(http_fields::accept_encoding, accept_encoding);
+    return html_policy.encodings(request, TEXT_HTML);
+  }
+
+  std::string page = std::string(4096, 'a') + "<p>hello</p>";
+};
+
+// Only the configured types are compressed, ignoring any parameters
+TEST_F(CompressionTest, CompressibleTypes) {
+  EXPECT_TRUE(html_policy.enabled());
+  EXPECT_TRUE(html_policy.compressible("text/html"));
+  EXPECT_TRUE(html_policy.compressible("text/css; charset=utf-8"));
+  EXPECT_FALSE(html_policy.compressible("image/png"));
+  EXPECT_EQ(html_policy.minSize(), 16);
+
+  CompressionPolicy off({});
+  EXPECT_FALSE(off.enabled());
+  EXPECT_FALSE(off.compressible("text/html"));
+}
+
+// Encodings are ordered by q-value, then brotli, gzip, deflate; q=0 rules
+// one out, and "*" stands in for any not listed
+TEST_F(CompressionTest, AcceptEncoding) {
+  std::vector<CONTENT_ENCODING> gzip_deflate = {ENCODING_GZIP, ENCODING_DEFLATE};
+  std::vector<CONTENT_ENCODING> all = {ENCODING_GZIP, ENCODING_DEFLATE};
+  if (brotliSupported()) {
+    all.insert(all.begin(), ENCODING_BROTLI);
+  }
+  EXPECT_EQ(encodings("gzip, deflate"), gzip_deflate);
+  EXPECT_EQ(encodings("deflate, GZIP"), gzip_deflate);
+  EXPECT_EQ(encodings("gzip, deflate, br"), all);
+  EXPECT_EQ(encodings("*"), all);
+  EXPECT_EQ(encodings("deflate;q=1.0, gzip;q=0.5"),
+            std::vector<CONTENT_ENCODING>({ENCODING_DEFLATE, ENCODING_GZIP}));
+  EXPECT_EQ(encodings("gzip;q=0, deflate"),
+            std::vector<CONTENT_ENCODING>({ENCODING_DEFLATE}));
+  EXPECT_EQ(encodings("*;q=0, gzip"),
+            std::vector<CONTENT_ENCODING>({ENCODING_GZIP}));
+  EXPECT_TRUE(encodings("identity").empty());
+  EXPECT_TRUE(encodings("").empty());
+
+  http_request request{boost::beast::http::verb::get, "/", 11};
+  EXPECT_TRUE(html_policy.encodings(request, TEXT_HTML).empty());
+  request.set(http_fields::accept_encoding, "gzip");
+  EXPECT_TRUE(html_policy.encodings(request, IMAGE_PNG).empty());
+}
+
+// gzip and deflate output inflates back to the original
+TEST_F(CompressionTest, RoundTrip) {
+  for (CONTENT_ENCODING encoding : {ENCODING_GZIP, ENCODING_DEFLATE}) {
+    std::optional<std::string> compressed = compress(page, encoding);
+    ASSERT_TRUE(compressed.has_value());
+    EXPECT_LT(compressed.value().size(), page.size());
+
+    z_stream stream{};
+    // 32 more window bits detects a gzip or zlib header
+    ASSERT_EQ(inflateInit2(&stream, 15 + 32), Z_OK);
+    std::string inflated(page.size(), '\0');
+    stream.next_in = reinterpret_cast<Bytef *>(compressed.value().data());
+    stream.avail_in = compressed.value().size();
+    stream.next_out = reinterpret_cast<Bytef *>(inflated.data());
+    stream.avail_out = inflated.size();
+    EXPECT_EQ(inflate(&stream, Z_FINISH), Z_STREAM_END);
+    inflated.resize(stream.total_out);
+    inflateEnd(&stream);
+    EXPECT_EQ(inflated, page);
+  }
+  EXPECT_EQ(compress(page, ENCODING_BROTLI).has_value(), brotliSupported());
+  EXPECT_FALSE(compress(page, ENCODING_IDENTITY).has_value());
+}
+
+// Responses are compressed in place, unless too small or not compressible
+TEST_F(CompressionTest, CompressResponse) {
+  http_response response;
+  response.set(http_fields::content_type, TEXT_HTML);
+  response.body() = page;
+  response.content_length(page.size());
+  EXPECT_TRUE(html_policy.compressResponse(response, ENCODING_GZIP));
+  EXPECT_EQ(response[http_fields::content_encoding], "gzip");
+  EXPECT_EQ(response[http_fields::vary], "Accept-Encoding");
+  EXPECT_EQ(response[http_fields::content_length],
+            std::to_string(response.body().size()));
+  EXPECT_LT(response.body().size(), page.size());
+
+  http_response small;
+  small.set(http_fields::content_type, TEXT_HTML);
+  small.body() = "<p>hi</p>";
+  EXPECT_FALSE(html_policy.compressResponse(small, ENCODING_GZIP));
+  EXPECT_EQ(small.body(), "<p>hi</p>");
+  EXPECT_EQ(small[http_fields::vary], "Accept-Encoding");
+
+  http_response image;
+  image.set(http_fields::content_type, IMAGE_PNG);
+  image.body() = page;
+  EXPECT_FALSE(html_policy.compressResponse(image, ENCODING_GZIP));
+  EXPECT_EQ(image.count(http_fields::vary), 0);
+}
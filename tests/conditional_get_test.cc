@@ -0,0 +1,143 @@
+#include "conditional_get.h"
+#include "gtest/gtest.h"
+
+class ConditionalGetTest : public testing::Test {
+protected:
+  // A file last written at 1994-11-06 08:49:37.5 UTC
+  FileStat stat{1234, std::chrono::file_clock::from_sys(
+                          std::chrono::system_clock::from_time_t(784111777) +
+                          std::chrono::milliseconds(500))};
+
+  http_request request(http_fields field, const std::string &value) {
+    http_request request{boost::beast::http::verb::get, "/", 11};
+    request.set(field, value);
+    return request;
+  }
+};
+
+TEST_F(ConditionalGetTest, HttpDates) {
+  auto time = std::chrono::system_clock::from_time_t(784111777);
+  EXPECT_EQ(httpDate(time), "Sun, 06 Nov 1994 08:49:37 GMT");
+  EXPECT_EQ(parseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT"), time);
+  EXPECT_EQ(parseHttpDate("Sunday, 06-Nov-94 08:49:37 GMT"), std::nullopt);
+  EXPECT_EQ(parseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT trailing"),
+            std::nullopt);
+  EXPECT_EQ(parseHttpDate(""), std::nullopt);
+}
+
+// File ETags change with the file's size or modification time, and with the
+// variant of it being sent
+TEST_F(ConditionalGetTest, FileValidators) {
+  Validators validators = fileValidators(stat);
+  EXPECT_EQ(validators.etag.front(), '"');
+  EXPECT_EQ(validators.etag.back(), '"');
+  EXPECT_EQ(httpDate(validators.last_modified.value()),
+            "Sun, 06 Nov 1994 08:49:37 GMT");
+  EXPECT_EQ(fileValidators(stat).etag, validators.etag);
+
+  FileStat resized = stat;
+  resized.size++;
+  EXPECT_NE(fileValidators(resized).etag, validators.etag);
+  FileStat touched = stat;
+  touched.last_write_time += std::chrono::nanoseconds(1);
+  EXPECT_NE(fileValidators(touched).etag, validators.etag);
+
+  EXPECT_NE(fileValidators(stat, "gzip").etag, validators.etag);
+  EXPECT_EQ(fileValidators(stat, "", true).etag, "W/" + validators.etag);
+
+  // Same size and modification time, different contents
+  Validators content = contentValidators("DOH", stat);
+  EXPECT_TRUE(content.etag.starts_with("W/\""));
+  EXPECT_EQ(content.last_modified, validators.last_modified);
+  EXPECT_NE(contentValidators("WOO", stat).etag, content.etag);
+  EXPECT_EQ(contentValidators("DOH").etag, content.etag);
+  EXPECT_EQ(contentValidators("DOH").last_modified, std::nullopt);
+
+  Validators generated = versionValidators(0xabc, 2);
+  EXPECT_EQ(generated.etag, "W/\"0000000000000abc-2\"");
+  EXPECT_EQ(generated.last_modified, std::nullopt);
+  EXPECT_NE(versionValidators(0xabc, 3).etag, generated.etag);
+  EXPECT_NE(versionValidators(0xabd, 2).etag, generated.etag);
+}
+
+// If-None-Match matches weakly, against any tag in its list or "*"
+TEST_F(ConditionalGetTest, IfNoneMatch) {
+  Validators validators = fileValidators(stat);
+  const std::string etag = validators.etag;
+  EXPECT_TRUE(notModified(request(http_fields::if_none_match, etag), validators));
+  EXPECT_TRUE(
+      notModified(request(http_fields::if_none_match, "W/" + etag), validators));
+  EXPECT_TRUE(notModified(
+      request(http_fields::if_none_match, "\"other\", " + etag), validators));
+  EXPECT_TRUE(notModified(request(http_fields::if_none_match, "*"), validators));
+  EXPECT_FALSE(
+      notModified(request(http_fields::if_none_match, "\"other\""), validators));
+  EXPECT_FALSE(notModified(request(http_fields::if_none_match, "garbage"),
+                           validators));
+
+  Validators weak = fileValidators(stat, "", true);
+  EXPECT_TRUE(notModified(request(http_fields::if_none_match, etag), weak));
+}
+
+// If-Modified-Since compares to the second, and only counts without
+// If-None-Match
+TEST_F(ConditionalGetTest, IfModifiedSince) {
+  Validators validators = fileValidators(stat);
+  EXPECT_TRUE(notModified(request(http_fields::if_modified_since,
+                                  "Sun, 06 Nov 1994 08:49:37 GMT"),
+                          validators));
+  EXPECT_TRUE(notModified(request(http_fields::if_modified_since,
+                                  "Mon, 07 Nov 1994 08:49:37 GMT"),
+                          validators));
+  EXPECT_FALSE(notModified(request(http_fields::if_modified_since,
+                                   "Sun, 06 Nov 1994 08:49:36 GMT"),
+                           validators));
+  EXPECT_FALSE(notModified(
+      request(http_fields::if_modified_since, "yesterday"), validators));
+
+  http_request both = request(http_fields::if_modified_since,
+                              "Mon, 07 Nov 1994 08:49:37 GMT");
+  both.set(http_fields::if_none_match, "\"other\"");
+  EXPECT_FALSE(notModified(both, validators));
+
+  EXPECT_FALSE(notModified(request(http_fields::if_modified_since,
+                                   "Mon, 07 Nov 1994 08:49:37 GMT"),
+                           versionValidators(1, 1)));
+}
+
+// A Range only applies if If-Range names the current version exactly
+TEST_F(ConditionalGetTest, IfRange) {
+  Validators validators = fileValidators(stat);
+  http_request no_condition{boost::beast::http::verb::get, "/", 11};
+  EXPECT_TRUE(ifRangeMatches(no_condition, validators));
+  EXPECT_TRUE(ifRangeMatches(request(http_fields::if_range, validators.etag),
+                             validators));
+  EXPECT_FALSE(
+      ifRangeMatches(request(http_fields::if_range, "\"other\""), validators));
+  EXPECT_FALSE(ifRangeMatches(
+      request(http_fields::if_range, "W/" + validators.etag), validators));
+  EXPECT_FALSE(ifRangeMatches(request(http_fields::if_range, validators.etag),
+                              fileValidators(stat, "", true)));
+
+  EXPECT_TRUE(ifRangeMatches(
+      request(http_fields::if_range, "Sun, 06 Nov 1994 08:49:37 GMT"),
+      validators));
+  EXPECT_FALSE(ifRangeMatches(
+      request(http_fields::if_range, "Mon, 07 Nov 1994 08:49:37 GMT"),
+      validators));
+}
+
+// A 304 has the validators and Cache-Control, but no body
+TEST_F(ConditionalGetTest, NotModifiedResponse) {
+  Validators validators = fileValidators(stat);
+  http_response response = notModifiedResponse(validators, "max-age=60");
+  EXPECT_EQ(response.result_int(), NOT_MODIFIED_STATUS);
+  EXPECT_EQ(response[http_fields::etag], validators.etag);
+  EXPECT_EQ(response[http_fields::last_modified],
+            "Sun, 06 Nov 1994 08:49:37 GMT");
+  EXPECT_EQ(response[http_fields::cache_control], "max-age=60");
+  EXPECT_TRUE(response.body().empty());
+
+  EXPECT_EQ(notModifiedResponse(validators, "").count(http_fields::cache_control),
+            0);
+}
@@ -174,6 +174,73 @@ TEST_F(NginxConfigTest, MultiplePorts) {
   find_port_failure();
 }
 
+// threading defaults to a shared io_service, can select a per core one,
+// and fails on unknown modes
+TEST_F(NginxConfigTest, ThreadingMode) {
+  SetUp("configs/single_port_config");
+  EXPECT_EQ(full_parsed_config.findThreadingMode(), THREADING_SHARED);
+  SetUp("configs/threading_config");
+  EXPECT_EQ(full_parsed_config.findThreadingMode(), THREADING_PER_CORE_PINNED);
+  find_port_success(80);
+  SetUp("configs/unknown_threading_config");
+  EXPECT_FALSE(full_parsed_config.findThreadingMode().has_value());
+}
+
+// logging defaults to asynchronous, can be made synchronous, and fails on
+// unknown modes
+TEST_F(NginxConfigTest, LoggingMode) {
+  SetUp("configs/single_port_config");
+  EXPECT_EQ(full_parsed_config.findLoggingMode(), LOGGING_ASYNC);
+  SetUp("configs/sync_logging_config");
+  EXPECT_EQ(full_parsed_config.findLoggingMode(), LOGGING_SYNC);
+  find_port_success(80);
+  SetUp("configs/unknown_logging_config");
+  EXPECT_FALSE(full_parsed_config.findLoggingMode().has_value());
+}
+
+// the binary access log is off unless a single path is given
+TEST_F(NginxConfigTest, AccessLog) {
+  SetUp("configs/single_port_config");
+  EXPECT_EQ(full_parsed_config.findAccessLog(), "");
+  SetUp("configs/access_log_config");
+  EXPECT_EQ(full_parsed_config.findAccessLog(), "/var/log/webserver/access.bin");
+  SetUp("configs/multiple_access_log_config");
+  EXPECT_FALSE(full_parsed_config.findAccessLog().has_value());
+}
+
+// session settings have defaults, can be configured, and must be
+// non-negative integers (and a positive pipeline depth)
+TEST_F(NginxConfigTest, SessionConfig) {
+  SetUp("configs/single_port_config");
+  std::optional<SessionConfig> session_config =
+      full_parsed_config.findSessionConfig();
+  ASSERT_TRUE(session_config.has_value());
+  EXPECT_EQ(session_config->pipeline_depth, SessionConfig().pipeline_depth);
+  EXPECT_EQ(session_config->idle_timeout, SessionConfig().idle_timeout);
+
+  SetUp("configs/session_config");
+  session_config = full_parsed_config.findSessionConfig();
+  ASSERT_TRUE(session_config.has_value());
+  EXPECT_EQ(session_config->pipeline_depth, 4);
+  EXPECT_EQ(session_config->idle_timeout, std::chrono::seconds(5));
+  EXPECT_EQ(session_config->header_timeout, std::chrono::seconds(0));
+  EXPECT_EQ(session_config->body_timeout, SessionConfig().body_timeout);
+  EXPECT_EQ(session_config->write_timeout, std::chrono::seconds(120));
+
+  SetUp("configs/zero_pipeline_depth_config");
+  EXPECT_FALSE(full_parsed_config.findSessionConfig().has_value());
+  SetUp("configs/negative_timeout_config");
+  EXPECT_FALSE(full_parsed_config.findSessionConfig().has_value());
+}
+
+// shutdown timeout has a default and can be configured
+TEST_F(NginxConfigTest, ShutdownTimeout) {
+  SetUp("configs/single_port_config");
+  EXPECT_EQ(full_parsed_config.findShutdownTimeout(), DEFAULT_SHUTDOWN_TIMEOUT);
+  SetUp("configs/session_config");
+  EXPECT_EQ(full_parsed_config.findShutdownTimeout(), std::chrono::seconds(5));
+}
+
 // config with some distinct locations should parse successfully
 // while finding locations should succeed
 TEST_F(NginxConfigTest, GoodLocations) {
@@ -248,3 +315,23 @@ TEST_F(NginxConfigTest, QuotedArgs) {
        {"/static",
         LocationData(STATIC_HANDLER, {{"root", "/etc/files"}})}});
 }
+
+// optional arguments may be given alongside the expected ones, as may the
+// body_limit every location takes
+TEST_F(NginxConfigTest, OptionalArgs) {
+  SetUp("configs/optional_args_config");
+  find_locations_success(
+      {{"/static",
+        LocationData(STATIC_HANDLER, {{"root", "/etc/files"},
+                                      {"cache_size", "1048576"},
+                                      {"body_limit", "4096"}})}});
+}
+
+// body_limit must be a plain number of bytes; a sign or a unit is an error
+// rather than something to guess at
+TEST_F(NginxConfigTest, InvalidBodyLimit) {
+  SetUp("configs/negative_body_limit_config");
+  find_locations_failure();
+  SetUp("configs/suffixed_body_limit_config");
+  find_locations_failure();
+}
@@ -0,0 +1,70 @@
+#include "config_parser.h"
+#include "config_reloader.h"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+class ConfigReloaderTest : public testing::Test {
+protected:
+  void SetUp() override {
+    config_path = fs::temp_directory_path() /
+                  ("config_reloader_test_" + std::to_string(::getpid()));
+    writeConfig("port 80;\nlocation /echo EchoHandler {\n}\n");
+    NginxConfigParser parser;
+    NginxConfig config;
+    ASSERT_TRUE(parser.Parse(config_path.c_str(), &config));
+    std::unordered_map<std::string, LocationData> locations =
+        config.findLocations().value();
+    request_manager = std::make_unique<RequestManager>(locations);
+  }
+  void TearDown() override { fs::remove(config_path); }
+  void writeConfig(const std::string &contents) {
+    std::ofstream config_file(config_path);
+    config_file << contents;
+  }
+  fs::path config_path;
+  std::unique_ptr<RequestManager> request_manager;
+  boost::asio::io_service io_service;
+};
+
+// A valid config replaces the locations
+TEST_F(ConfigReloaderTest, ReloadsValidConfig) {
+  ConfigReloader reloader(io_service, config_path, *request_manager);
+  writeConfig("port 80;\nlocation /health HealthHandler {\n}\n");
+  EXPECT_TRUE(reloader.reload());
+  EXPECT_EQ(request_manager->matchPath("/echo"), std::nullopt);
+  EXPECT_EQ(request_manager->matchPath("/health"), "/health");
+}
+
+// An invalid config leaves the current locations in place
+TEST_F(ConfigReloaderTest, KeepsLocationsOnInvalidConfig) {
+  ConfigReloader reloader(io_service, config_path, *request_manager);
+  writeConfig("port 80;\nlocation /health HealthHandler {\n");
+  EXPECT_FALSE(reloader.reload());
+  writeConfig("port 80;\nlocation /health UnknownHandler {\n}\n");
+  EXPECT_FALSE(reloader.reload());
+  EXPECT_EQ(request_manager->matchPath("/echo"), "/echo");
+  EXPECT_EQ(request_manager->matchPath("/health"), std::nullopt);
+}
+
+// SIGHUP triggers a reload
+TEST_F(ConfigReloaderTest, ReloadsOnSighup) {
+  ConfigReloader reloader(io_service, config_path, *request_manager);
+  writeConfig("port 80;\nlocation /health HealthHandler {\n}\n");
+  std::thread runner([this] { io_service.run(); });
+  std::raise(SIGHUP);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (request_manager->matchPath("/health") == std::nullopt &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(request_manager->matchPath("/health"), "/health");
+  io_service.stop();
+  runner.join();
+}
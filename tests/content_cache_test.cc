@@ -0,0 +1,89 @@
+#include "content_cache.h"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <memory>
+
+class ContentCacheTest : public testing::Test {
+protected:
+  void SetUp() override {}
+  FileStat version(uintmax_t size, int time) {
+    return FileStat{size, std::filesystem::file_time_type(
+                              std::chrono::seconds(time))};
+  }
+  std::shared_ptr<const CachedContent> content(std::string body, int time) {
+    http_response response;
+    response.body() = body;
+    return std::make_shared<CachedContent>(
+        CachedContent{version(body.size(), time), response});
+  }
+};
+
+// Cached content is returned only for the version it was built from
+TEST_F(ContentCacheTest, HitsMatchingVersion) {
+  ContentCache cache(100);
+  EXPECT_EQ(cache.get("/a", version(5, 1)), nullptr);
+  cache.put("/a", content("hello", 1));
+  std::shared_ptr<const CachedContent> cached = cache.get("/a", version(5, 1));
+  ASSERT_NE(cached, nullptr);
+  EXPECT_EQ(cached->response.body(), "hello");
+
+  // a newer version of the file makes the entry stale, and drops it
+  EXPECT_EQ(cache.get("/a", version(5, 2)), nullptr);
+  EXPECT_EQ(cache.get("/a", version(5, 1)), nullptr);
+
+  ContentCache::Stats stats = cache.stats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 3);
+  EXPECT_EQ(stats.entries, 0);
+  EXPECT_EQ(stats.bytes, 0);
+}
+
+// An entry cached at one revision misses at any other, even with the same
+// stat
+TEST_F(ContentCacheTest, HitsMatchingRevision) {
+  ContentCache cache(100);
+  http_response response;
+  response.body() = "hello";
+  cache.put("/a", std::make_shared<CachedContent>(
+                      CachedContent{version(5, 1), response, 3}));
+  EXPECT_NE(cache.get("/a", version(5, 1), 3), nullptr);
+  EXPECT_EQ(cache.get("/a", version(5, 1), 4), nullptr);
+  EXPECT_EQ(cache.stats().entries, 0);
+}
+
+// The least recently used entries are evicted to stay within capacity
+TEST_F(ContentCacheTest, EvictsLeastRecentlyUsed) {
+  ContentCache cache(10);
+  cache.put("/a", content("aaaa", 1));
+  cache.put("/b", content("bbbb", 1));
+  // touch /a, so /b is now the least recently used
+  EXPECT_NE(cache.get("/a", version(4, 1)), nullptr);
+  cache.put("/c", content("cccc", 1));
+
+  EXPECT_NE(cache.get("/a", version(4, 1)), nullptr);
+  EXPECT_EQ(cache.get("/b", version(4, 1)), nullptr);
+  EXPECT_NE(cache.get("/c", version(4, 1)), nullptr);
+  ContentCache::Stats stats = cache.stats();
+  EXPECT_EQ(stats.evictions, 1);
+  EXPECT_EQ(stats.bytes, 8);
+  EXPECT_EQ(stats.entries, 2);
+}
+
+// Content larger than the cache is never stored
+TEST_F(ContentCacheTest, SkipsOversizedContent) {
+  ContentCache cache(3);
+  cache.put("/a", content("aaaa", 1));
+  EXPECT_EQ(cache.get("/a", version(4, 1)), nullptr);
+  EXPECT_EQ(cache.stats().entries, 0);
+}
+
+// Replacing and invalidating entries keeps the byte count right
+TEST_F(ContentCacheTest, ReplaceAndInvalidate) {
+  ContentCache cache(10);
+  cache.put("/a", content("aaaa", 1));
+  cache.put("/a", content("aaaaaa", 2));
+  EXPECT_EQ(cache.stats().bytes, 6);
+  cache.invalidate("/a");
+  EXPECT_EQ(cache.get("/a", version(6, 2)), nullptr);
+  EXPECT_EQ(cache.stats().bytes, 0);
+}
@@ -2,7 +2,11 @@
 #include "handlers/crud_handler.h"
 #include "gtest/gtest.h"
 #include <boost/filesystem.hpp>
+#include <fstream>
 #include <memory>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <unistd.h>
 
 class CrudHandlerTest : public testing::Test {
 protected:
@@ -149,6 +153,37 @@ TEST_F(CrudHandlerTest, PostGet) {
   EXPECT_EQ(bad_response.body(), "");
 }
 
+// IDs keep counting up after the first POST, skipping files made by PUT
+TEST_F(CrudHandlerTest, PostAfterPut) {
+  std::unique_ptr<FileSystemInterface> filesystem =
+      std::make_unique<FakeFileSystem>();
+  filesystem->write("/mnt/crud/Shoes/1", "");
+
+  CrudHandler handler("/api", {{"data_path", "/mnt/crud"}},
+                      std::move(filesystem));
+
+  http_request post_request;
+  post_request.method(boost::beast::http::verb::post);
+  post_request.set(boost::beast::http::field::content_type, "application/json");
+  post_request.target("/api/Shoes");
+  http_response response = handler.handle_request(post_request);
+  EXPECT_EQ(response.body(), "{\n"
+                             "    \"id\": \"2\"\n"
+                             "}\n");
+
+  http_request put_request;
+  put_request.method(boost::beast::http::verb::put);
+  put_request.set(boost::beast::http::field::content_type, "application/json");
+  put_request.target("/api/Shoes/3");
+  response = handler.handle_request(put_request);
+  EXPECT_EQ(response.result(), boost::beast::http::status::no_content);
+
+  response = handler.handle_request(post_request);
+  EXPECT_EQ(response.body(), "{\n"
+                             "    \"id\": \"4\"\n"
+                             "}\n");
+}
+
 // Try deleting files that are there and aren't there
 TEST_F(CrudHandlerTest, DeleteFile) {
   std::unique_ptr<FileSystemInterface> filesystem = std::make_unique<FakeFileSystem>();
@@ -306,3 +341,375 @@ TEST_F(CrudHandlerTest, PutSuccessNoFile) {
   EXPECT_EQ(response_get.body(), body);
 
 }
+
+// With `storage log;` records go to a log under data_path, and survive a
+// restart of the handler
+TEST_F(CrudHandlerTest, LogStorage) {
+  const std::filesystem::path data_path =
+      std::filesystem::temp_directory_path() /
+      ("crud_handler_test_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(data_path);
+  std::unordered_map<std::string, std::string> args = {
+      {"data_path", data_path.string()}, {"storage", "log"}};
+
+  http_request post_request;
+  post_request.method(boost::beast::http::verb::post);
+  post_request.set(boost::beast::http::field::content_type, "application/json");
+  post_request.target("/api/Shoes");
+  post_request.body() = "{\"size\": 10}";
+  {
+    std::unique_ptr<RequestHandler> handler(CrudHandler::Init("/api", args));
+    EXPECT_EQ(handler->handle_request(post_request).result(),
+              boost::beast::http::status::ok);
+  }
+  EXPECT_TRUE(std::filesystem::exists(data_path / "segment-000001.log"));
+  EXPECT_FALSE(std::filesystem::exists(data_path / "Shoes"));
+
+  std::unique_ptr<RequestHandler> handler(CrudHandler::Init("/api", args));
+  http_request get_request;
+  get_request.method(boost::beast::http::verb::get);
+  get_request.target("/api/Shoes/1");
+  http_response response = handler->handle_request(get_request);
+  EXPECT_EQ(response.result(), boost::beast::http::status::ok);
+  EXPECT_EQ(response.body(), "{\"size\": 10}");
+
+  get_request.target("/api/Shoes");
+  response = handler->handle_request(get_request);
+  EXPECT_EQ(response.body(), "{\n"
+                             "    \"files\": [\n"
+                             "        \"1\"\n"
+                             "    ]\n"
+                             "}\n");
+  handler.reset();
+  std::filesystem::remove_all(data_path);
+}
+
+// A storage it doesn't know is a config error, not a silent fallback to files
+TEST_F(CrudHandlerTest, UnknownStorage) {
+  EXPECT_THROW(CrudHandler::Init("/api", {{"data_path", "/tmp/crud_handler_test"},
+                                          {"storage", "logs"}}),
+               std::invalid_argument);
+}
+
+// A streamed body is moved into place from its upload file under data_path
+TEST_F(CrudHandlerTest, Upload) {
+  const std::filesystem::path data_path =
+      std::filesystem::temp_directory_path() /
+      ("crud_handler_upload_test_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(data_path);
+  std::unique_ptr<RequestHandler> handler(
+      CrudHandler::Init("/api", {{"data_path", data_path.string()}}));
+  ASSERT_EQ(handler->uploadDirectory(), data_path / UPLOAD_DIRECTORY);
+
+  auto upload = [&](const std::string &data) {
+    std::filesystem::create_directories(data_path / UPLOAD_DIRECTORY);
+    std::filesystem::path path =
+        UploadedBody::temporaryPath(data_path / UPLOAD_DIRECTORY);
+    std::ofstream(path) << data;
+    return std::make_shared<UploadedBody>(path, data.size());
+  };
+
+  http_request request;
+  request.method(boost::beast::http::verb::post);
+  request.set(boost::beast::http::field::content_type, "application/json");
+  request.target("/api/Shoes");
+  std::shared_ptr<UploadedBody> body = upload("{\"size\": 10}");
+  http_response response = handler->handle_upload(request, *body);
+  EXPECT_EQ(response.result(), boost::beast::http::status::ok);
+  EXPECT_EQ(response.body(), "{\n"
+                             "    \"id\": \"1\"\n"
+                             "}\n");
+  EXPECT_FALSE(std::filesystem::exists(body->path()));
+
+  request.method(boost::beast::http::verb::put);
+  request.target("/api/Shoes/1");
+  body = upload("{\"size\": 11}");
+  EXPECT_EQ(handler->handle_upload(request, *body).result(),
+            boost::beast::http::status::no_content);
+
+  request.method(boost::beast::http::verb::get);
+  response = handler->handle_request(request);
+  EXPECT_EQ(response.body(), "{\"size\": 11}");
+  request.target("/api/Shoes");
+  response = handler->handle_request(request);
+  EXPECT_EQ(response.body(), "{\n"
+                             "    \"files\": [\n"
+                             "        \"1\"\n"
+                             "    ]\n"
+                             "}\n");
+  std::filesystem::remove_all(data_path);
+}
+
+// A client sending back a record's or a listing's ETag gets a 304 until the
+// record or listing changes
+TEST_F(CrudHandlerTest, ConditionalGet) {
+  std::unique_ptr<FileSystemInterface> filesystem =
+      std::make_unique<FakeFileSystem>();
+  filesystem->write("/mnt/crud/Shoes/1", "{\"size\": 9}");
+  filesystem->create_directories("/mnt/crud/Shoes");
+  CrudHandler handler(
+      "/api", {{"data_path", "/mnt/crud"}, {"cache_control", "no-cache"}},
+      std::move(filesystem));
+
+  for (std::string target : {"/api/Shoes/1", "/api/Shoes"}) {
+    http_request request;
+    request.method(boost::beast::http::verb::get);
+    request.target(target);
+    http_response response = handler.handle_request(request);
+    EXPECT_EQ(response.result(), boost::beast::http::status::ok);
+    EXPECT_EQ(response.at(boost::beast::http::field::cache_control), "no-cache");
+    std::string etag(response.at(boost::beast::http::field::etag));
+
+    request.set(boost::beast::http::field::if_none_match, etag);
+    response = handler.handle_request(request);
+    EXPECT_EQ(response.result(), boost::beast::http::status::not_modified);
+    EXPECT_EQ(response.at(boost::beast::http::field::etag), etag);
+    EXPECT_EQ(response.body(), "");
+  }
+
+  http_request put_request;
+  put_request.method(boost::beast::http::verb::put);
+  put_request.target("/api/Shoes/1");
+  put_request.set(boost::beast::http::field::content_type, "application/json");
+  put_request.body() = "{\"size\": 10}";
+  handler.handle_request(put_request);
+  http_request post_request;
+  post_request.method(boost::beast::http::verb::post);
+  post_request.target("/api/Shoes");
+  post_request.set(boost::beast::http::field::content_type, "application/json");
+  post_request.body() = "{\"size\": 11}";
+  handler.handle_request(post_request);
+
+  for (std::string target : {"/api/Shoes/1", "/api/Shoes"}) {
+    http_request request;
+    request.method(boost::beast::http::verb::get);
+    request.target(target);
+    std::string etag(
+        handler.handle_request(request).at(boost::beast::http::field::etag));
+    request.set(boost::beast::http::field::if_none_match, "\"stale\", " + etag);
+    EXPECT_EQ(handler.handle_request(request).result(),
+              boost::beast::http::status::not_modified);
+    request.set(boost::beast::http::field::if_none_match, "\"stale\"");
+    EXPECT_EQ(handler.handle_request(request).result(),
+              boost::beast::http::status::ok);
+  }
+}
+
+// A listing pages through the records in order, and picks up changes
+// without walking the directory again
+TEST_F(CrudHandlerTest, ListPages) {
+  std::unique_ptr<FileSystemInterface> filesystem =
+      std::make_unique<FakeFileSystem>();
+  for (std::string name : {"1", "2", "10", "laces"}) {
+    filesystem->write("/mnt/crud/Shoes/" + name, "");
+  }
+  CrudHandler handler("/api", {{"data_path", "/mnt/crud"}},
+                      std::move(filesystem));
+  auto get = [&](std::string target) {
+    http_request request;
+    request.method(boost::beast::http::verb::get);
+    request.target(target);
+    return handler.handle_request(request);
+  };
+
+  http_response response = get("/api/Shoes?limit=2");
+  EXPECT_EQ(response.result(), boost::beast::http::status::ok);
+  EXPECT_EQ(response.body(), "{\n"
+                             "    \"files\": [\n"
+                             "        \"1\",\n"
+                             "        \"2\"\n"
+                             "    ],\n"
+                             "    \"next\": \"2\"\n"
+                             "}\n");
+  std::string etag(response.at(boost::beast::http::field::etag));
+  EXPECT_EQ(get("/api/Shoes/?cursor=2&limit=2").body(),
+            "{\n"
+            "    \"files\": [\n"
+            "        \"10\",\n"
+            "        \"laces\"\n"
+            "    ]\n"
+            "}\n");
+  EXPECT_EQ(get("/api/Shoes?cursor=laces").body(), "{\n"
+                                                   "    \"files\": []\n"
+                                                   "}\n");
+  EXPECT_EQ(get("/api/Shoes?limit=0").result(),
+            boost::beast::http::status::bad_request);
+  EXPECT_EQ(get("/api/Shoes?limit=two").result(),
+            boost::beast::http::status::bad_request);
+
+  http_request post_request;
+  post_request.method(boost::beast::http::verb::post);
+  post_request.target("/api/Shoes");
+  post_request.set(boost::beast::http::field::content_type, "application/json");
+  handler.handle_request(post_request);
+  http_request delete_request;
+  delete_request.method(boost::beast::http::verb::delete_);
+  delete_request.target("/api/Shoes/2");
+  handler.handle_request(delete_request);
+  http_request put_request;
+  put_request.method(boost::beast::http::verb::put);
+  put_request.target("/api/Shoes/a%22b");
+  put_request.set(boost::beast::http::field::content_type, "application/json");
+  handler.handle_request(put_request);
+
+  response = get("/api/Shoes?cursor=1&limit=3");
+  EXPECT_EQ(response.body(), "{\n"
+                             "    \"files\": [\n"
+                             "        \"10\",\n"
+                             "        \"11\",\n"
+                             "        \"a%22b\"\n"
+                             "    ],\n"
+                             "    \"next\": \"a%22b\"\n"
+                             "}\n");
+  EXPECT_NE(response.at(boost::beast::http::field::etag), etag);
+  EXPECT_EQ(get("/api/Shoes?cursor=a%2522b").body(),
+            "{\n"
+            "    \"files\": [\n"
+            "        \"laces\"\n"
+            "    ]\n"
+            "}\n");
+  // + is a space, which sorts before %
+  EXPECT_EQ(get("/api/Shoes?cursor=a+b").body(),
+            "{\n"
+            "    \"files\": [\n"
+            "        \"a%22b\",\n"
+            "        \"laces\"\n"
+            "    ]\n"
+            "}\n");
+}
+
+// A listing longer than a chunk is streamed to HTTP/1.1 clients, and built
+// whole for anyone else
+TEST_F(CrudHandlerTest, StreamedList) {
+  std::unique_ptr<FileSystemInterface> filesystem =
+      std::make_unique<FakeFileSystem>();
+  const size_t records = CRUD_HANDLER_LIST_CHUNK * 2 + 1;
+  for (size_t id = 1; id <= records; id++) {
+    filesystem->write("/mnt/crud/Shoes/" + std::to_string(id), "");
+  }
+  CrudHandler handler("/api", {{"data_path", "/mnt/crud"}},
+                      std::move(filesystem));
+
+  http_request request;
+  request.method(boost::beast::http::verb::get);
+  request.target("/api/Shoes");
+  std::string whole = handler.handle_request(request).body();
+  EXPECT_TRUE(whole.ends_with("        \"" + std::to_string(records) +
+                              "\"\n    ]\n}\n"));
+
+  http_response_variant response = handler.serve(request);
+  ASSERT_TRUE(std::holds_alternative<http_stream_response>(response));
+  http_stream_response &streamed = std::get<http_stream_response>(response);
+  EXPECT_TRUE(streamed.chunked());
+  EXPECT_EQ(streamed.at(boost::beast::http::field::content_type),
+            "application/json");
+  std::string body;
+  size_t chunks = 0;
+  for (std::string piece = streamed.body().next(); !piece.empty();
+       piece = streamed.body().next()) {
+    body += piece;
+    chunks++;
+  }
+  EXPECT_EQ(body, whole);
+  EXPECT_EQ(chunks, 3);
+  EXPECT_EQ(streamed.body().size(), whole.size());
+
+  request.version(10);
+  EXPECT_TRUE(std::holds_alternative<http_response>(handler.serve(request)));
+  request.version(11);
+  request.target("/api/Shoes?limit=5");
+  EXPECT_TRUE(std::holds_alternative<http_response>(handler.serve(request)));
+}
+
+// With validate_json, malformed documents are refused whether they arrive in
+// the request or streamed to a file, and nothing is stored
+TEST_F(CrudHandlerTest, ValidateJson) {
+  const std::filesystem::path data_path =
+      std::filesystem::temp_directory_path() /
+      ("crud_handler_validate_test_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(data_path);
+  std::filesystem::create_directories(data_path);
+  std::unique_ptr<RequestHandler> handler(CrudHandler::Init(
+      "/api", {{"data_path", data_path.string()}, {"validate_json", "true"}}));
+
+  http_request request;
+  request.method(boost::beast::http::verb::post);
+  request.set(boost::beast::http::field::content_type, "application/json");
+  request.target("/api/Shoes");
+  request.body() = "{\"size\": 10";
+  EXPECT_EQ(handler->handle_request(request).result(),
+            boost::beast::http::status::bad_request);
+  request.body() = "{\"size\": 10}";
+  EXPECT_EQ(handler->handle_request(request).result(),
+            boost::beast::http::status::ok);
+
+  request.method(boost::beast::http::verb::put);
+  request.target("/api/Shoes/1");
+  request.body() = "ID 1 NEW";
+  EXPECT_EQ(handler->handle_request(request).result(),
+            boost::beast::http::status::bad_request);
+
+  std::filesystem::path upload_path = UploadedBody::temporaryPath(data_path);
+  std::ofstream(upload_path) << "[1, 2,]";
+  UploadedBody upload(upload_path, 7);
+  EXPECT_EQ(handler->handle_upload(request, upload).result(),
+            boost::beast::http::status::bad_request);
+
+  std::ifstream stored(data_path / "Shoes" / "1");
+  EXPECT_EQ(std::string(std::istreambuf_iterator<char>{stored}, {}),
+            "{\"size\": 10}");
+  std::filesystem::remove_all(data_path);
+}
+
+// A PUT that can't be stored is an error, not a 204
+TEST_F(CrudHandlerTest, PutFailure) {
+  const std::filesystem::path data_path =
+      std::filesystem::temp_directory_path() /
+      ("crud_handler_put_failure_test_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(data_path);
+  std::unique_ptr<RequestHandler> handler(
+      CrudHandler::Init("/api", {{"data_path", data_path.string()}}));
+
+  http_request request;
+  request.method(boost::beast::http::verb::put);
+  request.set(boost::beast::http::field::content_type, "application/json");
+  request.target("/api/Shoes/1");
+  request.body() = "{\"size\": 10}";
+  EXPECT_EQ(handler->handle_request(request).result(),
+            boost::beast::http::status::no_content);
+
+  // Shoes/1 is a record, so nothing can be stored below it
+  request.target("/api/Shoes/1/2");
+  EXPECT_EQ(handler->handle_request(request).result(),
+            boost::beast::http::status::internal_server_error);
+  std::filesystem::remove_all(data_path);
+}
+
+// Uploads left behind by a server that died are removed when the handler is
+// built, but not those of a server still running
+TEST_F(CrudHandlerTest, RemovesStaleUploads) {
+  const std::filesystem::path data_path =
+      std::filesystem::temp_directory_path() /
+      ("crud_handler_stale_upload_test_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(data_path);
+  const std::filesystem::path upload_directory = data_path / UPLOAD_DIRECTORY;
+  std::filesystem::create_directories(upload_directory);
+
+  pid_t dead = ::fork();
+  if (dead == 0) {
+    ::_exit(0);
+  }
+  ::waitpid(dead, nullptr, 0);
+  const std::filesystem::path stale =
+      upload_directory /
+      (TEMP_FILE_PREFIX + "upload-" + std::to_string(dead) + "-0");
+  const std::filesystem::path live = UploadedBody::temporaryPath(upload_directory);
+  std::ofstream(stale) << "{}";
+  std::ofstream(live) << "{}";
+
+  std::unique_ptr<RequestHandler> handler(
+      CrudHandler::Init("/api", {{"data_path", data_path.string()}}));
+  EXPECT_FALSE(std::filesystem::exists(stale));
+  EXPECT_TRUE(std::filesystem::exists(live));
+  std::filesystem::remove_all(data_path);
+}
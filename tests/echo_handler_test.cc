@@ -22,8 +22,10 @@ protected:
     // Defined to help parse requests
     http_request data = parseRequest(request);
 
-    echoHandler->handle_request(data);
-    EXPECT_EQ(echoHandler->getLastResponse(), expected_response);
+    http_response response = echoHandler->handle_request(data);
+    std::stringstream result;
+    result << response;
+    EXPECT_EQ(result.str(), expected_response);
   }
 };
 
@@ -25,8 +25,10 @@ protected:
     // Defined to help parse requests
     http_request data = parseRequest(request);
 
-    errorHandler->handle_request(data);
-    EXPECT_EQ(errorHandler->getLastResponse(), expected_response);
+    http_response response = errorHandler->handle_request(data);
+    std::stringstream result;
+    result << response;
+    EXPECT_EQ(result.str(), expected_response);
   }
 };
 
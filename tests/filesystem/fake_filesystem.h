@@ -50,6 +50,15 @@ public:
     }
     return filesystem_.at(filename);
   }
+
+  std::optional<FileStat>
+  stat(const std::filesystem::path &filename) const override {
+    if (!exists(filename)) {
+      return std::nullopt;
+    }
+    return FileStat{filesystem_.at(filename).size(),
+                    write_times_.at(filename)};
+  }
   
   bool write(const std::filesystem::path &filename,
              const std::string &data) override {
@@ -59,14 +68,26 @@ public:
     }
 
     filesystem_[filename] = data;
+    // Every write gets a distinct modification time
+    write_times_[filename] =
+        std::filesystem::file_time_type(std::chrono::seconds(++write_count_));
     return true;
   }
   
+  bool create(const std::filesystem::path &filename,
+              const std::string &data) override {
+    if (exists(filename)) {
+      return false;
+    }
+    return write(filename, data);
+  }
+
   bool remove(const std::filesystem::path &filename) override {
     if (!exists(filename)) {
       return false;
     }
     filesystem_.erase(filename);
+    write_times_.erase(filename);
     return true;
   }
   
@@ -85,4 +106,7 @@ public:
 
 private:
   std::unordered_map<std::filesystem::path, std::string> filesystem_;
+  std::unordered_map<std::filesystem::path, std::filesystem::file_time_type>
+      write_times_;
+  int write_count_ = 0;
 };
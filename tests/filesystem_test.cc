@@ -1,6 +1,9 @@
 #include "filesystem/fake_filesystem.h"
+#include "filesystem/filesystem.h"
 #include "gtest/gtest.h"
+#include <fstream>
 #include <memory>
+#include <thread>
 
 
 class FileSystemTest : public testing::Test {
@@ -53,3 +56,110 @@ TEST_F(FileSystemTest, ListDirectory) {
   EXPECT_NE(filesystem.list("foo/"), std::nullopt);
   EXPECT_EQ(filesystem.list("foo/").value().size(), 2);
 }
+
+// Storing from a file on disk reads it in, and consumes it on success
+TEST_F(FileSystemTest, WriteFromFile) {
+  FakeFileSystem filesystem;
+  const std::filesystem::path source =
+      std::filesystem::temp_directory_path() /
+      ("fake_filesystem_source_" + std::to_string(::getpid()));
+  std::ofstream(source) << "uploaded";
+  EXPECT_TRUE(filesystem.write("foo/bar", "taken"));
+  EXPECT_FALSE(filesystem.createFrom("foo/bar", source));
+  EXPECT_TRUE(std::filesystem::exists(source));
+  EXPECT_TRUE(filesystem.writeFrom("foo/bar", source));
+  EXPECT_EQ(filesystem.read("foo/bar"), "uploaded");
+  EXPECT_FALSE(std::filesystem::exists(source));
+  EXPECT_FALSE(filesystem.writeFrom("foo/baz", source));
+}
+
+class RealFileSystemTest : public testing::Test {
+protected:
+  void SetUp() override {
+    directory = std::filesystem::temp_directory_path() /
+                ("filesystem_test_" + std::to_string(::getpid()));
+    std::filesystem::remove_all(directory);
+  }
+  void TearDown() override { std::filesystem::remove_all(directory); }
+  std::filesystem::path directory;
+  FileSystem filesystem;
+};
+
+// Creating a file only succeeds if nothing is there yet
+TEST_F(RealFileSystemTest, CreateDoesNotOverwrite) {
+  const std::filesystem::path path = directory / "1";
+  EXPECT_TRUE(filesystem.create(path, "first"));
+  EXPECT_FALSE(filesystem.create(path, "second"));
+  EXPECT_EQ(filesystem.read(path), "first");
+  EXPECT_EQ(filesystem.list(directory).value().size(), 1);
+}
+
+// A file written elsewhere is moved into place, replacing what was there
+// unless created, and left alone if it can't be
+TEST_F(RealFileSystemTest, StoreFromFile) {
+  const std::filesystem::path source = directory / ".tmp-upload";
+  std::filesystem::create_directories(directory);
+  std::ofstream(source) << "uploaded";
+
+  const std::filesystem::path path = directory / "records" / "1";
+  EXPECT_TRUE(filesystem.create(path, "first"));
+  EXPECT_FALSE(filesystem.createFrom(path, source));
+  EXPECT_TRUE(std::filesystem::exists(source));
+  EXPECT_EQ(filesystem.read(path), "first");
+
+  EXPECT_TRUE(filesystem.createFrom(directory / "records" / "2", source));
+  EXPECT_FALSE(std::filesystem::exists(source));
+  EXPECT_EQ(filesystem.read(directory / "records" / "2"), "uploaded");
+
+  std::ofstream(source) << "replaced";
+  EXPECT_TRUE(filesystem.writeFrom(path, source));
+  EXPECT_FALSE(std::filesystem::exists(source));
+  EXPECT_EQ(filesystem.read(path), "replaced");
+  EXPECT_EQ(filesystem.list(directory / "records").value().size(), 2);
+}
+
+// Concurrent readers only ever see whole versions of a file being rewritten
+TEST_F(RealFileSystemTest, ConcurrentWritesAreAtomic) {
+  const std::filesystem::path path = directory / "file";
+  const std::string first(100000, 'a');
+  const std::string second(200000, 'b');
+  ASSERT_TRUE(filesystem.write(path, first));
+
+  std::vector<std::thread> writers;
+  for (int i = 0; i < 4; i++) {
+    writers.emplace_back([&, i] {
+      for (int j = 0; j < 25; j++) {
+        EXPECT_TRUE(filesystem.write(path, (i + j) % 2 ? first : second));
+      }
+    });
+  }
+  for (int i = 0; i < 200; i++) {
+    std::optional<std::string> data = filesystem.read(path);
+    ASSERT_TRUE(data.has_value());
+    EXPECT_TRUE(data.value() == first || data.value() == second);
+  }
+  for (std::thread &writer : writers) {
+    writer.join();
+  }
+  // No temporary files are left behind
+  EXPECT_EQ(std::distance(std::filesystem::directory_iterator(directory),
+                          std::filesystem::directory_iterator()),
+            1);
+}
+
+// Concurrent creators of the same file see exactly one of them succeed
+TEST_F(RealFileSystemTest, ConcurrentCreatesAreExclusive) {
+  std::atomic<int> created = 0;
+  std::vector<std::thread> creators;
+  for (int i = 0; i < 8; i++) {
+    creators.emplace_back([&] {
+      if (filesystem.create(directory / "1", "data")) {
+        created++;
+      }
+    });
+  }
+  for (std::thread &creator : creators) {
+    creator.join();
+  }
+  EXPECT_EQ(created, 1);
+}
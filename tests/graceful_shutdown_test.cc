@@ -0,0 +1,71 @@
+#include "graceful_shutdown.h"
+#include "gtest/gtest.h"
+#include <boost/beast/http.hpp>
+#include <csignal>
+#include <string>
+#include <thread>
+
+class GracefulShutdownTest : public testing::Test {
+protected:
+  void SetUp() override {
+    locations = {{"/echo", LocationData("EchoHandler", {})}};
+    request_manager = std::make_unique<RequestManager>(locations);
+  }
+  std::unordered_map<std::string, LocationData> locations;
+  std::unique_ptr<RequestManager> request_manager;
+  boost::asio::io_service client_service;
+};
+
+// On SIGTERM the server stops accepting, closes idle connections, and the
+// I/O threads return once nothing is left
+TEST_F(GracefulShutdownTest, DrainsOnSignal) {
+  IoServicePool io_services(THREADING_SHARED, 2);
+  server s(io_services.get(0), *request_manager, 0);
+  s.start_accept();
+  GracefulShutdown shutdown(io_services, {&s}, std::chrono::seconds(5));
+  std::thread runner([&] { io_services.run(); });
+
+  tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), s.port());
+  tcp::socket idle(client_service);
+  idle.connect(endpoint);
+  boost::asio::write(idle, boost::asio::buffer(std::string(
+                               "GET /echo HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+  boost::beast::flat_buffer buffer;
+  http_response response;
+  boost::beast::http::read(idle, buffer, response);
+  EXPECT_EQ(response.result_int(), 200);
+
+  std::raise(SIGTERM);
+  runner.join();
+  EXPECT_TRUE(shutdown.drained());
+  char data[1];
+  boost::system::error_code error;
+  idle.read_some(boost::asio::buffer(data), error);
+  EXPECT_EQ(error, boost::asio::error::eof);
+  tcp::socket late(client_service);
+  late.connect(endpoint, error);
+  EXPECT_TRUE(error);
+}
+
+// Connections still busy when the timeout passes are left behind
+TEST_F(GracefulShutdownTest, TimesOut) {
+  IoServicePool io_services(THREADING_PER_CORE, 1);
+  server s(io_services.get(0), *request_manager, 0);
+  s.start_accept();
+  GracefulShutdown shutdown(io_services, {&s}, std::chrono::seconds(1));
+  std::thread runner([&] { io_services.run(); });
+
+  tcp::socket arriving(client_service);
+  arriving.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), s.port()));
+  boost::asio::write(arriving,
+                     boost::asio::buffer(std::string("GET /echo HTTP/1.1\r\n")));
+  while (SessionRegistry::GetInstance().size() == 0) {
+    std::this_thread::yield();
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  shutdown.start();
+  runner.join();
+  EXPECT_FALSE(shutdown.drained());
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+}
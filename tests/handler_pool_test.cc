@@ -0,0 +1,84 @@
+#include "handler_pool.h"
+#include "gtest/gtest.h"
+#include <memory>
+
+// Counts how many instances have been built
+class CountingHandler : public RequestHandler {
+public:
+  CountingHandler() { instances++; }
+  http_response handle_request(const http_request &request) {
+    return http_response();
+  }
+  static inline int instances = 0;
+};
+
+class HandlerPoolTest : public testing::Test {
+protected:
+  void SetUp() override { CountingHandler::instances = 0; }
+  RequestHandlerFactory factory =
+      [](std::string path, std::unordered_map<std::string, std::string> args) {
+        return new CountingHandler();
+      };
+};
+
+// Thread-safe handlers are built once and shared between leases
+TEST_F(HandlerPoolTest, SharedHandler) {
+  HandlerPool pool(factory, true, "/count", {}, 4);
+  EXPECT_EQ(CountingHandler::instances, 1);
+  HandlerPool::Lease first = pool.acquire();
+  HandlerPool::Lease second = pool.acquire();
+  EXPECT_EQ(&*first, &*second);
+  EXPECT_EQ(CountingHandler::instances, 1);
+}
+
+// Pooled handlers are built up front, and never leased twice at once
+TEST_F(HandlerPoolTest, PooledHandler) {
+  HandlerPool pool(factory, false, "/count", {}, 2);
+  EXPECT_EQ(CountingHandler::instances, 2);
+  HandlerPool::Lease first = pool.acquire();
+  HandlerPool::Lease second = pool.acquire();
+  EXPECT_NE(&*first, &*second);
+  EXPECT_EQ(CountingHandler::instances, 2);
+}
+
+// An exhausted pool grows, and released instances are reused
+TEST_F(HandlerPoolTest, PoolGrowsAndReuses) {
+  HandlerPool pool(factory, false, "/count", {}, 1);
+  RequestHandler *released;
+  {
+    HandlerPool::Lease first = pool.acquire();
+    HandlerPool::Lease second = pool.acquire();
+    EXPECT_EQ(CountingHandler::instances, 2);
+    released = &*second;
+  }
+  HandlerPool::Lease third = pool.acquire();
+  HandlerPool::Lease fourth = pool.acquire();
+  EXPECT_TRUE(&*third == released || &*fourth == released);
+  EXPECT_EQ(CountingHandler::instances, 2);
+}
+
+// Takes uploads as files in /uploads
+class UploadingHandler : public CountingHandler {
+public:
+  std::optional<std::filesystem::path> uploadDirectory() const override {
+    return "/uploads";
+  }
+};
+
+// The body limit comes from the location's args, and the upload directory
+// from its handler
+TEST_F(HandlerPoolTest, BodyPolicy) {
+  HandlerPool pool(factory, false, "/count", {{"body_limit", "4096"}}, 1);
+  EXPECT_EQ(pool.bodyLimit(), 4096);
+  EXPECT_EQ(pool.uploadDirectory(), std::nullopt);
+
+  HandlerPool defaulted(factory, true, "/count", {}, 1);
+  EXPECT_EQ(defaulted.bodyLimit(), DEFAULT_BODY_LIMIT);
+
+  HandlerPool uploading(
+      [](std::string path, std::unordered_map<std::string, std::string> args) {
+        return new UploadingHandler();
+      },
+      true, "/upload", {}, 1);
+  EXPECT_EQ(uploading.uploadDirectory(), std::filesystem::path("/uploads"));
+}
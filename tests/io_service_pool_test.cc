@@ -0,0 +1,40 @@
+#include "io_service_pool.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <boost/asio/post.hpp>
+#include <thread>
+
+class IoServicePoolTest : public testing::Test {
+protected:
+  void SetUp() override {}
+};
+
+// Shared mode runs one io_service on every thread; the per core modes run
+// one io_service per thread
+TEST_F(IoServicePoolTest, ServiceCount) {
+  EXPECT_EQ(IoServicePool(THREADING_SHARED, 4).size(), 1);
+  EXPECT_EQ(IoServicePool(THREADING_PER_CORE, 4).size(), 4);
+  EXPECT_EQ(IoServicePool(THREADING_PER_CORE_PINNED, 4).size(), 4);
+  EXPECT_EQ(IoServicePool(THREADING_PER_CORE, 0).size(), 1);
+}
+
+// Work posted to each io_service runs, and stop() makes run() return
+TEST_F(IoServicePoolTest, RunAndStop) {
+  IoServicePool io_services(THREADING_PER_CORE_PINNED, 3);
+  std::atomic<size_t> ran = 0;
+  // Keep run() from returning before stop() is called
+  std::vector<boost::asio::executor_work_guard<
+      boost::asio::io_service::executor_type>>
+      work;
+  for (size_t i = 0; i < io_services.size(); i++) {
+    work.push_back(boost::asio::make_work_guard(io_services.get(i)));
+    boost::asio::post(io_services.get(i), [&] { ran++; });
+  }
+  std::thread runner([&] { io_services.run(); });
+  while (ran < io_services.size()) {
+    std::this_thread::yield();
+  }
+  io_services.stop();
+  runner.join();
+  EXPECT_EQ(ran, 3);
+}
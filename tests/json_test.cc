@@ -0,0 +1,118 @@
+#include "json.h"
+#include "gtest/gtest.h"
+#include <string>
+
+class JsonTest : public testing::Test {
+protected:
+  void SetUp() override {}
+};
+
+// Output is laid out like property_tree's write_json
+TEST_F(JsonTest, WriterLayout) {
+  JsonWriter writer;
+  writer.beginObject();
+  writer.key("id");
+  writer.string("1");
+  writer.key("files");
+  writer.beginArray();
+  writer.string("1");
+  writer.string("2");
+  writer.endArray();
+  writer.key("empty");
+  writer.beginArray();
+  writer.endArray();
+  writer.key("nested");
+  writer.beginObject();
+  writer.key("count");
+  writer.number(-42);
+  writer.key("ok");
+  writer.boolean(true);
+  writer.key("none");
+  writer.null();
+  writer.endObject();
+  writer.endObject();
+  EXPECT_EQ(writer.text(), "{\n"
+                           "    \"id\": \"1\",\n"
+                           "    \"files\": [\n"
+                           "        \"1\",\n"
+                           "        \"2\"\n"
+                           "    ],\n"
+                           "    \"empty\": [],\n"
+                           "    \"nested\": {\n"
+                           "        \"count\": -42,\n"
+                           "        \"ok\": true,\n"
+                           "        \"none\": null\n"
+                           "    }\n"
+                           "}\n");
+  EXPECT_TRUE(validJson(writer.text()));
+
+  JsonWriter scalar;
+  scalar.number(7);
+  EXPECT_EQ(scalar.text(), "7\n");
+}
+
+// Taking the text a piece at a time adds up to the whole document
+TEST_F(JsonTest, WriterTake) {
+  JsonWriter writer;
+  writer.beginArray();
+  writer.string("a");
+  std::string first = writer.take();
+  EXPECT_EQ(writer.text(), "");
+  writer.string("b");
+  writer.endArray();
+  EXPECT_EQ(first + writer.take(), "[\n    \"a\",\n    \"b\"\n]\n");
+}
+
+TEST_F(JsonTest, Escapes) {
+  EXPECT_EQ(jsonString("plain"), "\"plain\"");
+  EXPECT_EQ(jsonString("a\"b\\c\n\t\x01"), "\"a\\\"b\\\\c\\n\\t\\u0001\"");
+  EXPECT_EQ(jsonString("caf\xc3\xa9"), "\"caf\xc3\xa9\"");
+  EXPECT_TRUE(validJson(jsonString(std::string("\x00\x1f\x7f", 3))));
+}
+
+TEST_F(JsonTest, ValidDocuments) {
+  for (std::string text :
+       {"{}", "[]", " {\"size\": 10} \n", "0", "-0.5e+10", "1E3", "\"\"",
+        "true", "false", "null", "[1, \"two\", {\"three\": [null]}, false]",
+        "{\"a\": {\"b\": {}}, \"c\": []}", "\"\\u00e9\\/\\b\\f\\n\\r\\t\"",
+        "\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80\""}) {
+    EXPECT_TRUE(validJson(text)) << text;
+  }
+}
+
+TEST_F(JsonTest, InvalidDocuments) {
+  for (std::string text :
+       {"", " ", "{", "}", "[1,]", "[1 2]", "{\"a\" 1}", "{\"a\": 1,}",
+        "{1: 2}", "{\"a\": 1} {}", "01", "-", "1.", ".5", "1e", "+1", "tru",
+        "nul", "True", "'a'", "\"open", "\"bad \\x escape\"", "\"\\u12g4\"",
+        "\"tab\tinside\"", "\"\xc0\xaf\"", "\"\xed\xa0\x80\"", "\"\xf5\x80\x80\x80\"",
+        "\"\xe2\x82\"", "ID 1 NEW"}) {
+    EXPECT_FALSE(validJson(text)) << text;
+  }
+}
+
+// Special characters are found wherever they fall in a run of plain ones
+TEST_F(JsonTest, LongStrings) {
+  for (size_t at = 0; at < 40; at++) {
+    std::string plain(40, 'x');
+    std::string escaped = plain;
+    escaped.replace(at, 1, "\\n");
+    EXPECT_TRUE(validJson("\"" + escaped + "\""));
+    std::string control = plain;
+    control[at] = '\x1f';
+    EXPECT_FALSE(validJson("\"" + control + "\"")) << at;
+    std::string unterminated = plain;
+    unterminated[at] = '"';
+    EXPECT_FALSE(validJson("\"" + unterminated + "\"")) << at;
+    std::string invalid_utf8 = plain;
+    invalid_utf8[at] = '\xff';
+    EXPECT_FALSE(validJson("\"" + invalid_utf8 + "\"")) << at;
+  }
+}
+
+TEST_F(JsonTest, Depth) {
+  std::string deep(JSON_MAX_DEPTH, '[');
+  deep += std::string(JSON_MAX_DEPTH, ']');
+  EXPECT_TRUE(validJson(deep));
+  EXPECT_FALSE(validJson("[" + deep + "]"));
+}
@@ -0,0 +1,162 @@
+#include "filesystem/log_filesystem.h"
+#include "gtest/gtest.h"
+#include <memory>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+class LogFileSystemTest : public testing::Test {
+protected:
+  void SetUp() override {
+    root = fs::temp_directory_path() /
+           ("log_filesystem_test_" + std::to_string(::getpid()));
+    fs::remove_all(root);
+    filesystem = std::make_unique<LogFileSystem>(root);
+  }
+  void TearDown() override {
+    filesystem.reset();
+    fs::remove_all(root);
+  }
+  // Close and reopen the log, rebuilding the index from disk
+  void reopen(size_t segment_size = LOG_FILESYSTEM_DEFAULT_SEGMENT_SIZE) {
+    filesystem.reset();
+    filesystem = std::make_unique<LogFileSystem>(root, segment_size);
+  }
+  fs::path root;
+  std::unique_ptr<LogFileSystem> filesystem;
+};
+
+// Writing, overwriting, reading, then removing the same file
+TEST_F(LogFileSystemTest, BasicReadWriteRemove) {
+  const fs::path path = root / "Shoes/1";
+  EXPECT_EQ(filesystem->read(path), std::nullopt);
+  EXPECT_TRUE(filesystem->write(path, "first"));
+  EXPECT_TRUE(filesystem->write(path, "second"));
+  EXPECT_EQ(filesystem->read(path), "second");
+  EXPECT_EQ(filesystem->stat(path).value().size, 6);
+  EXPECT_TRUE(filesystem->exists(path));
+  EXPECT_TRUE(filesystem->remove(path));
+  EXPECT_FALSE(filesystem->remove(path));
+  EXPECT_FALSE(filesystem->exists(path));
+  EXPECT_EQ(filesystem->read(path), std::nullopt);
+}
+
+// Paths outside of the root, and the root itself, can't be written
+TEST_F(LogFileSystemTest, RejectsPathsOutsideRoot) {
+  EXPECT_FALSE(filesystem->write(root / "../escape", "data"));
+  EXPECT_FALSE(filesystem->write("/elsewhere/1", "data"));
+  EXPECT_FALSE(filesystem->write(root, "data"));
+  EXPECT_FALSE(filesystem->write(root / "Shoes/", "data"));
+}
+
+// Creating only succeeds for new files
+TEST_F(LogFileSystemTest, CreateDoesNotOverwrite) {
+  EXPECT_TRUE(filesystem->create(root / "Shoes/1", "first"));
+  EXPECT_FALSE(filesystem->create(root / "Shoes/1", "second"));
+  EXPECT_EQ(filesystem->read(root / "Shoes/1"), "first");
+}
+
+// Directories exist while they have files, and listing skips nested files
+TEST_F(LogFileSystemTest, ListDirectory) {
+  EXPECT_TRUE(filesystem->write(root / "Shoes/2", ""));
+  EXPECT_TRUE(filesystem->write(root / "Shoes/1", ""));
+  EXPECT_TRUE(filesystem->write(root / "Shoes/foo/bar", ""));
+  EXPECT_TRUE(filesystem->write(root / "Shoesies/1", ""));
+
+  EXPECT_TRUE(filesystem->is_directory(root / "Shoes"));
+  EXPECT_TRUE(filesystem->is_directory(root / "Shoes/"));
+  EXPECT_TRUE(filesystem->is_directory(root / "Shoes/foo"));
+  EXPECT_FALSE(filesystem->is_directory(root / "Shoes/1"));
+  EXPECT_FALSE(filesystem->is_directory(root / "Hats"));
+  EXPECT_EQ(filesystem->list(root / "Shoes/"),
+            std::vector<fs::path>({root / "Shoes/1", root / "Shoes/2"}));
+  EXPECT_EQ(filesystem->list(root / "Hats"), std::nullopt);
+
+  EXPECT_TRUE(filesystem->remove(root / "Shoesies/1"));
+  EXPECT_FALSE(filesystem->exists(root / "Shoesies"));
+}
+
+// The index is rebuilt from the log, and a torn final record is dropped
+TEST_F(LogFileSystemTest, RecoversAfterReopen) {
+  EXPECT_TRUE(filesystem->write(root / "Shoes/1", "one"));
+  EXPECT_TRUE(filesystem->write(root / "Shoes/2", "two"));
+  EXPECT_TRUE(filesystem->write(root / "Shoes/1", "uno"));
+  EXPECT_TRUE(filesystem->remove(root / "Shoes/2"));
+  EXPECT_TRUE(filesystem->write(root / "Shoes/3", "three"));
+  filesystem.reset();
+
+  // Simulate a crash in the middle of appending a record
+  const fs::path segment = root / "segment-000001.log";
+  const uintmax_t size = fs::file_size(segment);
+  fs::resize_file(segment, size - 2);
+
+  reopen();
+  EXPECT_EQ(filesystem->read(root / "Shoes/1"), "uno");
+  EXPECT_FALSE(filesystem->exists(root / "Shoes/2"));
+  EXPECT_FALSE(filesystem->exists(root / "Shoes/3"));
+  EXPECT_TRUE(filesystem->write(root / "Shoes/4", "four"));
+  reopen();
+  EXPECT_EQ(filesystem->read(root / "Shoes/4"), "four");
+}
+
+// A file's modification time is the time it was written, even after the
+// log is reopened or compacted
+TEST_F(LogFileSystemTest, KeepsModificationTimes) {
+  reopen(64);
+  EXPECT_TRUE(filesystem->write(root / "Shoes/1", "one"));
+  const FileStat written = filesystem->stat(root / "Shoes/1").value();
+  reopen(64);
+  EXPECT_EQ(filesystem->stat(root / "Shoes/1"), written);
+
+  // Fill and seal the first segment with garbage, so compaction copies the
+  // record to a new one
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(filesystem->write(root / "Shoes/2", std::string(40, 'a')));
+  }
+  filesystem->compact();
+  EXPECT_FALSE(fs::exists(root / "segment-000001.log"));
+  EXPECT_EQ(filesystem->stat(root / "Shoes/1"), written);
+  reopen(64);
+  EXPECT_EQ(filesystem->stat(root / "Shoes/1"), written);
+}
+
+// Compaction drops garbage segments but keeps live files and removals
+TEST_F(LogFileSystemTest, CompactionKeepsLiveRecords) {
+  reopen(64);
+  for (int i = 0; i < 20; i++) {
+    EXPECT_TRUE(filesystem->write(root / "Shoes/1", std::string(20, 'a' + i)));
+  }
+  EXPECT_TRUE(filesystem->write(root / "Shoes/2", "kept"));
+  EXPECT_TRUE(filesystem->write(root / "Shoes/3", "removed"));
+  EXPECT_TRUE(filesystem->remove(root / "Shoes/3"));
+  // Compaction may also have run in the background by now
+  filesystem->compact();
+  EXPECT_FALSE(fs::exists(root / "segment-000001.log"));
+  EXPECT_LE(filesystem->segmentCount(), 4);
+
+  EXPECT_EQ(filesystem->read(root / "Shoes/1"), std::string(20, 'a' + 19));
+  EXPECT_EQ(filesystem->read(root / "Shoes/2"), "kept");
+  EXPECT_FALSE(filesystem->exists(root / "Shoes/3"));
+  reopen(64);
+  EXPECT_EQ(filesystem->read(root / "Shoes/1"), std::string(20, 'a' + 19));
+  EXPECT_EQ(filesystem->read(root / "Shoes/2"), "kept");
+  EXPECT_FALSE(filesystem->exists(root / "Shoes/3"));
+}
+
+// Opening the same root twice shares one instance while it's held
+TEST_F(LogFileSystemTest, OpenSharesInstances) {
+  const fs::path shared_root = root.string() + "_shared";
+  std::shared_ptr<LogFileSystem> first = LogFileSystem::Open(shared_root);
+  std::shared_ptr<LogFileSystem> second =
+      LogFileSystem::Open(shared_root / "." / "");
+  EXPECT_EQ(first, second);
+  EXPECT_TRUE(first->write(shared_root / "Shoes/1", "data"));
+  EXPECT_EQ(second->read(shared_root / "Shoes/1"), "data");
+
+  first.reset();
+  second.reset();
+  std::shared_ptr<LogFileSystem> reopened = LogFileSystem::Open(shared_root);
+  EXPECT_EQ(reopened->read(shared_root / "Shoes/1"), "data");
+  reopened.reset();
+  fs::remove_all(shared_root);
+}
@@ -0,0 +1,64 @@
+#include "logging.h"
+#include "gtest/gtest.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+class LoggingTest : public testing::Test {
+protected:
+  void SetUp() override {
+    log_dir = fs::temp_directory_path() /
+              ("logging_test_" + std::to_string(::getpid()));
+    fs::remove_all(log_dir);
+  }
+  void TearDown() override {
+    shutdown_logging();
+    fs::remove_all(log_dir);
+  }
+  std::string logFile() { return (log_dir / "test_%N.log").string(); }
+  // Contents of the first log file
+  std::string logged() {
+    std::ifstream file(log_dir / "test_0.log");
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+  }
+  fs::path log_dir;
+};
+
+// Synchronous records are on disk as soon as they are logged
+TEST_F(LoggingTest, SyncWritesImmediately) {
+  init_logging(LOGGING_SYNC, logFile(), false);
+  BOOST_LOG_TRIVIAL(info) << "sync record";
+  EXPECT_NE(logged().find("[info] sync record"), std::string::npos);
+}
+
+// Asynchronous records are written by the flusher, and everything queued is
+// written out by shutdown_logging
+TEST_F(LoggingTest, AsyncWritesInBackground) {
+  init_logging(LOGGING_ASYNC, logFile(), false);
+  BOOST_LOG_TRIVIAL(info) << "first record";
+  std::this_thread::sleep_for(ASYNC_LOG_FLUSH_INTERVAL * 4);
+  EXPECT_NE(logged().find("[info] first record"), std::string::npos);
+
+  for (int i = 0; i < 100; i++) {
+    BOOST_LOG_TRIVIAL(warning) << "record " << i;
+  }
+  shutdown_logging();
+  EXPECT_NE(logged().find("[warning] record 99"), std::string::npos);
+  EXPECT_EQ(dropped_log_records(), 0);
+}
+
+// Records below the filter are not written
+TEST_F(LoggingTest, FiltersDebug) {
+  init_logging(LOGGING_ASYNC, logFile(), false);
+  BOOST_LOG_TRIVIAL(debug) << "debug record";
+  BOOST_LOG_TRIVIAL(error) << "error record";
+  shutdown_logging();
+  EXPECT_EQ(logged().find("debug record"), std::string::npos);
+  EXPECT_NE(logged().find("error record"), std::string::npos);
+}
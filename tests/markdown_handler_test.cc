@@ -1,6 +1,7 @@
 #include "filesystem/fake_filesystem.h"
 #include "handlers/markdown_handler.h"
 #include "gtest/gtest.h"
+#include <functional>
 #include <memory>
 
 const std::string MD_HTML_PREFIX = "<!DOCTYPE html>\n"
@@ -328,4 +329,235 @@ MarkdownHandler handler(
   post_request.body() = "NEW BODY";
   http_response post_response = handler.handle_request(post_request);
   EXPECT_EQ(post_response.result(), boost::beast::http::status::bad_request);
-}
\ No newline at end of file
+}
+// Rendered pages are cached until the page is written through the handler
+TEST_F(MarkdownHandlerTest, CachedRender){
+  std::unique_ptr<FileSystemInterface> filesystem =
+      std::make_unique<FakeFileSystem>();
+  filesystem->write("/mnt/markdown/homer.md", "DOH");
+  MarkdownHandler handler(
+                      "/markdown",
+                      {
+                        {"data_path", "/mnt/markdown"},
+                        {"format_path", "stylesheet"}
+                      },
+                      std::move(filesystem)
+  );
+
+  http_request get_request;
+  get_request.method(boost::beast::http::verb::get);
+  get_request.target("/markdown/homer.md");
+  EXPECT_EQ(handler.handle_request(get_request).body(),
+            MD_HTML_PREFIX + "<p>DOH</p>\n" + MD_HTML_SUFFIX);
+  EXPECT_EQ(handler.handle_request(get_request).body(),
+            MD_HTML_PREFIX + "<p>DOH</p>\n" + MD_HTML_SUFFIX);
+  EXPECT_EQ(handler.cacheStats().value().hits, 1);
+  EXPECT_EQ(handler.cacheStats().value().entries, 1);
+
+  http_request put_request;
+  put_request.method(boost::beast::http::verb::put);
+  put_request.set(boost::beast::http::field::content_type, MARKDOWN);
+  put_request.target("/markdown/homer.md");
+  put_request.body() = "WOOHOO";
+  EXPECT_EQ(handler.handle_request(put_request).result(),
+            boost::beast::http::status::no_content);
+  EXPECT_EQ(handler.cacheStats().value().entries, 0);
+  EXPECT_EQ(handler.handle_request(get_request).body(),
+            MD_HTML_PREFIX + "<p>WOOHOO</p>\n" + MD_HTML_SUFFIX);
+
+  http_request delete_request;
+  delete_request.method(boost::beast::http::verb::delete_);
+  delete_request.target("/markdown/homer.md");
+  handler.handle_request(delete_request);
+  EXPECT_EQ(handler.handle_request(get_request).result(),
+            boost::beast::http::status::not_found);
+}
+
+// A cache_size of 0 turns the cache off
+TEST_F(MarkdownHandlerTest, CacheDisabled){
+  MarkdownHandler handler(
+                      "/markdown",
+                      {
+                        {"data_path", "/mnt/markdown"},
+                        {"format_path", "stylesheet"},
+                        {"cache_size", "0"}
+                      },
+                      std::make_unique<FakeFileSystem>()
+  );
+  EXPECT_EQ(handler.cacheStats(), std::nullopt);
+}
+
+// Compressed renders are cached next to the plain one, and dropped with it
+TEST_F(MarkdownHandlerTest, CompressedRender){
+  std::unique_ptr<FileSystemInterface> filesystem =
+      std::make_unique<FakeFileSystem>();
+  filesystem->write("/mnt/markdown/homer.md", std::string(2040, 'D'));
+  MarkdownHandler handler(
+                      "/markdown",
+                      {
+                        {"data_path", "/mnt/markdown"},
+                        {"format_path", "stylesheet"},
+                        {"compress_types", "text/html"}
+                      },
+                      std::move(filesystem)
+  );
+
+  http_request get_request;
+  get_request.method(boost::beast::http::verb::get);
+  get_request.target("/markdown/homer.md");
+  get_request.set(boost::beast::http::field::accept_encoding, "gzip");
+  for (int i = 0; i < 2; i++) {
+    http_response response = handler.handle_request(get_request);
+    EXPECT_EQ(response.at(boost::beast::http::field::content_encoding), "gzip");
+    EXPECT_EQ(response.at(boost::beast::http::field::vary), "Accept-Encoding");
+    EXPECT_LT(response.body().size(), 2048);
+  }
+  EXPECT_EQ(handler.cacheStats().value().hits, 1);
+  EXPECT_EQ(handler.cacheStats().value().entries, 2);
+
+  get_request.erase(boost::beast::http::field::accept_encoding);
+  http_response plain = handler.handle_request(get_request);
+  EXPECT_EQ(plain.count(boost::beast::http::field::content_encoding), 0);
+  EXPECT_EQ(plain.body(), MD_HTML_PREFIX + "<p>" + std::string(2040, 'D') +
+                              "</p>\n" + MD_HTML_SUFFIX);
+
+  http_request delete_request;
+  delete_request.method(boost::beast::http::verb::delete_);
+  delete_request.target("/markdown/homer.md");
+  handler.handle_request(delete_request);
+  EXPECT_EQ(handler.cacheStats().value().entries, 0);
+}
+
+// Pages carry a weak ETag and Last-Modified, and a client revalidating the
+// current version gets a 304
+TEST_F(MarkdownHandlerTest, ConditionalGet){
+  std::unique_ptr<FileSystemInterface> filesystem =
+      std::make_unique<FakeFileSystem>();
+  filesystem->write("/mnt/markdown/homer.md", "DOH");
+  MarkdownHandler handler(
+                      "/markdown",
+                      {
+                        {"data_path", "/mnt/markdown"},
+                        {"format_path", "stylesheet"},
+                        {"cache_control", "max-age=60"}
+                      },
+                      std::move(filesystem)
+  );
+
+  http_request get_request;
+  get_request.method(boost::beast::http::verb::get);
+  get_request.target("/markdown/homer.md");
+  http_response response = handler.handle_request(get_request);
+  std::string etag(response.at(boost::beast::http::field::etag));
+  std::string last_modified(
+      response.at(boost::beast::http::field::last_modified));
+  EXPECT_TRUE(etag.starts_with("W/\""));
+  EXPECT_EQ(response.at(boost::beast::http::field::cache_control), "max-age=60");
+
+  get_request.set(boost::beast::http::field::if_none_match, etag);
+  response = handler.handle_request(get_request);
+  EXPECT_EQ(response.result(), boost::beast::http::status::not_modified);
+  EXPECT_EQ(response.body(), "");
+
+  get_request.erase(boost::beast::http::field::if_none_match);
+  get_request.set(boost::beast::http::field::if_modified_since, last_modified);
+  EXPECT_EQ(handler.handle_request(get_request).result(),
+            boost::beast::http::status::not_modified);
+}
+
+// A filesystem whose modification times are too coarse to tell writes
+// apart, and which runs `on_read` once a read has taken the page's contents
+class CoarseFileSystem : public FakeFileSystem {
+public:
+  std::optional<FileStat>
+  stat(const std::filesystem::path &filename) const override {
+    std::optional<FileStat> file_stat = FakeFileSystem::stat(filename);
+    if (file_stat.has_value()) {
+      file_stat->last_write_time = std::filesystem::file_time_type();
+    }
+    return file_stat;
+  }
+  std::optional<std::string>
+  read(const std::filesystem::path &filename) const override {
+    std::optional<std::string> contents = FakeFileSystem::read(filename);
+    if (on_read) {
+      std::function<void()> run = std::move(on_read);
+      on_read = nullptr;
+      run();
+    }
+    return contents;
+  }
+  mutable std::function<void()> on_read;
+};
+
+// A GET that read the page before a PUT, and renders it after, doesn't leave
+// its stale render to be served once the PUT is done
+TEST_F(MarkdownHandlerTest, PutDuringGet){
+  std::unique_ptr<CoarseFileSystem> filesystem =
+      std::make_unique<CoarseFileSystem>();
+  CoarseFileSystem *coarse = filesystem.get();
+  filesystem->write("/mnt/markdown/homer.md", "DOH");
+  MarkdownHandler handler(
+                      "/markdown",
+                      {
+                        {"data_path", "/mnt/markdown"},
+                        {"format_path", "stylesheet"}
+                      },
+                      std::move(filesystem)
+  );
+
+  http_request get_request;
+  get_request.method(boost::beast::http::verb::get);
+  get_request.target("/markdown/homer.md");
+  http_request put_request;
+  put_request.method(boost::beast::http::verb::put);
+  put_request.set(boost::beast::http::field::content_type, MARKDOWN);
+  put_request.target("/markdown/homer.md");
+  put_request.body() = "WOO";
+  coarse->on_read = [&] {
+    EXPECT_EQ(handler.handle_request(put_request).result(),
+              boost::beast::http::status::no_content);
+  };
+  EXPECT_EQ(handler.handle_request(get_request).body(),
+            MD_HTML_PREFIX + "<p>DOH</p>\n" + MD_HTML_SUFFIX);
+  EXPECT_EQ(handler.handle_request(get_request).body(),
+            MD_HTML_PREFIX + "<p>WOO</p>\n" + MD_HTML_SUFFIX);
+  EXPECT_EQ(handler.handle_request(get_request).body(),
+            MD_HTML_PREFIX + "<p>WOO</p>\n" + MD_HTML_SUFFIX);
+  EXPECT_EQ(handler.cacheStats().value().hits, 1);
+}
+
+// A page rewritten with the same size, within one tick of its modification
+// time, gets a new ETag, so a client holding the old one isn't told 304
+TEST_F(MarkdownHandlerTest, SameSizePutChangesETag){
+  MarkdownHandler handler(
+                      "/markdown",
+                      {
+                        {"data_path", "/mnt/markdown"},
+                        {"format_path", "stylesheet"}
+                      },
+                      std::make_unique<CoarseFileSystem>()
+  );
+  http_request post_request;
+  post_request.method(boost::beast::http::verb::post);
+  post_request.set(boost::beast::http::field::content_type, MARKDOWN);
+  post_request.target("/markdown/homer.md");
+  post_request.body() = "DOH";
+  handler.handle_request(post_request);
+
+  http_request get_request;
+  get_request.method(boost::beast::http::verb::get);
+  get_request.target("/markdown/homer.md");
+  std::string etag(
+      handler.handle_request(get_request).at(boost::beast::http::field::etag));
+
+  http_request put_request = post_request;
+  put_request.method(boost::beast::http::verb::put);
+  put_request.body() = "WOO";
+  handler.handle_request(put_request);
+  get_request.set(boost::beast::http::field::if_none_match, etag);
+  http_response response = handler.handle_request(get_request);
+  EXPECT_EQ(response.result(), boost::beast::http::status::ok);
+  EXPECT_NE(response.at(boost::beast::http::field::etag), etag);
+  EXPECT_EQ(response.body(), MD_HTML_PREFIX + "<p>WOO</p>\n" + MD_HTML_SUFFIX);
+}
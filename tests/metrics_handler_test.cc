@@ -0,0 +1,25 @@
+#include "handlers/metrics_handler.h"
+#include "gtest/gtest.h"
+
+// Metrics are served on GET, with the connection gauges
+TEST(MetricsHandlerTest, ServesMetrics) {
+  MetricsHandler handler;
+  http_request request{boost::beast::http::verb::get, "/metrics", 11};
+  http_response response = handler.handle_request(request);
+  EXPECT_EQ(response.result_int(), OK_STATUS);
+  EXPECT_EQ(response[http_fields::content_type], PROMETHEUS_TEXT);
+  EXPECT_NE(response.body().find("webserver_active_connections 0\n"),
+            std::string::npos);
+  EXPECT_NE(response.body().find(
+                "webserver_connection_timeouts_total{timeout=\"idle\"} 0\n"),
+            std::string::npos);
+  EXPECT_NE(response.body().find("# TYPE webserver_requests_total counter"),
+            std::string::npos);
+}
+
+// Anything but GET is refused
+TEST(MetricsHandlerTest, RejectsOtherMethods) {
+  MetricsHandler handler;
+  http_request request{boost::beast::http::verb::post, "/metrics", 11};
+  EXPECT_EQ(handler.handle_request(request).result_int(), NOT_SUPPORTED_STATUS);
+}
@@ -0,0 +1,99 @@
+#include "metrics.h"
+#include "gtest/gtest.h"
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// Responses are counted by status, with unlisted codes as "other"
+TEST(MetricsTest, CountsResponses) {
+  MetricsSeries series("/echo", "EchoHandler");
+  series.record(200, 10, 100, 50us);
+  series.record(200, 0, 20, 50us);
+  series.record(404, 0, 0, 50us);
+  series.record(299, 0, 0, 50us);
+  MetricsSeries::Totals totals = series.totals();
+  EXPECT_EQ(totals.requests, 4);
+  EXPECT_EQ(totals.bytes_in, 10);
+  EXPECT_EQ(totals.bytes_out, 120);
+  EXPECT_EQ(totals.statuses[0], 2);
+  EXPECT_EQ(totals.statuses[6], 1);
+  EXPECT_EQ(totals.statuses.back(), 1);
+  EXPECT_EQ(totals.latency_sum_us, 200);
+}
+
+// Latencies land in power of two buckets from 64us up, the last unbounded
+TEST(MetricsTest, LatencyBuckets) {
+  MetricsSeries series("/echo", "EchoHandler");
+  series.record(200, 0, 0, 0us);
+  series.record(200, 0, 0, 63us);
+  series.record(200, 0, 0, 64us);
+  series.record(200, 0, 0, 127us);
+  series.record(200, 0, 0, 1ms);
+  series.record(200, 0, 0, 1h);
+  MetricsSeries::Totals totals = series.totals();
+  EXPECT_EQ(totals.latency_buckets[0], 2);
+  EXPECT_EQ(totals.latency_buckets[1], 2);
+  // 1000us is under 1024us = 2^(6 + 4)
+  EXPECT_EQ(totals.latency_buckets[4], 1);
+  EXPECT_EQ(totals.latency_buckets.back(), 1);
+}
+
+// Counts from every thread's shard are merged
+TEST(MetricsTest, MergesShards) {
+  MetricsSeries series("/echo", "EchoHandler");
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 32; i++) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < 1000; j++) {
+        series.record(200, 1, 1, 10us);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  MetricsSeries::Totals totals = series.totals();
+  EXPECT_EQ(totals.requests, 32000);
+  EXPECT_EQ(totals.bytes_out, 32000);
+  EXPECT_EQ(totals.statuses[0], 32000);
+}
+
+// The same location and handler always get the same series, which is
+// written in the Prometheus text format
+TEST(MetricsTest, WritesSeries) {
+  Metrics &metrics = Metrics::GetInstance();
+  MetricsSeries &series = metrics.series("/metrics_test", "EchoHandler");
+  EXPECT_EQ(&series, &metrics.series("/metrics_test", "EchoHandler"));
+  EXPECT_NE(&series, &metrics.series("/metrics_test", "HealthHandler"));
+  series.record(200, 3, 5, 100us);
+
+  std::ostringstream out;
+  metrics.write(out);
+  const std::string labels = "location=\"/metrics_test\",handler=\"EchoHandler\"";
+  EXPECT_NE(out.str().find("# TYPE webserver_requests_total counter\n"),
+            std::string::npos);
+  EXPECT_NE(out.str().find("webserver_requests_total{" + labels + "} 1\n"),
+            std::string::npos);
+  EXPECT_NE(out.str().find("webserver_responses_total{" + labels +
+                           ",code=\"200\"} 1\n"),
+            std::string::npos);
+  EXPECT_NE(out.str().find("webserver_request_bytes_total{" + labels + "} 3\n"),
+            std::string::npos);
+  EXPECT_NE(
+      out.str().find("webserver_response_bytes_total{" + labels + "} 5\n"),
+      std::string::npos);
+  EXPECT_NE(out.str().find("webserver_request_duration_seconds_bucket{" +
+                           labels + ",le=\"0.000064\"} 0\n"),
+            std::string::npos);
+  EXPECT_NE(out.str().find("webserver_request_duration_seconds_bucket{" +
+                           labels + ",le=\"0.000128\"} 1\n"),
+            std::string::npos);
+  EXPECT_NE(out.str().find("webserver_request_duration_seconds_bucket{" +
+                           labels + ",le=\"+Inf\"} 1\n"),
+            std::string::npos);
+  EXPECT_NE(out.str().find("webserver_request_duration_seconds_sum{" + labels +
+                           "} 0.000100\n"),
+            std::string::npos);
+}
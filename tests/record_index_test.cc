@@ -0,0 +1,80 @@
+#include "filesystem/fake_filesystem.h"
+#include "record_index.h"
+#include "gtest/gtest.h"
+
+class RecordIndexTest : public testing::Test {
+protected:
+  void SetUp() override {
+    for (std::string name : {"10", "2", "1", "shoe", "Boot", "300"}) {
+      filesystem.write("/mnt/crud/Shoes/" + name, "");
+    }
+    filesystem.write("/mnt/crud/Shoes/laces/1", "nested files are ignored");
+    ASSERT_TRUE(index.load(filesystem, "/mnt/crud/Shoes"));
+  }
+  std::vector<std::string> all() {
+    bool more = false;
+    return index.page("", 100, more);
+  }
+  FakeFileSystem filesystem;
+  RecordIndex index;
+};
+
+// Numeric IDs sort by value, ahead of any other names
+TEST_F(RecordIndexTest, Order) {
+  EXPECT_EQ(all(), std::vector<std::string>(
+                       {"1", "2", "10", "300", "Boot", "shoe"}));
+  RecordOrder order;
+  EXPECT_TRUE(order("9", "10"));
+  EXPECT_FALSE(order("10", "9"));
+  EXPECT_TRUE(order("99", "a"));
+  EXPECT_FALSE(order("a", "a"));
+}
+
+// Pages pick up strictly after the cursor, which needn't be in the index
+TEST_F(RecordIndexTest, Pages) {
+  bool more = false;
+  EXPECT_EQ(index.page("", 2, more), std::vector<std::string>({"1", "2"}));
+  EXPECT_TRUE(more);
+  EXPECT_EQ(index.page("2", 2, more), std::vector<std::string>({"10", "300"}));
+  EXPECT_TRUE(more);
+  EXPECT_EQ(index.page("300", 2, more),
+            std::vector<std::string>({"Boot", "shoe"}));
+  EXPECT_FALSE(more);
+  EXPECT_EQ(index.page("5", 1, more), std::vector<std::string>({"10"}));
+  EXPECT_TRUE(more);
+  EXPECT_EQ(index.page("zzz", 10, more), std::vector<std::string>());
+  EXPECT_FALSE(more);
+  EXPECT_EQ(index.page("", 0, more), std::vector<std::string>());
+  EXPECT_TRUE(more);
+}
+
+// Changes are reflected without reloading, and bump the version only if they
+// change the index
+TEST_F(RecordIndexTest, Changes) {
+  uint64_t version = index.version();
+  index.insert("11");
+  EXPECT_GT(index.version(), version);
+  version = index.version();
+  index.insert("11");
+  index.erase("12");
+  EXPECT_EQ(index.version(), version);
+  index.erase("Boot");
+  EXPECT_GT(index.version(), version);
+  EXPECT_EQ(all(), std::vector<std::string>({"1", "2", "10", "11", "300", "shoe"}));
+
+  // loading again doesn't walk the directory
+  filesystem.write("/mnt/crud/Shoes/4", "");
+  EXPECT_TRUE(index.load(filesystem, "/mnt/crud/Shoes"));
+  EXPECT_EQ(index.size(), 6);
+}
+
+// Changes before the first load are left for it to find
+TEST_F(RecordIndexTest, Unloaded) {
+  RecordIndex gloves;
+  gloves.insert("1");
+  EXPECT_EQ(gloves.size(), 0);
+  filesystem.write("/mnt/crud/Gloves/2", "");
+  EXPECT_TRUE(gloves.load(filesystem, "/mnt/crud/Gloves"));
+  EXPECT_EQ(gloves.size(), 1);
+  EXPECT_NE(gloves.id(), index.id());
+}
@@ -2,6 +2,8 @@
 #include "request_manager.h"
 #include "gtest/gtest.h"
 #include <fstream>
+#include <future>
+#include <thread>
 
 class RequestManagerTest : public testing::Test {
 protected:
@@ -108,3 +110,110 @@ TEST_F(RequestManagerTest, ManageMalformedRequestTest) {
   SetUp("configs/all_items_config");
   manage_request_success(request, bad_request_header);
 }
+
+// Echo requests are answered inline; static files on the blocking executor
+TEST_F(RequestManagerTest, ServeRequestAsync) {
+  SetUp("configs/all_items_config");
+  std::unordered_map<std::string, LocationData> locations =
+      full_parsed_config.findLocations().value();
+  RequestManager request_manager = RequestManager(locations);
+  boost::asio::io_service io_service;
+
+  http_request echo_request{boost::beast::http::verb::get, "/echo", 11};
+  bool responded = false;
+  request_manager.serveRequestAsync(
+      request_manager.route(echo_request), echo_request, io_service,
+      [&](http_response_variant response) {
+        EXPECT_EQ(std::get<http_response>(response).result_int(), 200);
+        responded = true;
+      });
+  EXPECT_TRUE(responded);
+
+  http_request static_request{boost::beast::http::verb::get,
+                              "/static/missing.txt", 11};
+  std::promise<unsigned> status;
+  request_manager.serveRequestAsync(
+      request_manager.route(static_request), static_request, io_service,
+      [&](http_response_variant response) {
+        status.set_value(std::get<http_response>(response).result_int());
+      });
+  EXPECT_EQ(status.get_future().get(), 404);
+}
+
+// Reloading routes new requests with the new locations, while a table taken
+// before the reload keeps serving the old ones
+TEST_F(RequestManagerTest, Reload) {
+  SetUp("configs/all_items_config");
+  std::unordered_map<std::string, LocationData> locations =
+      full_parsed_config.findLocations().value();
+  RequestManager request_manager = RequestManager(locations);
+  std::shared_ptr<const RoutingTable> before = request_manager.routingTable();
+  ASSERT_EQ(request_manager.matchPath("/echo"), "/echo");
+
+  std::unordered_map<std::string, LocationData> reloaded;
+  reloaded["/echo2"] = locations.at("/echo");
+  request_manager.reload(reloaded);
+
+  EXPECT_EQ(request_manager.matchPath("/echo"), std::nullopt);
+  EXPECT_EQ(request_manager.matchPath("/echo2/extra"), "/echo2");
+  EXPECT_EQ(before->matchPath("/echo"), "/echo");
+  EXPECT_EQ(before->matchPath("/echo2"), std::nullopt);
+
+  http_request request{boost::beast::http::verb::get, "/echo2", 11};
+  EXPECT_EQ(request_manager.manageRequest(request).result_int(), 200);
+}
+
+// A request routed before a reload is served by the handlers it was routed
+// to, which its route keeps alive, even if the reload removed its location
+TEST_F(RequestManagerTest, RouteOutlivesReload) {
+  SetUp("configs/all_items_config");
+  std::unordered_map<std::string, LocationData> locations =
+      full_parsed_config.findLocations().value();
+  RequestManager request_manager = RequestManager(locations);
+  boost::asio::io_service io_service;
+
+  http_request request{boost::beast::http::verb::get, "/echo", 11};
+  RequestManager::Route route = request_manager.route(request);
+  std::weak_ptr<const RoutingTable> before = route.table;
+  std::unordered_map<std::string, LocationData> reloaded;
+  reloaded["/echo2"] = locations.at("/echo");
+  request_manager.reload(reloaded);
+  ASSERT_FALSE(before.expired());
+
+  unsigned status = 0;
+  request_manager.serveRequestAsync(
+      std::move(route), request, io_service,
+      [&](http_response_variant response) {
+        status = std::get<http_response>(response).result_int();
+      });
+  EXPECT_EQ(status, 200);
+  EXPECT_TRUE(before.expired());
+}
+
+// Once a reload has replaced it and nothing is using it any more, the old
+// table is freed, even while threads that routed with it are still around
+TEST_F(RequestManagerTest, ReloadFreesOldTable) {
+  SetUp("configs/all_items_config");
+  std::unordered_map<std::string, LocationData> locations =
+      full_parsed_config.findLocations().value();
+  RequestManager request_manager = RequestManager(locations);
+  std::weak_ptr<const RoutingTable> before = request_manager.routingTable();
+
+  // A thread that routes a request and then sits idle
+  std::promise<void> routed;
+  std::promise<void> finish;
+  std::thread idle([&] {
+    http_request request{boost::beast::http::verb::get, "/echo", 11};
+    request_manager.manageRequest(request);
+    routed.set_value();
+    finish.get_future().wait();
+  });
+  routed.get_future().wait();
+  ASSERT_FALSE(before.expired());
+
+  request_manager.reload(locations);
+  EXPECT_TRUE(before.expired());
+
+  finish.set_value();
+  idle.join();
+}
@@ -0,0 +1,61 @@
+#include "route_trie.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+class RouteTrieTest : public testing::Test {
+protected:
+  void SetUp() override {
+    paths = {"/echo", "/static", "/static/css", "/", "/api/v1"};
+    trie = RouteTrie(paths);
+  }
+  // Returns the matched path, or "" if nothing matched
+  std::string matched(std::string target) {
+    std::optional<size_t> index = trie.match(target);
+    return index.has_value() ? paths[index.value()] : "";
+  }
+  std::vector<std::string> paths;
+  RouteTrie trie;
+};
+
+// Exact matches should be found
+TEST_F(RouteTrieTest, ExactMatch) {
+  EXPECT_EQ(matched("/echo"), "/echo");
+  EXPECT_EQ(matched("/static/css"), "/static/css");
+  EXPECT_EQ(matched("/api/v1"), "/api/v1");
+}
+
+// The longest matching prefix wins
+TEST_F(RouteTrieTest, LongestPrefixMatch) {
+  EXPECT_EQ(matched("/static/hello.txt"), "/static");
+  EXPECT_EQ(matched("/static/css/markdown.css"), "/static/css");
+  EXPECT_EQ(matched("/echo/"), "/echo");
+  EXPECT_EQ(matched("/echo/extra"), "/echo");
+}
+
+// Prefixes only match on segment boundaries
+TEST_F(RouteTrieTest, PartialSegmentsDoNotMatch) {
+  EXPECT_EQ(matched("/echoP"), "");
+  EXPECT_EQ(matched("/ech"), "");
+  EXPECT_EQ(matched("/staticfoo/bar"), "");
+  EXPECT_EQ(matched("/api"), "");
+  EXPECT_EQ(matched("/echo?query"), "");
+}
+
+// "/" only matches itself, or targets starting with "//"
+TEST_F(RouteTrieTest, RootPath) {
+  EXPECT_EQ(matched("/"), "/");
+  EXPECT_EQ(matched("//echo"), "/");
+  EXPECT_EQ(matched("/unknown"), "");
+  EXPECT_EQ(matched("echo"), "");
+  EXPECT_EQ(matched(""), "");
+}
+
+// Empty paths never match, and an empty trie matches nothing
+TEST_F(RouteTrieTest, EmptyPaths) {
+  paths = {""};
+  trie = RouteTrie(paths);
+  EXPECT_EQ(matched("/echo"), "");
+  EXPECT_EQ(matched(""), "");
+  EXPECT_FALSE(RouteTrie().match("/echo").has_value());
+}
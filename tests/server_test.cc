@@ -1,13 +1,38 @@
+#include "filesystem/filesystem_constants.h"
 #include "location_data.h"
+#include "metrics.h"
 #include "server.h"
 #include "gtest/gtest.h"
 #include <boost/asio.hpp>
+#include <boost/beast/http.hpp>
 
+#include <filesystem>
+#include <fstream>
 #include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 class ServerTest : public testing::Test {
 protected:
   void SetUp() {}
+  // Read one response from `socket`
+  http_response read_response(tcp::socket &socket) {
+    http_response response;
+    boost::beast::http::read(socket, response_buf, response);
+    return response;
+  }
+  // Wait for the server to close `socket`, and return how long that took
+  std::chrono::steady_clock::duration time_until_closed(tcp::socket &socket) {
+    auto start = std::chrono::steady_clock::now();
+    char data[64];
+    boost::system::error_code error;
+    while (!error) {
+      socket.read_some(boost::asio::buffer(data), error);
+    }
+    return std::chrono::steady_clock::now() - start;
+  }
+  boost::beast::flat_buffer response_buf;
 };
 
 // Basic initialization of server and calling of start_accept method
@@ -19,6 +44,413 @@ TEST_F(ServerTest, StartAndAccept) {
   RequestManager request_manager = RequestManager(locations);
 
   // Setup server
-  server s(io_service, request_manager, 8080);
+  server s(io_service, request_manager, 0);
   s.start_accept();
 }
+
+// Servers with reuse_port set can accept on the same port
+TEST_F(ServerTest, ReusePort) {
+  boost::asio::io_service io_service;
+  std::unordered_map<std::string, LocationData> locations;
+  RequestManager request_manager = RequestManager(locations);
+
+  server first(io_service, request_manager, 0, true);
+  server second(io_service, request_manager, first.port(), true);
+  first.start_accept();
+  second.start_accept();
+}
+
+// Pipelined requests are all answered, in the order they were sent, even when
+// an earlier one takes longer to handle than a later one
+TEST_F(ServerTest, PipelinedRequests) {
+  boost::asio::io_service io_service;
+  std::unordered_map<std::string, LocationData> locations = {
+      {"/echo", LocationData("EchoHandler", {})},
+      {"/static", LocationData("StaticHandler", {{"root", "markdown"}})}};
+  RequestManager request_manager = RequestManager(locations);
+  server s(io_service, request_manager, 0, false, SessionConfig{2});
+  s.start_accept();
+  std::thread runner([&] { io_service.run(); });
+
+  boost::asio::io_service client_service;
+  tcp::socket client(client_service);
+  client.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), s.port()));
+  std::string requests;
+  for (std::string target : {"/static/sample.md", "/echo/1", "/missing",
+                             "/echo/2", "/echo/3"}) {
+    requests += "GET " + target + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  }
+  boost::asio::write(client, boost::asio::buffer(requests));
+
+  http_response file = read_response(client);
+  EXPECT_EQ(file.result_int(), 200);
+  EXPECT_EQ(file.body().size(),
+            std::filesystem::file_size("markdown/sample.md"));
+  EXPECT_NE(read_response(client).body().find("GET /echo/1 "),
+            std::string::npos);
+  EXPECT_EQ(read_response(client).result_int(), 404);
+  EXPECT_NE(read_response(client).body().find("GET /echo/2 "),
+            std::string::npos);
+  EXPECT_NE(read_response(client).body().find("GET /echo/3 "),
+            std::string::npos);
+
+  // Each response is counted against the location that served it, once its
+  // write has completed
+  MetricsSeries &series = Metrics::GetInstance().series("/echo", "EchoHandler");
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  while (series.totals().requests < 3 &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  MetricsSeries::Totals echo = series.totals();
+  EXPECT_EQ(echo.requests, 3);
+  EXPECT_EQ(echo.statuses[0], 3);
+
+  io_service.stop();
+  runner.join();
+}
+
+// A write and the GET after it, pipelined, run in the order they were sent,
+// so the GET sees what was written
+TEST_F(ServerTest, PipelinedWriteThenRead) {
+  const std::filesystem::path data_path =
+      std::filesystem::temp_directory_path() /
+      ("server_test_pipelined_write_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(data_path);
+  boost::asio::io_service io_service;
+  std::unordered_map<std::string, LocationData> locations = {
+      {"/api", LocationData("CrudHandler", {{"data_path", data_path.string()},
+                                            {"storage", "log"}})}};
+  RequestManager request_manager = RequestManager(locations);
+  server s(io_service, request_manager, 0, false);
+  s.start_accept();
+  std::thread runner([&] { io_service.run(); });
+
+  boost::asio::io_service client_service;
+  tcp::socket client(client_service);
+  client.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), s.port()));
+  const std::string get = "GET /api/Shoes/1 HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  for (int round = 0; round < 10; round++) {
+    // Large enough that storing it takes a while
+    std::string record = "\"" + std::string(512 * 1024, 'a' + round) + "\"";
+    std::string put = "PUT /api/Shoes/1 HTTP/1.1\r\nHost: localhost\r\n"
+                      "Content-Type: application/json\r\n"
+                      "Content-Length: " + std::to_string(record.size()) +
+                      "\r\n\r\n" + record;
+    boost::asio::write(client, boost::asio::buffer(put + get));
+    EXPECT_EQ(read_response(client).result_int(), 204);
+    http_response response = read_response(client);
+    EXPECT_EQ(response.result_int(), 200);
+    EXPECT_TRUE(response.body() == record) << "round " << round;
+  }
+
+  std::string remove = "DELETE /api/Shoes/1 HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  boost::asio::write(client, boost::asio::buffer(remove + get));
+  EXPECT_EQ(read_response(client).result_int(), 204);
+  EXPECT_NE(read_response(client).result_int(), 200);
+
+  io_service.stop();
+  runner.join();
+  std::filesystem::remove_all(data_path);
+}
+
+// A range of a file is sent straight from the middle of it
+TEST_F(ServerTest, RangeRequest) {
+  boost::asio::io_service io_service;
+  std::unordered_map<std::string, LocationData> locations = {
+      {"/static", LocationData("StaticHandler", {{"root", "markdown"}})}};
+  RequestManager request_manager = RequestManager(locations);
+  server s(io_service, request_manager, 0, false);
+  s.start_accept();
+  std::thread runner([&] { io_service.run(); });
+
+  boost::asio::io_service client_service;
+  tcp::socket client(client_service);
+  client.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), s.port()));
+  std::string request = "GET /static/sample.md HTTP/1.1\r\nHost: localhost\r\n"
+                        "Range: bytes=5-14\r\n\r\n"
+                        "GET /static/sample.md HTTP/1.1\r\nHost: localhost\r\n"
+                        "Range: bytes=-3\r\n\r\n";
+  boost::asio::write(client, boost::asio::buffer(request));
+
+  std::ifstream file("markdown/sample.md");
+  std::string contents(std::istreambuf_iterator<char>{file}, {});
+  http_response middle = read_response(client);
+  EXPECT_EQ(middle.result_int(), 206);
+  EXPECT_EQ(middle.body(), contents.substr(5, 10));
+  http_response end = read_response(client);
+  EXPECT_EQ(end.result_int(), 206);
+  EXPECT_EQ(end.body(), contents.substr(contents.size() - 3));
+
+  io_service.stop();
+  runner.join();
+}
+
+// Bodies bound for a handler taking uploads are streamed to disk, so they
+// may be larger than fits in a request, up to the location's body_limit
+TEST_F(ServerTest, StreamedUpload) {
+  const std::filesystem::path data_path =
+      std::filesystem::temp_directory_path() /
+      ("server_test_upload_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(data_path);
+  boost::asio::io_service io_service;
+  std::unordered_map<std::string, LocationData> locations = {
+      {"/api", LocationData("CrudHandler", {{"data_path", data_path.string()},
+                                            {"body_limit", "4194304"}})},
+      {"/echo", LocationData("EchoHandler", {})}};
+  RequestManager request_manager = RequestManager(locations);
+  server s(io_service, request_manager, 0, false);
+  s.start_accept();
+  std::thread runner([&] { io_service.run(); });
+
+  boost::asio::io_service client_service;
+  tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), s.port());
+  tcp::socket client(client_service);
+  client.connect(endpoint);
+  std::string record(3 * 1024 * 1024, 'x');
+  std::string request = "POST /api/Shoes HTTP/1.1\r\nHost: localhost\r\n"
+                        "Content-Type: application/json\r\n"
+                        "Content-Length: " + std::to_string(record.size()) +
+                        "\r\n\r\n" + record;
+  boost::asio::write(client, boost::asio::buffer(request));
+  EXPECT_EQ(read_response(client).result_int(), 200);
+  std::ifstream file(data_path / "Shoes" / "1", std::ios::binary);
+  EXPECT_EQ(std::string(std::istreambuf_iterator<char>{file}, {}), record);
+  // Only the record is left; the upload was moved into place
+  EXPECT_EQ(std::distance(std::filesystem::directory_iterator(data_path / UPLOAD_DIRECTORY),
+                          std::filesystem::directory_iterator()),
+            0);
+
+  // Over the location's limit
+  std::string too_large =
+      "POST /api/Shoes HTTP/1.1\r\nHost: localhost\r\n"
+      "Content-Type: application/json\r\nContent-Length: 4194305\r\n\r\n";
+  boost::asio::write(client, boost::asio::buffer(too_large));
+  EXPECT_EQ(read_response(client).result_int(), 413);
+
+  // Over the default limit for a location without one
+  tcp::socket echo(client_service);
+  echo.connect(endpoint);
+  std::string echo_request = "POST /echo HTTP/1.1\r\nHost: localhost\r\n"
+                             "Content-Length: 2097152\r\n\r\n";
+  boost::asio::write(echo, boost::asio::buffer(echo_request));
+  EXPECT_EQ(read_response(echo).result_int(), 413);
+
+  io_service.stop();
+  runner.join();
+  std::filesystem::remove_all(data_path);
+}
+
+// A long CRUD listing is streamed in chunks, and the connection carries on
+// with the next request afterwards
+TEST_F(ServerTest, StreamedListing) {
+  const std::filesystem::path data_path =
+      std::filesystem::temp_directory_path() /
+      ("server_test_listing_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(data_path);
+  std::filesystem::create_directories(data_path / "Shoes");
+  for (int id = 1; id <= 3000; id++) {
+    std::ofstream(data_path / "Shoes" / std::to_string(id)) << "{}";
+  }
+  boost::asio::io_service io_service;
+  std::unordered_map<std::string, LocationData> locations = {
+      {"/api", LocationData("CrudHandler", {{"data_path", data_path.string()}})}};
+  RequestManager request_manager = RequestManager(locations);
+  server s(io_service, request_manager, 0, false);
+  s.start_accept();
+  std::thread runner([&] { io_service.run(); });
+
+  boost::asio::io_service client_service;
+  tcp::socket client(client_service);
+  client.connect(
+      tcp::endpoint(boost::asio::ip::address_v4::loopback(), s.port()));
+  std::string requests = "GET /api/Shoes HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                         "GET /api/Shoes?limit=1 HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  boost::asio::write(client, boost::asio::buffer(requests));
+  http_response listing = read_response(client);
+  EXPECT_EQ(listing.result_int(), 200);
+  EXPECT_TRUE(listing.chunked());
+  EXPECT_TRUE(listing.body().starts_with("{\n    \"files\": [\n        \"1\",\n"));
+  EXPECT_TRUE(listing.body().ends_with("        \"3000\"\n    ]\n}\n"));
+  http_response page = read_response(client);
+  EXPECT_FALSE(page.chunked());
+  EXPECT_EQ(page.body(), "{\n    \"files\": [\n        \"1\"\n    ],\n"
+                         "    \"next\": \"1\"\n}\n");
+
+  io_service.stop();
+  runner.join();
+  std::filesystem::remove_all(data_path);
+}
+
+// Connections are closed once they have sat idle for idle_timeout, and
+// requests that arrive too slowly are cut off by header_timeout and
+// body_timeout
+TEST_F(ServerTest, Timeouts) {
+  boost::asio::io_service io_service;
+  std::unordered_map<std::string, LocationData> locations = {
+      {"/echo", LocationData("EchoHandler", {})}};
+  RequestManager request_manager = RequestManager(locations);
+  SessionConfig config;
+  config.idle_timeout = std::chrono::seconds(1);
+  config.header_timeout = std::chrono::seconds(1);
+  config.body_timeout = std::chrono::seconds(1);
+  server s(io_service, request_manager, 0, false, config);
+  s.start_accept();
+  std::thread runner([&] { io_service.run(); });
+  uint64_t idle_timeouts = session::timeoutCount(SESSION_IDLE_TIMEOUT);
+  uint64_t header_timeouts = session::timeoutCount(SESSION_HEADER_TIMEOUT);
+  uint64_t body_timeouts = session::timeoutCount(SESSION_BODY_TIMEOUT);
+
+  boost::asio::io_service client_service;
+  tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), s.port());
+  // Idle after one request
+  tcp::socket idle(client_service);
+  idle.connect(endpoint);
+  boost::asio::write(idle, boost::asio::buffer(std::string(
+                               "GET /echo HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+  EXPECT_EQ(read_response(idle).result_int(), 200);
+  // Half a header
+  tcp::socket slow_header(client_service);
+  slow_header.connect(endpoint);
+  boost::asio::write(slow_header,
+                     boost::asio::buffer(std::string("GET /echo HTTP/1.1\r\n")));
+  // Half a body
+  tcp::socket slow_body(client_service);
+  slow_body.connect(endpoint);
+  boost::asio::write(
+      slow_body, boost::asio::buffer(std::string(
+                     "GET /echo HTTP/1.1\r\nContent-Length: 10\r\n\r\n12345")));
+
+  EXPECT_LT(time_until_closed(idle), std::chrono::seconds(3));
+  EXPECT_LT(time_until_closed(slow_header), std::chrono::seconds(3));
+  EXPECT_LT(time_until_closed(slow_body), std::chrono::seconds(3));
+  EXPECT_EQ(session::timeoutCount(SESSION_IDLE_TIMEOUT), idle_timeouts + 1);
+  EXPECT_EQ(session::timeoutCount(SESSION_HEADER_TIMEOUT), header_timeouts + 1);
+  EXPECT_EQ(session::timeoutCount(SESSION_BODY_TIMEOUT), body_timeouts + 1);
+
+  io_service.stop();
+  runner.join();
+}
+
+// A body that takes longer than body_timeout to arrive is still read, as
+// long as each piece of it arrives in time
+TEST_F(ServerTest, SlowBodyKeepsArriving) {
+  const std::filesystem::path data_path =
+      std::filesystem::temp_directory_path() /
+      ("server_test_slow_body_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(data_path);
+  boost::asio::io_service io_service;
+  std::unordered_map<std::string, LocationData> locations = {
+      {"/api", LocationData("CrudHandler", {{"data_path", data_path.string()}})},
+      {"/echo", LocationData("EchoHandler", {})}};
+  RequestManager request_manager = RequestManager(locations);
+  SessionConfig config;
+  config.body_timeout = std::chrono::seconds(1);
+  server s(io_service, request_manager, 0, false, config);
+  s.start_accept();
+  std::thread runner([&] { io_service.run(); });
+  uint64_t body_timeouts = session::timeoutCount(SESSION_BODY_TIMEOUT);
+
+  boost::asio::io_service client_service;
+  tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), s.port());
+  // One read into memory, one streamed to disk
+  for (std::string start : {"GET /echo", "POST /api/Shoes"}) {
+    tcp::socket client(client_service);
+    client.connect(endpoint);
+    boost::asio::write(client, boost::asio::buffer(
+                                   start + " HTTP/1.1\r\nHost: localhost\r\n"
+                                   "Content-Type: application/json\r\n"
+                                   "Content-Length: 5\r\n\r\n"));
+    for (int i = 0; i < 5; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(400));
+      boost::asio::write(client, boost::asio::buffer(std::string("x")));
+    }
+    EXPECT_EQ(read_response(client).result_int(), 200) << start;
+  }
+  EXPECT_EQ(session::timeoutCount(SESSION_BODY_TIMEOUT), body_timeouts);
+
+  io_service.stop();
+  runner.join();
+  std::filesystem::remove_all(data_path);
+}
+
+// A response that takes longer than write_timeout to send is still sent in
+// full, as long as the client keeps reading it
+TEST_F(ServerTest, SlowReaderKeepsReading) {
+  const size_t body_size = 24 * 1024 * 1024;
+  boost::asio::io_service io_service;
+  std::unordered_map<std::string, LocationData> locations = {
+      {"/echo", LocationData("EchoHandler",
+                             {{"body_limit", std::to_string(body_size)}})}};
+  RequestManager request_manager = RequestManager(locations);
+  SessionConfig config;
+  config.write_timeout = std::chrono::seconds(1);
+  server s(io_service, request_manager, 0, false, config);
+  s.start_accept();
+  std::thread runner([&] { io_service.run(); });
+  uint64_t write_timeouts = session::timeoutCount(SESSION_WRITE_TIMEOUT);
+
+  boost::asio::io_service client_service;
+  tcp::socket client(client_service);
+  client.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), s.port()));
+  std::string request = "GET /echo HTTP/1.1\r\nHost: localhost\r\n"
+                        "Content-Length: " + std::to_string(body_size) +
+                        "\r\n\r\n" + std::string(body_size, 'x');
+  boost::asio::write(client, boost::asio::buffer(request));
+  // The echoed response is longer than the body; read that much of it, a
+  // megabyte every 100ms
+  std::vector<char> piece(1024 * 1024);
+  boost::system::error_code error;
+  size_t received = 0;
+  while (!error && received < body_size) {
+    received += boost::asio::read(client, boost::asio::buffer(piece), error);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  EXPECT_FALSE(error) << error.message();
+  EXPECT_EQ(received, body_size);
+  EXPECT_EQ(session::timeoutCount(SESSION_WRITE_TIMEOUT), write_timeouts);
+
+  io_service.stop();
+  runner.join();
+}
+
+// Live sessions are registered, and shutting them down closes idle
+// connections straight away while a request already arriving is answered
+TEST_F(ServerTest, ShutdownSessions) {
+  boost::asio::io_service io_service;
+  std::unordered_map<std::string, LocationData> locations = {
+      {"/echo", LocationData("EchoHandler", {})}};
+  RequestManager request_manager = RequestManager(locations);
+  server s(io_service, request_manager, 0);
+  s.start_accept();
+  std::thread runner([&] { io_service.run(); });
+
+  boost::asio::io_service client_service;
+  tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), s.port());
+  tcp::socket idle(client_service);
+  idle.connect(endpoint);
+  boost::asio::write(idle, boost::asio::buffer(std::string(
+                               "GET /echo HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+  EXPECT_EQ(read_response(idle).result_int(), 200);
+  tcp::socket arriving(client_service);
+  arriving.connect(endpoint);
+  boost::asio::write(arriving,
+                     boost::asio::buffer(std::string("GET /echo HTTP/1.1\r\n")));
+  while (SessionRegistry::GetInstance().size() < 2) {
+    std::this_thread::yield();
+  }
+
+  SessionRegistry::GetInstance().shutdownAll();
+  EXPECT_LT(time_until_closed(idle), std::chrono::seconds(1));
+  boost::asio::write(arriving, boost::asio::buffer(std::string(
+                                   "Host: localhost\r\n\r\n")));
+  response_buf.clear();
+  EXPECT_EQ(read_response(arriving).result_int(), 200);
+  EXPECT_LT(time_until_closed(arriving), std::chrono::seconds(1));
+  while (SessionRegistry::GetInstance().size() > 0) {
+    std::this_thread::yield();
+  }
+
+  io_service.stop();
+  runner.join();
+}
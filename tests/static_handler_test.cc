@@ -1,6 +1,8 @@
 #include "handlers/static_handler.h"
 #include "gtest/gtest.h"
 #include "filesystem/filesystem.h"
+#include "filesystem/fake_filesystem.h"
+#include <fstream>
 
 const std::string NOT_FOUND_RESPONSE_HEADER = "HTTP/1.1 404 Bad Request\r\n\
 Content-Type: text/plain\r\n\
@@ -16,8 +18,10 @@ protected:
     static_handler.reset(
         new StaticHandler("/static", {{"root", root_directory}}, std::make_unique<FileSystem>()));
     http_request data {boost::beast::http::verb::get,rel_path,11};
-    static_handler->handle_request(data);
-    EXPECT_EQ(static_handler->getLastResponse(), expected_response);
+    http_response response = static_handler->handle_request(data);
+    std::stringstream result;
+    result << response;
+    EXPECT_EQ(result.str(), expected_response);
   }
 };
 
@@ -29,4 +33,222 @@ TEST_F(StaticHandlerTest, EmptyFileRequest) {
       "0\r\n\r\n";
   content_handle_success("/static/empty.txt", "../tests/files",
                          EMPTY_OK_RESPONSE_HEADER);
-}
\ No newline at end of file
+}
+// Serving an existing file should hand back the open file, not its contents
+TEST_F(StaticHandlerTest, ServeFileRequest) {
+  StaticHandler static_handler("/static", {{"root", "../tests/files"}},
+                               std::make_unique<FileSystem>());
+  http_request data{boost::beast::http::verb::get, "/static/empty.txt", 11};
+  http_response_variant response = static_handler.serve(data);
+  ASSERT_TRUE(std::holds_alternative<http_file_response>(response));
+  http_file_response &file_response = std::get<http_file_response>(response);
+  EXPECT_EQ(file_response.result(), boost::beast::http::status::ok);
+  EXPECT_EQ(file_response.at(boost::beast::http::field::content_type),
+            "text/plain");
+  EXPECT_EQ(file_response.body().size(), 0);
+  EXPECT_TRUE(file_response.body().is_open());
+}
+
+// Serving a missing file should fall back to an in-memory 404
+TEST_F(StaticHandlerTest, ServeMissingFileRequest) {
+  StaticHandler static_handler("/static", {{"root", "../tests/files"}},
+                               std::make_unique<FileSystem>());
+  http_request data{boost::beast::http::verb::get, "/static/missing.txt", 11};
+  http_response_variant response = static_handler.serve(data);
+  ASSERT_TRUE(std::holds_alternative<http_response>(response));
+  EXPECT_EQ(std::get<http_response>(response).result(),
+            boost::beast::http::status::not_found);
+}
+
+// With a cache, repeat requests are served from memory until the file changes
+TEST_F(StaticHandlerTest, ServeCachedFile) {
+  std::unique_ptr<FakeFileSystem> filesystem = std::make_unique<FakeFileSystem>();
+  FakeFileSystem *fake = filesystem.get();
+  fake->write("/files/hello.txt", "hello");
+  StaticHandler static_handler("/static",
+                               {{"root", "/files"}, {"cache_size", "1024"}},
+                               std::move(filesystem));
+  http_request data{boost::beast::http::verb::get, "/static/hello.txt", 11};
+
+  http_response_variant response = static_handler.serve(data);
+  ASSERT_TRUE(std::holds_alternative<http_response>(response));
+  EXPECT_EQ(std::get<http_response>(response).body(), "hello");
+  response = static_handler.serve(data);
+  EXPECT_EQ(std::get<http_response>(response).body(), "hello");
+  EXPECT_EQ(static_handler.cacheStats().value().hits, 1);
+  EXPECT_EQ(static_handler.cacheStats().value().misses, 1);
+
+  fake->write("/files/hello.txt", "hello again");
+  response = static_handler.serve(data);
+  EXPECT_EQ(std::get<http_response>(response).body(), "hello again");
+  EXPECT_EQ(std::get<http_response>(response).at(
+                boost::beast::http::field::content_length),
+            "11");
+  EXPECT_EQ(static_handler.cacheStats().value().misses, 2);
+}
+
+// A precompressed sibling is streamed to clients that accept its encoding;
+// everyone else gets the file itself
+TEST_F(StaticHandlerTest, ServePrecompressedSibling) {
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "static_handler_test_gz";
+  std::filesystem::create_directories(root);
+  std::ofstream(root / "style.css") << std::string(4096, 'a');
+  std::ofstream(root / "style.css.gz") << "not really gzip";
+  StaticHandler static_handler(
+      "/static", {{"root", root.string()}, {"compress_types", "text/css"}},
+      std::make_unique<FileSystem>());
+
+  http_request data{boost::beast::http::verb::get, "/static/style.css", 11};
+  data.set(boost::beast::http::field::accept_encoding, "br;q=0.5, gzip");
+  http_response_variant response = static_handler.serve(data);
+  ASSERT_TRUE(std::holds_alternative<http_file_response>(response));
+  http_file_response &gzipped = std::get<http_file_response>(response);
+  EXPECT_EQ(gzipped.at(boost::beast::http::field::content_encoding), "gzip");
+  EXPECT_EQ(gzipped.at(boost::beast::http::field::content_type), "text/css");
+  EXPECT_EQ(gzipped.at(boost::beast::http::field::vary), "Accept-Encoding");
+  EXPECT_EQ(gzipped.body().size(), 15);
+
+  data.erase(boost::beast::http::field::accept_encoding);
+  response = static_handler.serve(data);
+  ASSERT_TRUE(std::holds_alternative<http_file_response>(response));
+  http_file_response &plain = std::get<http_file_response>(response);
+  EXPECT_EQ(plain.count(boost::beast::http::field::content_encoding), 0);
+  EXPECT_EQ(plain.at(boost::beast::http::field::vary), "Accept-Encoding");
+  EXPECT_EQ(plain.body().size(), 4096);
+
+  std::filesystem::remove_all(root);
+}
+
+// Without a sibling, compressible files are compressed in memory, and each
+// encoding is cached separately
+TEST_F(StaticHandlerTest, ServeCompressedFile) {
+  std::unique_ptr<FakeFileSystem> filesystem = std::make_unique<FakeFileSystem>();
+  filesystem->write("/files/page.html", std::string(4096, 'a'));
+  StaticHandler static_handler("/static",
+                               {{"root", "/files"},
+                                {"cache_size", "65536"},
+                                {"compress_types", "text/html"}},
+                               std::move(filesystem));
+  http_request data{boost::beast::http::verb::get, "/static/page.html", 11};
+  data.set(boost::beast::http::field::accept_encoding, "gzip");
+
+  for (int i = 0; i < 2; i++) {
+    http_response_variant response = static_handler.serve(data);
+    ASSERT_TRUE(std::holds_alternative<http_response>(response));
+    http_response &gzipped = std::get<http_response>(response);
+    EXPECT_EQ(gzipped.at(boost::beast::http::field::content_encoding), "gzip");
+    EXPECT_LT(gzipped.body().size(), 4096);
+  }
+  EXPECT_EQ(static_handler.cacheStats().value().hits, 1);
+
+  data.erase(boost::beast::http::field::accept_encoding);
+  http_response_variant response = static_handler.serve(data);
+  EXPECT_EQ(std::get<http_response>(response).body(), std::string(4096, 'a'));
+  EXPECT_EQ(static_handler.cacheStats().value().entries, 2);
+}
+
+// Files carry an ETag and Last-Modified; a client revalidating the current
+// version gets a 304 without the file being read
+TEST_F(StaticHandlerTest, ConditionalGet) {
+  StaticHandler static_handler(
+      "/static", {{"root", "../tests/files"}, {"cache_control", "max-age=60"}},
+      std::make_unique<FileSystem>());
+  http_request data{boost::beast::http::verb::get, "/static/empty.txt", 11};
+  http_response_variant response = static_handler.serve(data);
+  ASSERT_TRUE(std::holds_alternative<http_file_response>(response));
+  http_file_response &file_response = std::get<http_file_response>(response);
+  std::string etag(file_response.at(boost::beast::http::field::etag));
+  std::string last_modified(
+      file_response.at(boost::beast::http::field::last_modified));
+  EXPECT_EQ(file_response.at(boost::beast::http::field::cache_control),
+            "max-age=60");
+
+  data.set(boost::beast::http::field::if_none_match, etag);
+  response = static_handler.serve(data);
+  ASSERT_TRUE(std::holds_alternative<http_response>(response));
+  EXPECT_EQ(std::get<http_response>(response).result(),
+            boost::beast::http::status::not_modified);
+  EXPECT_EQ(std::get<http_response>(response).at(boost::beast::http::field::etag),
+            etag);
+
+  data.set(boost::beast::http::field::if_none_match, "\"other\"");
+  response = static_handler.serve(data);
+  EXPECT_TRUE(std::holds_alternative<http_file_response>(response));
+
+  data.erase(boost::beast::http::field::if_none_match);
+  data.set(boost::beast::http::field::if_modified_since, last_modified);
+  response = static_handler.serve(data);
+  ASSERT_TRUE(std::holds_alternative<http_response>(response));
+  EXPECT_EQ(std::get<http_response>(response).result(),
+            boost::beast::http::status::not_modified);
+}
+
+// A single range is sent as a slice of the open file, several as a
+// multipart body, and a range past the end gets a 416
+TEST_F(StaticHandlerTest, ServeRanges) {
+  std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "static_handler_test_range";
+  std::filesystem::create_directories(root);
+  std::string contents;
+  for (int i = 0; i < 100; i++) {
+    contents += std::to_string(i % 10);
+  }
+  std::ofstream(root / "digits.txt") << contents;
+  StaticHandler static_handler("/static", {{"root", root.string()}},
+                               std::make_unique<FileSystem>());
+  http_request data{boost::beast::http::verb::get, "/static/digits.txt", 11};
+
+  http_response_variant response = static_handler.serve(data);
+  ASSERT_TRUE(std::holds_alternative<http_file_response>(response));
+  EXPECT_EQ(std::get<http_file_response>(response).at(
+                boost::beast::http::field::accept_ranges),
+            "bytes");
+
+  data.set(boost::beast::http::field::range, "bytes=10-19");
+  response = static_handler.serve(data);
+  ASSERT_TRUE(std::holds_alternative<http_file_response>(response));
+  http_file_response &slice = std::get<http_file_response>(response);
+  EXPECT_EQ(slice.result(), boost::beast::http::status::partial_content);
+  EXPECT_EQ(slice.at(boost::beast::http::field::content_range),
+            "bytes 10-19/100");
+  EXPECT_EQ(slice.at(boost::beast::http::field::content_length), "10");
+  EXPECT_EQ(slice.body().offset(), 10);
+  EXPECT_EQ(slice.body().size(), 10);
+
+  data.set(boost::beast::http::field::range, "bytes=0-2,-3");
+  response = static_handler.serve(data);
+  ASSERT_TRUE(std::holds_alternative<http_response>(response));
+  http_response &multipart = std::get<http_response>(response);
+  EXPECT_EQ(multipart.result(), boost::beast::http::status::partial_content);
+  std::string content_type(
+      multipart.at(boost::beast::http::field::content_type));
+  ASSERT_TRUE(content_type.starts_with("multipart/byteranges; boundary="));
+  std::string boundary = content_type.substr(content_type.find('=') + 1);
+  EXPECT_EQ(multipart.body(),
+            "--" + boundary + "\r\nContent-Type: text/plain\r\n"
+            "Content-Range: bytes 0-2/100\r\n\r\n012\r\n"
+            "--" + boundary + "\r\nContent-Type: text/plain\r\n"
+            "Content-Range: bytes 97-99/100\r\n\r\n789\r\n"
+            "--" + boundary + "--\r\n");
+
+  data.set(boost::beast::http::field::range, "bytes=100-");
+  response = static_handler.serve(data);
+  ASSERT_TRUE(std::holds_alternative<http_response>(response));
+  EXPECT_EQ(std::get<http_response>(response).result(),
+            boost::beast::http::status::range_not_satisfiable);
+  EXPECT_EQ(std::get<http_response>(response).at(
+                boost::beast::http::field::content_range),
+            "bytes */100");
+
+  // A range for an older version of the file gets the whole current one
+  data.set(boost::beast::http::field::range, "bytes=10-19");
+  data.set(boost::beast::http::field::if_range, "\"old\"");
+  response = static_handler.serve(data);
+  ASSERT_TRUE(std::holds_alternative<http_file_response>(response));
+  EXPECT_EQ(std::get<http_file_response>(response).result(),
+            boost::beast::http::status::ok);
+  EXPECT_EQ(std::get<http_file_response>(response).body().size(), 100);
+
+  std::filesystem::remove_all(root);
+}